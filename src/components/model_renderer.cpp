@@ -24,7 +24,8 @@ void ModelRenderer::Render(const Render_view &view, RenderQueue &queue) {
 
     // TODO: Do culling per sub-model
 
-    const XMMATRIX worldMatrix = XMMatrixTranspose(transform->GetRenderMatrix());
+    const XMMATRIX renderMatrix = transform->GetRenderMatrix();
+    const XMMATRIX worldMatrix = XMMatrixTranspose(renderMatrix);
 
     Model *model = this->modelHandle.Get();
     for (int i = 0; i < model->subModels.size(); ++i) {
@@ -34,6 +35,7 @@ void ModelRenderer::Render(const Render_view &view, RenderQueue &queue) {
 
         command.vertexBuffer = model->vertexBuffer;
         command.indexBuffer = model->indexBuffer;
+        command.positionBuffer = model->positionBuffer;
 
         command.indexCount = subModel.mesh.indexCount;
         command.startIndex = subModel.mesh.startIndex;
@@ -41,8 +43,10 @@ void ModelRenderer::Render(const Render_view &view, RenderQueue &queue) {
 
         command.material = subModel.material;
         command.isReflective = this->isReflective;
+        command.isStatic = this->GetOwner()->isStatic;
 
         XMStoreFloat4x4(&command.worldMatrix, worldMatrix);
+        subModel.localBounds.Transform(command.worldBounds, renderMatrix);
 
         Material *material = subModel.material.Get();
         if (material && material->useTessellation && view.type == View_type::primary)
@@ -3,6 +3,8 @@
 #include "components/transform.hpp"
 #include "scene/entity.hpp"
 
+#include <algorithm>
+
 void ReflectionProbe::OnStart(const Engine_context &context) {}
 void ReflectionProbe::Update(const Frame_context &context) {}
 
@@ -24,6 +26,12 @@ void ReflectionProbe::Render(const Render_view &view, RenderQueue &queue) {
     command.nearPlane = this->nearPlane;
     command.farPlane = this->farPlane;
     command.radius = this->radius;
+    command.updatePolicy = static_cast<Probe_update_policy>(std::clamp(this->updatePolicy, 0, 2));
+    command.facesPerFrame = this->facesPerFrame;
+    command.needsUpdate = this->requestUpdate;
+    command.id = reinterpret_cast<uintptr_t>(this);
+
+    this->requestUpdate = false;
 
     queue.Submit(command);
 }
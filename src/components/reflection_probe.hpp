@@ -8,6 +8,10 @@ class ReflectionProbe : public Component {
     float farPlane = 50.0f;
     float radius = 10.0f;
 
+    int updatePolicy = 1; // 0 bake once, 1 on change, 2 round robin
+    int facesPerFrame = 1;
+    bool requestUpdate = false; // Renders every face next frame
+
 public:
     ReflectionProbe(Entity *owner, bool isActive) : Component(owner, isActive) {}
     ~ReflectionProbe() = default;
@@ -21,6 +25,9 @@ public:
         BIND(nearPlane);
         BIND(farPlane);
         BIND(radius);
+        BIND(updatePolicy);
+        BIND(facesPerFrame);
+        BIND(requestUpdate);
     }
 };
 
@@ -5,6 +5,11 @@
 #include "rendering/render_queue.hpp"
 #include "rendering/renderer.hpp"
 
+#include <cstring>
+
+// Revisions are unique across lights, so a light created where a destroyed one was doesn't reuse its packed data
+static uint32_t revisionCounter = 0;
+
 void SpotLight::OnStart(const Engine_context &context) {}
 void SpotLight::Update(const Frame_context &context) {}
 
@@ -21,6 +26,29 @@ void SpotLight::Render(const Render_view &view, RenderQueue &queue) {
         return;
     }
 
+    const float properties[PROPERTY_COUNT] = {
+        this->colour.x,
+        this->colour.y,
+        this->colour.z,
+        this->intensity,
+        this->range,
+        this->innerConeAngle,
+        this->outerConeAngle,
+        this->castsShadows ? 1.0f : 0.0f
+    };
+
+    const uint32_t worldVersion = transform->GetWorldVersion();
+
+    if (!this->hasSubmitted ||
+        worldVersion != this->submittedWorldVersion ||
+        memcmp(properties, this->submittedProperties, sizeof(properties)) != 0
+    ) {
+        memcpy(this->submittedProperties, properties, sizeof(properties));
+        this->submittedWorldVersion = worldVersion;
+        this->hasSubmitted = true;
+        this->revision = ++revisionCounter;
+    }
+
     Spot_light_command slc{};
     slc.position       = transform->GetRenderPosition();
     slc.direction      = transform->GetForward();
@@ -30,6 +58,8 @@ void SpotLight::Render(const Render_view &view, RenderQueue &queue) {
     slc.innerConeAngle = XMConvertToRadians(this->innerConeAngle);
     slc.outerConeAngle = XMConvertToRadians(this->outerConeAngle);
     slc.castsShadows   = this->castsShadows;
+    slc.id             = reinterpret_cast<uintptr_t>(this);
+    slc.revision       = this->revision;
 
     queue.Submit(slc);
 }
@@ -4,6 +4,7 @@
 #include "scene/component.hpp"
 
 #include <DirectXMath.h>
+#include <cstdint>
 
 using namespace DirectX;
 
@@ -17,6 +18,14 @@ class SpotLight : public Component {
 
     bool castsShadows = false;
 
+    // What the last command was built from. The inspector writes the fields directly, so they are compared rather
+    // than flagged by setters.
+    static constexpr int PROPERTY_COUNT = 8;
+    float submittedProperties[PROPERTY_COUNT] = {};
+    uint32_t submittedWorldVersion = 0;
+    bool hasSubmitted = false;
+    uint32_t revision = 0;
+
 public:
     SpotLight(Entity *owner, bool isActive) : Component(owner, isActive) {}
     ~SpotLight() = default;
@@ -9,6 +9,8 @@ void Transform::MarkLocalDirty() {
 }
 
 void Transform::MarkWorldDirty() {
+    ++this->worldVersion;
+
     if (this->isWorldDirty)
         return;
 
@@ -179,6 +181,7 @@ XMFLOAT3 Transform::GetLocalScale() const {
 
 void Transform::SetLocalPivot(const XMFLOAT3 &pivot) {
     this->localPivot = pivot;
+    this->MarkLocalDirty();
 }
 
 XMFLOAT3 Transform::GetLocalPivot() const {
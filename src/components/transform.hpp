@@ -6,6 +6,7 @@
 #include "scene/component_registry.hpp"
 
 #include <DirectXMath.h>
+#include <cstdint>
 
 using namespace DirectX;
 
@@ -24,6 +25,8 @@ class Transform : public Component {
     mutable XMFLOAT4X4 cachedWorld{};
     mutable bool isWorldDirty = true;
 
+    uint32_t worldVersion = 0; // Changes whenever the world matrix does, unlike isWorldDirty it isn't reset by reads
+
     void MarkLocalDirty();
     void MarkWorldDirty();
 
@@ -116,6 +119,7 @@ public:
     XMFLOAT3 InverseTransformDirection(const XMFLOAT3 &worldDirection) const;
 
     bool IsWorldDirty() const { return this->isWorldDirty; }
+    uint32_t GetWorldVersion() const { return this->worldVersion; }
 };
 
 REGISTER_COMPONENT(Transform);
@@ -4,6 +4,7 @@
 #include "core/input.hpp"
 #include "debugging/debug.hpp"
 #include "debugging/debug_draw.hpp"
+#include "debugging/render_tests.hpp"
 
 #include <Windows.h>
 #include <stdio.h>
@@ -44,6 +45,8 @@ void Application::Update(const Frame_context &context) {
 }
 
 void Application::Render(float deltaTime) {
+    RenderTests::RunRequested(this->renderer.GetDevice());
+
     this->renderer.Render(this->sceneManager.GetCurrentScene());
 
     if (this->isEditorEnabled) {
@@ -15,13 +15,14 @@ namespace LogImpl {
     const char *GetFilename(const char *path);
 }
 
-#ifdef _DEBUG
+// Builds outside of Windows, like the offline tools, always log to the console
+#if defined(_DEBUG) || !defined(_WIN32)
 
 #define LogInfo(format, ...) \
     do { \
         printf("[INFO] "); \
         if (LogImpl::GetIndent() > 0) printf("%*s> ", (LogImpl::GetIndent() - 1) * LogImpl::SPACES_PER_INDENT, ""); \
-        printf(format, __VA_ARGS__); \
+        printf(format, ##__VA_ARGS__); \
     } while (0)
 
 #define LogWarn(format, ...) \
@@ -36,7 +37,7 @@ namespace LogImpl {
 #define LogIndent() LogImpl::Indent()
 #define LogUnindent() LogImpl::Unindent()
 
-#else // _DEBUG
+#else // defined(_DEBUG) || !defined(_WIN32)
 
 #include "Windows.h"
 
@@ -57,6 +58,6 @@ namespace LogImpl {
 #define LogIndent() (void)0
 #define LogUnindent() (void)0
 
-#endif // _DEBUG
+#endif // defined(_DEBUG) || !defined(_WIN32)
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "render_tests.hpp"
+#include "core/logging.hpp"
+#include "debugging/debug.hpp"
+#include "rendering/frame_graph.hpp"
+#include "rendering/render_queue.hpp"
+#include "rendering/gpu_culling_system.hpp"
+#include "rendering/material_table.hpp"
+#include "rendering/state_cache.hpp"
+#include "rendering/resolution_controller.hpp"
+#include "rendering/shadow_system.hpp"
+#include "rendering/shadow_atlas.hpp"
+#include "rendering/shadow_cache.hpp"
+#include "rendering/light_selector.hpp"
+#include "rendering/light_cluster_builder.hpp"
+#include "rendering/light_store.hpp"
+#include "rendering/probe_scheduler.hpp"
+#include "rendering/reflection_probe_system.hpp"
+
+bool TestChecks::Check(bool condition, const char *description) {
+    if (!condition) {
+        LogWarn("Failed: %s\n", description);
+        ++this->failedCount;
+    }
+
+    return condition;
+}
+
+void TestChecks::LogSummary() const {
+    if (this->failedCount == 0)
+        LogInfo("All checks passed\n");
+}
+
+struct Test_hook {
+    const char *setting;
+    void (*run)();
+};
+
+static const Test_hook testHooks[] = {
+    { "frameGraph.runCompileBenchmark",       FrameGraph::RunCompileBenchmark },
+    { "frameGraph.runScheduleTest",           FrameGraph::RunScheduleTest },
+    { "frameGraph.runHazardTest",             FrameGraph::RunHazardTest },
+    { "renderer.runResolutionControllerTest", ResolutionController::RunControllerTest },
+    { "renderer.runSortTest",                 RenderQueue::RunSortTest },
+    { "renderer.runStateCacheTest",           StateCache::RunCacheTest },
+    { "renderer.runGpuCullingTest",           GpuCullingSystem::RunReferenceTest },
+    { "renderer.runMaterialTableTest",        MaterialTable::RunPackingTest },
+    { "shadows.runCascadeTest",               ShadowSystem::RunCascadeTest },
+    { "shadows.runAtlasTest",                 ShadowAtlas::RunAllocatorTest },
+    { "shadows.runCacheTest",                 ShadowCache::RunInvalidationTest },
+    { "shadows.runLightSelectionTest",        LightSelector::RunSelectionTest },
+    { "lighting.runClusterTest",              LightClusterBuilder::RunBuilderTest },
+    { "lighting.runLightStoreTest",           LightStore::RunStoreTest },
+    { "reflections.runSchedulerTest",         ProbeScheduler::RunSchedulerTest },
+    { "reflections.runAssignmentTest",        ReflectionProbeSystem::RunProbeAssignmentTest },
+    { "reflections.runFaceMaskTest",          ReflectionProbeSystem::RunFaceMaskTest },
+};
+
+void RenderTests::RunRequested(ID3D11Device *device) {
+    for (const Test_hook &hook : testHooks) {
+        if (!Debug::GetSetting(hook.setting, false))
+            continue;
+
+        Debug::SetSetting(hook.setting, false);
+        hook.run();
+    }
+
+    // Creates its own frame graph on the device, the renderer's graph and resources are left alone
+    if (Debug::GetSetting("frameGraph.runResizeTest", false)) {
+        Debug::SetSetting("frameGraph.runResizeTest", false);
+        FrameGraph::RunResizeTest(device);
+    }
+}
\ No newline at end of file
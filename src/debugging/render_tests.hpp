@@ -0,0 +1,48 @@
+#ifndef RENDER_TESTS_HPP
+#define RENDER_TESTS_HPP
+
+#include <d3d11.h>
+#include <cstdint>
+
+// Runs the renderer's CPU tests and benchmarks on request, outside of rendering a frame. Each one is started by
+// its debug setting, which turns itself off again once the test ran.
+// Counts the failed checks of one test, logging each failure as it happens
+class TestChecks {
+    int failedCount = 0;
+
+public:
+    // Returns the condition, so callers can log details of a failure
+    bool Check(bool condition, const char *description);
+
+    int GetFailedCount() const { return this->failedCount; }
+
+    // Logs "All checks passed" if nothing failed, the failures were already logged
+    void LogSummary() const;
+};
+
+// Seeded linear congruential generator, so every run of a test sees the same inputs
+class TestRandom {
+    uint32_t state;
+
+    uint32_t Next() {
+        this->state = this->state * 1664525u + 1013904223u;
+        return this->state >> 8;
+    }
+
+public:
+    explicit TestRandom(uint32_t seed) : state(seed) {}
+
+    // In [0, range)
+    uint32_t NextUint(uint32_t range) { return this->Next() % range; }
+
+    // In [min, max)
+    float NextFloat(float min, float max) { return min + (max - min) * this->Next() / 16777216.0f; }
+};
+
+class RenderTests {
+public:
+    // The device is only used by tests that create their own GPU resources, never the renderer's
+    static void RunRequested(ID3D11Device *device);
+};
+
+#endif
\ No newline at end of file
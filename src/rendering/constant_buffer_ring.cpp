@@ -0,0 +1,175 @@
+#include "constant_buffer_ring.hpp"
+#include "core/logging.hpp"
+
+#include <cstring>
+
+ConstantBufferRing::~ConstantBufferRing() {
+    this->Shutdown();
+}
+
+bool ConstantBufferRing::CreateBuffer(UINT size) {
+    if (this->buffer) {
+        this->buffer->Release();
+        this->buffer = nullptr;
+    }
+
+    D3D11_BUFFER_DESC desc{};
+    desc.ByteWidth      = size;
+    desc.Usage          = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags      = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+    HRESULT result = this->device->CreateBuffer(&desc, nullptr, &this->buffer);
+    if (FAILED(result)) {
+        this->bufferSize = 0;
+        return false;
+    }
+
+    this->bufferSize = size;
+    return true;
+}
+
+bool ConstantBufferRing::Initialize(ID3D11Device *device, const StateCache &stateCache, UINT size) {
+    this->device = device;
+
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options{};
+    HRESULT result = device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+
+    this->supportsOffsets =
+        SUCCEEDED(result) &&
+        options.ConstantBufferOffsetting &&
+        options.MapNoOverwriteOnDynamicConstantBuffer &&
+        stateCache.SupportsConstantBufferOffsets();
+
+    if (!this->supportsOffsets)
+        LogWarn("Constant buffer offsetting is not supported, falling back to per-draw uploads\n");
+
+    // Without offsets only the CPU-side copy is used
+    if (this->supportsOffsets && !this->CreateBuffer(size)) {
+        LogError("Failed to create constant buffer ring");
+        return false;
+    }
+
+    this->cpuData.reserve(size);
+
+    LogInfo("Constant buffer ring created (%u KB)\n", size / 1024);
+    return true;
+}
+
+void ConstantBufferRing::Shutdown() {
+    if (this->buffer) {
+        this->buffer->Release();
+        this->buffer = nullptr;
+    }
+
+    this->bufferSize = 0;
+    this->cpuData.clear();
+    this->sharedAllocations.clear();
+    this->fallbackContents.clear();
+}
+
+void ConstantBufferRing::BeginFrame() {
+    this->cpuData.clear();
+    this->uploadedSize = 0;
+
+    this->sharedAllocations.clear();
+    this->fallbackContents.clear();
+}
+
+Ring_allocation ConstantBufferRing::Allocate(const void *data, UINT size) {
+    const UINT alignedSize = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    const UINT offset = this->cpuData.size();
+
+    this->cpuData.resize(offset + alignedSize);
+    memcpy(this->cpuData.data() + offset, data, size);
+
+    ++this->stats.allocationCount;
+
+    Ring_allocation allocation{};
+    allocation.firstConstant = offset / 16;
+    allocation.constantCount = alignedSize / 16;
+    allocation.byteSize      = size;
+    return allocation;
+}
+
+void ConstantBufferRing::Flush(ID3D11DeviceContext *deviceContext) {
+    if (!this->supportsOffsets)
+        return;
+
+    const UINT size = this->cpuData.size();
+    if (size == this->uploadedSize)
+        return;
+
+    if (size > this->bufferSize) {
+        UINT newSize = this->bufferSize ? this->bufferSize : DEFAULT_SIZE;
+        while (newSize < size)
+            newSize *= 2;
+
+        LogInfo("Growing constant buffer ring to %u KB\n", newSize / 1024);
+
+        if (!this->CreateBuffer(newSize)) {
+            LogWarn("Failed to grow constant buffer ring\n");
+            return;
+        }
+
+        // The new buffer has to contain everything allocated this frame, not just the pending part
+        this->uploadedSize = 0;
+    }
+
+    // The first upload of a frame discards, the rest append behind data the GPU may still be reading
+    D3D11_MAP mapType = this->uploadedSize == 0 ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT result = deviceContext->Map(this->buffer, 0, mapType, 0, &mapped);
+    if (FAILED(result)) {
+        LogWarn("Failed to map constant buffer ring\n");
+        return;
+    }
+
+    memcpy(
+        static_cast<uint8_t *>(mapped.pData) + this->uploadedSize,
+        this->cpuData.data() + this->uploadedSize,
+        size - this->uploadedSize
+    );
+    deviceContext->Unmap(this->buffer, 0);
+
+    ++this->stats.mapCount;
+    this->stats.uploadedBytes += size - this->uploadedSize;
+
+    this->uploadedSize = size;
+}
+
+void ConstantBufferRing::Bind(StateCache &stateCache, Shader_stage stage, UINT slot, const Ring_allocation &allocation, ID3D11Buffer *fallbackBuffer) {
+    if (this->supportsOffsets) {
+        stateCache.SetConstantBufferRange(stage, slot, this->buffer, allocation.firstConstant, allocation.constantCount);
+        return;
+    }
+
+    stateCache.SetConstantBuffers(stage, slot, 1, &fallbackBuffer);
+
+    // Consecutive draws often share constants (e.g. the same material), skip the upload if they're already there
+    auto it = this->fallbackContents.find(fallbackBuffer);
+    if (it != this->fallbackContents.end() && it->second == allocation.firstConstant)
+        return;
+
+    ID3D11DeviceContext *deviceContext = stateCache.GetDeviceContext();
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT result = deviceContext->Map(fallbackBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+    if (FAILED(result)) {
+        LogWarn("Failed to map resouce\n");
+        return;
+    }
+
+    memcpy(mapped.pData, this->cpuData.data() + allocation.firstConstant * 16, allocation.byteSize);
+    deviceContext->Unmap(fallbackBuffer, 0);
+
+    ++this->stats.mapCount;
+    this->stats.uploadedBytes += allocation.byteSize;
+
+    this->fallbackContents[fallbackBuffer] = allocation.firstConstant;
+}
+
+void ConstantBufferRing::ResetStats() {
+    this->stats = Stats{};
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#ifndef CONSTANT_BUFFER_RING_HPP
+#define CONSTANT_BUFFER_RING_HPP
+
+#include "rendering/state_cache.hpp"
+
+#include <d3d11.h>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+// Location of a block of constants inside the ring, in units of 16-byte constants
+struct Ring_allocation {
+    UINT firstConstant = 0;
+    UINT constantCount = 0;
+    UINT byteSize = 0;
+};
+
+// One large dynamic constant buffer per frame. Draw constants are written to a CPU-side copy, uploaded with
+// a single Map() per Flush() and bound by offset. Falls back to mapping per bind if the device can't offset.
+class ConstantBufferRing {
+public:
+    static constexpr UINT ALIGNMENT = 256; // D3D11.1 offsets must be multiples of 16 constants
+    static constexpr UINT DEFAULT_SIZE = 1 << 20;
+
+    struct Stats {
+        int mapCount = 0;
+        int allocationCount = 0;
+        int sharedHitCount = 0;
+        int uploadedBytes = 0;
+    };
+
+private:
+    ID3D11Device *device = nullptr;
+    ID3D11Buffer *buffer = nullptr;
+    UINT bufferSize = 0;
+
+    bool supportsOffsets = false;
+
+    std::vector<uint8_t> cpuData;
+    UINT uploadedSize = 0;
+
+    std::unordered_map<uint64_t, Ring_allocation> sharedAllocations;
+
+    // Fallback path: which allocation each fallback buffer currently holds
+    std::unordered_map<ID3D11Buffer *, UINT> fallbackContents;
+
+    Stats stats;
+
+    bool CreateBuffer(UINT size);
+    Ring_allocation Allocate(const void *data, UINT size);
+
+public:
+    ConstantBufferRing() = default;
+    ~ConstantBufferRing();
+
+    ConstantBufferRing(const ConstantBufferRing &other) = delete;
+    ConstantBufferRing &operator=(const ConstantBufferRing &other) = delete;
+
+    bool Initialize(ID3D11Device *device, const StateCache &stateCache, UINT size = DEFAULT_SIZE);
+    void Shutdown();
+
+    void BeginFrame();
+
+    template <typename T>
+    Ring_allocation Allocate(const T &data) {
+        static_assert(sizeof(T) % 16 == 0);
+        return this->Allocate(&data, sizeof(T));
+    }
+
+    // Returns the existing allocation if something was already allocated under this key this frame
+    template <typename T>
+    Ring_allocation AllocateShared(uint64_t key, const T &data) {
+        auto it = this->sharedAllocations.find(key);
+        if (it != this->sharedAllocations.end()) {
+            ++this->stats.sharedHitCount;
+            return it->second;
+        }
+
+        Ring_allocation allocation = this->Allocate(data);
+        this->sharedAllocations.emplace(key, allocation);
+        return allocation;
+    }
+
+    // Uploads everything allocated since the last flush. Must be called before binding those allocations.
+    void Flush(ID3D11DeviceContext *deviceContext);
+
+    // fallbackBuffer must be at least allocation.byteSize large and is only used if offsets are unsupported
+    void Bind(StateCache &stateCache, Shader_stage stage, UINT slot, const Ring_allocation &allocation, ID3D11Buffer *fallbackBuffer);
+
+    bool SupportsOffsets() const { return this->supportsOffsets; }
+
+    const Stats &GetStats() const { return this->stats; }
+    void ResetStats();
+};
+
+#endif
\ No newline at end of file
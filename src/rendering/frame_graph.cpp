@@ -1,7 +1,13 @@
 #include "frame_graph.hpp"
 #include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
 
-#include <queue>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#undef min
+#undef max
 
 #define SafeRelease(obj) do { if (obj) (obj)->Release(); (obj) = nullptr; } while (0)
 
@@ -9,22 +15,26 @@ FrameGraph::Render_pass_base *FrameGraph::RenderPassBuilder::GetRenderPass() {
     return this->frameGraph.renderPasses[this->passHandle].get();
 }
 
-FrameGraph::TextureHandle FrameGraph::RenderPassBuilder::Read(TextureHandle textureHandle) {
-    if (textureHandle == INVALID_HANDLE)
+FrameGraph::ResourceHandle FrameGraph::RenderPassBuilder::Read(ResourceHandle resourceHandle) {
+    if (resourceHandle == INVALID_HANDLE)
         return INVALID_HANDLE;
 
-    this->GetRenderPass()->reads.insert(textureHandle);
+    std::vector<ResourceHandle> &reads = this->GetRenderPass()->reads;
+    if (std::find(reads.begin(), reads.end(), resourceHandle) == reads.end())
+        reads.push_back(resourceHandle);
 
-    return textureHandle;
+    return resourceHandle;
 }
 
-FrameGraph::TextureHandle FrameGraph::RenderPassBuilder::Write(TextureHandle textureHandle) {
-    if (textureHandle == INVALID_HANDLE)
+FrameGraph::ResourceHandle FrameGraph::RenderPassBuilder::Write(ResourceHandle resourceHandle) {
+    if (resourceHandle == INVALID_HANDLE)
         return INVALID_HANDLE;
 
-    this->GetRenderPass()->writes.insert(textureHandle);
+    std::vector<ResourceHandle> &writes = this->GetRenderPass()->writes;
+    if (std::find(writes.begin(), writes.end(), resourceHandle) == writes.end())
+        writes.push_back(resourceHandle);
 
-    return textureHandle;
+    return resourceHandle;
 }
 
 void FrameGraph::RenderPassBuilder::WritesBackbuffer() {
@@ -39,32 +49,39 @@ Render_view *FrameGraph::ExecutionContext::GetView(View_type type, int index) {
     return nullptr;
 }
 
-ID3D11ShaderResourceView *FrameGraph::ExecutionContext::GetShaderResourceView(TextureHandle handle) const {
-    if (handle == INVALID_HANDLE || handle >= this->frameGraph.textureResources.size())
+ID3D11ShaderResourceView *FrameGraph::ExecutionContext::GetShaderResourceView(ResourceHandle handle) const {
+    if (handle == INVALID_HANDLE || handle >= this->frameGraph.resources.size())
         return nullptr;
 
-    return this->frameGraph.textureResources[handle].shaderResourceView;
+    return this->frameGraph.resources[handle].shaderResourceView;
 }
 
 ID3D11RenderTargetView *FrameGraph::ExecutionContext::GetRenderTargetView(TextureHandle handle) const {
-    if (handle == INVALID_HANDLE || handle >= this->frameGraph.textureResources.size())
+    if (handle == INVALID_HANDLE || handle >= this->frameGraph.resources.size())
         return nullptr;
 
-    return this->frameGraph.textureResources[handle].renderTargetView;
+    return this->frameGraph.resources[handle].renderTargetView;
 }
 
 ID3D11DepthStencilView *FrameGraph::ExecutionContext::GetDepthStencilView(TextureHandle handle) const {
-    if (handle == INVALID_HANDLE || handle >= this->frameGraph.textureResources.size())
+    if (handle == INVALID_HANDLE || handle >= this->frameGraph.resources.size())
+        return nullptr;
+
+    return this->frameGraph.resources[handle].depthStencilView;
+}
+
+ID3D11UnorderedAccessView *FrameGraph::ExecutionContext::GetUnorderedAccessView(ResourceHandle handle) const {
+    if (handle == INVALID_HANDLE || handle >= this->frameGraph.resources.size())
         return nullptr;
 
-    return this->frameGraph.textureResources[handle].depthStencilView;
+    return this->frameGraph.resources[handle].unorderedAccessView;
 }
 
-ID3D11UnorderedAccessView *FrameGraph::ExecutionContext::GetUnorderedAccessView(TextureHandle handle) const {
-    if (handle == INVALID_HANDLE || handle >= this->frameGraph.textureResources.size())
+ID3D11Buffer *FrameGraph::ExecutionContext::GetBuffer(BufferHandle handle) const {
+    if (handle == INVALID_HANDLE || handle >= this->frameGraph.resources.size())
         return nullptr;
 
-    return this->frameGraph.textureResources[handle].unorderedAccessView;
+    return this->frameGraph.resources[handle].buffer;
 }
 
 FrameGraph::~FrameGraph() {
@@ -73,57 +90,170 @@ FrameGraph::~FrameGraph() {
 
 void FrameGraph::SetDevice(ID3D11Device *device) {
     this->device = device;
+
+    this->profiler.Shutdown();
+    this->profiler.Initialize(device);
+}
+
+void FrameGraph::SetAliasingEnabled(bool enableAliasing) {
+    this->enableAliasing = enableAliasing;
+}
+
+uint32_t FrameGraph::AssignAliasSlots(const std::vector<Alias_interval> &intervals, std::vector<uint32_t> &outSlots) {
+    struct Slot {
+        uint32_t descIndex;
+        uint32_t lastUse;
+    };
+
+    std::vector<uint32_t> order(intervals.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (intervals[a].firstUse != intervals[b].firstUse)
+            return intervals[a].firstUse < intervals[b].firstUse;
+
+        return a < b;
+    });
+
+    outSlots.assign(intervals.size(), 0);
+
+    std::vector<Slot> slots;
+    for (uint32_t index : order) {
+        const Alias_interval &interval = intervals[index];
+
+        auto it = std::find_if(slots.begin(), slots.end(), [&](const Slot &slot) {
+            return slot.descIndex == interval.descIndex && slot.lastUse < interval.firstUse;
+        });
+
+        if (it == slots.end()) {
+            slots.push_back(Slot{ interval.descIndex, interval.lastUse });
+            it = slots.end() - 1;
+        }
+        else {
+            it->lastUse = interval.lastUse;
+        }
+
+        outSlots[index] = static_cast<uint32_t>(it - slots.begin());
+    }
+
+    return static_cast<uint32_t>(slots.size());
+}
+
+bool FrameGraph::ValidateAliasSlots(const std::vector<Alias_interval> &intervals, const std::vector<uint32_t> &slots) {
+    if (slots.size() != intervals.size())
+        return false;
+
+    for (size_t i = 0; i < intervals.size(); ++i) {
+        for (size_t j = i + 1; j < intervals.size(); ++j) {
+            if (slots[i] != slots[j])
+                continue;
+
+            if (intervals[i].descIndex != intervals[j].descIndex)
+                return false;
+
+            if (intervals[i].firstUse <= intervals[j].lastUse && intervals[j].firstUse <= intervals[i].lastUse)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+uint64_t FrameGraph::CalculatePeakBytes(const std::vector<Alias_interval> &intervals) {
+    uint32_t passCount = 0;
+    for (const Alias_interval &interval : intervals)
+        passCount = std::max(passCount, interval.lastUse + 1);
+
+    // Difference array over pass indices
+    std::vector<int64_t> deltas(passCount + 1, 0);
+    for (const Alias_interval &interval : intervals) {
+        deltas[interval.firstUse]    += interval.bytes;
+        deltas[interval.lastUse + 1] -= interval.bytes;
+    }
+
+    int64_t liveBytes = 0;
+    int64_t peakBytes = 0;
+    for (int64_t delta : deltas) {
+        liveBytes += delta;
+        peakBytes = std::max(peakBytes, liveBytes);
+    }
+
+    return static_cast<uint64_t>(peakBytes);
+}
+
+void FrameGraph::BuildProducerLists() {
+    Compile_scratch &scratch = this->scratch;
+
+    const uint32_t resourceCount = this->resources.size();
+
+    scratch.producerOffsets.assign(resourceCount + 1, 0);
+    for (const auto &pass : this->renderPasses)
+        for (ResourceHandle resourceHandle : pass->writes)
+            if (resourceHandle < resourceCount)
+                ++scratch.producerOffsets[resourceHandle + 1];
+
+    for (uint32_t i = 0; i < resourceCount; ++i)
+        scratch.producerOffsets[i + 1] += scratch.producerOffsets[i];
+
+    scratch.producers.resize(scratch.producerOffsets[resourceCount]);
+    scratch.cursors.assign(scratch.producerOffsets.begin(), scratch.producerOffsets.end() - 1);
+
+    for (PassHandle passHandle = 0; passHandle < this->renderPasses.size(); ++passHandle)
+        for (ResourceHandle resourceHandle : this->renderPasses[passHandle]->writes)
+            if (resourceHandle < resourceCount)
+                scratch.producers[scratch.cursors[resourceHandle]++] = passHandle;
 }
 
 void FrameGraph::CullUnusedPasses() {
+    Compile_scratch &scratch = this->scratch;
+
     for (auto &pass : this->renderPasses) {
         pass->isCulled = false;
         pass->refCount = 0;
     }
 
-    for (auto &resource : this->textureResources)
+    for (auto &resource : this->resources)
         resource.readRefCount = 0;
 
     for (const auto &pass : this->renderPasses)
-        for (TextureHandle textureHandle : pass->reads)
-            if (textureHandle < this->textureResources.size())
-                ++this->textureResources[textureHandle].readRefCount;
+        for (ResourceHandle resourceHandle : pass->reads)
+            if (resourceHandle < this->resources.size())
+                ++this->resources[resourceHandle].readRefCount;
 
     for (auto &pass : this->renderPasses) {
         if (pass->writesBackbuffer)
             ++pass->refCount;
 
-        for (TextureHandle textureHandle : pass->writes)
-            if (textureHandle < this->textureResources.size() && this->textureResources[textureHandle].readRefCount > 0)
+        for (ResourceHandle resourceHandle : pass->writes)
+            if (resourceHandle < this->resources.size() && this->resources[resourceHandle].readRefCount > 0)
                 ++pass->refCount;
     }
 
-    std::queue<PassHandle> cullQueue;
+    scratch.passQueue.clear();
     for (PassHandle passHandle = 0; passHandle < this->renderPasses.size(); ++passHandle)
         if (this->renderPasses[passHandle]->refCount == 0)
-            cullQueue.push(passHandle);
-
-    while (!cullQueue.empty()) {
-        PassHandle passHandle = cullQueue.front();
-        cullQueue.pop();
+            scratch.passQueue.push_back(passHandle);
 
-        Render_pass_base *pass = this->renderPasses[passHandle].get();
+    for (size_t head = 0; head < scratch.passQueue.size(); ++head) {
+        Render_pass_base *pass = this->renderPasses[scratch.passQueue[head]].get();
         pass->isCulled = true;
 
-        for (TextureHandle textureHandle : pass->reads) {
-            if (textureHandle >= this->textureResources.size())
+        for (ResourceHandle resourceHandle : pass->reads) {
+            if (resourceHandle >= this->resources.size())
                 continue;
 
-            if (--this->textureResources[textureHandle].readRefCount > 0)
+            if (--this->resources[resourceHandle].readRefCount > 0)
                 continue;
 
-            for (PassHandle otherPassHandle = 0; otherPassHandle < this->renderPasses.size(); ++otherPassHandle) {
-                if (this->renderPasses[otherPassHandle]->isCulled)
+            // The resource is dead, so its producers lose a reference
+            for (uint32_t i = scratch.producerOffsets[resourceHandle]; i < scratch.producerOffsets[resourceHandle + 1]; ++i) {
+                PassHandle producerHandle = scratch.producers[i];
+                if (this->renderPasses[producerHandle]->isCulled)
                     continue;
 
-                if (this->renderPasses[otherPassHandle]->writes.count(textureHandle))
-                    if (--this->renderPasses[otherPassHandle]->refCount == 0)
-                        cullQueue.push(otherPassHandle);
+                if (--this->renderPasses[producerHandle]->refCount == 0)
+                    scratch.passQueue.push_back(producerHandle);
             }
         }
     }
@@ -131,52 +261,70 @@ void FrameGraph::CullUnusedPasses() {
 
 // https://en.wikipedia.org/wiki/Topological_sorting#Kahn's_algorithm
 bool FrameGraph::TopologicalSort() {
+    Compile_scratch &scratch = this->scratch;
+
     this->sortedPassHandles.clear();
 
     const uint32_t passCount = this->renderPasses.size();
 
-    // Construct the graph
+    // Construct the graph, an edge goes from every live producer of a read resource to the reading pass.
+    // The stamps remember the last pass an edge from a producer was added for, which drops duplicate edges.
 
-    std::vector<std::unordered_set<PassHandle>> dependencies(passCount);
-    std::vector<std::unordered_set<PassHandle>> successors(passCount);
+    scratch.edges.clear();
+    scratch.edgeStamps.assign(passCount, INVALID_HANDLE);
+    scratch.inDegree.assign(passCount, 0);
 
     for (PassHandle passHandle = 0; passHandle < passCount; ++passHandle) {
         if (this->renderPasses[passHandle]->isCulled)
             continue;
 
-        for (TextureHandle textureHandle : this->renderPasses[passHandle]->reads) {
-            for (PassHandle otherPassHandle = 0; otherPassHandle < passCount; ++otherPassHandle) {
-                if (otherPassHandle == passHandle || this->renderPasses[otherPassHandle]->isCulled)
+        for (ResourceHandle resourceHandle : this->renderPasses[passHandle]->reads) {
+            if (resourceHandle >= this->resources.size())
+                continue;
+
+            for (uint32_t i = scratch.producerOffsets[resourceHandle]; i < scratch.producerOffsets[resourceHandle + 1]; ++i) {
+                PassHandle producerHandle = scratch.producers[i];
+                if (producerHandle == passHandle || this->renderPasses[producerHandle]->isCulled)
+                    continue;
+
+                if (scratch.edgeStamps[producerHandle] == passHandle)
                     continue;
 
-                if (this->renderPasses[otherPassHandle]->writes.count(textureHandle))
-                    if (dependencies[passHandle].insert(otherPassHandle).second)
-                        successors[otherPassHandle].insert(passHandle);
+                scratch.edgeStamps[producerHandle] = passHandle;
+                scratch.edges.emplace_back(producerHandle, passHandle);
+                ++scratch.inDegree[passHandle];
             }
         }
     }
 
-    // Sort the graph
+    scratch.successorOffsets.assign(passCount + 1, 0);
+    for (const auto &edge : scratch.edges)
+        ++scratch.successorOffsets[edge.first + 1];
 
-    std::vector<int> inDegree(passCount, 0);
-    for (PassHandle passHandle = 0; passHandle < passCount; ++passHandle)
-        if (!this->renderPasses[passHandle]->isCulled)
-            inDegree[passHandle] = dependencies[passHandle].size();
+    for (uint32_t i = 0; i < passCount; ++i)
+        scratch.successorOffsets[i + 1] += scratch.successorOffsets[i];
+
+    scratch.successors.resize(scratch.edges.size());
+    scratch.cursors.assign(scratch.successorOffsets.begin(), scratch.successorOffsets.end() - 1);
 
-    std::queue<PassHandle> readyQueue;
+    for (const auto &edge : scratch.edges)
+        scratch.successors[scratch.cursors[edge.first]++] = edge.second;
+
+    // Sort the graph
+
+    scratch.passQueue.clear();
     for (PassHandle passHandle = 0; passHandle < passCount; ++passHandle)
-        if (!this->renderPasses[passHandle]->isCulled && inDegree[passHandle] == 0)
-            readyQueue.push(passHandle);
+        if (!this->renderPasses[passHandle]->isCulled && scratch.inDegree[passHandle] == 0)
+            scratch.passQueue.push_back(passHandle);
 
-    while (!readyQueue.empty()) {
-        PassHandle passHandle = readyQueue.front();
-        readyQueue.pop();
+    for (size_t head = 0; head < scratch.passQueue.size(); ++head) {
+        PassHandle passHandle = scratch.passQueue[head];
 
         this->sortedPassHandles.push_back(passHandle);
 
-        for (PassHandle successor : successors[passHandle])
-            if (--inDegree[successor] == 0)
-                readyQueue.push(successor);
+        for (uint32_t i = scratch.successorOffsets[passHandle]; i < scratch.successorOffsets[passHandle + 1]; ++i)
+            if (--scratch.inDegree[scratch.successors[i]] == 0)
+                scratch.passQueue.push_back(scratch.successors[i]);
     }
 
     int liveCount = 0; 
@@ -184,44 +332,98 @@ bool FrameGraph::TopologicalSort() {
         if (!pass->isCulled)
             ++liveCount;
 
+    // Not fatal here, Compile reports the failure and the caller decides
     if (this->sortedPassHandles.size() != liveCount) {
-        LogError("Cycle detected in render pass dependency graph");
+        LogWarn("Cycle detected in render pass dependency graph\n");
         return false;
     }
 
     return true;
 }
 
+void FrameGraph::ScheduleByLevel() {
+    Compile_scratch &scratch = this->scratch;
+
+    for (auto &pass : this->renderPasses)
+        pass->level = 0;
+
+    // The sorted order visits every pass after all of its producers...
+    this->levelCount = 0;
+    for (PassHandle passHandle : this->sortedPassHandles) {
+        const uint32_t level = this->renderPasses[passHandle]->level;
+        this->levelCount = std::max(this->levelCount, level + 1);
+
+        for (uint32_t i = scratch.successorOffsets[passHandle]; i < scratch.successorOffsets[passHandle + 1]; ++i) {
+            Render_pass_base *successor = this->renderPasses[scratch.successors[i]].get();
+            successor->level = std::max(successor->level, level + 1);
+        }
+    }
+
+    // ...and, reversed, every pass after all of its consumers
+    scratch.criticalPaths.assign(this->renderPasses.size(), 1);
+    for (auto it = this->sortedPassHandles.rbegin(); it != this->sortedPassHandles.rend(); ++it) {
+        const PassHandle passHandle = *it;
+
+        for (uint32_t i = scratch.successorOffsets[passHandle]; i < scratch.successorOffsets[passHandle + 1]; ++i)
+            scratch.criticalPaths[passHandle] = std::max(scratch.criticalPaths[passHandle], scratch.criticalPaths[scratch.successors[i]] + 1);
+    }
+
+    // Edges always go to a higher level, so any order within a level is valid. Starting the longest chains first
+    // leaves the independent passes behind them free to overlap with their tails.
+    std::sort(this->sortedPassHandles.begin(), this->sortedPassHandles.end(), [&](PassHandle a, PassHandle b) {
+        const uint32_t levelA = this->renderPasses[a]->level;
+        const uint32_t levelB = this->renderPasses[b]->level;
+        if (levelA != levelB)
+            return levelA < levelB;
+
+        if (scratch.criticalPaths[a] != scratch.criticalPaths[b])
+            return scratch.criticalPaths[a] > scratch.criticalPaths[b];
+
+        return a < b;
+    });
+}
+
+bool FrameGraph::CompilePasses() {
+    this->BuildProducerLists();
+    this->CullUnusedPasses();
+
+    if (!this->TopologicalSort())
+        return false;
+
+    this->ScheduleByLevel();
+    this->ComputeResourceLifetimes();
+    return true;
+}
+
 void FrameGraph::ComputeResourceLifetimes() {
-    for (auto &resource : this->textureResources) {
+    for (auto &resource : this->resources) {
         resource.firstWrite = INVALID_HANDLE;
         resource.lastRead   = INVALID_HANDLE;
+        resource.lastUse    = INVALID_HANDLE;
     }
 
     for (int i = 0; i < this->sortedPassHandles.size(); ++i) {
         PassHandle passHandle = this->sortedPassHandles[i];
         const Render_pass_base *pass = this->renderPasses[passHandle].get();
 
-        for (TextureHandle textureHandle : pass->writes)
-            if (textureHandle < this->textureResources.size() && this->textureResources[textureHandle].firstWrite == INVALID_HANDLE)
-                this->textureResources[textureHandle].firstWrite = i;
+        for (ResourceHandle resourceHandle : pass->writes) {
+            if (resourceHandle >= this->resources.size())
+                continue;
 
-        for (TextureHandle textureHandle : pass->reads)
-            if (textureHandle < this->textureResources.size())
-                this->textureResources[textureHandle].lastRead = i;
-    }
-}
+            Resource &resource = this->resources[resourceHandle];
+            if (resource.firstWrite == INVALID_HANDLE)
+                resource.firstWrite = i;
 
-static bool IsDepthStencilFormat(DXGI_FORMAT format) {
-    switch (format) {
-        case DXGI_FORMAT_D32_FLOAT:
-        case DXGI_FORMAT_D24_UNORM_S8_UINT:
-        case DXGI_FORMAT_D16_UNORM:
-        case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
-            return true;
+            resource.lastUse = i;
+        }
 
-        default:
-            return false;
+        for (ResourceHandle resourceHandle : pass->reads) {
+            if (resourceHandle >= this->resources.size())
+                continue;
+
+            this->resources[resourceHandle].lastRead = i;
+            this->resources[resourceHandle].lastUse  = i;
+        }
     }
 }
 
@@ -257,236 +459,1630 @@ static DXGI_FORMAT GetDepthStencilSRVFormat(DXGI_FORMAT format) {
     }
 }
 
-void FrameGraph::CreateTemporaryResources() {
-    for (auto &resource : this->textureResources) {
-        if (resource.wasImported)
-            continue;
+static uint32_t GetBitsPerPixel(DXGI_FORMAT format) {
+    switch (format) {
+        case DXGI_FORMAT_R8_UNORM:
+            return 8;
 
-        if (resource.firstWrite == INVALID_HANDLE)
-            continue;
+        case DXGI_FORMAT_D16_UNORM:
+        case DXGI_FORMAT_R16_TYPELESS:
+        case DXGI_FORMAT_R16_FLOAT:
+            return 16;
 
-        UINT width, height;
-        if (resource.desc.sizeMode == Texture_desc::Size_mode::absolute) {
-            width  = resource.desc.width;
-            height = resource.desc.height;
-        }
-        else {
-            width  = this->backbufferWidth  * resource.desc.width;
-            height = this->backbufferHeight * resource.desc.height;
-        }
-
-        width  = width  < 1u ? 1u : width;
-        height = height < 1u ? 1u : height;
-
-        const bool bindsDepthStencil    = (resource.desc.bindFlags & D3D11_BIND_DEPTH_STENCIL)    != 0;
-        const bool bindsShaderResource  = (resource.desc.bindFlags & D3D11_BIND_SHADER_RESOURCE)  != 0;
-        const bool bindsRenderTarget    = (resource.desc.bindFlags & D3D11_BIND_RENDER_TARGET)    != 0;
-        const bool bindsUnorderedAccess = (resource.desc.bindFlags & D3D11_BIND_UNORDERED_ACCESS) != 0;
-
-        DXGI_FORMAT format = resource.desc.format;
-        if (bindsDepthStencil && bindsShaderResource)
-            format = GetTypelessDepthStencilFormat(format);
-
-        D3D11_TEXTURE2D_DESC desc{};
-        desc.Width              = width;
-        desc.Height             = height;
-        desc.MipLevels          = resource.desc.mipLevels;
-        desc.ArraySize          = 1;
-        desc.Format             = format;
-        desc.SampleDesc.Count   = 1;
-        desc.SampleDesc.Quality = 0;
-        desc.Usage              = D3D11_USAGE_DEFAULT;
-        desc.BindFlags          = resource.desc.bindFlags;
-        desc.CPUAccessFlags     = 0;
-        desc.MiscFlags          = 0;
-
-        HRESULT result = this->device->CreateTexture2D(&desc, nullptr, &resource.texture);
-        if (FAILED(result)) {
-            LogWarn("Failed to create texture '%s'\n", resource.name.c_str());
-            continue;
-        }
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        case DXGI_FORMAT_R32G32_FLOAT:
+        case DXGI_FORMAT_R32G8X24_TYPELESS:
+            return 64;
 
-        if (bindsRenderTarget && !bindsDepthStencil) {
-            D3D11_RENDER_TARGET_VIEW_DESC rtvDesc{};
-            rtvDesc.Format = resource.desc.format;
-            rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-            rtvDesc.Texture2D.MipSlice = 0;
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+            return 128;
 
-            result = this->device->CreateRenderTargetView(resource.texture, &rtvDesc, &resource.renderTargetView);
-            if (FAILED(result))
-                LogWarn("Failed to create Render Target View for '%s'\n", resource.name.c_str());
-        }
+        default:
+            return 32;
+    }
+}
 
-        if (bindsDepthStencil) {
-            D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc{};
-            dsvDesc.Format = resource.desc.format;
-            dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-            dsvDesc.Texture2D.MipSlice = 0;
+static uint64_t CalculateTextureBytes(const D3D11_TEXTURE2D_DESC &desc) {
+    uint64_t bytes = 0;
+    for (UINT mip = 0; mip < desc.MipLevels; ++mip) {
+        uint64_t width  = std::max(desc.Width >> mip, 1u);
+        uint64_t height = std::max(desc.Height >> mip, 1u);
+        bytes += width * height * GetBitsPerPixel(desc.Format) / 8;
+    }
 
-            result = this->device->CreateDepthStencilView(resource.texture, &dsvDesc, &resource.depthStencilView);
-            if (FAILED(result))
-                LogWarn("Failed to create Depth Stencil View for '%s'\n", resource.name.c_str());
-        }
+    return bytes;
+}
 
-        if (bindsShaderResource) {
-            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
-            srvDesc.Format = bindsDepthStencil ? GetDepthStencilSRVFormat(resource.desc.format) : resource.desc.format;
-            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-            srvDesc.Texture2D.MostDetailedMip = 0;
-            srvDesc.Texture2D.MipLevels = resource.desc.mipLevels;
+bool FrameGraph::Physical_desc::operator==(const Physical_desc &other) const {
+    if (this->type != other.type)
+        return false;
 
-            result = this->device->CreateShaderResourceView(resource.texture, &srvDesc, &resource.shaderResourceView);
-            if (FAILED(result))
-                LogWarn("Failed to create Shader Resource View for '%s'\n", resource.name.c_str());
-        }
+    if (this->type == Resource_type::buffer)
+        return memcmp(&this->bufferDesc, &other.bufferDesc, sizeof(D3D11_BUFFER_DESC)) == 0;
 
-        if (bindsUnorderedAccess) {
-            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc{};
-            uavDesc.Format = resource.desc.format;
-            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
-            uavDesc.Texture2D.MipSlice = 0;
+    return memcmp(&this->textureDesc, &other.textureDesc, sizeof(D3D11_TEXTURE2D_DESC)) == 0 && this->viewFormat == other.viewFormat;
+}
 
-            result = this->device->CreateUnorderedAccessView(resource.texture, &uavDesc, &resource.unorderedAccessView);
-            if (FAILED(result))
-                LogWarn("Failed to create Unordered Access View for '%s'\n", resource.name.c_str());
-        }
-    }
+uint64_t FrameGraph::Physical_desc::CalculateBytes() const {
+    if (this->type == Resource_type::buffer)
+        return this->bufferDesc.ByteWidth;
+
+    return CalculateTextureBytes(this->textureDesc);
 }
 
-void FrameGraph::ReleaseTemporaryResources() {
-    for (auto &resource : this->textureResources) {
-        if (resource.wasImported)
-            continue;
+FrameGraph::Physical_desc FrameGraph::ResolvePhysicalDesc(const Resource &resource) const {
+    Physical_desc physicalDesc{};
+    physicalDesc.type = resource.type;
+
+    if (resource.type == Resource_type::buffer) {
+        const Buffer_desc &bufferDesc = resource.bufferDesc;
+        const bool isStructured = (bufferDesc.miscFlags & D3D11_RESOURCE_MISC_BUFFER_STRUCTURED) != 0;
+
+        D3D11_BUFFER_DESC &desc = physicalDesc.bufferDesc;
+        desc.ByteWidth           = bufferDesc.elementSize * bufferDesc.elementCount;
+        desc.Usage               = D3D11_USAGE_DEFAULT;
+        desc.BindFlags           = bufferDesc.bindFlags;
+        desc.CPUAccessFlags      = 0;
+        desc.MiscFlags           = bufferDesc.miscFlags;
+        desc.StructureByteStride = isStructured ? bufferDesc.elementSize : 0;
+
+        return physicalDesc;
+    }
 
-        SafeRelease(resource.unorderedAccessView);
-        SafeRelease(resource.shaderResourceView);
-        SafeRelease(resource.renderTargetView);
-        SafeRelease(resource.depthStencilView);
-        SafeRelease(resource.texture);
+    const Texture_desc &textureDesc = resource.desc;
+
+    UINT width, height;
+    if (textureDesc.sizeMode == Texture_desc::Size_mode::absolute) {
+        width  = textureDesc.width;
+        height = textureDesc.height;
+    }
+    else {
+        width  = this->backbufferWidth  * textureDesc.width;
+        height = this->backbufferHeight * textureDesc.height;
     }
+
+    width  = width  < 1u ? 1u : width;
+    height = height < 1u ? 1u : height;
+
+    const bool bindsDepthStencil   = (textureDesc.bindFlags & D3D11_BIND_DEPTH_STENCIL)   != 0;
+    const bool bindsShaderResource = (textureDesc.bindFlags & D3D11_BIND_SHADER_RESOURCE) != 0;
+
+    DXGI_FORMAT format = textureDesc.format;
+    if (bindsDepthStencil && bindsShaderResource)
+        format = GetTypelessDepthStencilFormat(format);
+
+    D3D11_TEXTURE2D_DESC &desc = physicalDesc.textureDesc;
+    desc.Width              = width;
+    desc.Height             = height;
+    desc.MipLevels          = textureDesc.mipLevels;
+    desc.ArraySize          = 1;
+    desc.Format             = format;
+    desc.SampleDesc.Count   = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage              = D3D11_USAGE_DEFAULT;
+    desc.BindFlags          = textureDesc.bindFlags;
+    desc.CPUAccessFlags     = 0;
+    desc.MiscFlags          = 0;
+
+    physicalDesc.viewFormat = textureDesc.format;
+
+    return physicalDesc;
 }
 
-FrameGraph::TextureHandle FrameGraph::CreateTexture(const std::string &name, FrameGraph::Texture_desc desc) {
-    TextureHandle handle = this->textureResources.size();
+bool FrameGraph::CreatePhysicalTexture(const Resource &resource, const Physical_desc &desc, Physical_resource &outTexture) {
+    const bool bindsDepthStencil    = (resource.desc.bindFlags & D3D11_BIND_DEPTH_STENCIL)    != 0;
+    const bool bindsShaderResource  = (resource.desc.bindFlags & D3D11_BIND_SHADER_RESOURCE)  != 0;
+    const bool bindsRenderTarget    = (resource.desc.bindFlags & D3D11_BIND_RENDER_TARGET)    != 0;
+    const bool bindsUnorderedAccess = (resource.desc.bindFlags & D3D11_BIND_UNORDERED_ACCESS) != 0;
 
-    Texture_resource resource{};
-    resource.name = name;
-    resource.desc = desc;
-    resource.wasImported = false;
+    HRESULT result = this->device->CreateTexture2D(&desc.textureDesc, nullptr, &outTexture.texture);
+    if (FAILED(result)) {
+        LogWarn("Failed to create texture '%s'\n", resource.name.c_str());
+        return false;
+    }
 
-    this->textureResources.push_back(resource);
+    if (bindsRenderTarget && !bindsDepthStencil) {
+        D3D11_RENDER_TARGET_VIEW_DESC rtvDesc{};
+        rtvDesc.Format = resource.desc.format;
+        rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+        rtvDesc.Texture2D.MipSlice = 0;
 
-    return handle;
+        result = this->device->CreateRenderTargetView(outTexture.texture, &rtvDesc, &outTexture.renderTargetView);
+        if (FAILED(result))
+            LogWarn("Failed to create Render Target View for '%s'\n", resource.name.c_str());
+    }
+
+    if (bindsDepthStencil) {
+        D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc{};
+        dsvDesc.Format = resource.desc.format;
+        dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+        dsvDesc.Texture2D.MipSlice = 0;
+
+        result = this->device->CreateDepthStencilView(outTexture.texture, &dsvDesc, &outTexture.depthStencilView);
+        if (FAILED(result))
+            LogWarn("Failed to create Depth Stencil View for '%s'\n", resource.name.c_str());
+    }
+
+    if (bindsShaderResource) {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Format = bindsDepthStencil ? GetDepthStencilSRVFormat(resource.desc.format) : resource.desc.format;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MostDetailedMip = 0;
+        srvDesc.Texture2D.MipLevels = resource.desc.mipLevels;
+
+        result = this->device->CreateShaderResourceView(outTexture.texture, &srvDesc, &outTexture.shaderResourceView);
+        if (FAILED(result))
+            LogWarn("Failed to create Shader Resource View for '%s'\n", resource.name.c_str());
+    }
+
+    if (bindsUnorderedAccess) {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc{};
+        uavDesc.Format = resource.desc.format;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+        uavDesc.Texture2D.MipSlice = 0;
+
+        result = this->device->CreateUnorderedAccessView(outTexture.texture, &uavDesc, &outTexture.unorderedAccessView);
+        if (FAILED(result))
+            LogWarn("Failed to create Unordered Access View for '%s'\n", resource.name.c_str());
+    }
+
+    return true;
 }
 
-FrameGraph::TextureHandle FrameGraph::ImportTexture(
-    const std::string &name,
-    ID3D11Texture2D *texture,
-    ID3D11RenderTargetView *renderTargetView,
-    ID3D11ShaderResourceView *shaderResourceView,
-    ID3D11DepthStencilView *depthStencilView,
-    ID3D11UnorderedAccessView *unorderedAccessView
-) {
-    TextureHandle handle = this->textureResources.size();
+bool FrameGraph::CreatePhysicalBuffer(const Resource &resource, const Physical_desc &desc, Physical_resource &outBuffer) {
+    const Buffer_desc &bufferDesc = resource.bufferDesc;
 
-    Texture_resource resource{};
-    resource.name = name;
-    resource.wasImported = true;
-    resource.texture = texture;
-    resource.renderTargetView = renderTargetView;
-    resource.shaderResourceView = shaderResourceView;
-    resource.depthStencilView = depthStencilView;
-    resource.unorderedAccessView = unorderedAccessView;
+    const bool bindsShaderResource  = (bufferDesc.bindFlags & D3D11_BIND_SHADER_RESOURCE)  != 0;
+    const bool bindsUnorderedAccess = (bufferDesc.bindFlags & D3D11_BIND_UNORDERED_ACCESS) != 0;
+    const bool isRaw = (bufferDesc.miscFlags & D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS) != 0;
+
+    HRESULT result = this->device->CreateBuffer(&desc.bufferDesc, nullptr, &outBuffer.buffer);
+    if (FAILED(result)) {
+        LogWarn("Failed to create buffer '%s'\n", resource.name.c_str());
+        return false;
+    }
 
-    this->textureResources.push_back(resource);
+    if (bindsShaderResource) {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Format = isRaw ? DXGI_FORMAT_R32_TYPELESS : DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+        srvDesc.BufferEx.FirstElement = 0;
+        srvDesc.BufferEx.NumElements = bufferDesc.elementCount;
+        srvDesc.BufferEx.Flags = isRaw ? D3D11_BUFFEREX_SRV_FLAG_RAW : 0;
+
+        result = this->device->CreateShaderResourceView(outBuffer.buffer, &srvDesc, &outBuffer.shaderResourceView);
+        if (FAILED(result))
+            LogWarn("Failed to create Shader Resource View for '%s'\n", resource.name.c_str());
+    }
 
-    return handle;
+    if (bindsUnorderedAccess) {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc{};
+        uavDesc.Format = isRaw ? DXGI_FORMAT_R32_TYPELESS : DXGI_FORMAT_UNKNOWN;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.FirstElement = 0;
+        uavDesc.Buffer.NumElements = bufferDesc.elementCount;
+        uavDesc.Buffer.Flags = isRaw ? D3D11_BUFFER_UAV_FLAG_RAW : 0;
+
+        result = this->device->CreateUnorderedAccessView(outBuffer.buffer, &uavDesc, &outBuffer.unorderedAccessView);
+        if (FAILED(result))
+            LogWarn("Failed to create Unordered Access View for '%s'\n", resource.name.c_str());
+    }
+
+    return true;
 }
 
-void FrameGraph::UpdateImportedTexture(
-    TextureHandle handle,
-    ID3D11Texture2D *texture,
-    ID3D11RenderTargetView *renderTargetView,
-    ID3D11ShaderResourceView *shaderResourceView,
-    ID3D11DepthStencilView *depthStencilView,
-    ID3D11UnorderedAccessView *unorderedAccessView
+// D3D11 has no placed resources, so transients can only alias by reusing a resource with the exact same description.
+// The peak of simultaneously live bytes is still reported as what a heap-based backend could get down to.
+uint32_t FrameGraph::AcquirePhysicalResource(
+    const Resource &resource, 
+    const Physical_desc &desc, 
+    const std::vector<uint32_t> &takenResources
 ) {
-    if (handle == INVALID_HANDLE || handle >= this->textureResources.size()) {
-        LogWarn("Invalid handle\n");
-        return;
+    uint32_t freeIndex = INVALID_HANDLE;
+
+    for (uint32_t i = 0; i < this->physicalResources.size(); ++i) {
+        const Physical_resource &physicalResource = this->physicalResources[i];
+
+        if (!physicalResource.IsAllocated()) {
+            if (freeIndex == INVALID_HANDLE)
+                freeIndex = i;
+
+            continue;
+        }
+
+        if (!(physicalResource.desc == desc))
+            continue;
+
+        if (std::find(takenResources.begin(), takenResources.end(), i) != takenResources.end())
+            continue;
+
+        // Either shared with another cached graph or taken back out of the pool
+        ++this->physicalResources[i].refCount;
+        return i;
     }
 
-    Texture_resource &resource = this->textureResources[handle];
-    if (!resource.wasImported) {
-        LogWarn("Tried to update non-imported texture resource '%s'\n", resource.name.c_str());
-        return;
+    if (freeIndex == INVALID_HANDLE) {
+        freeIndex = static_cast<uint32_t>(this->physicalResources.size());
+        this->physicalResources.emplace_back();
     }
 
-    resource.texture = texture;
-    resource.renderTargetView = renderTargetView;
-    resource.shaderResourceView = shaderResourceView;
-    resource.depthStencilView = depthStencilView;
-    resource.unorderedAccessView = unorderedAccessView;
+    Physical_resource &physicalResource = this->physicalResources[freeIndex];
+    const bool wasCreated = resource.type == Resource_type::buffer ?
+        this->CreatePhysicalBuffer(resource, desc, physicalResource) :
+        this->CreatePhysicalTexture(resource, desc, physicalResource);
+
+    if (!wasCreated) {
+        // Leaves the entry free
+        physicalResource.Release();
+        return INVALID_HANDLE;
+    }
+
+    physicalResource.desc     = desc;
+    physicalResource.bytes    = desc.CalculateBytes();
+    physicalResource.refCount = 1;
+
+    ++this->cacheStats.createdCount;
+
+    return freeIndex;
 }
 
-void FrameGraph::Compile(int backbufferWidth, int backbufferHeight) {
-    LogInfo("Compiling frame graph... (%dx%d)\n", backbufferWidth, backbufferHeight);
-    LogIndent();
+void FrameGraph::CreateTemporaryResources(Compiled_graph &compiledGraph) {
+    Memory_stats &memoryStats = compiledGraph.memoryStats;
+    memoryStats = Memory_stats{};
 
-    this->isCompiled = false;
+    compiledGraph.resourcePlacements.assign(this->resources.size(), INVALID_HANDLE);
+    compiledGraph.physicalResources.clear();
 
-    this->backbufferWidth  = backbufferWidth;
-    this->backbufferHeight = backbufferHeight;
+    std::vector<ResourceHandle> transientHandles;
+    std::vector<Alias_interval> intervals;
 
-    this->ReleaseTemporaryResources();
-    this->CullUnusedPasses();
-    this->TopologicalSort();
-    this->ComputeResourceLifetimes();
-    this->CreateTemporaryResources();
+    std::vector<Physical_desc> descs;
 
-    this->isCompiled = true;
+    for (ResourceHandle handle = 0; handle < this->resources.size(); ++handle) {
+        const Resource &resource = this->resources[handle];
+        if (resource.wasImported)
+            continue;
 
-    LogUnindent();
-    this->LogGraph();
-}
+        if (resource.firstWrite == INVALID_HANDLE)
+            continue;
 
-void FrameGraph::OnResize(int width, int height) {
-    LogInfo("Resizing frame graph\n");
-    this->Compile(width, height);
-}
+        Physical_desc desc = this->ResolvePhysicalDesc(resource);
 
-void FrameGraph::Execute(ID3D11DeviceContext *deviceContext, std::vector<Render_view> &views) {
-    if (!this->isCompiled) {
-        LogWarn("Tried to execute uncompiled frame graph!\n");
-        return;
+        auto it = std::find(descs.begin(), descs.end(), desc);
+        if (it == descs.end()) {
+            descs.push_back(desc);
+            it = descs.end() - 1;
+        }
+
+        Alias_interval interval{};
+        interval.firstUse  = resource.firstWrite;
+        interval.lastUse   = resource.lastUse;
+        interval.bytes     = desc.CalculateBytes();
+        interval.descIndex = static_cast<uint32_t>(it - descs.begin());
+
+        transientHandles.push_back(handle);
+        intervals.push_back(interval);
     }
 
-    ExecutionContext context(deviceContext, views, *this);
+    std::vector<uint32_t> slots;
+    uint32_t slotCount = 0;
 
-    for (PassHandle passHandle : this->sortedPassHandles)
-        this->renderPasses[passHandle]->Execute(context);
-}
+    if (this->enableAliasing) {
+        slotCount = AssignAliasSlots(intervals, slots);
 
-void FrameGraph::Clear() {
-    this->ReleaseTemporaryResources();
+        if (!ValidateAliasSlots(intervals, slots)) {
+            LogWarn("Frame graph alias slots overlap, falling back to one allocation per resource\n");
+            slotCount = 0;
+        }
+    }
 
-    this->renderPasses.clear();
-    this->textureResources.clear();
-    this->sortedPassHandles.clear();
+    if (slotCount == 0) {
+        slotCount = static_cast<uint32_t>(intervals.size());
 
-    this->isCompiled = false;
-}
+        slots.resize(intervals.size());
+        for (uint32_t i = 0; i < slots.size(); ++i)
+            slots[i] = i;
+    }
 
-void FrameGraph::LogGraph() const {
-    int culledCount = 0;
-    for (const auto &pass : this->renderPasses)
-        if (pass->isCulled)
-            ++culledCount;
+    // The first resource placed in a slot acquires its physical resource, possibly one another cached graph already uses
+    std::vector<bool> wasAcquired(slotCount, false);
+    std::vector<uint32_t> slotResources(slotCount, INVALID_HANDLE);
 
-    LogInfo(
-        "Frame graph: %zu passes (%d culled), %zu resources\n", 
-        this->renderPasses.size(), 
-        culledCount, 
-        this->textureResources.size()
-    );
-}
+    for (size_t i = 0; i < transientHandles.size(); ++i) {
+        const Resource &resource = this->resources[transientHandles[i]];
+        const uint32_t slot = slots[i];
+
+        if (!wasAcquired[slot]) {
+            wasAcquired[slot] = true;
+            slotResources[slot] = this->AcquirePhysicalResource(resource, descs[intervals[i].descIndex], compiledGraph.physicalResources);
+
+            if (slotResources[slot] != INVALID_HANDLE) {
+                compiledGraph.physicalResources.push_back(slotResources[slot]);
+                memoryStats.allocatedBytes += intervals[i].bytes;
+            }
+        }
+
+        compiledGraph.resourcePlacements[transientHandles[i]] = slotResources[slot];
+    }
+
+    memoryStats.transientCount  = static_cast<int>(intervals.size());
+    memoryStats.allocationCount = static_cast<int>(slotCount);
+    memoryStats.peakBytes       = CalculatePeakBytes(intervals);
+
+    for (const Alias_interval &interval : intervals)
+        memoryStats.summedBytes += interval.bytes;
+}
+
+void FrameGraph::Physical_resource::Release() {
+    SafeRelease(this->unorderedAccessView);
+    SafeRelease(this->shaderResourceView);
+    SafeRelease(this->renderTargetView);
+    SafeRelease(this->depthStencilView);
+    SafeRelease(this->texture);
+    SafeRelease(this->buffer);
+
+    this->refCount = 0;
+}
+
+void FrameGraph::ReleaseCompiledGraph(Compiled_graph &compiledGraph) {
+    for (uint32_t index : compiledGraph.physicalResources) {
+        Physical_resource &physicalResource = this->physicalResources[index];
+        if (--physicalResource.refCount == 0)
+            physicalResource.unusedSinceFrame = this->frameIndex;
+    }
+
+    compiledGraph.physicalResources.clear();
+}
+
+void FrameGraph::EvictPooledResources() {
+    uint64_t unusedBytes = 0;
+    for (auto &physicalResource : this->physicalResources) {
+        if (!physicalResource.IsAllocated() || physicalResource.refCount > 0)
+            continue;
+
+        if (this->frameIndex - physicalResource.unusedSinceFrame > POOL_MAX_UNUSED_FRAMES) {
+            physicalResource.Release();
+            ++this->cacheStats.evictedCount;
+            continue;
+        }
+
+        unusedBytes += physicalResource.bytes;
+    }
+
+    // Over budget, e.g. while the window is dragged through many sizes without executing a frame in between
+    while (unusedBytes > POOL_MAX_UNUSED_BYTES) {
+        Physical_resource *oldest = nullptr;
+        for (auto &physicalResource : this->physicalResources) {
+            if (!physicalResource.IsAllocated() || physicalResource.refCount > 0)
+                continue;
+
+            if (!oldest || physicalResource.unusedSinceFrame < oldest->unusedSinceFrame)
+                oldest = &physicalResource;
+        }
+
+        unusedBytes -= oldest->bytes;
+        oldest->Release();
+        ++this->cacheStats.evictedCount;
+    }
+
+    this->UpdatePoolStats();
+}
+
+void FrameGraph::UpdatePoolStats() {
+    this->cacheStats.physicalResourceCount = 0;
+    this->cacheStats.pooledResourceCount = 0;
+
+    for (const auto &physicalResource : this->physicalResources) {
+        if (!physicalResource.IsAllocated())
+            continue;
+
+        ++this->cacheStats.physicalResourceCount;
+        if (physicalResource.refCount == 0)
+            ++this->cacheStats.pooledResourceCount;
+    }
+}
+
+void FrameGraph::ReleaseCompiledGraphs() {
+    for (auto &compiledGraph : this->compiledGraphs)
+        this->ReleaseCompiledGraph(compiledGraph);
+
+    this->compiledGraphs.clear();
+
+    this->isCompiled = false;
+
+    // Views of transient resources are borrowed from the physical resources
+    for (auto &resource : this->resources) {
+        if (resource.wasImported)
+            continue;
+
+        resource.unorderedAccessView = nullptr;
+        resource.shaderResourceView  = nullptr;
+        resource.renderTargetView    = nullptr;
+        resource.depthStencilView    = nullptr;
+        resource.texture             = nullptr;
+        resource.buffer              = nullptr;
+        resource.physicalResource    = INVALID_HANDLE;
+    }
+}
+
+void FrameGraph::ReleaseTemporaryResources() {
+    this->ReleaseCompiledGraphs();
+
+    for (auto &physicalResource : this->physicalResources)
+        physicalResource.Release();
+
+    this->physicalResources.clear();
+    this->UpdatePoolStats();
+}
+
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+static uint64_t HashValue(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        hash ^= (value >> (i * 8)) & 0xFF;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static uint64_t HashFloat(uint64_t hash, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return HashValue(hash, bits);
+}
+
+uint64_t FrameGraph::ComputeStructureHash() const {
+    uint64_t hash = 14695981039346656037ull;
+
+    hash = HashValue(hash, this->backbufferWidth);
+    hash = HashValue(hash, this->backbufferHeight);
+    hash = HashValue(hash, this->enableAliasing);
+
+    hash = HashValue(hash, this->resources.size());
+    for (const auto &resource : this->resources) {
+        hash = HashValue(hash, resource.wasImported);
+        if (resource.wasImported)
+            continue;
+
+        hash = HashValue(hash, static_cast<uint64_t>(resource.type));
+        if (resource.type == Resource_type::buffer) {
+            hash = HashValue(hash, resource.bufferDesc.elementSize);
+            hash = HashValue(hash, resource.bufferDesc.elementCount);
+            hash = HashValue(hash, resource.bufferDesc.bindFlags);
+            hash = HashValue(hash, resource.bufferDesc.miscFlags);
+            continue;
+        }
+
+        hash = HashValue(hash, static_cast<uint64_t>(resource.desc.sizeMode));
+        hash = HashFloat(hash, resource.desc.width);
+        hash = HashFloat(hash, resource.desc.height);
+        hash = HashValue(hash, resource.desc.mipLevels);
+        hash = HashValue(hash, resource.desc.format);
+        hash = HashValue(hash, resource.desc.bindFlags);
+    }
+
+    hash = HashValue(hash, this->renderPasses.size());
+    for (const auto &pass : this->renderPasses) {
+        hash = HashValue(hash, pass->writesBackbuffer);
+
+        hash = HashValue(hash, pass->reads.size());
+        for (ResourceHandle resourceHandle : pass->reads)
+            hash = HashValue(hash, resourceHandle);
+
+        hash = HashValue(hash, pass->writes.size());
+        for (ResourceHandle resourceHandle : pass->writes)
+            hash = HashValue(hash, resourceHandle);
+    }
+
+    return hash;
+}
+
+void FrameGraph::ApplyCompiledGraph(const Compiled_graph &compiledGraph) {
+    this->sortedPassHandles = compiledGraph.sortedPassHandles;
+
+    for (PassHandle passHandle = 0; passHandle < this->renderPasses.size(); ++passHandle) {
+        this->renderPasses[passHandle]->isCulled = compiledGraph.culledPasses[passHandle];
+        this->renderPasses[passHandle]->level    = compiledGraph.passLevels[passHandle];
+    }
+
+    this->levelCount = compiledGraph.levelCount;
+
+    for (ResourceHandle handle = 0; handle < this->resources.size(); ++handle) {
+        Resource &resource = this->resources[handle];
+        if (resource.wasImported)
+            continue;
+
+        const uint32_t index = compiledGraph.resourcePlacements[handle];
+        resource.physicalResource = index;
+
+        if (index == INVALID_HANDLE) {
+            resource.texture             = nullptr;
+            resource.buffer              = nullptr;
+            resource.shaderResourceView  = nullptr;
+            resource.renderTargetView    = nullptr;
+            resource.depthStencilView    = nullptr;
+            resource.unorderedAccessView = nullptr;
+            continue;
+        }
+
+        const Physical_resource &physicalResource = this->physicalResources[index];
+        resource.texture             = physicalResource.texture;
+        resource.buffer              = physicalResource.buffer;
+        resource.shaderResourceView  = physicalResource.shaderResourceView;
+        resource.renderTargetView    = physicalResource.renderTargetView;
+        resource.depthStencilView    = physicalResource.depthStencilView;
+        resource.unorderedAccessView = physicalResource.unorderedAccessView;
+    }
+
+    this->memoryStats = compiledGraph.memoryStats;
+}
+
+FrameGraph::TextureHandle FrameGraph::CreateTexture(const std::string &name, FrameGraph::Texture_desc desc) {
+    TextureHandle handle = this->resources.size();
+
+    Resource resource{};
+    resource.name = name;
+    resource.desc = desc;
+    resource.wasImported = false;
+
+    this->resources.push_back(resource);
+
+    return handle;
+}
+
+FrameGraph::BufferHandle FrameGraph::CreateBuffer(const std::string &name, FrameGraph::Buffer_desc desc) {
+    BufferHandle handle = this->resources.size();
+
+    Resource resource{};
+    resource.name = name;
+    resource.type = Resource_type::buffer;
+    resource.bufferDesc = desc;
+    resource.wasImported = false;
+
+    this->resources.push_back(resource);
+
+    return handle;
+}
+
+FrameGraph::TextureHandle FrameGraph::ImportTexture(
+    const std::string &name,
+    ID3D11Texture2D *texture,
+    ID3D11RenderTargetView *renderTargetView,
+    ID3D11ShaderResourceView *shaderResourceView,
+    ID3D11DepthStencilView *depthStencilView,
+    ID3D11UnorderedAccessView *unorderedAccessView
+) {
+    TextureHandle handle = this->resources.size();
+
+    Resource resource{};
+    resource.name = name;
+    resource.wasImported = true;
+    resource.texture = texture;
+    resource.renderTargetView = renderTargetView;
+    resource.shaderResourceView = shaderResourceView;
+    resource.depthStencilView = depthStencilView;
+    resource.unorderedAccessView = unorderedAccessView;
+
+    this->resources.push_back(resource);
+
+    return handle;
+}
+
+void FrameGraph::UpdateImportedTexture(
+    TextureHandle handle,
+    ID3D11Texture2D *texture,
+    ID3D11RenderTargetView *renderTargetView,
+    ID3D11ShaderResourceView *shaderResourceView,
+    ID3D11DepthStencilView *depthStencilView,
+    ID3D11UnorderedAccessView *unorderedAccessView
+) {
+    if (handle == INVALID_HANDLE || handle >= this->resources.size()) {
+        LogWarn("Invalid handle\n");
+        return;
+    }
+
+    Resource &resource = this->resources[handle];
+    if (!resource.wasImported || resource.type != Resource_type::texture) {
+        LogWarn("Tried to update non-imported texture resource '%s'\n", resource.name.c_str());
+        return;
+    }
+
+    resource.texture = texture;
+    resource.renderTargetView = renderTargetView;
+    resource.shaderResourceView = shaderResourceView;
+    resource.depthStencilView = depthStencilView;
+    resource.unorderedAccessView = unorderedAccessView;
+}
+
+FrameGraph::BufferHandle FrameGraph::ImportBuffer(
+    const std::string &name,
+    ID3D11Buffer *buffer,
+    ID3D11ShaderResourceView *shaderResourceView,
+    ID3D11UnorderedAccessView *unorderedAccessView
+) {
+    BufferHandle handle = this->resources.size();
+
+    Resource resource{};
+    resource.name = name;
+    resource.type = Resource_type::buffer;
+    resource.wasImported = true;
+    resource.buffer = buffer;
+    resource.shaderResourceView = shaderResourceView;
+    resource.unorderedAccessView = unorderedAccessView;
+
+    this->resources.push_back(resource);
+
+    return handle;
+}
+
+void FrameGraph::UpdateImportedBuffer(
+    BufferHandle handle,
+    ID3D11Buffer *buffer,
+    ID3D11ShaderResourceView *shaderResourceView,
+    ID3D11UnorderedAccessView *unorderedAccessView
+) {
+    if (handle == INVALID_HANDLE || handle >= this->resources.size()) {
+        LogWarn("Invalid handle\n");
+        return;
+    }
+
+    Resource &resource = this->resources[handle];
+    if (!resource.wasImported || resource.type != Resource_type::buffer) {
+        LogWarn("Tried to update non-imported buffer resource '%s'\n", resource.name.c_str());
+        return;
+    }
+
+    resource.buffer = buffer;
+    resource.shaderResourceView = shaderResourceView;
+    resource.unorderedAccessView = unorderedAccessView;
+}
+
+bool FrameGraph::Compile(int backbufferWidth, int backbufferHeight) {
+    this->isCompiled = false;
+
+    this->backbufferWidth  = backbufferWidth;
+    this->backbufferHeight = backbufferHeight;
+
+    const uint64_t hash = this->ComputeStructureHash();
+
+    // Already reported, a per-frame rebuild would otherwise log the same error every frame
+    if (this->hasFailedHash && this->failedHash == hash)
+        return false;
+
+    for (auto &compiledGraph : this->compiledGraphs) {
+        if (compiledGraph.hash != hash)
+            continue;
+
+        compiledGraph.lastUsed = ++this->compileCounter;
+        this->ApplyCompiledGraph(compiledGraph);
+
+        ++this->cacheStats.hitCount;
+        this->isCompiled = true;
+        return true;
+    }
+
+    ++this->cacheStats.missCount;
+
+    LogInfo("Compiling frame graph... (%dx%d)\n", backbufferWidth, backbufferHeight);
+    LogIndent();
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    const bool isSorted = this->CompilePasses();
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+    this->compileMilliseconds = elapsed.count();
+
+    // The sort already logged the cycle and left the sorted passes partial, neither cache nor execute them
+    if (!isSorted) {
+        this->hasFailedHash = true;
+        this->failedHash = hash;
+
+        LogUnindent();
+        return false;
+    }
+
+    this->hasFailedHash = false;
+
+    // Evict the least recently used graph, its resources are only released if no other graph uses them
+    if (this->compiledGraphs.size() >= MAX_CACHED_GRAPHS) {
+        auto oldest = std::min_element(this->compiledGraphs.begin(), this->compiledGraphs.end(), [](const Compiled_graph &a, const Compiled_graph &b) {
+            return a.lastUsed < b.lastUsed;
+        });
+
+        this->ReleaseCompiledGraph(*oldest);
+        this->compiledGraphs.erase(oldest);
+    }
+
+    this->compiledGraphs.emplace_back();
+    Compiled_graph &compiledGraph = this->compiledGraphs.back();
+    compiledGraph.hash              = hash;
+    compiledGraph.lastUsed          = ++this->compileCounter;
+    compiledGraph.sortedPassHandles = this->sortedPassHandles;
+
+    compiledGraph.levelCount        = this->levelCount;
+
+    compiledGraph.culledPasses.resize(this->renderPasses.size());
+    compiledGraph.passLevels.resize(this->renderPasses.size());
+    for (PassHandle passHandle = 0; passHandle < this->renderPasses.size(); ++passHandle) {
+        compiledGraph.culledPasses[passHandle] = this->renderPasses[passHandle]->isCulled;
+        compiledGraph.passLevels[passHandle]   = this->renderPasses[passHandle]->level;
+    }
+
+    this->CreateTemporaryResources(compiledGraph);
+    this->ApplyCompiledGraph(compiledGraph);
+
+    this->cacheStats.cachedGraphCount = static_cast<int>(this->compiledGraphs.size());
+    this->EvictPooledResources();
+
+    this->isCompiled = true;
+
+    LogUnindent();
+    this->LogGraph();
+    return true;
+}
+
+bool FrameGraph::OnResize(int width, int height) {
+    LogInfo("Resizing frame graph\n");
+
+    // Every cached graph depends on the old size, but their resources stay pooled so the ones that
+    // don't scale with the backbuffer are picked up again by the new graph
+    this->ReleaseCompiledGraphs();
+    return this->Compile(width, height);
+}
+
+void FrameGraph::Execute(StateCache &stateCache, std::vector<Render_view> &views) {
+    if (!this->isCompiled) {
+        LogWarn("Tried to execute uncompiled frame graph!\n");
+        return;
+    }
+
+    ++this->frameIndex;
+    this->EvictPooledResources();
+
+    ExecutionContext context(stateCache, views, *this);
+    ID3D11DeviceContext *deviceContext = stateCache.GetDeviceContext();
+
+    this->profiler.BeginFrame(deviceContext);
+
+    for (PassHandle passHandle : this->sortedPassHandles) {
+        Render_pass_base &pass = *this->renderPasses[passHandle];
+
+        this->profiler.BeginPass(pass.name);
+
+        this->UnbindHazards(pass, stateCache);
+        pass.Execute(context);
+
+        this->profiler.EndPass(deviceContext);
+    }
+
+    this->profiler.EndFrame(deviceContext);
+}
+
+ID3D11Resource *FrameGraph::GetNativeResource(ResourceHandle handle) const {
+    if (handle >= this->resources.size())
+        return nullptr;
+
+    const Resource &resource = this->resources[handle];
+    if (resource.type == Resource_type::buffer)
+        return resource.buffer;
+
+    return resource.texture;
+}
+
+// Passes leave their views bound when they finish. Before a pass runs, the resources it reads are removed from the
+// output bindings and the ones it writes from the shader resource bindings, as D3D11 refuses to bind a view while its
+// resource is bound the other way, or silently drops the older binding.
+void FrameGraph::UnbindHazards(const Render_pass_base &pass, StateCache &stateCache) const {
+    for (ResourceHandle resourceHandle : pass.reads)
+        stateCache.UnbindOutputs(this->GetNativeResource(resourceHandle));
+
+    for (ResourceHandle resourceHandle : pass.writes)
+        stateCache.UnbindShaderResources(this->GetNativeResource(resourceHandle));
+}
+
+void FrameGraph::Reset() {
+    this->renderPasses.clear();
+    this->resources.clear();
+    this->sortedPassHandles.clear();
+
+    this->isCompiled = false;
+}
+
+void FrameGraph::Clear() {
+    this->ReleaseTemporaryResources();
+    this->Reset();
+}
+
+void FrameGraph::RunCompileBenchmark() {
+    struct Benchmark_pass_data {
+        TextureHandle output = INVALID_HANDLE;
+    };
+
+    const int passCounts[] = { 10, 100, 1000, 5000 };
+
+    LogInfo("Frame graph compile benchmark:\n");
+    LogIndent();
+
+    for (int passCount : passCounts) {
+        FrameGraph frameGraph;
+
+        Texture_desc desc{};
+        std::vector<TextureHandle> outputs;
+
+        // Every tenth pass writes an output nobody reads and gets culled. The others read the latest live output
+        // and one from further back, the last pass writes the backbuffer.
+        auto isDead = [&](int i) { return i % 10 == 9 && i != passCount - 1; };
+
+        for (int i = 0; i < passCount; ++i) {
+            outputs.push_back(frameGraph.CreateTexture("Benchmark_" + std::to_string(i), desc));
+
+            frameGraph.AddRenderPass<Benchmark_pass_data>(
+                "Benchmark_pass_" + std::to_string(i),
+                [&](Benchmark_pass_data &data, RenderPassBuilder &builder) {
+                    const int previous = (i > 0 && isDead(i - 1)) ? i - 2 : i - 1;
+                    if (previous >= 0 && !isDead(i))
+                        builder.Read(outputs[previous]);
+
+                    if (i > 1 && !isDead(i / 2) && !isDead(i))
+                        builder.Read(outputs[i / 2]);
+
+                    data.output = builder.Write(outputs[i]);
+
+                    if (i == passCount - 1)
+                        builder.WritesBackbuffer();
+                },
+                [](const Benchmark_pass_data &data, ExecutionContext &context) {
+                }
+            );
+        }
+
+        const int iterationCount = std::max(10000 / passCount, 10);
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterationCount; ++i)
+            frameGraph.CompilePasses();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+        LogInfo(
+            "%d passes: %.4f ms per compile (%zu live)\n",
+            passCount,
+            elapsed.count() / iterationCount,
+            frameGraph.sortedPassHandles.size()
+        );
+    }
+
+    // Roughly the shape of the renderer's graph. Textures are imported so no device is needed, which leaves out
+    // nothing a cache hit does.
+    {
+        FrameGraph frameGraph;
+
+        auto buildGraph = [&frameGraph]() {
+            frameGraph.Reset();
+
+            TextureHandle textures[8];
+            for (int i = 0; i < 8; ++i)
+                textures[i] = frameGraph.ImportTexture("Benchmark", nullptr, nullptr);
+
+            const int passReads[8][3] = {
+                { -1, -1, -1 }, { -1, -1, -1 }, { 0, -1, -1 }, { 1, 2, -1 },
+                { 3, 1, -1 },   { 4, 3, -1 },   { 5, 3, 4 },   { 6, 5, -1 }
+            };
+
+            for (int i = 0; i < 8; ++i) {
+                frameGraph.AddRenderPass<Benchmark_pass_data>(
+                    "Benchmark_pass",
+                    [&](Benchmark_pass_data &data, RenderPassBuilder &builder) {
+                        for (int read : passReads[i])
+                            if (read >= 0)
+                                builder.Read(textures[read]);
+
+                        data.output = builder.Write(textures[i]);
+
+                        if (i == 7)
+                            builder.WritesBackbuffer();
+                    },
+                    [](const Benchmark_pass_data &data, ExecutionContext &context) {
+                    }
+                );
+            }
+
+            frameGraph.Compile(1920, 1080);
+        };
+
+        // Warm up the cache and the allocations
+        buildGraph();
+
+        const int iterationCount = 10000;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterationCount; ++i)
+            buildGraph();
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+        const double microseconds = elapsed.count() / iterationCount;
+        if (microseconds <= REBUILD_BUDGET_MICROSECONDS)
+            LogInfo("Rebuild with cache hit: %.3f us per frame (budget %.1f us)\n", microseconds, REBUILD_BUDGET_MICROSECONDS);
+        else
+            LogWarn("Rebuild with cache hit: %.3f us per frame, over the budget of %.1f us\n", microseconds, REBUILD_BUDGET_MICROSECONDS);
+    }
+
+    LogUnindent();
+}
+
+void FrameGraph::RunResizeTest(ID3D11Device *device) {
+    struct Test_pass_data {
+        TextureHandle output = INVALID_HANDLE;
+    };
+
+    const int width = 1280;
+    const int height = 720;
+
+    std::vector<std::pair<int, int>> sizes;
+    for (int i = 1; i <= RESIZE_TEST_STEPS; ++i)
+        sizes.emplace_back(width + i * 16, height + i * 9);
+    for (int i = RESIZE_TEST_STEPS - 1; i >= 0; --i)
+        sizes.emplace_back(width + i * 16, height + i * 9);
+
+    LogInfo("Frame graph resize test:\n");
+    LogIndent();
+
+    // Shaped like the renderer's graph: backbuffer sized G-buffers and lighting output, a fixed size shadow map
+    // that the pool keeps across resizes, and a pass that writes the backbuffer
+    FrameGraph frameGraph;
+    frameGraph.SetDevice(device);
+
+    Texture_desc relativeDesc{};
+    relativeDesc.width  = 1.0f;
+    relativeDesc.height = 1.0f;
+
+    Texture_desc shadowDesc{};
+    shadowDesc.sizeMode = Texture_desc::Size_mode::absolute;
+    shadowDesc.width    = 1024.0f;
+    shadowDesc.height   = 1024.0f;
+    shadowDesc.format   = DXGI_FORMAT_R32_FLOAT;
+
+    const TextureHandle shadowMap      = frameGraph.CreateTexture("Test_shadow_map", shadowDesc);
+    const TextureHandle albedo         = frameGraph.CreateTexture("Test_albedo", relativeDesc);
+    const TextureHandle normal         = frameGraph.CreateTexture("Test_normal", relativeDesc);
+    const TextureHandle lightingOutput = frameGraph.CreateTexture("Test_lighting_output", relativeDesc);
+    const TextureHandle backbuffer     = frameGraph.ImportTexture("Test_backbuffer", nullptr, nullptr);
+
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Shadows",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            data.output = builder.Write(shadowMap);
+        },
+        [](const Test_pass_data &data, ExecutionContext &context) {
+        }
+    );
+
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Geometry",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            data.output = builder.Write(albedo);
+            builder.Write(normal);
+        },
+        [](const Test_pass_data &data, ExecutionContext &context) {
+        }
+    );
+
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Lighting",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            builder.Read(shadowMap);
+            builder.Read(albedo);
+            builder.Read(normal);
+            data.output = builder.Write(lightingOutput);
+        },
+        [](const Test_pass_data &data, ExecutionContext &context) {
+        }
+    );
+
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Resolve",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            builder.Read(lightingOutput);
+            data.output = builder.Write(backbuffer);
+            builder.WritesBackbuffer();
+        },
+        [](const Test_pass_data &data, ExecutionContext &context) {
+        }
+    );
+
+    if (!frameGraph.Compile(width, height)) {
+        LogWarn("Failed to compile the test graph\n");
+        LogUnindent();
+        return;
+    }
+
+    int createdCounts[2] = {};
+    for (int &createdCount : createdCounts) {
+        const int createdBefore = frameGraph.cacheStats.createdCount;
+
+        for (const auto &size : sizes)
+            frameGraph.OnResize(size.first, size.second);
+
+        createdCount = frameGraph.cacheStats.createdCount - createdBefore;
+    }
+
+    LogInfo("First drag created %d resources over %zu resizes\n", createdCounts[0], sizes.size());
+    if (createdCounts[1] == 0)
+        LogInfo("Repeated drag created no resources (%d pooled)\n", frameGraph.cacheStats.pooledResourceCount);
+    else
+        LogWarn("Repeated drag created %d resources, the pool should have served all of them\n", createdCounts[1]);
+
+    frameGraph.Clear();
+    frameGraph.SetDevice(nullptr);
+
+    LogUnindent();
+}
+
+void FrameGraph::RunScheduleTest() {
+    struct Test_pass_data {
+        TextureHandle output = INVALID_HANDLE;
+    };
+
+    // Returns the number of problems in the schedule of a compiled graph
+    auto checkSchedule = [](const FrameGraph &frameGraph) {
+        const Compile_scratch &scratch = frameGraph.scratch;
+        const std::vector<PassHandle> &sorted = frameGraph.sortedPassHandles;
+
+        std::vector<int> positions(frameGraph.renderPasses.size(), -1);
+        for (size_t i = 0; i < sorted.size(); ++i)
+            positions[sorted[i]] = static_cast<int>(i);
+
+        // A pass on a level above 0 needs a producer on the level right below, or it could have gone lower
+        std::vector<bool> hasProducerBelow(frameGraph.renderPasses.size(), false);
+
+        int errorCount = 0;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            const uint32_t level = frameGraph.renderPasses[sorted[i]]->level;
+
+            if (i > 0 && frameGraph.renderPasses[sorted[i - 1]]->level > level)
+                ++errorCount;
+
+            for (uint32_t j = scratch.successorOffsets[sorted[i]]; j < scratch.successorOffsets[sorted[i] + 1]; ++j) {
+                const PassHandle successor = scratch.successors[j];
+                const uint32_t successorLevel = frameGraph.renderPasses[successor]->level;
+
+                if (successorLevel <= level || positions[successor] <= static_cast<int>(i))
+                    ++errorCount;
+
+                if (successorLevel == level + 1)
+                    hasProducerBelow[successor] = true;
+            }
+        }
+
+        for (PassHandle passHandle : sorted)
+            if (frameGraph.renderPasses[passHandle]->level > 0 && !hasProducerBelow[passHandle])
+                ++errorCount;
+
+        return errorCount;
+    };
+
+    LogInfo("Frame graph schedule test:\n");
+    LogIndent();
+
+    // The renderer's passes, the first three only depend on data from earlier frames
+    {
+        FrameGraph frameGraph;
+
+        const char *names[] = { "Reflections", "Shadows", "Culling", "Geometry", "Lighting", "Particles", "Resolve" };
+        const int passReads[7][3] = {
+            { -1, -1, -1 }, { -1, -1, -1 }, { -1, -1, -1 }, { 2, -1, -1 },
+            { 3, 1, 0 },    { 3, 4, -1 },   { 4, 3, -1 }
+        };
+        const int passWrites[7] = { 0, 1, 2, 3, 4, 4, 5 };
+        const uint32_t expectedLevels[7] = { 0, 0, 0, 1, 2, 3, 4 };
+
+        Texture_desc desc{};
+        TextureHandle textures[6];
+        for (int i = 0; i < 6; ++i)
+            textures[i] = frameGraph.CreateTexture("Test_" + std::to_string(i), desc);
+
+        for (int i = 0; i < 7; ++i) {
+            frameGraph.AddRenderPass<Test_pass_data>(
+                names[i],
+                [&](Test_pass_data &data, RenderPassBuilder &builder) {
+                    for (int read : passReads[i])
+                        if (read >= 0)
+                            builder.Read(textures[read]);
+
+                    data.output = builder.Write(textures[passWrites[i]]);
+
+                    if (i == 6)
+                        builder.WritesBackbuffer();
+                },
+                [](const Test_pass_data &data, ExecutionContext &context) {
+                }
+            );
+        }
+
+        frameGraph.CompilePasses();
+
+        int errorCount = checkSchedule(frameGraph);
+        for (int i = 0; i < 7; ++i)
+            if (frameGraph.renderPasses[i]->level != expectedLevels[i])
+                ++errorCount;
+
+        std::string order;
+        for (PassHandle passHandle : frameGraph.sortedPassHandles)
+            order += (order.empty() ? "" : ", ") + frameGraph.renderPasses[passHandle]->name;
+
+        if (errorCount == 0)
+            LogInfo("Renderer graph: %u levels, %s\n", frameGraph.levelCount, order.c_str());
+        else
+            LogWarn("Renderer graph: %d problems, %s\n", errorCount, order.c_str());
+    }
+
+    // Random DAGs, each pass reads up to three earlier outputs and the last one reads eight more to keep most alive
+    const int passCounts[] = { 10, 100, 1000 };
+    const int graphsPerCount = 20;
+
+    TestRandom random(12345);
+
+    for (int passCount : passCounts) {
+        int errorCount = 0;
+        int liveCount = 0;
+        uint32_t levelCount = 0;
+
+        for (int graph = 0; graph < graphsPerCount; ++graph) {
+            FrameGraph frameGraph;
+
+            Texture_desc desc{};
+            std::vector<TextureHandle> outputs;
+
+            for (int i = 0; i < passCount; ++i) {
+                outputs.push_back(frameGraph.CreateTexture("Test_" + std::to_string(i), desc));
+
+                frameGraph.AddRenderPass<Test_pass_data>(
+                    "Test_pass_" + std::to_string(i),
+                    [&](Test_pass_data &data, RenderPassBuilder &builder) {
+                        const int readCount = i == 0 ? 0 : (i == passCount - 1 ? 8 : random.NextUint(4));
+                        for (int j = 0; j < readCount; ++j)
+                            builder.Read(outputs[random.NextUint(i)]);
+
+                        data.output = builder.Write(outputs[i]);
+
+                        if (i == passCount - 1)
+                            builder.WritesBackbuffer();
+                    },
+                    [](const Test_pass_data &data, ExecutionContext &context) {
+                    }
+                );
+            }
+
+            frameGraph.CompilePasses();
+
+            errorCount += checkSchedule(frameGraph);
+            liveCount  += static_cast<int>(frameGraph.sortedPassHandles.size());
+            levelCount += frameGraph.levelCount;
+        }
+
+        if (errorCount == 0)
+            LogInfo(
+                "%d graphs of %d passes: %.1f live passes in %.1f levels on average\n",
+                graphsPerCount,
+                passCount,
+                liveCount / static_cast<float>(graphsPerCount),
+                levelCount / static_cast<float>(graphsPerCount)
+            );
+        else
+            LogWarn("%d graphs of %d passes: %d problems\n", graphsPerCount, passCount, errorCount);
+    }
+
+    // Two passes reading each other's output, compiling has to fail without caching the partial schedule
+    {
+        FrameGraph frameGraph;
+
+        Texture_desc desc{};
+        TextureHandle textures[2] = {
+            frameGraph.CreateTexture("Test_0", desc),
+            frameGraph.CreateTexture("Test_1", desc)
+        };
+
+        for (int i = 0; i < 2; ++i) {
+            frameGraph.AddRenderPass<Test_pass_data>(
+                "Test_pass_" + std::to_string(i),
+                [&](Test_pass_data &data, RenderPassBuilder &builder) {
+                    builder.Read(textures[1 - i]);
+                    data.output = builder.Write(textures[i]);
+
+                    if (i == 1)
+                        builder.WritesBackbuffer();
+                },
+                [](const Test_pass_data &data, ExecutionContext &context) {
+                }
+            );
+        }
+
+        const bool isFirstCompiled = frameGraph.Compile(1920, 1080);
+        const bool isSecondCompiled = frameGraph.Compile(1920, 1080);
+
+        if (!isFirstCompiled && !isSecondCompiled && !frameGraph.IsCompiled() && frameGraph.compiledGraphs.empty() && frameGraph.cacheStats.missCount == 1)
+            LogInfo("Cyclic graph: not compiled, not cached, compiled once\n");
+        else
+            LogWarn("Cyclic graph: compiled %d, cached %d graphs, compiled %d times\n", frameGraph.IsCompiled(), static_cast<int>(frameGraph.compiledGraphs.size()), frameGraph.cacheStats.missCount);
+    }
+
+    LogUnindent();
+}
+
+void FrameGraph::RunHazardTest() {
+    struct Test_pass_data {
+        ResourceHandle output = INVALID_HANDLE;
+    };
+
+    using Call_type = RecordingStateSink::Call_type;
+
+    LogInfo("Frame graph hazard test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    // Made up resources and views, only their addresses are used
+    static char objects[64];
+    auto fake = [](int index) { return static_cast<void *>(&objects[index]); };
+
+    enum Test_resource { albedo, depth, shadowMap, clusters, lightingOutput, backbuffer, resourceCount };
+
+    ID3D11Resource *nativeResources[resourceCount];
+    ID3D11ShaderResourceView *shaderResourceViews[resourceCount];
+    for (int i = 0; i < resourceCount; ++i) {
+        nativeResources[i] = static_cast<ID3D11Resource *>(fake(i));
+        shaderResourceViews[i] = static_cast<ID3D11ShaderResourceView *>(fake(16 + i));
+    }
+
+    ID3D11RenderTargetView *albedoTarget = static_cast<ID3D11RenderTargetView *>(fake(32));
+    ID3D11RenderTargetView *backbufferTarget = static_cast<ID3D11RenderTargetView *>(fake(33));
+    ID3D11DepthStencilView *depthView = static_cast<ID3D11DepthStencilView *>(fake(34));
+    ID3D11DepthStencilView *shadowMapView = static_cast<ID3D11DepthStencilView *>(fake(35));
+    ID3D11UnorderedAccessView *clustersView = static_cast<ID3D11UnorderedAccessView *>(fake(36));
+    ID3D11UnorderedAccessView *lightingOutputView = static_cast<ID3D11UnorderedAccessView *>(fake(37));
+
+    RecordingStateSink sink;
+    for (int i = 0; i < resourceCount; ++i)
+        sink.SetViewResource(shaderResourceViews[i], nativeResources[i]);
+    sink.SetViewResource(albedoTarget, nativeResources[albedo]);
+    sink.SetViewResource(backbufferTarget, nativeResources[backbuffer]);
+    sink.SetViewResource(depthView, nativeResources[depth]);
+    sink.SetViewResource(shadowMapView, nativeResources[shadowMap]);
+    sink.SetViewResource(clustersView, nativeResources[clusters]);
+    sink.SetViewResource(lightingOutputView, nativeResources[lightingOutput]);
+
+    StateCache stateCache;
+    stateCache.SetSink(&sink);
+
+    FrameGraph frameGraph;
+
+    auto texture = [&](int resource) { return static_cast<ID3D11Texture2D *>(static_cast<void *>(nativeResources[resource])); };
+    auto buffer = [&](int resource) { return static_cast<ID3D11Buffer *>(static_cast<void *>(nativeResources[resource])); };
+
+    ResourceHandle handles[resourceCount];
+    handles[albedo]         = frameGraph.ImportTexture("Albedo", texture(albedo), albedoTarget, shaderResourceViews[albedo]);
+    handles[depth]          = frameGraph.ImportTexture("Depth", texture(depth), nullptr, shaderResourceViews[depth], depthView);
+    handles[shadowMap]      = frameGraph.ImportTexture("Shadow_map", texture(shadowMap), nullptr, shaderResourceViews[shadowMap], shadowMapView);
+    handles[clusters]       = frameGraph.ImportBuffer("Clusters", buffer(clusters), shaderResourceViews[clusters], clustersView);
+    handles[lightingOutput] = frameGraph.ImportTexture("Lighting_output", texture(lightingOutput), nullptr, shaderResourceViews[lightingOutput], nullptr, lightingOutputView);
+    handles[backbuffer]     = frameGraph.ImportTexture("Backbuffer", texture(backbuffer), backbufferTarget);
+
+    // Like the renderer's passes, each one binds what it uses and leaves it bound
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Shadows",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            data.output = builder.Write(handles[shadowMap]);
+        },
+        [](const Test_pass_data &data, ExecutionContext &context) {
+            context.GetStateCache().SetRenderTargets(0, nullptr, context.GetDepthStencilView(data.output));
+        }
+    );
+
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Clusters",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            data.output = builder.Write(handles[clusters]);
+        },
+        [](const Test_pass_data &data, ExecutionContext &context) {
+            ID3D11UnorderedAccessView *view = context.GetUnorderedAccessView(data.output);
+            context.GetStateCache().SetUnorderedAccessViews(0, 1, &view);
+        }
+    );
+
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Geometry",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            data.output = builder.Write(handles[albedo]);
+            builder.Write(handles[depth]);
+        },
+        [&](const Test_pass_data &data, ExecutionContext &context) {
+            ID3D11RenderTargetView *view = context.GetRenderTargetView(data.output);
+            context.GetStateCache().SetRenderTargets(1, &view, context.GetDepthStencilView(handles[depth]));
+        }
+    );
+
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Lighting",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            builder.Read(handles[albedo]);
+            builder.Read(handles[depth]);
+            builder.Read(handles[shadowMap]);
+            builder.Read(handles[clusters]);
+            data.output = builder.Write(handles[lightingOutput]);
+        },
+        [&](const Test_pass_data &data, ExecutionContext &context) {
+            ID3D11ShaderResourceView *views[4] = {
+                context.GetShaderResourceView(handles[albedo]),
+                context.GetShaderResourceView(handles[depth]),
+                context.GetShaderResourceView(handles[shadowMap]),
+                context.GetShaderResourceView(handles[clusters])
+            };
+            context.GetStateCache().SetShaderResources(Shader_stage::compute, 0, 4, views);
+
+            ID3D11UnorderedAccessView *view = context.GetUnorderedAccessView(data.output);
+            context.GetStateCache().SetUnorderedAccessViews(0, 1, &view);
+        }
+    );
+
+    frameGraph.AddRenderPass<Test_pass_data>(
+        "Resolve",
+        [&](Test_pass_data &data, RenderPassBuilder &builder) {
+            builder.Read(handles[lightingOutput]);
+            data.output = builder.Write(handles[backbuffer]);
+            builder.WritesBackbuffer();
+        },
+        [&](const Test_pass_data &data, ExecutionContext &context) {
+            ID3D11ShaderResourceView *view = context.GetShaderResourceView(handles[lightingOutput]);
+            context.GetStateCache().SetShaderResources(Shader_stage::pixel, 0, 1, &view);
+
+            ID3D11RenderTargetView *target = context.GetRenderTargetView(data.output);
+            context.GetStateCache().SetRenderTargets(1, &target, nullptr);
+        }
+    );
+
+    // Replays calls the way the runtime binds them and counts the ones that find their resource bound the other
+    // way, the runtime would refuse the input or silently drop it
+    struct Bindings {
+        const void *shaderResources[+Shader_stage::count][StateCache::MAX_SHADER_RESOURCES] = {};
+        const void *renderTargets[StateCache::MAX_RENDER_TARGETS] = {};
+        const void *depthStencil = nullptr;
+        const void *unorderedAccessViews[StateCache::MAX_UNORDERED_ACCESS_VIEWS] = {};
+    };
+
+    auto replay = [](const RecordingStateSink &recorded, size_t first, Bindings &bindings) {
+        auto resourceOf = [&recorded](const void *view) {
+            return recorded.GetViewResource(static_cast<ID3D11View *>(const_cast<void *>(view)));
+        };
+
+        auto isInput = [&](ID3D11Resource *resource) {
+            for (const auto &stage : bindings.shaderResources)
+                for (const void *view : stage)
+                    if (view && resourceOf(view) == resource)
+                        return true;
+            return false;
+        };
+
+        auto isOutput = [&](ID3D11Resource *resource) {
+            for (const void *view : bindings.renderTargets)
+                if (view && resourceOf(view) == resource)
+                    return true;
+            for (const void *view : bindings.unorderedAccessViews)
+                if (view && resourceOf(view) == resource)
+                    return true;
+            return bindings.depthStencil && resourceOf(bindings.depthStencil) == resource;
+        };
+
+        int conflictCount = 0;
+
+        const std::vector<RecordingStateSink::Call> &calls = recorded.GetCalls();
+        for (size_t i = first; i < calls.size(); ++i) {
+            const RecordingStateSink::Call &call = calls[i];
+
+            if (call.type == Call_type::shaderResources) {
+                for (size_t slot = 0; slot < call.objects.size(); ++slot) {
+                    const void *view = call.objects[slot];
+                    if (view && isOutput(resourceOf(view)))
+                        ++conflictCount;
+
+                    bindings.shaderResources[+call.stage][call.startSlot + slot] = view;
+                }
+            }
+            else if (call.type == Call_type::renderTargets || call.type == Call_type::unorderedAccessViews) {
+                for (const void *view : call.objects)
+                    if (view && isInput(resourceOf(view)))
+                        ++conflictCount;
+
+                if (call.type == Call_type::renderTargets) {
+                    // The depth stencil view comes last
+                    for (size_t slot = 0; slot < StateCache::MAX_RENDER_TARGETS; ++slot)
+                        bindings.renderTargets[slot] = slot + 1 < call.objects.size() ? call.objects[slot] : nullptr;
+                    bindings.depthStencil = call.objects.back();
+                }
+                else {
+                    for (size_t slot = 0; slot < call.objects.size(); ++slot)
+                        bindings.unorderedAccessViews[call.startSlot + slot] = call.objects[slot];
+                }
+            }
+        }
+
+        return conflictCount;
+    };
+
+    {
+        // The replay has to see a conflict when nothing is unbound first
+        RecordingStateSink conflictSink;
+        conflictSink.SetViewResource(albedoTarget, nativeResources[albedo]);
+        conflictSink.SetViewResource(shaderResourceViews[albedo], nativeResources[albedo]);
+
+        conflictSink.SetRenderTargets(1, &albedoTarget, nullptr);
+        conflictSink.SetShaderResources(Shader_stage::pixel, 0, 1, &shaderResourceViews[albedo]);
+
+        Bindings bindings;
+        checks.Check(replay(conflictSink, 0, bindings) == 1, "Binding a render target as a shader resource is a conflict");
+    }
+
+    if (!frameGraph.Compile(1920, 1080)) {
+        LogWarn("Failed to compile the test graph\n");
+        LogUnindent();
+        return;
+    }
+
+    std::vector<Render_view> views;
+    Bindings bindings;
+    int conflictCount = 0;
+    int hazardUnbindCounts[3] = {};
+
+    for (int frame = 0; frame < 3; ++frame) {
+        const size_t firstCall = sink.GetCalls().size();
+        const int unbindsBefore = stateCache.GetStats().hazardUnbindCount;
+
+        frameGraph.Execute(stateCache, views);
+
+        conflictCount += replay(sink, firstCall, bindings);
+        hazardUnbindCounts[frame] = stateCache.GetStats().hazardUnbindCount - unbindsBefore;
+    }
+
+    checks.Check(conflictCount == 0, "No resource is bound as an input and an output at once");
+
+    // Lighting unbinds the render targets and the clusters it reads, Resolve the lighting output. From the second
+    // frame on, the shadow map, clusters, albedo, depth and lighting output are also unbound as inputs of the last
+    // frame before they're written again.
+    checks.Check(hazardUnbindCounts[0] == 3, "The first frame unbinds the outputs that are read");
+    checks.Check(hazardUnbindCounts[1] == 8 && hazardUnbindCounts[2] == 8, "Later frames also unbind the inputs that are written");
+
+    // Every hazard unbind comes before the bind of the pass that needed it
+    const std::vector<RecordingStateSink::Call> &calls = sink.GetCalls();
+    auto findCall = [&calls](size_t first, Call_type type, const void *object) {
+        for (size_t i = first; i < calls.size(); ++i)
+            for (const void *callObject : calls[i].objects)
+                if (calls[i].type == type && callObject == object)
+                    return i;
+        return calls.size();
+    };
+
+    const size_t albedoTargetBind = findCall(0, Call_type::renderTargets, albedoTarget);
+    const size_t albedoInputBind = findCall(albedoTargetBind, Call_type::shaderResources, shaderResourceViews[albedo]);
+    const size_t outputUnbind = findCall(albedoTargetBind + 1, Call_type::renderTargets, nullptr);
+    checks.Check(outputUnbind < albedoInputBind, "The render targets are unbound before Lighting reads them");
+
+    const size_t shadowMapInputBind = findCall(0, Call_type::shaderResources, shaderResourceViews[shadowMap]);
+    const size_t shadowMapTargetBind = findCall(shadowMapInputBind, Call_type::renderTargets, shadowMapView);
+    size_t shadowMapInputUnbind = calls.size();
+    for (size_t i = shadowMapInputBind + 1; i < shadowMapTargetBind; ++i)
+        if (calls[i].type == Call_type::shaderResources && calls[i].stage == Shader_stage::compute && calls[i].startSlot == 2 && calls[i].objects[0] == nullptr)
+            shadowMapInputUnbind = i;
+    checks.Check(shadowMapInputUnbind < shadowMapTargetBind, "The shadow map is unbound as an input before the next frame renders to it");
+
+    LogInfo("%d frames, %d calls, %d hazard unbinds per frame\n", 3, static_cast<int>(calls.size()), hazardUnbindCounts[2]);
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
+
+void FrameGraph::LogGraph() const {
+    int culledCount = 0;
+    for (const auto &pass : this->renderPasses)
+        if (pass->isCulled)
+            ++culledCount;
+
+    LogInfo(
+        "Frame graph: %zu passes (%d culled) in %u levels, %zu resources, compiled in %.3f ms\n", 
+        this->renderPasses.size(), 
+        culledCount, 
+        this->levelCount,
+        this->resources.size(),
+        this->compileMilliseconds
+    );
+
+    LogInfo(
+        "Transient memory: %d resources in %d allocations, %.2f MB allocated (%.2f MB without aliasing, %.2f MB peak)\n",
+        this->memoryStats.transientCount,
+        this->memoryStats.allocationCount,
+        this->memoryStats.allocatedBytes / (1024.0 * 1024.0),
+        this->memoryStats.summedBytes / (1024.0 * 1024.0),
+        this->memoryStats.peakBytes / (1024.0 * 1024.0)
+    );
+}
+
+
+Frame_graph_dump FrameGraph::CreateDump() const {
+    Frame_graph_dump dump;
+
+    dump.passes.resize(this->renderPasses.size());
+    for (PassHandle passHandle = 0; passHandle < this->renderPasses.size(); ++passHandle) {
+        const Render_pass_base &pass = *this->renderPasses[passHandle];
+        Frame_graph_dump::Pass &dumpPass = dump.passes[passHandle];
+
+        dumpPass.name             = pass.name;
+        dumpPass.reads            = pass.reads;
+        dumpPass.writes           = pass.writes;
+        dumpPass.writesBackbuffer = pass.writesBackbuffer;
+        dumpPass.isCulled         = pass.isCulled;
+    }
+
+    dump.resources.resize(this->resources.size());
+    for (ResourceHandle handle = 0; handle < this->resources.size(); ++handle) {
+        const Resource &resource = this->resources[handle];
+        Frame_graph_dump::Resource &dumpResource = dump.resources[handle];
+
+        dumpResource.name        = resource.name;
+        dumpResource.isBuffer    = resource.type == Resource_type::buffer;
+        dumpResource.wasImported = resource.wasImported;
+
+        if (resource.wasImported)
+            continue;
+
+        dumpResource.bytes = this->ResolvePhysicalDesc(resource).CalculateBytes();
+
+        if (resource.physicalResource != INVALID_HANDLE)
+            dumpResource.physicalResource = static_cast<int>(resource.physicalResource);
+    }
+
+    for (size_t i = 0; i < this->sortedPassHandles.size(); ++i) {
+        const PassHandle passHandle = this->sortedPassHandles[i];
+        const Render_pass_base &pass = *this->renderPasses[passHandle];
+        if (pass.isCulled)
+            continue;
+
+        const int order = static_cast<int>(i);
+        dump.passes[passHandle].order = order;
+        dump.passes[passHandle].level = static_cast<int>(pass.level);
+
+        for (const std::vector<ResourceHandle> *handles : { &pass.reads, &pass.writes }) {
+            for (ResourceHandle handle : *handles) {
+                Frame_graph_dump::Resource &dumpResource = dump.resources[handle];
+                if (dumpResource.firstUse < 0)
+                    dumpResource.firstUse = order;
+
+                dumpResource.lastUse = std::max(dumpResource.lastUse, order);
+            }
+        }
+    }
+
+    dump.summedBytes    = this->memoryStats.summedBytes;
+    dump.allocatedBytes = this->memoryStats.allocatedBytes;
+    dump.peakBytes      = this->memoryStats.peakBytes;
+
+    return dump;
+}
+
+bool FrameGraph::DumpGraph(const std::string &basePath) const {
+    if (!this->isCompiled) {
+        LogWarn("Frame graph must be compiled before it can be dumped\n");
+        return false;
+    }
+
+    const Frame_graph_dump dump = this->CreateDump();
+
+    if (!WriteFrameGraphJson(dump, basePath + ".json"))
+        return false;
+
+    if (!WriteFrameGraphDot(dump, basePath + ".dot"))
+        return false;
+
+    LogInfo("Wrote frame graph to '%s.json' and '%s.dot'\n", basePath.c_str(), basePath.c_str());
+
+    const Frame_graph_report report = ValidateFrameGraph(dump);
+    LogFrameGraphReport(dump, report);
+
+    return report.errors.empty();
+}
\ No newline at end of file
@@ -3,17 +3,20 @@
 
 #include "rendering/render_queue.hpp"
 #include "rendering/render_view.hpp"
+#include "rendering/state_cache.hpp"
+#include "rendering/pass_profiler.hpp"
+#include "rendering/frame_graph_dump.hpp"
 
 #include <d3d11.h>
 #include <cstdint>
 #include <vector>
 #include <functional>
 #include <memory>
-#include <unordered_set>
 
 class FrameGraph {
 public:
-    typedef uint32_t TextureHandle, PassHandle;
+    // Textures and buffers share one handle space, so passes read and write either through the same calls
+    typedef uint32_t ResourceHandle, TextureHandle, BufferHandle, PassHandle;
     static constexpr uint32_t INVALID_HANDLE = UINT32_MAX;
 
     struct Texture_desc {
@@ -31,6 +34,58 @@ public:
         UINT bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
     };
 
+    // Structured by default, raw when miscFlags has D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS (elementSize must be 4)
+    struct Buffer_desc {
+        UINT elementSize = 0;
+        UINT elementCount = 0;
+
+        UINT bindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+        UINT miscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    };
+
+    // A transient resource's lifetime in sorted pass indices, used to decide which resources may share memory
+    struct Alias_interval {
+        uint32_t firstUse = 0;
+        uint32_t lastUse = 0;
+        uint64_t bytes = 0;
+        uint32_t descIndex = 0; // Only intervals with the same resolved description can share a resource
+    };
+
+    static constexpr int MAX_CACHED_GRAPHS = 4;
+
+    // Physical resources no cached graph uses stay pooled, so recompiling or returning to an earlier size
+    // reuses them. They are released after this many executed frames or once the pool exceeds its budget.
+    static constexpr uint64_t POOL_MAX_UNUSED_FRAMES = 120;
+    static constexpr uint64_t POOL_MAX_UNUSED_BYTES = 256ull * 1024 * 1024;
+
+    struct Cache_stats {
+        int hitCount = 0;
+        int missCount = 0;
+        int cachedGraphCount = 0;
+        int physicalResourceCount = 0; // Shared by all cached graphs, including pooled ones
+        int pooledResourceCount = 0;   // Allocated but unused by any cached graph
+        int createdCount = 0;
+        int evictedCount = 0;
+    };
+
+    struct Memory_stats {
+        int transientCount = 0;
+        int allocationCount = 0;
+        uint64_t summedBytes = 0;    // Without aliasing
+        uint64_t allocatedBytes = 0; // With same-desc resource reuse
+        uint64_t peakBytes = 0;      // Lower bound for any placement into a shared heap
+    };
+
+    // Greedily assigns every interval a slot, reusing the first slot with the same description whose previous
+    // interval ended before this one starts. Returns the slot count.
+    static uint32_t AssignAliasSlots(const std::vector<Alias_interval> &intervals, std::vector<uint32_t> &outSlots);
+
+    // Checks that intervals sharing a slot have the same description and never overlap
+    static bool ValidateAliasSlots(const std::vector<Alias_interval> &intervals, const std::vector<uint32_t> &slots);
+
+    // Highest total size of simultaneously live intervals
+    static uint64_t CalculatePeakBytes(const std::vector<Alias_interval> &intervals);
+
     struct Render_pass_base;
 
     class RenderPassBuilder {
@@ -46,8 +101,8 @@ public:
         Render_pass_base *GetRenderPass();
 
     public:
-        TextureHandle Read(TextureHandle textureHandle);
-        TextureHandle Write(TextureHandle textureHandle);
+        ResourceHandle Read(ResourceHandle resourceHandle);
+        ResourceHandle Write(ResourceHandle resourceHandle);
 
         void WritesBackbuffer();
     };
@@ -56,32 +111,43 @@ public:
         friend class FrameGraph;
 
         ID3D11DeviceContext *deviceContext;
+        StateCache &stateCache;
         std::vector<Render_view> &views;
         FrameGraph &frameGraph;
 
-        ExecutionContext(ID3D11DeviceContext *deviceContext, std::vector<Render_view> &views, FrameGraph &frameGraph)
-            : deviceContext(deviceContext), views(views), frameGraph(frameGraph) {
+        ExecutionContext(StateCache &stateCache, std::vector<Render_view> &views, FrameGraph &frameGraph)
+            : deviceContext(stateCache.GetDeviceContext()), stateCache(stateCache), views(views), frameGraph(frameGraph) {
         }
 
     public:
         ID3D11DeviceContext *GetDeviceContext() { return this->deviceContext; }
+        StateCache &GetStateCache() { return this->stateCache; }
         std::vector<Render_view> &GetViews() { return this->views; }
 
         Render_view *GetView(View_type type, int index = 0);
 
-        ID3D11ShaderResourceView *GetShaderResourceView(TextureHandle handle) const;
+        ID3D11ShaderResourceView *GetShaderResourceView(ResourceHandle handle) const;
         ID3D11RenderTargetView *GetRenderTargetView(TextureHandle handle) const;
         ID3D11DepthStencilView *GetDepthStencilView(TextureHandle handle) const;
-        ID3D11UnorderedAccessView *GetUnorderedAccessView(TextureHandle handle) const;
+        ID3D11UnorderedAccessView *GetUnorderedAccessView(ResourceHandle handle) const;
+        ID3D11Buffer *GetBuffer(BufferHandle handle) const;
     };
 
 private:
-    struct Texture_resource {
+    enum class Resource_type {
+        texture,
+        buffer
+    };
+
+    struct Resource {
         std::string name;
+        Resource_type type = Resource_type::texture;
         Texture_desc desc;
+        Buffer_desc bufferDesc;
         bool wasImported = false;
 
         ID3D11Texture2D *texture = nullptr;
+        ID3D11Buffer *buffer = nullptr;
         ID3D11ShaderResourceView *shaderResourceView = nullptr;
         ID3D11RenderTargetView *renderTargetView = nullptr;
         ID3D11DepthStencilView *depthStencilView = nullptr;
@@ -89,20 +155,74 @@ private:
 
         PassHandle firstWrite = INVALID_HANDLE;
         PassHandle lastRead = INVALID_HANDLE;
+        PassHandle lastUse = INVALID_HANDLE;
         int readRefCount = 0;
+
+        uint32_t physicalResource = INVALID_HANDLE; // Of the applied compiled graph
+    };
+
+    // Everything a physical resource is created from, resources can only share one if these match.
+    // The view format is included since typeless depth formats are shared.
+    struct Physical_desc {
+        Resource_type type = Resource_type::texture;
+        D3D11_TEXTURE2D_DESC textureDesc{};
+        DXGI_FORMAT viewFormat = DXGI_FORMAT_UNKNOWN;
+        D3D11_BUFFER_DESC bufferDesc{};
+
+        bool operator==(const Physical_desc &other) const;
+        uint64_t CalculateBytes() const;
+    };
+
+    // Backing texture or buffer of one or more transient resources with non-overlapping lifetimes. Graphs only
+    // execute one at a time, so the cached graphs share these as well.
+    struct Physical_resource {
+        ID3D11Texture2D *texture = nullptr;
+        ID3D11Buffer *buffer = nullptr;
+        ID3D11ShaderResourceView *shaderResourceView = nullptr;
+        ID3D11RenderTargetView *renderTargetView = nullptr;
+        ID3D11DepthStencilView *depthStencilView = nullptr;
+        ID3D11UnorderedAccessView *unorderedAccessView = nullptr;
+
+        Physical_desc desc;
+        uint64_t bytes = 0;
+        int refCount = 0; // Cached graphs using it, pooled at zero
+        uint64_t unusedSinceFrame = 0;
+
+        bool IsAllocated() const { return this->texture || this->buffer; }
+        void Release();
+    };
+
+    // Schedule and resource placement of a compiled graph, reused by any later graph with the same structure
+    struct Compiled_graph {
+        uint64_t hash = 0;
+        uint64_t lastUsed = 0;
+
+        std::vector<PassHandle> sortedPassHandles;
+        std::vector<bool> culledPasses;
+        std::vector<uint32_t> passLevels;
+        uint32_t levelCount = 0;
+        std::vector<uint32_t> resourcePlacements; // Physical resource per handle, INVALID_HANDLE if none
+        std::vector<uint32_t> physicalResources;  // Every physical resource referenced, once
+
+        Memory_stats memoryStats;
     };
 
     struct Render_pass_base {
         std::string name;
 
-        std::unordered_set<TextureHandle> reads;
-        std::unordered_set<TextureHandle> writes;
+        // Passes only touch a handful of resources, so these are kept as small unique lists
+        std::vector<ResourceHandle> reads;
+        std::vector<ResourceHandle> writes;
 
         bool writesBackbuffer = false;
 
         bool isCulled = false;
         int refCount = 0;
 
+        // Longest chain of dependencies leading to the pass. Passes on the same level don't depend on each
+        // other, so they could be recorded in parallel or overlap on the GPU.
+        uint32_t level = 0;
+
         virtual ~Render_pass_base() = default;
 
         virtual void Execute(ExecutionContext &context) = 0;
@@ -118,24 +238,86 @@ private:
         }
     };
 
+    // Reused between compiles so recompiling (e.g. on resize) doesn't allocate. Lists are flattened, the
+    // entries of element i are in [offsets[i], offsets[i + 1]).
+    struct Compile_scratch {
+        std::vector<uint32_t> producerOffsets; // Per resource
+        std::vector<PassHandle> producers;
+
+        std::vector<uint32_t> successorOffsets; // Per pass
+        std::vector<PassHandle> successors;
+
+        std::vector<std::pair<PassHandle, PassHandle>> edges;
+        std::vector<uint32_t> cursors;
+        std::vector<PassHandle> edgeStamps;
+        std::vector<int> inDegree;
+        std::vector<PassHandle> passQueue;
+        std::vector<uint32_t> criticalPaths; // Per pass, passes in the longest chain starting at it
+    };
+
     ID3D11Device *device = nullptr;
 
-    std::vector<Texture_resource> textureResources;
+    std::vector<Resource> resources;
+    std::vector<Physical_resource> physicalResources; // Unallocated entries are free
+    uint64_t frameIndex = 0;
+
+    std::vector<Compiled_graph> compiledGraphs;
+    uint64_t compileCounter = 0;
 
     std::vector<std::unique_ptr<Render_pass_base>> renderPasses;
     std::vector<PassHandle> sortedPassHandles;
+    uint32_t levelCount = 0;
 
     int backbufferWidth = 0;
     int backbufferHeight = 0;
 
     bool isCompiled = false;
+    bool enableAliasing = true;
+
+    // Structure of the last graph that failed to compile, compiled again only once the structure changes
+    uint64_t failedHash = 0;
+    bool hasFailedHash = false;
 
+    Memory_stats memoryStats;
+    Cache_stats cacheStats;
+    float compileMilliseconds = 0.0f;
+
+    Compile_scratch scratch;
+
+    PassProfiler profiler;
+
+    void BuildProducerLists();
     void CullUnusedPasses();
     bool TopologicalSort();
 
+    // Reorders the sorted passes level by level, within a level by descending critical path
+    void ScheduleByLevel();
+
+    // Everything in a compile that doesn't touch the device
+    bool CompilePasses();
+
     void ComputeResourceLifetimes();
-    void CreateTemporaryResources();
+    Physical_desc ResolvePhysicalDesc(const Resource &resource) const;
+    bool CreatePhysicalTexture(const Resource &resource, const Physical_desc &desc, Physical_resource &outResource);
+    bool CreatePhysicalBuffer(const Resource &resource, const Physical_desc &desc, Physical_resource &outResource);
+    uint32_t AcquirePhysicalResource(
+        const Resource &resource, 
+        const Physical_desc &desc, 
+        const std::vector<uint32_t> &takenResources
+    );
+    void CreateTemporaryResources(Compiled_graph &compiledGraph);
+    void ReleaseCompiledGraph(Compiled_graph &compiledGraph);
+    void ReleaseCompiledGraphs();
     void ReleaseTemporaryResources();
+    void EvictPooledResources();
+    void UpdatePoolStats();
+
+    // Covers everything a compile depends on: the backbuffer size, resource descriptions and every pass' reads and writes
+    uint64_t ComputeStructureHash() const;
+
+    ID3D11Resource *GetNativeResource(ResourceHandle handle) const;
+    void UnbindHazards(const Render_pass_base &pass, StateCache &stateCache) const;
+    void ApplyCompiledGraph(const Compiled_graph &compiledGraph);
 
 public:
     FrameGraph() = default;
@@ -144,9 +326,14 @@ public:
     FrameGraph(const FrameGraph &other) = delete;
     FrameGraph &operator=(const FrameGraph &other) = delete;
 
+    // Also sets up the profiler's GPU timestamps, nullptr releases them
     void SetDevice(ID3D11Device *device);
 
+    // Takes effect on the next compile
+    void SetAliasingEnabled(bool enableAliasing);
+
     TextureHandle CreateTexture(const std::string &name, Texture_desc desc);
+    BufferHandle CreateBuffer(const std::string &name, Buffer_desc desc);
 
     TextureHandle ImportTexture(
         const std::string &name,
@@ -166,6 +353,20 @@ public:
         ID3D11UnorderedAccessView *unorderedAccessView = nullptr
     );
 
+    BufferHandle ImportBuffer(
+        const std::string &name,
+        ID3D11Buffer *buffer,
+        ID3D11ShaderResourceView *shaderResourceView = nullptr,
+        ID3D11UnorderedAccessView *unorderedAccessView = nullptr
+    );
+
+    void UpdateImportedBuffer(
+        BufferHandle handle,
+        ID3D11Buffer *buffer,
+        ID3D11ShaderResourceView *shaderResourceView = nullptr,
+        ID3D11UnorderedAccessView *unorderedAccessView = nullptr
+    );
+
     template <typename PassData>
     PassData &AddRenderPass(
         const std::string &name,
@@ -187,14 +388,55 @@ public:
         return renderPass->data;
     }
 
-    void Compile(int backbufferWidth, int backbufferHeight);
-    void OnResize(int width, int height);
+    // Reuses the schedule and resources of a cached graph with the same structure, so rebuilding and compiling
+    // an unchanged graph every frame is cheap. Fails on a dependency cycle, leaving the graph uncompiled.
+    bool Compile(int backbufferWidth, int backbufferHeight);
+    bool OnResize(int width, int height);
 
-    void Execute(ID3D11DeviceContext *deviceContext, std::vector<Render_view> &views);
+    void Execute(StateCache &stateCache, std::vector<Render_view> &views);
 
+    // Removes all passes and resources but keeps the compiled graphs and their resources, for per-frame rebuilds
+    void Reset();
+
+    // Like Reset, but also releases all compiled graphs and resources
     void Clear();
 
     void LogGraph() const;
+
+    // Describes the compiled graph without device objects, for writing out and validating
+    Frame_graph_dump CreateDump() const;
+
+    // Writes basePath.json and basePath.dot, then validates the graph and logs the report
+    bool DumpGraph(const std::string &basePath) const;
+
+    const Memory_stats &GetMemoryStats() const { return this->memoryStats; }
+    const Cache_stats &GetCacheStats() const { return this->cacheStats; }
+    float GetCompileMilliseconds() const { return this->compileMilliseconds; }
+    uint32_t GetLevelCount() const { return this->levelCount; }
+    bool IsCompiled() const { return this->isCompiled; }
+
+    PassProfiler &GetProfiler() { return this->profiler; }
+
+    // Compiles synthetic graphs of 10 to 5000 passes without a device and logs the average time per compile,
+    // then times rebuilding and compiling an unchanged renderer-sized graph against REBUILD_BUDGET_MICROSECONDS
+    static void RunCompileBenchmark();
+    static constexpr double REBUILD_BUDGET_MICROSECONDS = 5.0;
+
+    // Resizes a renderer-shaped graph of its own through a simulated window drag and back, twice, and logs how many
+    // physical resources were created. Repeating the drag should be served entirely from the pool. Only the
+    // resources of that graph are created on the device.
+    static void RunResizeTest(ID3D11Device *device);
+    static constexpr int RESIZE_TEST_STEPS = 3;
+
+    // Schedules a renderer-shaped graph and random synthetic DAGs without a device and checks that every edge goes
+    // to a later level and position, that levels are as low as possible and that the order follows the levels.
+    // Also checks that a cyclic graph fails to compile and isn't cached.
+    static void RunScheduleTest();
+
+    // Executes a renderer-shaped graph of imported made-up resources for a few frames through a recording state
+    // sink. Replays the recorded calls and checks that no resource is ever bound as an input and an output at once,
+    // and that the hazard unbinds come before the binds they make room for.
+    static void RunHazardTest();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,586 @@
+#include "frame_graph_dump.hpp"
+#include "core/logging.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static std::string Escape(const std::string &str) {
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+static void WriteIndexList(std::ofstream &file, const std::vector<uint32_t> &indices) {
+    file << "[";
+    for (size_t i = 0; i < indices.size(); ++i)
+        file << (i > 0 ? "," : "") << indices[i];
+    file << "]";
+}
+
+bool WriteFrameGraphJson(const Frame_graph_dump &dump, const std::string &path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        LogWarn("Unable to open '%s'\n", path.c_str());
+        return false;
+    }
+
+    file << "{\n\"passes\": [\n";
+    for (size_t i = 0; i < dump.passes.size(); ++i) {
+        const Frame_graph_dump::Pass &pass = dump.passes[i];
+
+        file << "  {\"name\": \"" << Escape(pass.name) << "\", \"culled\": " << (pass.isCulled ? "true" : "false")
+             << ", \"order\": " << pass.order << ", \"level\": " << pass.level << ", \"writesBackbuffer\": " << (pass.writesBackbuffer ? "true" : "false")
+             << ", \"reads\": ";
+        WriteIndexList(file, pass.reads);
+        file << ", \"writes\": ";
+        WriteIndexList(file, pass.writes);
+        file << "}" << (i + 1 < dump.passes.size() ? "," : "") << "\n";
+    }
+
+    file << "],\n\"resources\": [\n";
+    for (size_t i = 0; i < dump.resources.size(); ++i) {
+        const Frame_graph_dump::Resource &resource = dump.resources[i];
+
+        file << "  {\"name\": \"" << Escape(resource.name) << "\", \"type\": \"" << (resource.isBuffer ? "buffer" : "texture")
+             << "\", \"imported\": " << (resource.wasImported ? "true" : "false") << ", \"bytes\": " << resource.bytes
+             << ", \"firstUse\": " << resource.firstUse << ", \"lastUse\": " << resource.lastUse
+             << ", \"physicalResource\": " << resource.physicalResource << "}"
+             << (i + 1 < dump.resources.size() ? "," : "") << "\n";
+    }
+
+    file << "],\n\"memory\": {\"summedBytes\": " << dump.summedBytes << ", \"allocatedBytes\": " << dump.allocatedBytes
+         << ", \"peakBytes\": " << dump.peakBytes << "}\n}\n";
+
+    return true;
+}
+
+// Just enough JSON for the dumps: objects, arrays, strings with \" and \\ escapes, numbers and booleans
+struct Json_value {
+    enum class Type {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object
+    };
+
+    Type type = Type::null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<Json_value> elements;
+    std::vector<std::pair<std::string, Json_value>> members;
+
+    const Json_value *Find(const char *key) const {
+        for (const auto &[name, value] : this->members)
+            if (name == key)
+                return &value;
+
+        return nullptr;
+    }
+
+    int64_t GetInt(const char *key, int64_t fallback) const {
+        const Json_value *value = this->Find(key);
+        return value && value->type == Type::number ? static_cast<int64_t>(value->number) : fallback;
+    }
+
+    bool GetBool(const char *key) const {
+        const Json_value *value = this->Find(key);
+        return value && value->type == Type::boolean && value->boolean;
+    }
+
+    std::string GetString(const char *key) const {
+        const Json_value *value = this->Find(key);
+        return value && value->type == Type::string ? value->string : std::string();
+    }
+};
+
+class JsonParser {
+    const std::string &text;
+    size_t position = 0;
+
+    void SkipWhitespace() {
+        while (this->position < this->text.size() && isspace(static_cast<unsigned char>(this->text[this->position])))
+            ++this->position;
+    }
+
+    bool Consume(char c) {
+        this->SkipWhitespace();
+        if (this->position >= this->text.size() || this->text[this->position] != c)
+            return false;
+
+        ++this->position;
+        return true;
+    }
+
+    bool ParseString(std::string &outString) {
+        if (!this->Consume('"'))
+            return false;
+
+        outString.clear();
+        while (this->position < this->text.size()) {
+            char c = this->text[this->position++];
+            if (c == '"')
+                return true;
+
+            if (c == '\\') {
+                if (this->position >= this->text.size())
+                    return false;
+
+                c = this->text[this->position++];
+            }
+
+            outString += c;
+        }
+
+        return false;
+    }
+
+    bool ParseLiteral(const char *literal) {
+        const size_t length = strlen(literal);
+        if (this->text.compare(this->position, length, literal) != 0)
+            return false;
+
+        this->position += length;
+        return true;
+    }
+
+public:
+    JsonParser(const std::string &text) : text(text) {}
+
+    bool Parse(Json_value &outValue) {
+        this->SkipWhitespace();
+        if (this->position >= this->text.size())
+            return false;
+
+        const char c = this->text[this->position];
+
+        if (c == '{') {
+            outValue.type = Json_value::Type::object;
+            ++this->position;
+
+            if (this->Consume('}'))
+                return true;
+
+            do {
+                std::pair<std::string, Json_value> member;
+                if (!this->ParseString(member.first) || !this->Consume(':') || !this->Parse(member.second))
+                    return false;
+
+                outValue.members.push_back(std::move(member));
+            } while (this->Consume(','));
+
+            return this->Consume('}');
+        }
+
+        if (c == '[') {
+            outValue.type = Json_value::Type::array;
+            ++this->position;
+
+            if (this->Consume(']'))
+                return true;
+
+            do {
+                outValue.elements.emplace_back();
+                if (!this->Parse(outValue.elements.back()))
+                    return false;
+            } while (this->Consume(','));
+
+            return this->Consume(']');
+        }
+
+        if (c == '"') {
+            outValue.type = Json_value::Type::string;
+            return this->ParseString(outValue.string);
+        }
+
+        if (this->ParseLiteral("true") || this->ParseLiteral("false")) {
+            outValue.type = Json_value::Type::boolean;
+            outValue.boolean = c == 't';
+            return true;
+        }
+
+        if (this->ParseLiteral("null"))
+            return true;
+
+        const char *start = this->text.c_str() + this->position;
+        char *end = nullptr;
+        outValue.number = strtod(start, &end);
+        if (end == start)
+            return false;
+
+        outValue.type = Json_value::Type::number;
+        this->position += end - start;
+        return true;
+    }
+
+    bool IsAtEnd() {
+        this->SkipWhitespace();
+        return this->position == this->text.size();
+    }
+};
+
+static bool ReadIndexList(const Json_value *list, size_t resourceCount, std::vector<uint32_t> &outIndices) {
+    if (!list || list->type != Json_value::Type::array)
+        return false;
+
+    for (const Json_value &element : list->elements) {
+        if (element.type != Json_value::Type::number || element.number < 0.0 || element.number >= resourceCount)
+            return false;
+
+        outIndices.push_back(static_cast<uint32_t>(element.number));
+    }
+
+    return true;
+}
+
+bool ReadFrameGraphJson(const std::string &path, Frame_graph_dump &outDump) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        LogWarn("Unable to open '%s'\n", path.c_str());
+        return false;
+    }
+
+    std::stringstream stream;
+    stream << file.rdbuf();
+    const std::string text = stream.str();
+
+    Json_value root;
+    JsonParser parser(text);
+    if (!parser.Parse(root) || !parser.IsAtEnd() || root.type != Json_value::Type::object) {
+        LogWarn("'%s' is not valid JSON\n", path.c_str());
+        return false;
+    }
+
+    const Json_value *passes = root.Find("passes");
+    const Json_value *resources = root.Find("resources");
+    if (!passes || passes->type != Json_value::Type::array || !resources || resources->type != Json_value::Type::array) {
+        LogWarn("'%s' has no passes or resources\n", path.c_str());
+        return false;
+    }
+
+    outDump = {};
+
+    for (const Json_value &value : resources->elements) {
+        Frame_graph_dump::Resource resource;
+        resource.name             = value.GetString("name");
+        resource.isBuffer         = value.GetString("type") == "buffer";
+        resource.wasImported      = value.GetBool("imported");
+        resource.bytes            = static_cast<uint64_t>(value.GetInt("bytes", 0));
+        resource.firstUse         = static_cast<int>(value.GetInt("firstUse", -1));
+        resource.lastUse          = static_cast<int>(value.GetInt("lastUse", -1));
+        resource.physicalResource = static_cast<int>(value.GetInt("physicalResource", -1));
+
+        outDump.resources.push_back(std::move(resource));
+    }
+
+    for (const Json_value &value : passes->elements) {
+        Frame_graph_dump::Pass pass;
+        pass.name             = value.GetString("name");
+        pass.isCulled         = value.GetBool("culled");
+        pass.writesBackbuffer = value.GetBool("writesBackbuffer");
+        pass.order            = static_cast<int>(value.GetInt("order", -1));
+        pass.level            = static_cast<int>(value.GetInt("level", -1));
+
+        if (!ReadIndexList(value.Find("reads"), outDump.resources.size(), pass.reads) ||
+            !ReadIndexList(value.Find("writes"), outDump.resources.size(), pass.writes)) {
+            LogWarn("Pass '%s' in '%s' references a resource that doesn't exist\n", pass.name.c_str(), path.c_str());
+            return false;
+        }
+
+        outDump.passes.push_back(std::move(pass));
+    }
+
+    if (const Json_value *memory = root.Find("memory")) {
+        outDump.summedBytes    = static_cast<uint64_t>(memory->GetInt("summedBytes", 0));
+        outDump.allocatedBytes = static_cast<uint64_t>(memory->GetInt("allocatedBytes", 0));
+        outDump.peakBytes      = static_cast<uint64_t>(memory->GetInt("peakBytes", 0));
+    }
+
+    return true;
+}
+
+bool WriteFrameGraphDot(const Frame_graph_dump &dump, const std::string &path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        LogWarn("Unable to open '%s'\n", path.c_str());
+        return false;
+    }
+
+    file << "digraph FrameGraph {\n";
+    file << "    rankdir=LR;\n";
+    file << "    node [fontname=\"Helvetica\", fontsize=10];\n\n";
+
+    for (size_t i = 0; i < dump.passes.size(); ++i) {
+        const Frame_graph_dump::Pass &pass = dump.passes[i];
+
+        file << "    pass" << i << " [shape=box, label=\"" << Escape(pass.name);
+        if (pass.isCulled)
+            file << "\\nculled\", style=dashed, color=gray, fontcolor=gray];\n";
+        else
+            file << "\\n#" << pass.order << ", level " << pass.level << "\", style=filled, fillcolor=lightblue];\n";
+    }
+
+    // Independent passes side by side
+    int levelCount = 0;
+    for (const Frame_graph_dump::Pass &pass : dump.passes)
+        levelCount = std::max(levelCount, pass.level + 1);
+
+    for (int level = 0; level < levelCount; ++level) {
+        file << "    { rank=same;";
+        for (size_t i = 0; i < dump.passes.size(); ++i)
+            if (dump.passes[i].level == level)
+                file << " pass" << i << ";";
+        file << " }\n";
+    }
+
+    file << "\n";
+
+    for (size_t i = 0; i < dump.resources.size(); ++i) {
+        const Frame_graph_dump::Resource &resource = dump.resources[i];
+
+        file << "    resource" << i << " [shape=" << (resource.wasImported ? "note" : "ellipse") << ", label=\"" << Escape(resource.name);
+
+        if (resource.firstUse >= 0)
+            file << "\\nused #" << resource.firstUse << " to #" << resource.lastUse;
+
+        if (!resource.wasImported) {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "\\n%.2f MB", resource.bytes / (1024.0 * 1024.0));
+            file << buffer;
+
+            if (resource.physicalResource >= 0)
+                file << ", physical " << resource.physicalResource;
+        }
+
+        file << "\"];\n";
+    }
+
+    file << "\n";
+
+    for (size_t i = 0; i < dump.passes.size(); ++i) {
+        const Frame_graph_dump::Pass &pass = dump.passes[i];
+        const char *style = pass.isCulled ? " [style=dashed, color=gray]" : "";
+
+        for (uint32_t resourceIndex : pass.reads)
+            file << "    resource" << resourceIndex << " -> pass" << i << style << ";\n";
+
+        for (uint32_t resourceIndex : pass.writes)
+            file << "    pass" << i << " -> resource" << resourceIndex << style << ";\n";
+    }
+
+    file << "}\n";
+    return true;
+}
+
+Frame_graph_report ValidateFrameGraph(const Frame_graph_dump &dump) {
+    Frame_graph_report report;
+
+    const size_t passCount = dump.passes.size();
+    const size_t resourceCount = dump.resources.size();
+
+    std::vector<std::vector<uint32_t>> writers(resourceCount);
+    std::vector<std::vector<uint32_t>> readers(resourceCount);
+
+    for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex) {
+        const Frame_graph_dump::Pass &pass = dump.passes[passIndex];
+        if (pass.isCulled) {
+            ++report.culledPassCount;
+            continue;
+        }
+
+        ++report.livePassCount;
+
+        for (uint32_t resourceIndex : pass.writes)
+            if (resourceIndex < resourceCount)
+                writers[resourceIndex].push_back(passIndex);
+
+        for (uint32_t resourceIndex : pass.reads)
+            if (resourceIndex < resourceCount)
+                readers[resourceIndex].push_back(passIndex);
+    }
+
+    // Edges from every live writer of a resource to every other live pass reading it
+    std::vector<std::vector<uint32_t>> successors(passCount);
+    std::vector<int> inDegree(passCount, 0);
+    std::vector<int> outDegree(passCount, 0);
+
+    for (size_t resourceIndex = 0; resourceIndex < resourceCount; ++resourceIndex) {
+        for (uint32_t writer : writers[resourceIndex]) {
+            for (uint32_t reader : readers[resourceIndex]) {
+                if (reader == writer)
+                    continue;
+
+                if (std::find(successors[writer].begin(), successors[writer].end(), reader) != successors[writer].end())
+                    continue;
+
+                successors[writer].push_back(reader);
+                ++inDegree[reader];
+                ++outDegree[writer];
+            }
+        }
+    }
+
+    // Removing passes without inputs and then passes without outputs leaves the ones on or between cycles
+    std::vector<bool> isRemoved(passCount, false);
+    std::vector<uint32_t> queue;
+
+    for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex)
+        if (dump.passes[passIndex].isCulled || inDegree[passIndex] == 0)
+            queue.push_back(passIndex);
+
+    for (size_t head = 0; head < queue.size(); ++head) {
+        const uint32_t passIndex = queue[head];
+        isRemoved[passIndex] = true;
+
+        for (uint32_t successor : successors[passIndex])
+            if (--inDegree[successor] == 0)
+                queue.push_back(successor);
+    }
+
+    std::vector<std::vector<uint32_t>> predecessors(passCount);
+    for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex)
+        for (uint32_t successor : successors[passIndex])
+            predecessors[successor].push_back(passIndex);
+
+    queue.clear();
+    for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex) {
+        if (isRemoved[passIndex])
+            continue;
+
+        outDegree[passIndex] = 0;
+        for (uint32_t successor : successors[passIndex])
+            if (!isRemoved[successor])
+                ++outDegree[passIndex];
+
+        if (outDegree[passIndex] == 0)
+            queue.push_back(passIndex);
+    }
+
+    for (size_t head = 0; head < queue.size(); ++head) {
+        const uint32_t passIndex = queue[head];
+        isRemoved[passIndex] = true;
+
+        for (uint32_t predecessor : predecessors[passIndex])
+            if (!isRemoved[predecessor] && --outDegree[predecessor] == 0)
+                queue.push_back(predecessor);
+    }
+
+    std::string cyclePasses;
+    for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex)
+        if (!isRemoved[passIndex])
+            cyclePasses += (cyclePasses.empty() ? "'" : ", '") + dump.passes[passIndex].name + "'";
+
+    if (!cyclePasses.empty())
+        report.errors.push_back("Cycle between " + cyclePasses);
+
+    // Which passes are ordered after which, cycles included
+    std::vector<std::vector<bool>> isReachable(passCount, std::vector<bool>(passCount, false));
+    std::vector<uint32_t> stack;
+
+    for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex) {
+        if (dump.passes[passIndex].isCulled)
+            continue;
+
+        stack.assign(1, passIndex);
+        while (!stack.empty()) {
+            const uint32_t current = stack.back();
+            stack.pop_back();
+
+            for (uint32_t successor : successors[current]) {
+                if (isReachable[passIndex][successor])
+                    continue;
+
+                isReachable[passIndex][successor] = true;
+                stack.push_back(successor);
+            }
+        }
+    }
+
+    for (size_t resourceIndex = 0; resourceIndex < resourceCount; ++resourceIndex) {
+        const Frame_graph_dump::Resource &resource = dump.resources[resourceIndex];
+        const std::vector<uint32_t> &resourceWriters = writers[resourceIndex];
+
+        // Without an order between them, which write ends up in the resource depends on the sort
+        for (size_t i = 0; i < resourceWriters.size(); ++i) {
+            for (size_t j = i + 1; j < resourceWriters.size(); ++j) {
+                const uint32_t a = resourceWriters[i];
+                const uint32_t b = resourceWriters[j];
+                if (isReachable[a][b] || isReachable[b][a])
+                    continue;
+
+                report.errors.push_back(
+                    "'" + resource.name + "' is written by '" + dump.passes[a].name + "' and '" + dump.passes[b].name + "' in no defined order"
+                );
+            }
+        }
+
+        // Imported resources can be read outside of the graph
+        if (resource.wasImported)
+            continue;
+
+        for (uint32_t writer : resourceWriters) {
+            const bool isRead = std::any_of(readers[resourceIndex].begin(), readers[resourceIndex].end(), [&](uint32_t reader) {
+                return isReachable[writer][reader];
+            });
+
+            if (!isRead)
+                report.warnings.push_back("'" + dump.passes[writer].name + "' writes '" + resource.name + "', which no later pass reads");
+        }
+    }
+
+    std::vector<int> physicalResources;
+    // Transients only used by culled passes are never allocated
+    for (const Frame_graph_dump::Resource &resource : dump.resources) {
+        if (resource.wasImported || resource.firstUse < 0)
+            continue;
+
+        ++report.transientCount;
+        report.transientBytes += resource.bytes;
+
+        if (resource.physicalResource >= 0 &&
+            std::find(physicalResources.begin(), physicalResources.end(), resource.physicalResource) == physicalResources.end())
+            physicalResources.push_back(resource.physicalResource);
+    }
+
+    report.physicalResourceCount = static_cast<int>(physicalResources.size());
+    return report;
+}
+
+void LogFrameGraphReport(const Frame_graph_dump &dump, const Frame_graph_report &report) {
+    LogInfo("Frame graph validation:\n");
+    LogIndent();
+
+    LogInfo("%d live passes, %d culled\n", report.livePassCount, report.culledPassCount);
+    LogInfo(
+        "%d transients in %d physical resources: %.2f MB summed, %.2f MB allocated, %.2f MB peak\n",
+        report.transientCount,
+        report.physicalResourceCount,
+        report.transientBytes / (1024.0 * 1024.0),
+        dump.allocatedBytes / (1024.0 * 1024.0),
+        dump.peakBytes / (1024.0 * 1024.0)
+    );
+
+    for (const std::string &error : report.errors)
+        LogWarn("%s\n", error.c_str());
+
+    for (const std::string &warning : report.warnings)
+        LogWarn("%s\n", warning.c_str());
+
+    if (report.errors.empty() && report.warnings.empty())
+        LogInfo("No problems found\n");
+
+    LogUnindent();
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef FRAME_GRAPH_DUMP_HPP
+#define FRAME_GRAPH_DUMP_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Plain description of a compiled frame graph without any device objects, so it can be written out and validated
+// away from the renderer. Pass and resource references are indices into the dump's own lists.
+struct Frame_graph_dump {
+    struct Pass {
+        std::string name;
+        std::vector<uint32_t> reads;
+        std::vector<uint32_t> writes;
+        bool writesBackbuffer = false;
+        bool isCulled = false;
+        int order = -1; // Position in the execution order, -1 if culled or left unsorted by a cycle
+        int level = -1; // Passes on the same level are independent of each other
+    };
+
+    struct Resource {
+        std::string name;
+        bool isBuffer = false;
+        bool wasImported = false;
+        uint64_t bytes = 0;        // Transient resources only
+        int firstUse = -1;         // Execution order positions, -1 if unused
+        int lastUse = -1;
+        int physicalResource = -1; // Transients with the same index are aliased
+    };
+
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+
+    uint64_t summedBytes = 0;    // Without aliasing
+    uint64_t allocatedBytes = 0;
+    uint64_t peakBytes = 0;
+};
+
+struct Frame_graph_report {
+    std::vector<std::string> errors;   // Cycles and unordered writes to the same resource
+    std::vector<std::string> warnings; // Writes that are never read
+
+    int livePassCount = 0;
+    int culledPassCount = 0;
+    int transientCount = 0; // Used by live passes
+    int physicalResourceCount = 0;
+    uint64_t transientBytes = 0; // Summed over those transients, without aliasing
+};
+
+bool WriteFrameGraphJson(const Frame_graph_dump &dump, const std::string &path);
+
+// Reads back what WriteFrameGraphJson wrote, for validating a dump outside of the renderer
+bool ReadFrameGraphJson(const std::string &path, Frame_graph_dump &outDump);
+
+// Graphviz, render with e.g. dot -Tsvg
+bool WriteFrameGraphDot(const Frame_graph_dump &dump, const std::string &path);
+
+// Only looks at the dump, the ordering rules match FrameGraph: a pass runs after every live writer of a resource it
+// reads, and nothing else orders passes
+Frame_graph_report ValidateFrameGraph(const Frame_graph_dump &dump);
+
+void LogFrameGraphReport(const Frame_graph_dump &dump, const Frame_graph_report &report);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,752 @@
+#include "gpu_culling_system.hpp"
+#include "core/logging.hpp"
+#include "rendering/render_utils.hpp"
+#include "debugging/debug.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <tuple>
+#include <cmath>
+#include <cstring>
+
+void GpuCullingSystem::ExtractFrustumPlanes(const XMFLOAT4X4 &viewProjectionMatrix, XMFLOAT4 outPlanes[6]) {
+    const XMFLOAT4X4 &m = viewProjectionMatrix;
+
+    // Row vectors, so the clip-space components are dot products with the columns. D3D clips z to [0, w].
+    outPlanes[0] = {m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41}; // Left
+    outPlanes[1] = {m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41}; // Right
+    outPlanes[2] = {m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42}; // Bottom
+    outPlanes[3] = {m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42}; // Top
+    outPlanes[4] = {m._13,         m._23,         m._33,         m._43};         // Near
+    outPlanes[5] = {m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43}; // Far
+}
+
+bool GpuCullingSystem::IsInstanceVisible(const Gpu_instance_data &instance, const XMFLOAT4 planes[6]) {
+    const XMFLOAT3 &c = instance.boundsCenter;
+    const XMFLOAT3 &e = instance.boundsExtents;
+
+    for (int i = 0; i < 6; ++i) {
+        const XMFLOAT4 &p = planes[i];
+
+        float distance = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+        float radius = fabsf(p.x) * e.x + fabsf(p.y) * e.y + fabsf(p.z) * e.z;
+
+        if (distance + radius < 0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+void GpuCullingSystem::CullInstances(
+    const std::vector<Gpu_instance_data> &instances,
+    const std::vector<Gpu_batch_data> &batches,
+    const XMFLOAT4 planes[6],
+    std::vector<UINT> &outVisibleInstances,
+    std::vector<Draw_indexed_indirect_args> &outArgs
+) {
+    outVisibleInstances.assign(instances.size(), 0);
+    outArgs.resize(batches.size());
+
+    for (size_t i = 0; i < batches.size(); ++i) {
+        const Gpu_batch_data &batch = batches[i];
+
+        // Visible instances keep their relative order, same as the prefix sum in the shader
+        UINT visibleCount = 0;
+        for (UINT j = 0; j < batch.instanceCount; ++j) {
+            const UINT instanceIndex = batch.firstInstance + j;
+            if (IsInstanceVisible(instances[instanceIndex], planes))
+                outVisibleInstances[batch.firstInstance + visibleCount++] = instanceIndex;
+        }
+
+        Draw_indexed_indirect_args &args = outArgs[i];
+        args.indexCountPerInstance = batch.indexCount;
+        args.instanceCount         = visibleCount;
+        args.startIndexLocation    = batch.startIndex;
+        args.baseVertexLocation    = batch.baseVertex;
+        args.startInstanceLocation = batch.firstInstance;
+    }
+}
+
+void GpuCullingSystem::RunReferenceTest() {
+    LogInfo("GPU culling reference test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    // Camera at the origin looking down +z, 90 degree field of view, square aspect, near 1 and far 100
+    XMFLOAT4X4 viewProjectionMatrix;
+    XMStoreFloat4x4(&viewProjectionMatrix, XMMatrixMultiply(
+        XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+        XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 1.0f, 100.0f)
+    ));
+
+    XMFLOAT4 planes[6];
+    ExtractFrustumPlanes(viewProjectionMatrix, planes);
+
+    auto makeInstance = [](const XMFLOAT3 &center, const XMFLOAT3 &extents) {
+        Gpu_instance_data instance{};
+        instance.boundsCenter = center;
+        instance.boundsExtents = extents;
+        return instance;
+    };
+
+    const XMFLOAT3 smallExtents = { 0.5f, 0.5f, 0.5f };
+
+    checks.Check(IsInstanceVisible(makeInstance({ 0.0f, 0.0f, 10.0f }, smallExtents), planes), "Boxes in front of the camera are visible");
+    checks.Check(!IsInstanceVisible(makeInstance({ 0.0f, 0.0f, -10.0f }, smallExtents), planes), "Boxes behind the camera are culled");
+    checks.Check(IsInstanceVisible(makeInstance({ 0.0f, 0.0f, 0.0f }, { 2.0f, 2.0f, 2.0f }), planes), "Boxes around the camera are visible");
+    checks.Check(!IsInstanceVisible(makeInstance({ 0.0f, 0.0f, 0.25f }, { 0.1f, 0.1f, 0.1f }), planes), "Boxes before the near plane are culled");
+    checks.Check(!IsInstanceVisible(makeInstance({ 0.0f, 0.0f, 110.0f }, smallExtents), planes), "Boxes past the far plane are culled");
+    checks.Check(IsInstanceVisible(makeInstance({ 0.0f, 0.0f, 100.25f }, smallExtents), planes), "Boxes straddling the far plane are visible");
+    checks.Check(!IsInstanceVisible(makeInstance({ -12.0f, 0.0f, 10.0f }, smallExtents), planes), "Boxes left of the frustum are culled");
+    checks.Check(IsInstanceVisible(makeInstance({ -10.25f, 0.0f, 10.0f }, smallExtents), planes), "Boxes straddling the left plane are visible");
+    checks.Check(!IsInstanceVisible(makeInstance({ 0.0f, 12.0f, 10.0f }, smallExtents), planes), "Boxes above the frustum are culled");
+
+    TestRandom random(86420);
+
+    // Batches of 0 to 63 instances around the frustum, so some are fully visible, some fully culled and some mixed
+    auto makeScene = [&](int batchCount, std::vector<Gpu_instance_data> &outInstances, std::vector<Gpu_batch_data> &outBatches) {
+        outInstances.clear();
+        outBatches.clear();
+
+        for (int i = 0; i < batchCount; ++i) {
+            Gpu_batch_data batch{};
+            batch.firstInstance = static_cast<UINT>(outInstances.size());
+            batch.instanceCount = static_cast<UINT>(random.NextFloat(0.0f, 64.0f));
+            batch.indexCount    = 3 * (1 + i);
+            batch.startIndex    = 100 * i;
+            batch.baseVertex    = -i;
+
+            const float spread = random.NextFloat(0.0f, 1.0f) < 0.5f ? 20.0f : 150.0f;
+            for (UINT j = 0; j < batch.instanceCount; ++j) {
+                const float extent = random.NextFloat(0.1f, 2.0f);
+                outInstances.push_back(makeInstance(
+                    { random.NextFloat(-spread, spread), random.NextFloat(-spread, spread), random.NextFloat(-spread, spread) },
+                    { extent, extent, extent }
+                ));
+            }
+
+            outBatches.push_back(batch);
+        }
+    };
+
+    std::vector<Gpu_instance_data> instances;
+    std::vector<Gpu_batch_data> batches;
+    std::vector<UINT> visibleInstances;
+    std::vector<Draw_indexed_indirect_args> args;
+
+    int visibleTotal = 0;
+    int emptyBatchCount = 0;
+    int culledBatchCount = 0;
+    bool isCompacted = true;
+    bool hasMatchingArgs = true;
+
+    for (int scene = 0; scene < 20; ++scene) {
+        makeScene(100, instances, batches);
+        CullInstances(instances, batches, planes, visibleInstances, args);
+
+        hasMatchingArgs = hasMatchingArgs && args.size() == batches.size() && visibleInstances.size() == instances.size();
+        if (!hasMatchingArgs)
+            break;
+
+        for (size_t i = 0; i < batches.size(); ++i) {
+            const Gpu_batch_data &batch = batches[i];
+
+            // Brute force, every visible instance of the batch in order, then zeros for the rest of its range
+            std::vector<UINT> expected;
+            for (UINT j = 0; j < batch.instanceCount; ++j)
+                if (IsInstanceVisible(instances[batch.firstInstance + j], planes))
+                    expected.push_back(batch.firstInstance + j);
+
+            for (UINT j = 0; j < batch.instanceCount; ++j) {
+                const UINT expectedIndex = j < expected.size() ? expected[j] : 0;
+                isCompacted = isCompacted && visibleInstances[batch.firstInstance + j] == expectedIndex;
+            }
+
+            const Draw_indexed_indirect_args &batchArgs = args[i];
+            hasMatchingArgs = hasMatchingArgs &&
+                batchArgs.indexCountPerInstance == batch.indexCount &&
+                batchArgs.instanceCount == expected.size() &&
+                batchArgs.startIndexLocation == batch.startIndex &&
+                batchArgs.baseVertexLocation == batch.baseVertex &&
+                batchArgs.startInstanceLocation == batch.firstInstance;
+
+            visibleTotal += static_cast<int>(expected.size());
+            emptyBatchCount += batch.instanceCount == 0 ? 1 : 0;
+            culledBatchCount += batch.instanceCount > 0 && expected.empty() ? 1 : 0;
+        }
+    }
+
+    checks.Check(isCompacted, "Visible instances are compacted in order to the start of their batch");
+    checks.Check(hasMatchingArgs, "Draw arguments match their batch and visible count");
+    checks.Check(emptyBatchCount > 0 && culledBatchCount > 0, "The scenes have empty and fully culled batches");
+    LogInfo("2000 batches: %d visible instances, %d empty and %d fully culled batches\n", visibleTotal, emptyBatchCount, culledBatchCount);
+
+    {
+        makeScene(1000, instances, batches);
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (int iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration)
+            CullInstances(instances, batches, planes, visibleInstances, args);
+        std::chrono::duration<float, std::micro> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+        const float microseconds = elapsed.count() / BENCHMARK_ITERATIONS;
+        LogInfo(
+            "%d instances in %d batches: %.2f us per cull, %.2f ns per instance\n",
+            static_cast<int>(instances.size()),
+            static_cast<int>(batches.size()),
+            microseconds,
+            1000.0f * microseconds / std::max<size_t>(instances.size(), 1)
+        );
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
+
+bool GpuCullingSystem::LoadShaders(ID3D11Device *device, const std::string &shaderDir) {
+    std::vector<uint8_t> bytecode;
+
+    if (!LoadShaderBytecode(shaderDir + "cs_culling.cso", bytecode))
+        return false;
+
+    HRESULT result = device->CreateComputeShader(bytecode.data(), bytecode.size(), nullptr, &this->cullingCS);
+    if (FAILED(result)) {
+        LogError("Failed to create compute shader");
+        return false;
+    }
+
+    // Same input signature as vs_gbuffer, so the G-buffer input layout is reused
+    if (!LoadShaderBytecode(shaderDir + "vs_gbuffer_instanced.cso", bytecode))
+        return false;
+
+    result = device->CreateVertexShader(bytecode.data(), bytecode.size(), nullptr, &this->instancedVS);
+    if (FAILED(result)) {
+        LogError("Failed to create vertex shader");
+        return false;
+    }
+
+    return true;
+}
+
+bool GpuCullingSystem::CreateConstantBuffers(ID3D11Device *device) {
+    D3D11_BUFFER_DESC desc{};
+    desc.ByteWidth = sizeof(Culling_data);
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+    HRESULT result = device->CreateBuffer(&desc, nullptr, &this->cullingBuffer);
+    if (FAILED(result)) {
+        LogError("Failed to create constant buffer");
+        return false;
+    }
+
+    return true;
+}
+
+bool GpuCullingSystem::CreateInstanceBuffers(UINT instanceCount, UINT batchCount) {
+    this->ReleaseInstanceBuffers();
+
+    ID3D11Device *device = this->device;
+
+    {
+        D3D11_BUFFER_DESC desc{};
+        desc.ByteWidth = sizeof(Gpu_instance_data) * instanceCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(Gpu_instance_data);
+
+        HRESULT result = device->CreateBuffer(&desc, nullptr, &this->instanceBuffer);
+        if (FAILED(result)) {
+            LogWarn("Failed to create instance buffer\n");
+            return false;
+        }
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.NumElements = instanceCount;
+
+        result = device->CreateShaderResourceView(this->instanceBuffer, &srvDesc, &this->instanceBufferSRV);
+        if (FAILED(result)) {
+            LogWarn("Failed to create instance buffer SRV\n");
+            return false;
+        }
+    }
+
+    {
+        D3D11_BUFFER_DESC desc{};
+        desc.ByteWidth = sizeof(Gpu_batch_data) * batchCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(Gpu_batch_data);
+
+        HRESULT result = device->CreateBuffer(&desc, nullptr, &this->batchBuffer);
+        if (FAILED(result)) {
+            LogWarn("Failed to create batch buffer\n");
+            return false;
+        }
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.NumElements = batchCount;
+
+        result = device->CreateShaderResourceView(this->batchBuffer, &srvDesc, &this->batchBufferSRV);
+        if (FAILED(result)) {
+            LogWarn("Failed to create batch buffer SRV\n");
+            return false;
+        }
+    }
+
+    {
+        D3D11_BUFFER_DESC desc{};
+        desc.ByteWidth = sizeof(UINT) * instanceCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        HRESULT result = device->CreateBuffer(&desc, nullptr, &this->visibleBuffer);
+        if (FAILED(result)) {
+            LogWarn("Failed to create visible instance buffer\n");
+            return false;
+        }
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.NumElements = instanceCount;
+
+        result = device->CreateShaderResourceView(this->visibleBuffer, &srvDesc, &this->visibleBufferSRV);
+        if (FAILED(result)) {
+            LogWarn("Failed to create visible instance buffer SRV\n");
+            return false;
+        }
+
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc{};
+        uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.NumElements = instanceCount;
+
+        result = device->CreateUnorderedAccessView(this->visibleBuffer, &uavDesc, &this->visibleBufferUAV);
+        if (FAILED(result)) {
+            LogWarn("Failed to create visible instance buffer UAV\n");
+            return false;
+        }
+
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+        result = device->CreateBuffer(&desc, nullptr, &this->visibleStagingBuffer);
+        if (FAILED(result)) {
+            LogWarn("Failed to create visible instance staging buffer\n");
+            return false;
+        }
+    }
+
+    {
+        D3D11_BUFFER_DESC desc{};
+        desc.ByteWidth = sizeof(Draw_indexed_indirect_args) * batchCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS | D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+
+        HRESULT result = device->CreateBuffer(&desc, nullptr, &this->argsBuffer);
+        if (FAILED(result)) {
+            LogWarn("Failed to create indirect args buffer\n");
+            return false;
+        }
+
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc{};
+        uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.NumElements = desc.ByteWidth / 4;
+        uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+        result = device->CreateUnorderedAccessView(this->argsBuffer, &uavDesc, &this->argsBufferUAV);
+        if (FAILED(result)) {
+            LogWarn("Failed to create indirect args buffer UAV\n");
+            return false;
+        }
+
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+
+        result = device->CreateBuffer(&desc, nullptr, &this->argsStagingBuffer);
+        if (FAILED(result)) {
+            LogWarn("Failed to create indirect args staging buffer\n");
+            return false;
+        }
+    }
+
+    this->instanceCapacity = instanceCount;
+    this->batchCapacity = batchCount;
+
+    // Nothing has been uploaded to the new buffers yet
+    this->uploadedInstances.clear();
+    this->uploadedBatches.clear();
+
+    LogInfo("Created GPU culling buffers (%u instances, %u batches)\n", instanceCount, batchCount);
+    return true;
+}
+
+void GpuCullingSystem::ReleaseInstanceBuffers() {
+    SafeRelease(this->instanceBufferSRV);
+    SafeRelease(this->instanceBuffer);
+
+    SafeRelease(this->batchBufferSRV);
+    SafeRelease(this->batchBuffer);
+
+    SafeRelease(this->visibleBufferUAV);
+    SafeRelease(this->visibleBufferSRV);
+    SafeRelease(this->visibleBuffer);
+
+    SafeRelease(this->argsBufferUAV);
+    SafeRelease(this->argsBuffer);
+
+    SafeRelease(this->visibleStagingBuffer);
+    SafeRelease(this->argsStagingBuffer);
+
+    this->instanceCapacity = 0;
+    this->batchCapacity = 0;
+}
+
+bool GpuCullingSystem::Initialize(ID3D11Device *device, const std::string &shaderDir) {
+    LogInfo("Creating GPU culling system...\n");
+
+    this->device = device;
+
+    if (!this->LoadShaders(device, shaderDir))
+        return false;
+
+    if (!this->CreateConstantBuffers(device))
+        return false;
+
+    return true;
+}
+
+void GpuCullingSystem::Shutdown() {
+    this->ReleaseInstanceBuffers();
+
+    SafeRelease(this->cullingCS);
+    SafeRelease(this->instancedVS);
+    SafeRelease(this->cullingBuffer);
+
+    this->ClearBatches();
+    this->uploadedInstances.clear();
+    this->uploadedBatches.clear();
+}
+
+void GpuCullingSystem::Reset() {
+    this->isActive = false;
+}
+
+void GpuCullingSystem::ClearBatches() {
+    this->instances.clear();
+    this->batches.clear();
+    this->instanceBatches.clear();
+}
+
+void GpuCullingSystem::PrepareBatches(
+    ID3D11DeviceContext *deviceContext,
+    ConstantBufferRing &ring,
+    const RenderQueue &queue,
+    const Render_view &cullingView
+) {
+    this->isActive = false;
+    this->ClearBatches();
+
+    const std::vector<Geometry_command> &commands = queue.geometryCommands;
+    if (commands.empty())
+        return;
+
+    auto batchKey = [](const Geometry_command &command) {
+        return std::make_tuple(
+            reinterpret_cast<uintptr_t>(command.vertexBuffer),
+            reinterpret_cast<uintptr_t>(command.indexBuffer),
+            command.startIndex,
+            command.indexCount,
+            command.baseVertex,
+            reinterpret_cast<uintptr_t>(command.material.Get()),
+            command.isReflective
+        );
+    };
+
+    // Stable, so the instance order (and with it the uploaded data) stays the same between frames
+    std::vector<uint32_t> order(commands.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return batchKey(commands[a]) < batchKey(commands[b]);
+    });
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        const Geometry_command &command = commands[order[i]];
+
+        if (this->instanceBatches.empty() || batchKey(this->instanceBatches.back().command) != batchKey(command)) {
+            // The whole queue falls back to the CPU path, a partial set of batches is never drawn
+            if (this->instanceBatches.size() == MAX_BATCHES) {
+                if (!this->hasWarnedBatchLimit) {
+                    LogWarn("Too many instance batches for GPU culling (%u), falling back to CPU culling\n", MAX_BATCHES);
+                    this->hasWarnedBatchLimit = true;
+                }
+
+                this->ClearBatches();
+                return;
+            }
+
+            Instance_batch batch{};
+            batch.command = command;
+            batch.firstInstance = static_cast<UINT>(this->instances.size());
+            this->instanceBatches.push_back(batch);
+        }
+
+        ++this->instanceBatches.back().instanceCount;
+
+        Gpu_instance_data instance{};
+        instance.worldMatrix = command.worldMatrix;
+        XMStoreFloat4x4(
+            &instance.worldMatrixInvTranspose,
+            XMMatrixInverse(nullptr, XMMatrixTranspose(XMLoadFloat4x4(&command.worldMatrix)))
+        );
+        instance.boundsCenter  = command.worldBounds.Center;
+        instance.boundsExtents = command.worldBounds.Extents;
+
+        this->instances.push_back(instance);
+    }
+
+    for (Instance_batch &instanceBatch : this->instanceBatches) {
+        Gpu_batch_data batch{};
+        batch.firstInstance = instanceBatch.firstInstance;
+        batch.instanceCount = instanceBatch.instanceCount;
+        batch.indexCount    = instanceBatch.command.indexCount;
+        batch.startIndex    = instanceBatch.command.startIndex;
+        batch.baseVertex    = instanceBatch.command.baseVertex;
+        this->batches.push_back(batch);
+
+        Instance_batch_data batchData{};
+        batchData.firstInstance = instanceBatch.firstInstance;
+        instanceBatch.batchConstants = ring.Allocate(batchData);
+    }
+
+    XMMATRIX viewMatrix = XMLoadFloat4x4(&cullingView.viewMatrix);
+    XMMATRIX projectionMatrix = XMLoadFloat4x4(&cullingView.projectionMatrix);
+    XMFLOAT4X4 viewProjectionMatrix;
+    XMStoreFloat4x4(&viewProjectionMatrix, XMMatrixMultiply(viewMatrix, projectionMatrix));
+
+    ExtractFrustumPlanes(viewProjectionMatrix, this->cullingData.frustumPlanes);
+    this->cullingData.batchCount = static_cast<UINT>(this->batches.size());
+
+    this->UploadInstances(deviceContext);
+    if (this->instanceCapacity == 0) {
+        this->ClearBatches();
+        return;
+    }
+
+    this->stats.instanceCount = static_cast<int>(this->instances.size());
+    this->stats.batchCount = static_cast<int>(this->batches.size());
+
+    this->isActive = true;
+}
+
+void GpuCullingSystem::UploadInstances(ID3D11DeviceContext *deviceContext) {
+    const UINT instanceCount = static_cast<UINT>(this->instances.size());
+    const UINT batchCount = static_cast<UINT>(this->batches.size());
+
+    if (instanceCount > this->instanceCapacity || batchCount > this->batchCapacity) {
+        UINT newInstanceCapacity = std::max(this->instanceCapacity, 256U);
+        while (newInstanceCapacity < instanceCount)
+            newInstanceCapacity *= 2;
+
+        UINT newBatchCapacity = std::max(this->batchCapacity, 64U);
+        while (newBatchCapacity < batchCount)
+            newBatchCapacity *= 2;
+
+        if (!this->CreateInstanceBuffers(newInstanceCapacity, std::min(newBatchCapacity, MAX_BATCHES))) {
+            this->ReleaseInstanceBuffers();
+            return;
+        }
+    }
+
+    // Static scenes submit the same instances every frame, so most frames don't upload anything
+    const bool instancesChanged =
+        this->instances.size() != this->uploadedInstances.size() ||
+        memcmp(this->instances.data(), this->uploadedInstances.data(), this->instances.size() * sizeof(Gpu_instance_data)) != 0;
+
+    if (instancesChanged) {
+        D3D11_BOX box{};
+        box.right = instanceCount * sizeof(Gpu_instance_data);
+        box.bottom = box.back = 1;
+
+        deviceContext->UpdateSubresource(this->instanceBuffer, 0, &box, this->instances.data(), 0, 0);
+        this->uploadedInstances = this->instances;
+
+        ++this->stats.uploadCount;
+    }
+
+    const bool batchesChanged =
+        this->batches.size() != this->uploadedBatches.size() ||
+        memcmp(this->batches.data(), this->uploadedBatches.data(), this->batches.size() * sizeof(Gpu_batch_data)) != 0;
+
+    if (batchesChanged) {
+        D3D11_BOX box{};
+        box.right = batchCount * sizeof(Gpu_batch_data);
+        box.bottom = box.back = 1;
+
+        deviceContext->UpdateSubresource(this->batchBuffer, 0, &box, this->batches.data(), 0, 0);
+        this->uploadedBatches = this->batches;
+
+        ++this->stats.uploadCount;
+    }
+}
+
+void GpuCullingSystem::ExecuteCullingPass(
+    FrameGraph::ExecutionContext &context,
+    FrameGraph::BufferHandle visibleInstancesHandle,
+    FrameGraph::BufferHandle drawArgsHandle
+) {
+    if (!this->isActive)
+        return;
+
+    ID3D11DeviceContext *deviceContext = context.GetDeviceContext();
+    StateCache &stateCache = context.GetStateCache();
+
+    UploadConstantBuffer(deviceContext, this->cullingBuffer, this->cullingData);
+
+    stateCache.SetComputeShader(this->cullingCS);
+    stateCache.SetConstantBuffers(Shader_stage::compute, 0, 1, &this->cullingBuffer);
+
+    ID3D11ShaderResourceView *srvs[2] = {
+        this->instanceBufferSRV,
+        this->batchBufferSRV
+    };
+    stateCache.SetShaderResources(Shader_stage::compute, 0, 2, srvs);
+
+    ID3D11UnorderedAccessView *uavs[2] = {
+        context.GetUnorderedAccessView(visibleInstancesHandle),
+        context.GetUnorderedAccessView(drawArgsHandle)
+    };
+    stateCache.SetUnorderedAccessViews(0, 2, uavs);
+
+    // One group per batch, so every batch compacts its instances in a fixed order
+    deviceContext->Dispatch(this->cullingData.batchCount, 1, 1);
+
+    if (Debug::GetSetting("renderer.gpuCullingValidate", false))
+        this->ValidateAgainstReference(deviceContext);
+}
+
+void GpuCullingSystem::ValidateAgainstReference(ID3D11DeviceContext *deviceContext) {
+    std::vector<UINT> referenceVisible;
+    std::vector<Draw_indexed_indirect_args> referenceArgs;
+    CullInstances(this->instances, this->batches, this->cullingData.frustumPlanes, referenceVisible, referenceArgs);
+
+    // Stalls until the GPU catches up, debug only
+    deviceContext->CopyResource(this->visibleStagingBuffer, this->visibleBuffer);
+    deviceContext->CopyResource(this->argsStagingBuffer, this->argsBuffer);
+
+    D3D11_MAPPED_SUBRESOURCE mappedVisible;
+    HRESULT result = deviceContext->Map(this->visibleStagingBuffer, 0, D3D11_MAP_READ, 0, &mappedVisible);
+    if (FAILED(result)) {
+        LogWarn("Failed to map visible instance staging buffer\n");
+        return;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mappedArgs;
+    result = deviceContext->Map(this->argsStagingBuffer, 0, D3D11_MAP_READ, 0, &mappedArgs);
+    if (FAILED(result)) {
+        deviceContext->Unmap(this->visibleStagingBuffer, 0);
+        LogWarn("Failed to map indirect args staging buffer\n");
+        return;
+    }
+
+    const UINT *gpuVisible = static_cast<const UINT *>(mappedVisible.pData);
+    const Draw_indexed_indirect_args *gpuArgs = static_cast<const Draw_indexed_indirect_args *>(mappedArgs.pData);
+
+    for (size_t i = 0; i < referenceArgs.size(); ++i) {
+        const Draw_indexed_indirect_args &expected = referenceArgs[i];
+
+        // Only the compacted part of a batch's range is defined
+        bool isMatching =
+            memcmp(&gpuArgs[i], &expected, sizeof(Draw_indexed_indirect_args)) == 0 &&
+            memcmp(
+                gpuVisible + expected.startInstanceLocation,
+                referenceVisible.data() + expected.startInstanceLocation,
+                expected.instanceCount * sizeof(UINT)
+            ) == 0;
+
+        if (!isMatching) {
+            LogWarn("GPU culling result differs from the CPU reference in batch %zu\n", i);
+            ++this->stats.validationFailures;
+        }
+    }
+
+    deviceContext->Unmap(this->argsStagingBuffer, 0);
+    deviceContext->Unmap(this->visibleStagingBuffer, 0);
+}
+
+void GpuCullingSystem::UpdateImportedBuffers(FrameGraph &frameGraph) {
+    frameGraph.UpdateImportedBuffer(
+        this->handles.visibleInstances,
+        this->visibleBuffer,
+        this->visibleBufferSRV,
+        this->visibleBufferUAV
+    );
+
+    frameGraph.UpdateImportedBuffer(
+        this->handles.drawArgs,
+        this->argsBuffer,
+        nullptr,
+        this->argsBufferUAV
+    );
+}
+
+Gpu_culling_handles GpuCullingSystem::RegisterRenderPasses(FrameGraph &frameGraph, bool includeCullingPass) {
+    this->handles.visibleInstances = frameGraph.ImportBuffer(
+        "VisibleInstances",
+        this->visibleBuffer,
+        this->visibleBufferSRV,
+        this->visibleBufferUAV
+    );
+
+    this->handles.drawArgs = frameGraph.ImportBuffer(
+        "DrawArgs",
+        this->argsBuffer,
+        nullptr,
+        this->argsBufferUAV
+    );
+
+    if (!includeCullingPass)
+        return this->handles;
+
+    struct Culling_pass_data {
+        FrameGraph::BufferHandle visibleInstances;
+        FrameGraph::BufferHandle drawArgs;
+    };
+
+    frameGraph.AddRenderPass<Culling_pass_data>(
+        "GPU culling pass",
+        [&](Culling_pass_data &data, FrameGraph::RenderPassBuilder &builder) {
+            data.visibleInstances = builder.Write(this->handles.visibleInstances);
+            data.drawArgs         = builder.Write(this->handles.drawArgs);
+        },
+        [this](const Culling_pass_data &data, FrameGraph::ExecutionContext &context) {
+            this->ExecuteCullingPass(context, data.visibleInstances, data.drawArgs);
+        }
+    );
+
+    return this->handles;
+}
+
+void GpuCullingSystem::ResetStats() {
+    this->stats = Stats{};
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#ifndef GPU_CULLING_SYSTEM_HPP
+#define GPU_CULLING_SYSTEM_HPP
+
+#include "rendering/render_data.hpp"
+#include "rendering/render_commands.hpp"
+#include "rendering/render_view.hpp"
+#include "rendering/frame_graph.hpp"
+#include "rendering/constant_buffer_ring.hpp"
+
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+struct Gpu_culling_handles {
+    FrameGraph::BufferHandle visibleInstances = FrameGraph::INVALID_HANDLE;
+    FrameGraph::BufferHandle drawArgs = FrameGraph::INVALID_HANDLE;
+};
+
+// Draws that share mesh and material, culled and drawn as one indirect instanced draw
+struct Instance_batch {
+    Geometry_command command; // Representative command, its world matrix is unused
+    UINT firstInstance = 0;
+    UINT instanceCount = 0;
+
+    Ring_allocation batchConstants{};
+};
+
+// Culls the opaque geometry of the primary view on the GPU. Instances live in a persistent structured buffer
+// that is only re-uploaded when it changes; a compute pass compacts the visible instances of every batch and
+// writes the DrawIndexedInstancedIndirect arguments consumed by the geometry pass.
+class GpuCullingSystem {
+    friend class Renderer;
+
+public:
+    static constexpr UINT THREAD_GROUP_SIZE = 64; // Must match cs_culling.hlsl
+    static constexpr UINT MAX_BATCHES = D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION;
+
+    struct Stats {
+        int instanceCount = 0;
+        int batchCount = 0;
+        int uploadCount = 0;
+        int validationFailures = 0;
+    };
+
+    // CPU reference of cs_culling.hlsl. Uses the same operation order so results match bit for bit as long as
+    // neither side fuses multiply-adds (the shader marks its math precise).
+    static void ExtractFrustumPlanes(const XMFLOAT4X4 &viewProjectionMatrix, XMFLOAT4 outPlanes[6]);
+    static bool IsInstanceVisible(const Gpu_instance_data &instance, const XMFLOAT4 planes[6]);
+    static void CullInstances(
+        const std::vector<Gpu_instance_data> &instances,
+        const std::vector<Gpu_batch_data> &batches,
+        const XMFLOAT4 planes[6],
+        std::vector<UINT> &outVisibleInstances,
+        std::vector<Draw_indexed_indirect_args> &outArgs
+    );
+
+    // Checks the CPU reference without a device: visibility of hand-placed boxes, and compaction and draw arguments
+    // of random synthetic batches against a brute-force pass. Then times culling a large scene.
+    static void RunReferenceTest();
+    static constexpr int BENCHMARK_ITERATIONS = 100;
+
+private:
+    ID3D11Device *device = nullptr;
+
+    ID3D11ComputeShader *cullingCS = nullptr;
+    ID3D11VertexShader *instancedVS = nullptr;
+
+    ID3D11Buffer *cullingBuffer = nullptr;
+
+    ID3D11Buffer *instanceBuffer = nullptr;
+    ID3D11ShaderResourceView *instanceBufferSRV = nullptr;
+    UINT instanceCapacity = 0;
+
+    ID3D11Buffer *batchBuffer = nullptr;
+    ID3D11ShaderResourceView *batchBufferSRV = nullptr;
+    UINT batchCapacity = 0;
+
+    ID3D11Buffer *visibleBuffer = nullptr;
+    ID3D11ShaderResourceView *visibleBufferSRV = nullptr;
+    ID3D11UnorderedAccessView *visibleBufferUAV = nullptr;
+
+    ID3D11Buffer *argsBuffer = nullptr;
+    ID3D11UnorderedAccessView *argsBufferUAV = nullptr;
+
+    // Debug readback for validating against the CPU reference
+    ID3D11Buffer *visibleStagingBuffer = nullptr;
+    ID3D11Buffer *argsStagingBuffer = nullptr;
+
+    std::vector<Gpu_instance_data> instances;
+    std::vector<Gpu_batch_data> batches;
+    std::vector<Instance_batch> instanceBatches;
+
+    // What the GPU buffers currently hold
+    std::vector<Gpu_instance_data> uploadedInstances;
+    std::vector<Gpu_batch_data> uploadedBatches;
+
+    Culling_data cullingData{};
+    bool isActive = false;
+    bool hasWarnedBatchLimit = false;
+
+    Gpu_culling_handles handles;
+
+    Stats stats;
+
+    bool LoadShaders(ID3D11Device *device, const std::string &shaderDir);
+    bool CreateConstantBuffers(ID3D11Device *device);
+    bool CreateInstanceBuffers(UINT instanceCount, UINT batchCount);
+    void ReleaseInstanceBuffers();
+    void ClearBatches();
+
+    void UploadInstances(ID3D11DeviceContext *deviceContext);
+    void ValidateAgainstReference(ID3D11DeviceContext *deviceContext);
+
+    void ExecuteCullingPass(
+        FrameGraph::ExecutionContext &context,
+        FrameGraph::BufferHandle visibleInstancesHandle,
+        FrameGraph::BufferHandle drawArgsHandle
+    );
+
+    GpuCullingSystem() = default;
+
+    bool Initialize(ID3D11Device *device, const std::string &shaderDir);
+    void Shutdown();
+
+    // Groups the non-tessellated commands of the queue into batches and uploads the instance data if it changed.
+    // Must run after the commands have their material constants allocated.
+    void PrepareBatches(
+        ID3D11DeviceContext *deviceContext,
+        ConstantBufferRing &ring,
+        const RenderQueue &queue,
+        const Render_view &cullingView
+    );
+
+    // Call once per frame; batches from a frame that didn't prepare any are never drawn
+    void Reset();
+
+    // The buffers are recreated when the capacity grows, so a graph that isn't rebuilt has to be pointed at them
+    void UpdateImportedBuffers(FrameGraph &frameGraph);
+
+public:
+    // The buffers are always imported so the geometry pass can declare its reads, even without the culling pass
+    Gpu_culling_handles RegisterRenderPasses(FrameGraph &frameGraph, bool includeCullingPass);
+
+    const Stats &GetStats() const { return this->stats; }
+    void ResetStats();
+};
+
+#endif
\ No newline at end of file
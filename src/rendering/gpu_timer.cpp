@@ -0,0 +1,127 @@
+#include "gpu_timer.hpp"
+#include "core/logging.hpp"
+#include "resources/assets.hpp"
+
+GpuTimer::~GpuTimer() {
+    this->Shutdown();
+}
+
+bool GpuTimer::Initialize(ID3D11Device *device) {
+    D3D11_QUERY_DESC desc{};
+    desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+
+    for (Frame_queries &frame : this->frames) {
+        HRESULT result = device->CreateQuery(&desc, &frame.disjoint);
+        if (FAILED(result)) {
+            LogError("Failed to create GPU timer queries");
+            return false;
+        }
+    }
+
+    this->device = device;
+    return true;
+}
+
+void GpuTimer::Shutdown() {
+    for (Frame_queries &frame : this->frames) {
+        SafeRelease(frame.disjoint);
+
+        for (ID3D11Query *query : frame.timestamps)
+            query->Release();
+
+        frame.timestamps.clear();
+        frame.timestampCount = 0;
+        frame.isPending = false;
+    }
+
+    this->device = nullptr;
+    this->isInFrame = false;
+}
+
+void GpuTimer::BeginFrame(ID3D11DeviceContext *deviceContext, uint64_t frameId) {
+    if (!this->device || !deviceContext)
+        return;
+
+    Frame_queries &frame = this->frames[this->currentFrame];
+    frame.frameId = frameId;
+    frame.timestampCount = 0;
+    frame.isPending = false;
+
+    deviceContext->Begin(frame.disjoint);
+    this->isInFrame = true;
+}
+
+void GpuTimer::Timestamp(ID3D11DeviceContext *deviceContext) {
+    if (!this->isInFrame)
+        return;
+
+    Frame_queries &frame = this->frames[this->currentFrame];
+
+    // Grows to the most timestamps any frame used, then stays
+    if (frame.timestampCount == static_cast<int>(frame.timestamps.size())) {
+        D3D11_QUERY_DESC desc{};
+        desc.Query = D3D11_QUERY_TIMESTAMP;
+
+        ID3D11Query *query = nullptr;
+        if (FAILED(this->device->CreateQuery(&desc, &query))) {
+            LogWarn("Failed to create GPU timestamp query\n");
+            return;
+        }
+
+        frame.timestamps.push_back(query);
+    }
+
+    deviceContext->End(frame.timestamps[frame.timestampCount++]);
+}
+
+void GpuTimer::EndFrame(ID3D11DeviceContext *deviceContext) {
+    if (!this->isInFrame)
+        return;
+
+    Frame_queries &frame = this->frames[this->currentFrame];
+    deviceContext->End(frame.disjoint);
+
+    frame.isPending = true;
+    this->currentFrame = (this->currentFrame + 1) % QUERY_FRAME_COUNT;
+    this->isInFrame = false;
+}
+
+void GpuTimer::Poll(ID3D11DeviceContext *deviceContext, std::vector<Frame_result> &outResults) {
+    if (!this->device || !deviceContext)
+        return;
+
+    // Oldest first, the frame after the current one is the oldest
+    for (int i = 0; i < QUERY_FRAME_COUNT; ++i) {
+        Frame_queries &frame = this->frames[(this->currentFrame + i) % QUERY_FRAME_COUNT];
+        if (!frame.isPending)
+            continue;
+
+        D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+        if (deviceContext->GetData(frame.disjoint, &disjointData, sizeof(disjointData), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+            break;
+
+        frame.isPending = false;
+
+        // The timestamps are unreliable if the clock changed in between, e.g. from power management
+        if (disjointData.Disjoint || disjointData.Frequency == 0 || frame.timestampCount == 0)
+            continue;
+
+        Frame_result result;
+        result.frameId = frame.frameId;
+        result.timestamps.resize(frame.timestampCount);
+
+        // The timestamps are done once the disjoint query that encloses them is
+        UINT64 firstTime = 0;
+        for (int j = 0; j < frame.timestampCount; ++j) {
+            UINT64 time = 0;
+            deviceContext->GetData(frame.timestamps[j], &time, sizeof(time), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+
+            if (j == 0)
+                firstTime = time;
+
+            result.timestamps[j] = static_cast<double>(time - firstTime) / disjointData.Frequency * 1000.0;
+        }
+
+        outResults.push_back(std::move(result));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include <d3d11.h>
+#include <cstdint>
+#include <vector>
+
+// Records GPU timestamps within a frame using timestamp queries. Results are polled without stalling, so they lag a
+// few frames behind. A frame whose results aren't in by the time its queries are reused is dropped.
+class GpuTimer {
+public:
+    static constexpr int QUERY_FRAME_COUNT = 4;
+
+    struct Frame_result {
+        uint64_t frameId = 0;
+        std::vector<double> timestamps; // In milliseconds since the first timestamp of the frame
+    };
+
+private:
+    struct Frame_queries {
+        ID3D11Query *disjoint = nullptr;
+        std::vector<ID3D11Query *> timestamps;
+        int timestampCount = 0;
+
+        uint64_t frameId = 0;
+        bool isPending = false;
+    };
+
+    ID3D11Device *device = nullptr;
+
+    Frame_queries frames[QUERY_FRAME_COUNT];
+    int currentFrame = 0;
+    bool isInFrame = false;
+
+public:
+    GpuTimer() = default;
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer &other) = delete;
+    GpuTimer &operator=(const GpuTimer &other) = delete;
+
+    bool Initialize(ID3D11Device *device);
+    void Shutdown();
+
+    bool IsInitialized() const { return this->device != nullptr; }
+
+    void BeginFrame(ID3D11DeviceContext *deviceContext, uint64_t frameId);
+    void Timestamp(ID3D11DeviceContext *deviceContext);
+    void EndFrame(ID3D11DeviceContext *deviceContext);
+
+    // Appends the frames that finished since the last poll, oldest first
+    void Poll(ID3D11DeviceContext *deviceContext, std::vector<Frame_result> &outResults);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,395 @@
+#include "light_cluster_builder.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#undef min
+#undef max
+
+// One bit per lane of a comparison result, lane 0 in the lowest bit
+static uint32_t GetLaneMask(FXMVECTOR comparison) {
+#if defined(_XM_SSE_INTRINSICS_)
+    return static_cast<uint32_t>(_mm_movemask_ps(comparison));
+#else
+    XMUINT4 lanes;
+    XMStoreUInt4(&lanes, comparison);
+    return (lanes.x & 1) | (lanes.y & 1) << 1 | (lanes.z & 1) << 2 | (lanes.w & 1) << 3;
+#endif
+}
+
+// What is left of the squared radius after the distance along one axis, negative once the sphere can't reach
+static float GetRemainingRadiusSq(float radiusSq, float centre, float min, float max) {
+    const float distance = std::max(std::max(min - centre, centre - max), 0.0f);
+    return radiusSq - distance * distance;
+}
+
+int LightClusterBuilder::GetSlice(float depth) const {
+    if (depth <= this->grid.nearDepth)
+        return 0;
+
+    const int slice = static_cast<int>(floorf(logf(depth) * this->grid.depthScale + this->grid.depthBias));
+    return std::clamp(slice, 0, CLUSTER_COUNT_Z - 1);
+}
+
+void LightClusterBuilder::SetGrid(const XMFLOAT4X4 &projectionMatrix, float nearDepth, float farDepth) {
+    this->grid.projectionScaleX = projectionMatrix._11;
+    this->grid.projectionScaleY = projectionMatrix._22;
+    this->grid.nearDepth = nearDepth;
+    this->grid.farDepth = farDepth;
+    this->grid.depthScale = CLUSTER_COUNT_Z / logf(farDepth / nearDepth);
+    this->grid.depthBias = -logf(nearDepth) * this->grid.depthScale;
+
+    for (int z = 0; z < CLUSTER_COUNT_Z; ++z) {
+        // Neighbouring slices share their boundary exactly
+        const float sliceNear = z == 0 ? nearDepth : this->maxZ[z - 1];
+        const float sliceFar = z == CLUSTER_COUNT_Z - 1 ? farDepth : nearDepth * powf(farDepth / nearDepth, static_cast<float>(z + 1) / CLUSTER_COUNT_Z);
+
+        this->minZ[z] = sliceNear;
+        this->maxZ[z] = sliceFar;
+
+        // The tile's side planes go through the camera, so its widest extent is at one of the slice's ends
+        for (int x = 0; x < CLUSTER_COUNT_X; ++x) {
+            const float ndcMin = -1.0f + 2.0f * x / CLUSTER_COUNT_X;
+            const float ndcMax = -1.0f + 2.0f * (x + 1) / CLUSTER_COUNT_X;
+
+            this->minX[z][x] = std::min(ndcMin * sliceNear, ndcMin * sliceFar) / this->grid.projectionScaleX;
+            this->maxX[z][x] = std::max(ndcMax * sliceNear, ndcMax * sliceFar) / this->grid.projectionScaleX;
+        }
+
+        // Rows go from the top of the screen down
+        for (int y = 0; y < CLUSTER_COUNT_Y; ++y) {
+            const float ndcMax = 1.0f - 2.0f * y / CLUSTER_COUNT_Y;
+            const float ndcMin = 1.0f - 2.0f * (y + 1) / CLUSTER_COUNT_Y;
+
+            this->minY[z][y] = std::min(ndcMin * sliceNear, ndcMin * sliceFar) / this->grid.projectionScaleY;
+            this->maxY[z][y] = std::max(ndcMax * sliceNear, ndcMax * sliceFar) / this->grid.projectionScaleY;
+        }
+    }
+}
+
+bool LightClusterBuilder::GetClusterCoordinates(const XMFLOAT3 &position, XMFLOAT3 &outCoordinates) const {
+    if (position.z <= this->grid.nearDepth || position.z >= this->grid.farDepth)
+        return false;
+
+    const float ndcX = position.x * this->grid.projectionScaleX / position.z;
+    const float ndcY = position.y * this->grid.projectionScaleY / position.z;
+    if (fabsf(ndcX) >= 1.0f || fabsf(ndcY) >= 1.0f)
+        return false;
+
+    outCoordinates.x = (ndcX * 0.5f + 0.5f) * CLUSTER_COUNT_X;
+    outCoordinates.y = (-ndcY * 0.5f + 0.5f) * CLUSTER_COUNT_Y;
+    outCoordinates.z = logf(position.z) * this->grid.depthScale + this->grid.depthBias;
+    return true;
+}
+
+int LightClusterBuilder::GetClusterIndex(const XMFLOAT3 &coordinates) {
+    const int x = std::clamp(static_cast<int>(coordinates.x), 0, CLUSTER_COUNT_X - 1);
+    const int y = std::clamp(static_cast<int>(coordinates.y), 0, CLUSTER_COUNT_Y - 1);
+    const int z = std::clamp(static_cast<int>(coordinates.z), 0, CLUSTER_COUNT_Z - 1);
+
+    return (z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x;
+}
+
+void LightClusterBuilder::Build(const std::vector<XMFLOAT4> &lights) {
+    this->pairClusters.clear();
+    this->pairLights.clear();
+
+    const XMVECTOR zero = XMVectorZero();
+
+    for (uint32_t light = 0; light < lights.size(); ++light) {
+        const XMFLOAT4 &sphere = lights[light];
+        const float radiusSq = sphere.w * sphere.w;
+
+        // A slice of margin on both sides, the log can round into the neighbouring slice and the distance test
+        // decides anyway
+        const int firstSlice = std::max(this->GetSlice(sphere.z - sphere.w) - 1, 0);
+        const int lastSlice = std::min(this->GetSlice(sphere.z + sphere.w) + 1, CLUSTER_COUNT_Z - 1);
+
+        const XMVECTOR centreX = XMVectorReplicate(sphere.x);
+
+        for (int z = firstSlice; z <= lastSlice; ++z) {
+            const float remainingZ = GetRemainingRadiusSq(radiusSq, sphere.z, this->minZ[z], this->maxZ[z]);
+            if (remainingZ < 0.0f)
+                continue;
+
+            // Squared x distance to every column of the slice, shared by its rows
+            XMVECTOR distanceSqX[CLUSTER_COUNT_X / 4];
+            for (int i = 0; i < CLUSTER_COUNT_X / 4; ++i) {
+                const XMVECTOR tileMinX = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A *>(&this->minX[z][i * 4]));
+                const XMVECTOR tileMaxX = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A *>(&this->maxX[z][i * 4]));
+
+                const XMVECTOR distance = XMVectorMax(XMVectorMax(tileMinX - centreX, centreX - tileMaxX), zero);
+                distanceSqX[i] = distance * distance;
+            }
+
+            for (int y = 0; y < CLUSTER_COUNT_Y; ++y) {
+                const float remaining = GetRemainingRadiusSq(remainingZ, sphere.y, this->minY[z][y], this->maxY[z][y]);
+                if (remaining < 0.0f)
+                    continue;
+
+                const XMVECTOR remainingV = XMVectorReplicate(remaining);
+
+                uint32_t mask = 0;
+                for (int i = 0; i < CLUSTER_COUNT_X / 4; ++i)
+                    mask |= GetLaneMask(XMVectorLessOrEqual(distanceSqX[i], remainingV)) << (i * 4);
+
+                const uint32_t rowCluster = (z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X;
+                for (uint32_t x = 0; mask != 0; ++x, mask >>= 1) {
+                    if (mask & 1) {
+                        this->pairClusters.push_back(rowCluster + x);
+                        this->pairLights.push_back(light);
+                    }
+                }
+            }
+        }
+    }
+
+    this->CompactPairs(static_cast<int>(lights.size()));
+}
+
+void LightClusterBuilder::BuildBruteForce(const std::vector<XMFLOAT4> &lights) {
+    this->pairClusters.clear();
+    this->pairLights.clear();
+
+    for (int z = 0; z < CLUSTER_COUNT_Z; ++z) {
+        for (int y = 0; y < CLUSTER_COUNT_Y; ++y) {
+            for (int x = 0; x < CLUSTER_COUNT_X; ++x) {
+                const uint32_t cluster = (z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x;
+
+                for (uint32_t light = 0; light < lights.size(); ++light) {
+                    const XMFLOAT4 &sphere = lights[light];
+
+                    // Same operations as Build, so the rounding matches
+                    float remaining = GetRemainingRadiusSq(sphere.w * sphere.w, sphere.z, this->minZ[z], this->maxZ[z]);
+                    remaining = GetRemainingRadiusSq(remaining, sphere.y, this->minY[z][y], this->maxY[z][y]);
+
+                    const float distanceX = std::max(std::max(this->minX[z][x] - sphere.x, sphere.x - this->maxX[z][x]), 0.0f);
+                    if (distanceX * distanceX <= remaining) {
+                        this->pairClusters.push_back(cluster);
+                        this->pairLights.push_back(light);
+                    }
+                }
+            }
+        }
+    }
+
+    this->CompactPairs(static_cast<int>(lights.size()));
+}
+
+void LightClusterBuilder::CompactPairs(int lightCount) {
+    this->clusterRanges.assign(CLUSTER_COUNT, XMUINT2(0, 0));
+    this->stats = {};
+    this->stats.lightCount = lightCount;
+
+    for (uint32_t cluster : this->pairClusters)
+        ++this->clusterRanges[cluster].y;
+
+    uint32_t offset = 0;
+    for (XMUINT2 &range : this->clusterRanges) {
+        if (range.y > static_cast<uint32_t>(MAX_LIGHTS_PER_CLUSTER)) {
+            this->stats.overflowCount += static_cast<int>(range.y) - MAX_LIGHTS_PER_CLUSTER;
+            range.y = MAX_LIGHTS_PER_CLUSTER;
+        }
+
+        this->stats.maxClusterLightCount = std::max(this->stats.maxClusterLightCount, static_cast<int>(range.y));
+
+        range.x = offset;
+        offset += range.y;
+        range.y = 0; // Counts up again while filling
+    }
+
+    // Pairs of a cluster are in increasing light order, and the fill keeps that order
+    this->lightIndices.resize(offset);
+    for (size_t i = 0; i < this->pairClusters.size(); ++i) {
+        XMUINT2 &range = this->clusterRanges[this->pairClusters[i]];
+        if (range.y < static_cast<uint32_t>(MAX_LIGHTS_PER_CLUSTER))
+            this->lightIndices[range.x + range.y++] = this->pairLights[i];
+    }
+
+    this->stats.indexCount = static_cast<int>(offset);
+}
+
+void LightClusterBuilder::RunBuilderTest() {
+    LogInfo("Light cluster builder test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    TestRandom random(12345);
+
+    // Scattered through and around a 60 degree frustum
+    auto makeLights = [&random](int count) {
+        std::vector<XMFLOAT4> lights;
+        for (int i = 0; i < count; ++i)
+            lights.push_back({ random.NextFloat(-150.0f, 150.0f), random.NextFloat(-90.0f, 90.0f), random.NextFloat(-20.0f, 240.0f), random.NextFloat(0.5f, 25.0f) });
+        return lights;
+    };
+
+    auto isSame = [](const LightClusterBuilder &a, const LightClusterBuilder &b) {
+        if (a.lightIndices != b.lightIndices)
+            return false;
+
+        for (int i = 0; i < CLUSTER_COUNT; ++i)
+            if (a.clusterRanges[i].x != b.clusterRanges[i].x || a.clusterRanges[i].y != b.clusterRanges[i].y)
+                return false;
+
+        return true;
+    };
+
+    auto contains = [](const LightClusterBuilder &builder, int cluster, uint32_t light) {
+        const XMUINT2 &range = builder.clusterRanges[cluster];
+        const auto first = builder.lightIndices.begin() + range.x;
+        return std::binary_search(first, first + range.y, light);
+    };
+
+    const float nearDepth = 0.1f;
+    const float farDepth = 200.0f;
+
+    XMFLOAT4X4 projectionMatrix;
+    XMStoreFloat4x4(&projectionMatrix, XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, nearDepth, farDepth));
+
+    // Large members, kept off the stack
+    std::vector<LightClusterBuilder> builders(2);
+    LightClusterBuilder &builder = builders[0];
+    LightClusterBuilder &reference = builders[1];
+
+    builder.SetGrid(projectionMatrix, nearDepth, farDepth);
+    reference.SetGrid(projectionMatrix, nearDepth, farDepth);
+
+    {
+        bool isMatching = true;
+        for (int scene = 0; scene < 4; ++scene) {
+            const std::vector<XMFLOAT4> lights = makeLights(256 << scene);
+            builder.Build(lights);
+            reference.BuildBruteForce(lights);
+            isMatching = isMatching && isSame(builder, reference);
+        }
+        checks.Check(isMatching, "Assignment matches brute force");
+
+        const std::vector<XMFLOAT4> lights = makeLights(1024);
+        builder.Build(lights);
+        reference.Build(lights);
+        checks.Check(isSame(builder, reference), "Assignment is deterministic");
+    }
+
+    {
+        const std::vector<XMFLOAT4> lights = {
+            { 0.0f, 0.0f, -10.0f, 5.0f },  // Behind the camera
+            { 0.0f, 0.0f, 0.0f, 1.0f },    // Around the camera
+            { 0.0f, 0.0f, 230.0f, 10.0f }, // Past the far depth
+            { 0.0f, 0.0f, 205.0f, 10.0f }, // Reaching back into the last slice
+            { 0.0f, 0.0f, 100.0f, 1000.0f } // Everywhere
+        };
+
+        builder.Build(lights);
+        reference.BuildBruteForce(lights);
+        checks.Check(isSame(builder, reference), "Edge cases match brute force");
+
+        int counts[5] = {};
+        int lastSliceCount = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; ++cluster) {
+            for (uint32_t light = 0; light < 5; ++light) {
+                if (contains(builder, cluster, light)) {
+                    ++counts[light];
+                    if (light == 3 && cluster >= CLUSTER_COUNT - CLUSTER_COUNT_X * CLUSTER_COUNT_Y)
+                        ++lastSliceCount;
+                }
+            }
+        }
+
+        checks.Check(counts[0] == 0, "Lights behind the camera touch no clusters");
+        checks.Check(counts[1] > 0, "Lights around the camera touch the first slice");
+        checks.Check(counts[2] == 0, "Lights past the far depth touch no clusters");
+        checks.Check(counts[3] > 0 && counts[3] == lastSliceCount, "Lights just past the far depth only touch the last slice");
+        checks.Check(counts[4] == CLUSTER_COUNT, "Large lights touch every cluster");
+    }
+
+    {
+        // More lights in one place than a cluster can hold
+        const std::vector<XMFLOAT4> lights(MAX_LIGHTS_PER_CLUSTER + 50, XMFLOAT4(0.0f, 0.0f, 20.0f, 2.0f));
+
+        builder.Build(lights);
+        reference.BuildBruteForce(lights);
+        checks.Check(isSame(builder, reference), "Full clusters match brute force");
+        checks.Check(builder.stats.maxClusterLightCount == MAX_LIGHTS_PER_CLUSTER && builder.stats.overflowCount > 0, "Full clusters are capped");
+
+        bool keepsFirst = true;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+            if (builder.clusterRanges[cluster].y > 0)
+                keepsFirst = keepsFirst && builder.lightIndices[builder.clusterRanges[cluster].x + builder.clusterRanges[cluster].y - 1] == builder.clusterRanges[cluster].y - 1;
+        checks.Check(keepsFirst, "Full clusters keep the most important lights");
+    }
+
+    {
+        // Points inside the lights, looked up the way cs_lighting.hlsl does
+        const std::vector<XMFLOAT4> lights = makeLights(1024);
+        builder.Build(lights);
+
+        int missingCount = 0;
+        int testedCount = 0;
+
+        auto isNearEdge = [](float coordinate) {
+            const float fraction = coordinate - floorf(coordinate);
+            return fraction < 0.001f || fraction > 0.999f;
+        };
+
+        for (uint32_t light = 0; light < lights.size(); ++light) {
+            const XMFLOAT4 &sphere = lights[light];
+
+            for (int i = 0; i < 16; ++i) {
+                XMFLOAT3 offset = { random.NextFloat(-1.0f, 1.0f), random.NextFloat(-1.0f, 1.0f), random.NextFloat(-1.0f, 1.0f) };
+                if (offset.x * offset.x + offset.y * offset.y + offset.z * offset.z > 1.0f)
+                    continue;
+
+                const XMFLOAT3 point = { sphere.x + offset.x * sphere.w, sphere.y + offset.y * sphere.w, sphere.z + offset.z * sphere.w };
+
+                XMFLOAT3 coordinates;
+                if (!builder.GetClusterCoordinates(point, coordinates))
+                    continue;
+
+                if (isNearEdge(coordinates.x) || isNearEdge(coordinates.y) || isNearEdge(coordinates.z))
+                    continue;
+
+                const int cluster = GetClusterIndex(coordinates);
+                if (!contains(builder, cluster, light))
+                    ++missingCount;
+                ++testedCount;
+            }
+        }
+
+        LogInfo("%d points inside lights looked up, %d missing from their cluster\n", testedCount, missingCount);
+        checks.Check(missingCount == 0, "Clusters hold every light reaching into them");
+    }
+
+    {
+        const std::vector<XMFLOAT4> lights = makeLights(1024);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < BENCHMARK_ITERATIONS; ++i)
+            builder.Build(lights);
+        auto end = std::chrono::high_resolution_clock::now();
+        const double buildMicroseconds = std::chrono::duration<double, std::micro>(end - start).count() / BENCHMARK_ITERATIONS;
+
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < BENCHMARK_ITERATIONS / 10; ++i)
+            reference.BuildBruteForce(lights);
+        end = std::chrono::high_resolution_clock::now();
+        const double bruteForceMicroseconds = std::chrono::duration<double, std::micro>(end - start).count() / (BENCHMARK_ITERATIONS / 10);
+
+        LogInfo(
+            "1024 lights into %d clusters: %.1f us, %.1f us brute force, %d indices, at most %d per cluster\n",
+            CLUSTER_COUNT,
+            buildMicroseconds,
+            bruteForceMicroseconds,
+            builder.stats.indexCount,
+            builder.stats.maxClusterLightCount
+        );
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef LIGHT_CLUSTER_BUILDER_HPP
+#define LIGHT_CLUSTER_BUILDER_HPP
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+using namespace DirectX;
+
+// Splits the primary view's frustum into a grid of froxels, screen tiles sliced exponentially in view depth, and
+// lists the lights whose bounding spheres touch each of them, so the lighting shader only loops over the lights
+// of its pixel's cluster.
+class LightClusterBuilder {
+public:
+    static constexpr int CLUSTER_COUNT_X = 16; // A multiple of 4, each row of tiles is tested 4 at a time
+    static constexpr int CLUSTER_COUNT_Y = 9;
+    static constexpr int CLUSTER_COUNT_Z = 24;
+    static constexpr int CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+
+    // Lights past this in a cluster are left out. Lights come in order of importance, so those are the least important.
+    static constexpr int MAX_LIGHTS_PER_CLUSTER = 128;
+    static constexpr int MAX_LIGHT_INDICES = CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER;
+
+    static_assert(CLUSTER_COUNT_X % 4 == 0);
+
+    struct Grid {
+        float projectionScaleX = 1.0f; // _11 and _22 of the projection
+        float projectionScaleY = 1.0f;
+        float nearDepth = 0.1f;
+        float farDepth = 1000.0f;
+
+        // Slice of a view depth is floor(log(depth) * depthScale + depthBias)
+        float depthScale = 0.0f;
+        float depthBias = 0.0f;
+    };
+
+    struct Stats {
+        int lightCount = 0;
+        int indexCount = 0;
+        int overflowCount = 0; // Light and cluster pairs left out of full clusters
+        int maxClusterLightCount = 0;
+    };
+
+private:
+    Grid grid;
+
+    // View space bounds of every froxel. X only depends on the column and slice and y on the row and slice, so a
+    // sphere's distance to a froxel is split into per-axis parts that are shared by whole rows and columns.
+    alignas(16) float minX[CLUSTER_COUNT_Z][CLUSTER_COUNT_X] = {};
+    alignas(16) float maxX[CLUSTER_COUNT_Z][CLUSTER_COUNT_X] = {};
+    float minY[CLUSTER_COUNT_Z][CLUSTER_COUNT_Y] = {};
+    float maxY[CLUSTER_COUNT_Z][CLUSTER_COUNT_Y] = {};
+    float minZ[CLUSTER_COUNT_Z] = {};
+    float maxZ[CLUSTER_COUNT_Z] = {};
+
+    // Per cluster offset into lightIndices and light count, the layout the lighting shader reads
+    std::vector<XMUINT2> clusterRanges;
+    std::vector<uint32_t> lightIndices;
+
+    // Scratch
+    std::vector<uint32_t> pairClusters;
+    std::vector<uint32_t> pairLights;
+
+    Stats stats;
+
+    int GetSlice(float depth) const;
+
+    // Sorts the light and cluster pairs into per-cluster lists
+    void CompactPairs(int lightCount);
+
+public:
+    // Depths bound the grid, pixels outside of them use the first or last slice
+    void SetGrid(const XMFLOAT4X4 &projectionMatrix, float nearDepth, float farDepth);
+    const Grid &GetGrid() const { return this->grid; }
+
+    // Grid coordinates of a view space position, column, row and slice before they are floored the way
+    // cs_lighting.hlsl does. False when the position is outside the grid's frustum.
+    bool GetClusterCoordinates(const XMFLOAT3 &position, XMFLOAT3 &outCoordinates) const;
+    static int GetClusterIndex(const XMFLOAT3 &coordinates);
+
+    // Lights are view space bounding spheres, centre in xyz and radius in w. Lists of every cluster hold light
+    // indices in increasing order, so the result only depends on the input.
+    void Build(const std::vector<XMFLOAT4> &lights);
+
+    // Tests every light against every cluster. Same result as Build, bit for bit.
+    void BuildBruteForce(const std::vector<XMFLOAT4> &lights);
+
+    const std::vector<XMUINT2> &GetClusterRanges() const { return this->clusterRanges; }
+    const std::vector<uint32_t> &GetLightIndices() const { return this->lightIndices; }
+    const Stats &GetStats() const { return this->stats; }
+
+    // Compares Build against BuildBruteForce on synthetic lights, checks the lookup the shader does against
+    // points inside the lights and times both
+    static void RunBuilderTest();
+    static constexpr int BENCHMARK_ITERATIONS = 100;
+};
+
+#endif
\ No newline at end of file
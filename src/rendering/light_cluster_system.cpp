@@ -0,0 +1,387 @@
+#include "light_cluster_system.hpp"
+#include "core/logging.hpp"
+#include "rendering/render_utils.hpp"
+#include "rendering/light_selector.hpp"
+#include "debugging/debug.hpp"
+
+#include <chrono>
+#include <cstring>
+
+bool LightClusterSystem::LoadShaders(ID3D11Device *device, const std::string &shaderDir) {
+    std::vector<uint8_t> bytecode;
+
+    if (!LoadShaderBytecode(shaderDir + "cs_light_clusters.cso", bytecode))
+        return false;
+
+    HRESULT result = device->CreateComputeShader(bytecode.data(), bytecode.size(), nullptr, &this->clusterCS);
+    if (FAILED(result)) {
+        LogError("Failed to create compute shader");
+        return false;
+    }
+
+    return true;
+}
+
+bool LightClusterSystem::CreateConstantBuffers(ID3D11Device *device) {
+    D3D11_BUFFER_DESC desc{};
+    desc.ByteWidth = sizeof(Light_cluster_data);
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+    HRESULT result = device->CreateBuffer(&desc, nullptr, &this->clusterBuffer);
+    if (FAILED(result)) {
+        LogError("Failed to create constant buffer");
+        return false;
+    }
+
+    return true;
+}
+
+bool LightClusterSystem::CreateClusterBuffers(ID3D11Device *device, UINT maxLightCount, UINT maxProbeCount) {
+    if (!CreateStructuredBuffer(device, sizeof(XMFLOAT4), maxLightCount, &this->lightBoundsBuffer, &this->lightBoundsBufferSRV, "Light bounds"))
+        return false;
+
+    this->lightBoundsCapacity = maxLightCount;
+
+    // Written by the compute pass or updated from the CPU build, without a UAV when only the CPU build writes it
+    auto createBuffer = [device](
+        UINT elementSize,
+        UINT elementCount,
+        ID3D11Buffer **outBuffer,
+        ID3D11ShaderResourceView **outSRV,
+        ID3D11UnorderedAccessView **outUAV,
+        const char *debugName
+    ) {
+        D3D11_BUFFER_DESC desc{};
+        desc.ByteWidth = elementSize * elementCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = outUAV ? D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS : D3D11_BIND_SHADER_RESOURCE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = elementSize;
+
+        HRESULT result = device->CreateBuffer(&desc, nullptr, outBuffer);
+        if (FAILED(result)) {
+            LogError("Failed to create buffer '%s'", debugName);
+            return false;
+        }
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.NumElements = elementCount;
+
+        result = device->CreateShaderResourceView(*outBuffer, &srvDesc, outSRV);
+        if (FAILED(result)) {
+            LogError("Failed to create SRV for '%s'", debugName);
+            return false;
+        }
+
+        if (!outUAV)
+            return true;
+
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc{};
+        uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.NumElements = elementCount;
+
+        result = device->CreateUnorderedAccessView(*outBuffer, &uavDesc, outUAV);
+        if (FAILED(result)) {
+            LogError("Failed to create UAV for '%s'", debugName);
+            return false;
+        }
+
+        return true;
+    };
+
+    if (!createBuffer(
+        sizeof(XMUINT2),
+        LightClusterBuilder::CLUSTER_COUNT,
+        &this->clusterRangeBuffer,
+        &this->clusterRangeBufferSRV,
+        &this->clusterRangeBufferUAV,
+        "Light cluster ranges"
+    ))
+        return false;
+
+    // Large enough for every cluster to be full, which is the layout the compute pass writes
+    if (!createBuffer(
+        sizeof(UINT),
+        LightClusterBuilder::MAX_LIGHT_INDICES,
+        &this->lightIndexBuffer,
+        &this->lightIndexBufferSRV,
+        &this->lightIndexBufferUAV,
+        "Light cluster indices"
+    ))
+        return false;
+
+    if (!createBuffer(
+        sizeof(XMUINT2),
+        LightClusterBuilder::CLUSTER_COUNT,
+        &this->probeRangeBuffer,
+        &this->probeRangeBufferSRV,
+        nullptr,
+        "Probe cluster ranges"
+    ))
+        return false;
+
+    // Every probe in every cluster at most, the CPU build packs the lists
+    if (!createBuffer(
+        sizeof(UINT),
+        LightClusterBuilder::CLUSTER_COUNT * maxProbeCount,
+        &this->probeIndexBuffer,
+        &this->probeIndexBufferSRV,
+        nullptr,
+        "Probe cluster indices"
+    ))
+        return false;
+
+    this->probeCapacity = maxProbeCount;
+
+    return true;
+}
+
+bool LightClusterSystem::Initialize(ID3D11Device *device, const std::string &shaderDir, UINT maxLightCount, UINT maxProbeCount) {
+    LogInfo("Creating light cluster system...\n");
+
+    this->device = device;
+
+    if (!this->LoadShaders(device, shaderDir))
+        return false;
+
+    if (!this->CreateConstantBuffers(device))
+        return false;
+
+    if (!this->CreateClusterBuffers(device, maxLightCount, maxProbeCount))
+        return false;
+
+    return true;
+}
+
+void LightClusterSystem::Shutdown() {
+    SafeRelease(this->clusterCS);
+    SafeRelease(this->clusterBuffer);
+
+    SafeRelease(this->lightBoundsBufferSRV);
+    SafeRelease(this->lightBoundsBuffer);
+
+    SafeRelease(this->clusterRangeBufferUAV);
+    SafeRelease(this->clusterRangeBufferSRV);
+    SafeRelease(this->clusterRangeBuffer);
+
+    SafeRelease(this->lightIndexBufferUAV);
+    SafeRelease(this->lightIndexBufferSRV);
+    SafeRelease(this->lightIndexBuffer);
+
+    SafeRelease(this->probeRangeBufferSRV);
+    SafeRelease(this->probeRangeBuffer);
+
+    SafeRelease(this->probeIndexBufferSRV);
+    SafeRelease(this->probeIndexBuffer);
+
+    this->lightBoundsCapacity = 0;
+    this->lightBounds.clear();
+
+    this->probeCapacity = 0;
+    this->probeViewBounds.clear();
+}
+
+void LightClusterSystem::PrepareClusters(
+    const Render_view &primaryView,
+    const std::vector<int> &spotLights,
+    const std::vector<BoundingSphere> &probeBounds
+) {
+    this->builder.SetGrid(primaryView.projectionMatrix, primaryView.nearPlane, primaryView.farPlane);
+
+    const XMMATRIX viewMatrix = XMLoadFloat4x4(&primaryView.viewMatrix);
+
+    this->probeViewBounds.clear();
+    for (const BoundingSphere &bounds : probeBounds) {
+        if (this->probeViewBounds.size() == this->probeCapacity) {
+            LogWarn("Too many reflection probes for clustering\n");
+            break;
+        }
+
+        XMFLOAT4 viewBounds;
+        XMStoreFloat4(&viewBounds, XMVector3TransformCoord(XMLoadFloat3(&bounds.Center), viewMatrix));
+        viewBounds.w = bounds.Radius;
+        this->probeViewBounds.push_back(viewBounds);
+    }
+
+    // Few probes, so the lists are always built here
+    this->probeBuilder.SetGrid(primaryView.projectionMatrix, primaryView.nearPlane, primaryView.farPlane);
+    this->probeBuilder.Build(this->probeViewBounds);
+    Debug::SetStat("reflections.clusterIndices", this->probeBuilder.GetStats().indexCount);
+
+    this->lightBounds.clear();
+    for (int commandIndex : spotLights) {
+        if (this->lightBounds.size() == this->lightBoundsCapacity) {
+            LogWarn("Too many lights for light clustering\n");
+            break;
+        }
+
+        const BoundingSphere bounds = LightSelector::ComputeConeBounds(primaryView.queue.spotLightCommands[commandIndex]);
+
+        XMFLOAT4 viewBounds;
+        XMStoreFloat4(&viewBounds, XMVector3TransformCoord(XMLoadFloat3(&bounds.Center), viewMatrix));
+        viewBounds.w = bounds.Radius;
+        this->lightBounds.push_back(viewBounds);
+    }
+
+    const LightClusterBuilder::Grid &grid = this->builder.GetGrid();
+    this->clusterData.projectionScaleX = grid.projectionScaleX;
+    this->clusterData.projectionScaleY = grid.projectionScaleY;
+    this->clusterData.nearDepth = grid.nearDepth;
+    this->clusterData.farDepth = grid.farDepth;
+    this->clusterData.lightCount = static_cast<UINT>(this->lightBounds.size());
+
+    this->isBuiltOnGpu = Debug::GetSetting("lighting.gpuClusters", false);
+    if (this->isBuiltOnGpu)
+        return;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    this->builder.Build(this->lightBounds);
+    std::chrono::duration<float, std::micro> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+    const LightClusterBuilder::Stats &stats = this->builder.GetStats();
+    Debug::SetStat("lighting.clusterBuildUs", elapsed.count());
+    Debug::SetStat("lighting.clusterIndices", stats.indexCount);
+    Debug::SetStat("lighting.clusterMaxLights", stats.maxClusterLightCount);
+    Debug::SetStat("lighting.clusterOverflow", stats.overflowCount);
+}
+
+void LightClusterSystem::UploadProbeClusters(ID3D11DeviceContext *deviceContext) {
+    const std::vector<XMUINT2> &ranges = this->probeBuilder.GetClusterRanges();
+    const std::vector<uint32_t> &indices = this->probeBuilder.GetLightIndices();
+
+    if (ranges.size() != LightClusterBuilder::CLUSTER_COUNT) {
+        LogWarn("Probe clusters weren't built this frame\n");
+        return;
+    }
+
+    deviceContext->UpdateSubresource(this->probeRangeBuffer, 0, nullptr, ranges.data(), 0, 0);
+
+    if (!indices.empty()) {
+        D3D11_BOX box{};
+        box.right = static_cast<UINT>(indices.size() * sizeof(uint32_t));
+        box.bottom = box.back = 1;
+
+        deviceContext->UpdateSubresource(this->probeIndexBuffer, 0, &box, indices.data(), 0, 0);
+    }
+}
+
+void LightClusterSystem::ExecuteClusterPass(
+    FrameGraph::ExecutionContext &context,
+    FrameGraph::BufferHandle clusterRangesHandle,
+    FrameGraph::BufferHandle lightIndicesHandle
+) {
+    ID3D11DeviceContext *deviceContext = context.GetDeviceContext();
+
+    this->UploadProbeClusters(deviceContext);
+
+    if (!this->isBuiltOnGpu) {
+        const std::vector<XMUINT2> &ranges = this->builder.GetClusterRanges();
+        const std::vector<uint32_t> &indices = this->builder.GetLightIndices();
+
+        if (ranges.size() != LightClusterBuilder::CLUSTER_COUNT) {
+            LogWarn("Light clusters weren't built this frame\n");
+            return;
+        }
+
+        deviceContext->UpdateSubresource(this->clusterRangeBuffer, 0, nullptr, ranges.data(), 0, 0);
+
+        if (!indices.empty()) {
+            D3D11_BOX box{};
+            box.right = static_cast<UINT>(indices.size() * sizeof(uint32_t));
+            box.bottom = box.back = 1;
+
+            deviceContext->UpdateSubresource(this->lightIndexBuffer, 0, &box, indices.data(), 0, 0);
+        }
+
+        return;
+    }
+
+    if (!this->lightBounds.empty()) {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        HRESULT result = deviceContext->Map(this->lightBoundsBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        if (FAILED(result)) {
+            LogWarn("Failed to map light bounds buffer\n");
+            return;
+        }
+
+        memcpy(mapped.pData, this->lightBounds.data(), this->lightBounds.size() * sizeof(XMFLOAT4));
+        deviceContext->Unmap(this->lightBoundsBuffer, 0);
+    }
+
+    UploadConstantBuffer(deviceContext, this->clusterBuffer, this->clusterData);
+
+    StateCache &stateCache = context.GetStateCache();
+
+    stateCache.SetComputeShader(this->clusterCS);
+    stateCache.SetConstantBuffers(Shader_stage::compute, 0, 1, &this->clusterBuffer);
+    stateCache.SetShaderResources(Shader_stage::compute, 0, 1, &this->lightBoundsBufferSRV);
+
+    ID3D11UnorderedAccessView *uavs[2] = {
+        context.GetUnorderedAccessView(clusterRangesHandle),
+        context.GetUnorderedAccessView(lightIndicesHandle)
+    };
+    stateCache.SetUnorderedAccessViews(0, 2, uavs);
+
+    // One thread per cluster
+    deviceContext->Dispatch((LightClusterBuilder::CLUSTER_COUNT + THREAD_GROUP_SIZE - 1) / THREAD_GROUP_SIZE, 1, 1);
+
+    stateCache.SetComputeShader(nullptr);
+}
+
+Light_cluster_handles LightClusterSystem::RegisterRenderPasses(FrameGraph &frameGraph) {
+    Light_cluster_handles handles;
+
+    handles.clusterRanges = frameGraph.ImportBuffer(
+        "LightClusterRanges",
+        this->clusterRangeBuffer,
+        this->clusterRangeBufferSRV,
+        this->clusterRangeBufferUAV
+    );
+
+    handles.lightIndices = frameGraph.ImportBuffer(
+        "LightClusterIndices",
+        this->lightIndexBuffer,
+        this->lightIndexBufferSRV,
+        this->lightIndexBufferUAV
+    );
+
+    handles.probeClusterRanges = frameGraph.ImportBuffer(
+        "ProbeClusterRanges",
+        this->probeRangeBuffer,
+        this->probeRangeBufferSRV
+    );
+
+    handles.probeIndices = frameGraph.ImportBuffer(
+        "ProbeClusterIndices",
+        this->probeIndexBuffer,
+        this->probeIndexBufferSRV
+    );
+
+    struct Light_cluster_pass_data {
+        FrameGraph::BufferHandle clusterRanges;
+        FrameGraph::BufferHandle lightIndices;
+        FrameGraph::BufferHandle probeClusterRanges;
+        FrameGraph::BufferHandle probeIndices;
+    };
+
+    frameGraph.AddRenderPass<Light_cluster_pass_data>(
+        "Light cluster pass",
+        [&](Light_cluster_pass_data &data, FrameGraph::RenderPassBuilder &builder) {
+            data.clusterRanges = builder.Write(handles.clusterRanges);
+            data.lightIndices  = builder.Write(handles.lightIndices);
+
+            data.probeClusterRanges = builder.Write(handles.probeClusterRanges);
+            data.probeIndices       = builder.Write(handles.probeIndices);
+        },
+        [this](const Light_cluster_pass_data &data, FrameGraph::ExecutionContext &context) {
+            this->ExecuteClusterPass(context, data.clusterRanges, data.lightIndices);
+        }
+    );
+
+    return handles;
+}
\ No newline at end of file
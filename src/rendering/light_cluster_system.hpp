@@ -0,0 +1,96 @@
+#ifndef LIGHT_CLUSTER_SYSTEM_HPP
+#define LIGHT_CLUSTER_SYSTEM_HPP
+
+#include "rendering/render_data.hpp"
+#include "rendering/render_view.hpp"
+#include "rendering/frame_graph.hpp"
+#include "rendering/light_cluster_builder.hpp"
+
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+struct Light_cluster_handles {
+    FrameGraph::BufferHandle clusterRanges = FrameGraph::INVALID_HANDLE;
+    FrameGraph::BufferHandle lightIndices = FrameGraph::INVALID_HANDLE;
+
+    FrameGraph::BufferHandle probeClusterRanges = FrameGraph::INVALID_HANDLE;
+    FrameGraph::BufferHandle probeIndices = FrameGraph::INVALID_HANDLE;
+};
+
+// Lists the spot lights reaching into each cluster of the primary view for the lighting pass. The lists are built
+// on the CPU by LightClusterBuilder and uploaded, or built by a compute pass from the uploaded light bounds. Light
+// indices refer to the spot light buffer, so the lights have to come in the order they are uploaded in. Reflection
+// probe influence spheres get lists of their own on the same grid, always built on the CPU as there are few of them.
+class LightClusterSystem {
+    friend class Renderer;
+
+public:
+    static constexpr UINT THREAD_GROUP_SIZE = 64; // Must match cs_light_clusters.hlsl
+
+private:
+    ID3D11Device *device = nullptr;
+
+    ID3D11ComputeShader *clusterCS = nullptr;
+    ID3D11Buffer *clusterBuffer = nullptr;
+
+    ID3D11Buffer *lightBoundsBuffer = nullptr;
+    ID3D11ShaderResourceView *lightBoundsBufferSRV = nullptr;
+    UINT lightBoundsCapacity = 0;
+
+    ID3D11Buffer *clusterRangeBuffer = nullptr;
+    ID3D11ShaderResourceView *clusterRangeBufferSRV = nullptr;
+    ID3D11UnorderedAccessView *clusterRangeBufferUAV = nullptr;
+
+    ID3D11Buffer *lightIndexBuffer = nullptr;
+    ID3D11ShaderResourceView *lightIndexBufferSRV = nullptr;
+    ID3D11UnorderedAccessView *lightIndexBufferUAV = nullptr;
+
+    ID3D11Buffer *probeRangeBuffer = nullptr;
+    ID3D11ShaderResourceView *probeRangeBufferSRV = nullptr;
+
+    ID3D11Buffer *probeIndexBuffer = nullptr;
+    ID3D11ShaderResourceView *probeIndexBufferSRV = nullptr;
+    UINT probeCapacity = 0;
+
+    LightClusterBuilder builder;
+    std::vector<XMFLOAT4> lightBounds; // View space, centre and radius
+
+    LightClusterBuilder probeBuilder;
+    std::vector<XMFLOAT4> probeViewBounds;
+    Light_cluster_data clusterData{};
+    bool isBuiltOnGpu = false;
+
+    bool LoadShaders(ID3D11Device *device, const std::string &shaderDir);
+    bool CreateConstantBuffers(ID3D11Device *device);
+    bool CreateClusterBuffers(ID3D11Device *device, UINT maxLightCount, UINT maxProbeCount);
+
+    void ExecuteClusterPass(
+        FrameGraph::ExecutionContext &context,
+        FrameGraph::BufferHandle clusterRangesHandle,
+        FrameGraph::BufferHandle lightIndicesHandle
+    );
+    void UploadProbeClusters(ID3D11DeviceContext *deviceContext);
+
+    LightClusterSystem() = default;
+
+    bool Initialize(ID3D11Device *device, const std::string &shaderDir, UINT maxLightCount, UINT maxProbeCount);
+    void Shutdown();
+
+public:
+    // Lights are indices into the view's spot light commands and probes world space influence spheres, both in
+    // upload order
+    void PrepareClusters(
+        const Render_view &primaryView,
+        const std::vector<int> &spotLights,
+        const std::vector<BoundingSphere> &probeBounds
+    );
+    Light_cluster_handles RegisterRenderPasses(FrameGraph &frameGraph);
+
+    const LightClusterBuilder::Grid &GetGrid() const { return this->builder.GetGrid(); }
+};
+
+#endif
\ No newline at end of file
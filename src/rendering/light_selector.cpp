@@ -0,0 +1,226 @@
+#include "light_selector.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#undef min
+#undef max
+
+BoundingSphere LightSelector::ComputeConeBounds(const Spot_light_command &command) {
+    XMVECTOR apex = XMLoadFloat3(&command.position);
+    XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&command.direction));
+
+    // Wide cones are bounded by their cap, narrow ones by the sphere through the apex and the cap's rim
+    const float cosine = cosf(command.outerConeAngle);
+    float centreDistance, radius;
+    if (cosine < 0.70710678f) {
+        centreDistance = command.range * cosine;
+        radius = command.range * sinf(command.outerConeAngle);
+    }
+    else {
+        centreDistance = radius = command.range / (2.0f * cosine);
+    }
+
+    BoundingSphere bounds;
+    XMStoreFloat3(&bounds.Center, apex + direction * centreDistance);
+    bounds.Radius = radius;
+
+    return bounds;
+}
+
+float LightSelector::ComputeScore(const Candidate &candidate, const Camera &camera) {
+    const float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&candidate.bounds.Center) - XMLoadFloat3(&camera.position)));
+    const float radius = candidate.bounds.Radius;
+
+    if (distance <= radius)
+        return candidate.intensity;
+
+    // Half height of the sphere's silhouette over the screen's half height
+    const float coverage = std::min(radius * camera.projectionScale / sqrtf(distance * distance - radius * radius), 1.0f);
+    return coverage * coverage * candidate.intensity;
+}
+
+void LightSelector::Select(
+    const std::vector<Candidate> &candidates,
+    const Camera &camera,
+    int maxLights,
+    int maxShadowed,
+    Selection &outSelection
+) {
+    outSelection.lights.clear();
+    outSelection.shadowed.clear();
+    outSelection.culledCount = 0;
+    outSelection.droppedCount = 0;
+
+    struct Ranked {
+        int index;
+        float score;
+        float rank; // With the head start
+    };
+
+    auto isHigher = [&candidates](const Ranked &a, const Ranked &b) {
+        if (a.rank != b.rank)
+            return a.rank > b.rank;
+
+        return candidates[a.index].id < candidates[b.index].id;
+    };
+
+    std::vector<Ranked> ranked;
+    for (int i = 0; i < candidates.size(); ++i) {
+        const Candidate &candidate = candidates[i];
+
+        if (camera.frustum.Contains(candidate.bounds) == DISJOINT) {
+            ++outSelection.culledCount;
+            continue;
+        }
+
+        const float score = ComputeScore(candidate, camera);
+        const float rank = this->selectedLights.count(candidate.id) ? score * HYSTERESIS : score;
+        ranked.push_back({ i, score, rank });
+    }
+
+    std::sort(ranked.begin(), ranked.end(), isHigher);
+
+    if (ranked.size() > maxLights) {
+        outSelection.droppedCount = static_cast<int>(ranked.size()) - maxLights;
+        ranked.resize(maxLights);
+    }
+
+    // Shadows are ranked on their own, so holding on to a light doesn't also hold on to its shadow
+    std::vector<Ranked> shadowRanked;
+    for (const Ranked &light : ranked) {
+        const Candidate &candidate = candidates[light.index];
+        outSelection.lights.push_back(light.index);
+
+        if (candidate.castsShadows)
+            shadowRanked.push_back({ light.index, light.score, this->shadowedLights.count(candidate.id) ? light.score * HYSTERESIS : light.score });
+    }
+
+    std::sort(shadowRanked.begin(), shadowRanked.end(), isHigher);
+    if (shadowRanked.size() > maxShadowed)
+        shadowRanked.resize(maxShadowed);
+
+    for (const Ranked &light : shadowRanked)
+        outSelection.shadowed.push_back(light.index);
+
+    this->selectedLights.clear();
+    for (int index : outSelection.lights)
+        this->selectedLights.insert(candidates[index].id);
+
+    this->shadowedLights.clear();
+    for (int index : outSelection.shadowed)
+        this->shadowedLights.insert(candidates[index].id);
+}
+
+void LightSelector::Reset() {
+    this->selectedLights.clear();
+    this->shadowedLights.clear();
+}
+
+void LightSelector::RunSelectionTest() {
+    LogInfo("Light selection test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    // At the origin looking down +z
+    Camera camera;
+    const XMMATRIX projectionMatrix = XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+    camera.projectionScale = XMVectorGetY(projectionMatrix.r[1]);
+    BoundingFrustum::CreateFromMatrix(camera.frustum, projectionMatrix);
+
+    auto makeLight = [](uint64_t id, float x, float y, float z, float radius, float intensity, bool castsShadows) {
+        Candidate candidate;
+        candidate.id = id;
+        candidate.bounds = BoundingSphere({ x, y, z }, radius);
+        candidate.intensity = intensity;
+        candidate.castsShadows = castsShadows;
+        return candidate;
+    };
+
+    auto contains = [](const std::vector<int> &indices, int index) {
+        return std::find(indices.begin(), indices.end(), index) != indices.end();
+    };
+
+    {
+        LightSelector selector;
+        Selection selection;
+
+        const std::vector<Candidate> candidates = {
+            makeLight(1, 0.0f, 0.0f, 10.0f, 2.0f, 1.0f, true),   // Close
+            makeLight(2, 0.0f, 0.0f, 80.0f, 2.0f, 1.0f, true),   // Far
+            makeLight(3, 0.0f, 0.0f, -20.0f, 2.0f, 10.0f, true), // Behind the camera
+            makeLight(4, 0.0f, 0.0f, 80.0f, 2.0f, 200.0f, false), // Far but bright
+            makeLight(5, 0.0f, 0.0f, 0.5f, 3.0f, 0.1f, true)     // Around the camera
+        };
+
+        selector.Select(candidates, camera, 8, 8, selection);
+
+        checks.Check(selection.culledCount == 1 && !contains(selection.lights, 2), "Lights outside the frustum are culled");
+        checks.Check(selection.lights.size() == 4, "Every visible light fits the budget");
+        checks.Check(selection.lights[0] == 3, "Brightness outweighs distance");
+        checks.Check(
+            std::find(selection.lights.begin(), selection.lights.end(), 0) < std::find(selection.lights.begin(), selection.lights.end(), 1),
+            "Closer lights rank higher"
+        );
+        checks.Check(ComputeScore(candidates[4], camera) == candidates[4].intensity, "A camera inside a light sees all of it");
+        checks.Check(!contains(selection.shadowed, 3) && selection.shadowed.size() == 3, "Only shadow casters get shadows");
+
+        selector.Select(candidates, camera, 2, 1, selection);
+        checks.Check(selection.lights.size() == 2 && selection.droppedCount == 2, "The light budget holds");
+        checks.Check(selection.shadowed.size() == 1 && contains(selection.lights, selection.shadowed[0]), "Shadowed lights are a part of the selected ones");
+    }
+
+    {
+        // Two lights at the edge of the budget trading places within the head start
+        const int frameCount = 200;
+        int switchCount[2] = {};
+
+        for (int pass = 0; pass < 2; ++pass) {
+            LightSelector selector;
+            Selection selection;
+            int previous = -1;
+
+            for (int frame = 0; frame < frameCount; ++frame) {
+                const float wobble = (frame % 2 == 0 ? 1.1f : 0.9f);
+
+                std::vector<Candidate> candidates = {
+                    makeLight(1, 0.0f, 0.0f, 20.0f, 2.0f, 1.0f * wobble, true),
+                    makeLight(2, 1.0f, 0.0f, 20.0f, 2.0f, 1.0f / wobble, true)
+                };
+
+                if (pass == 1)
+                    selector.Reset(); // No memory of last frame, as without hysteresis
+
+                selector.Select(candidates, camera, 1, 1, selection);
+
+                const int picked = selection.lights.empty() ? -1 : selection.lights[0];
+                if (previous >= 0 && picked != previous)
+                    ++switchCount[pass];
+                previous = picked;
+            }
+        }
+
+        LogInfo(
+            "Two lights within %.0f%% of each other over %d frames: %d switches, %d without hysteresis\n",
+            (HYSTERESIS - 1.0f) * 100.0f,
+            frameCount,
+            switchCount[0],
+            switchCount[1]
+        );
+        checks.Check(switchCount[0] == 0, "Lights close in score don't take turns");
+
+        // A clear winner still takes over
+        LightSelector selector;
+        Selection selection;
+        selector.Select({ makeLight(1, 0.0f, 0.0f, 20.0f, 2.0f, 1.0f, true), makeLight(2, 0.0f, 0.0f, 20.0f, 2.0f, 0.5f, true) }, camera, 1, 1, selection);
+        selector.Select({ makeLight(1, 0.0f, 0.0f, 20.0f, 2.0f, 1.0f, true), makeLight(2, 0.0f, 0.0f, 20.0f, 2.0f, 2.0f, true) }, camera, 1, 1, selection);
+        checks.Check(selection.lights.size() == 1 && selection.lights[0] == 1, "A much more important light replaces the old one");
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef LIGHT_SELECTOR_HPP
+#define LIGHT_SELECTOR_HPP
+
+#include "rendering/render_commands.hpp"
+
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+using namespace DirectX;
+
+// Picks which spot lights get uploaded and which of those get shadows when there are more than the budgets allow.
+// Lights are ranked by how much of the screen they can light, and lights picked last frame get a head start so
+// two similar lights at the edge of a budget don't take turns. Reflection probes are picked the same way, by the
+// spheres they influence.
+class LightSelector {
+public:
+    // Scores of lights picked last frame are scaled by this
+    static constexpr float HYSTERESIS = 1.25f;
+
+    struct Candidate {
+        uint64_t id = 0;
+        BoundingSphere bounds; // Of everything the light reaches
+        float intensity = 0.0f;
+        bool castsShadows = false;
+    };
+
+    struct Camera {
+        XMFLOAT3 position{};
+        float projectionScale = 1.0f; // _22 of the projection, 1 / tan(fovY / 2)
+        BoundingFrustum frustum;      // World space
+    };
+
+    struct Selection {
+        std::vector<int> lights;   // Candidate indices, highest priority first
+        std::vector<int> shadowed; // The part of lights that gets shadows, in the same order
+        int culledCount = 0;       // Outside the frustum
+        int droppedCount = 0;      // Visible but over the light budget
+    };
+
+private:
+    std::unordered_set<uint64_t> selectedLights;
+    std::unordered_set<uint64_t> shadowedLights;
+
+public:
+    static BoundingSphere ComputeConeBounds(const Spot_light_command &command);
+
+    // Fraction of the screen height the bounds cover squared, weighted by intensity. 1 per unit of intensity
+    // once the camera is inside the bounds.
+    static float ComputeScore(const Candidate &candidate, const Camera &camera);
+
+    void Select(const std::vector<Candidate> &candidates, const Camera &camera, int maxLights, int maxShadowed, Selection &outSelection);
+
+    // Forgets last frame's picks
+    void Reset();
+
+    // Checks culling, ranking, budgets and hysteresis with synthetic lights
+    static void RunSelectionTest();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include "light_store.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#undef min
+#undef max
+
+void LightStore::AddToRanges(std::vector<Range> &ranges, int index) {
+    if (!ranges.empty() && ranges.back().first + ranges.back().count == index)
+        ++ranges.back().count;
+    else
+        ranges.push_back({ index, 1 });
+}
+
+void LightStore::BeginFrame() {
+    this->directionalCount = 0;
+    this->spotCount = 0;
+    this->directionalRanges.clear();
+    this->spotRanges.clear();
+    this->stats = {};
+
+    for (auto &[id, cached] : this->spotCache)
+        cached.isSubmitted = false;
+}
+
+void LightStore::AddDirectionalLight(const Directional_light_data &data) {
+    const int index = this->directionalCount++;
+
+    if (index == this->directionalLights.size())
+        this->directionalLights.push_back(data);
+    else if (index < this->writtenDirectionalCount && memcmp(&this->directionalLights[index], &data, sizeof(data)) == 0)
+        return;
+    else
+        this->directionalLights[index] = data;
+
+    AddToRanges(this->directionalRanges, index);
+}
+
+void LightStore::AddSpotLight(const Spot_light_command &command, const Spot_shadow &shadow) {
+    auto [it, isNew] = this->spotCache.try_emplace(command.id);
+    Cached_spot_light &cached = it->second;
+
+    if (isNew || cached.revision != command.revision) {
+        cached.revision = command.revision;
+        cached.data = PackSpotLight(command);
+
+        ++this->stats.packedCount;
+    }
+
+    cached.isSubmitted = true;
+
+    Spot_light_data data = cached.data;
+    data.shadowTileIndex = shadow.tileIndex;
+    data.shadowTexelSize = shadow.texelSize;
+    data.shadowAtlasRect = shadow.atlasRect;
+    data.viewProjectionMatrix = shadow.viewProjectionMatrix;
+
+    const int index = this->spotCount++;
+
+    if (index == this->spotLights.size())
+        this->spotLights.push_back(data);
+    else if (index < this->writtenSpotCount && memcmp(&this->spotLights[index], &data, sizeof(data)) == 0)
+        return;
+    else
+        this->spotLights[index] = data;
+
+    AddToRanges(this->spotRanges, index);
+}
+
+void LightStore::EndFrame() {
+    for (auto it = this->spotCache.begin(); it != this->spotCache.end();) {
+        if (!it->second.isSubmitted)
+            it = this->spotCache.erase(it);
+        else
+            ++it;
+    }
+
+    this->writtenDirectionalCount = std::max(this->writtenDirectionalCount, this->directionalCount);
+    this->writtenSpotCount = std::max(this->writtenSpotCount, this->spotCount);
+
+    for (const Range &range : this->directionalRanges)
+        this->stats.uploadedBytes += range.count * static_cast<int>(sizeof(Directional_light_data));
+
+    for (const Range &range : this->spotRanges)
+        this->stats.uploadedBytes += range.count * static_cast<int>(sizeof(Spot_light_data));
+
+    this->stats.uploadCount = static_cast<int>(this->directionalRanges.size() + this->spotRanges.size());
+}
+
+void LightStore::Invalidate() {
+    this->writtenDirectionalCount = 0;
+    this->writtenSpotCount = 0;
+}
+
+Spot_light_data LightStore::PackSpotLight(const Spot_light_command &command) {
+    Spot_light_data data{};
+    data.position      = command.position;
+    data.intensity     = command.intensity;
+    data.direction     = command.direction;
+    data.range         = command.range;
+    data.colour        = command.colour;
+    data.cosInnerAngle = cosf(command.innerConeAngle);
+    data.cosOuterAngle = cosf(command.outerConeAngle);
+    data.castsShadows  = command.castsShadows ? 1 : 0;
+
+    data.shadowTileIndex = -1;
+    XMStoreFloat4x4(&data.viewProjectionMatrix, XMMatrixIdentity());
+
+    return data;
+}
+
+void LightStore::RunStoreTest() {
+    LogInfo("Light store test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    TestRandom random(13579);
+
+    const int lightCount = 512;
+    const int shadowedCount = 32;
+
+    std::vector<Spot_light_command> lights(lightCount);
+    std::vector<Spot_shadow> shadows(lightCount);
+    for (int i = 0; i < lightCount; ++i) {
+        Spot_light_command &light = lights[i];
+        light.position       = { random.NextFloat(-100.0f, 100.0f), random.NextFloat(0.0f, 20.0f), random.NextFloat(-100.0f, 100.0f) };
+        light.direction      = { 0.0f, -1.0f, 0.0f };
+        light.colour         = { random.NextFloat(0.5f, 1.0f), random.NextFloat(0.5f, 1.0f), random.NextFloat(0.5f, 1.0f) };
+        light.intensity      = random.NextFloat(1.0f, 10.0f);
+        light.range          = random.NextFloat(5.0f, 30.0f);
+        light.innerConeAngle = random.NextFloat(0.2f, 0.5f);
+        light.outerConeAngle = light.innerConeAngle + 0.1f;
+        light.id             = i + 1;
+        light.revision       = 1;
+
+        if (i < shadowedCount) {
+            shadows[i].tileIndex = i;
+            shadows[i].texelSize = 1.0f / 256.0f;
+            shadows[i].atlasRect = { 0.125f, 0.125f, (i % 8) * 0.125f, (i / 8) * 0.125f };
+        }
+    }
+
+    std::vector<Directional_light_data> directionalLights(2);
+    for (int i = 0; i < directionalLights.size(); ++i) {
+        directionalLights[i] = {};
+        directionalLights[i].direction = { 0.0f, -1.0f, static_cast<float>(i) };
+        directionalLights[i].intensity = 1.0f;
+        directionalLights[i].shadowSliceIndex = -1;
+    }
+
+    // What the GPU buffers would hold, written only through the ranges
+    std::vector<Spot_light_data> spotBuffer(lightCount + 1);
+    std::vector<Directional_light_data> directionalBuffer(directionalLights.size());
+
+    LightStore store;
+
+    auto runFrame = [&]() {
+        store.BeginFrame();
+        for (const Directional_light_data &light : directionalLights)
+            store.AddDirectionalLight(light);
+        for (int i = 0; i < lights.size(); ++i)
+            store.AddSpotLight(lights[i], shadows[i]);
+        store.EndFrame();
+
+        for (const Range &range : store.GetSpotRanges())
+            memcpy(&spotBuffer[range.first], &store.GetSpotLights()[range.first], range.count * sizeof(Spot_light_data));
+        for (const Range &range : store.GetDirectionalRanges())
+            memcpy(&directionalBuffer[range.first], &store.GetDirectionalLights()[range.first], range.count * sizeof(Directional_light_data));
+    };
+
+    // Same as the upload used to do, every light packed from scratch
+    auto matchesRebuild = [&]() {
+        for (int i = 0; i < lights.size(); ++i) {
+            Spot_light_data expected = PackSpotLight(lights[i]);
+            expected.shadowTileIndex = shadows[i].tileIndex;
+            expected.shadowTexelSize = shadows[i].texelSize;
+            expected.shadowAtlasRect = shadows[i].atlasRect;
+            expected.viewProjectionMatrix = shadows[i].viewProjectionMatrix;
+
+            if (memcmp(&expected, &spotBuffer[i], sizeof(expected)) != 0)
+                return false;
+        }
+
+        for (int i = 0; i < directionalLights.size(); ++i)
+            if (memcmp(&directionalLights[i], &directionalBuffer[i], sizeof(Directional_light_data)) != 0)
+                return false;
+
+        return true;
+    };
+
+    auto hasSingleRange = [](const std::vector<Range> &ranges, int first, int count) {
+        return ranges.size() == 1 && ranges[0].first == first && ranges[0].count == count;
+    };
+
+    runFrame();
+    checks.Check(matchesRebuild(), "The first frame uploads every light");
+    checks.Check(store.GetStats().packedCount == lightCount && hasSingleRange(store.GetSpotRanges(), 0, lightCount), "The first frame packs every light in one range");
+
+    runFrame();
+    checks.Check(matchesRebuild() && store.GetStats().packedCount == 0, "Static lights aren't packed again");
+    checks.Check(store.GetStats().uploadCount == 0 && store.GetStats().uploadedBytes == 0, "A frame with static lights uploads nothing");
+    LogInfo("Static frame: %d uploads, %d bytes\n", store.GetStats().uploadCount, store.GetStats().uploadedBytes);
+
+    lights[10].intensity *= 2.0f;
+    ++lights[10].revision;
+    runFrame();
+    checks.Check(matchesRebuild(), "Changed lights are uploaded");
+    checks.Check(store.GetStats().packedCount == 1 && hasSingleRange(store.GetSpotRanges(), 10, 1), "Only the changed light is packed and uploaded");
+
+    shadows[20].atlasRect.z += 0.125f;
+    runFrame();
+    checks.Check(matchesRebuild(), "Moved shadow tiles are uploaded");
+    checks.Check(store.GetStats().packedCount == 0 && hasSingleRange(store.GetSpotRanges(), 20, 1), "Moved shadow tiles don't repack their light");
+
+    directionalLights[1].intensity = 0.5f;
+    runFrame();
+    checks.Check(matchesRebuild() && hasSingleRange(store.GetDirectionalRanges(), 1, 1) && store.GetSpotRanges().empty(), "Only the changed directional light is uploaded");
+
+    // Removing a light shifts the ones after it down
+    lights.erase(lights.begin() + 100);
+    shadows.erase(shadows.begin() + 100);
+    runFrame();
+    checks.Check(matchesRebuild() && store.GetStats().packedCount == 0, "Lights moving to other indices aren't packed again");
+
+    Spot_light_command added = lights[0];
+    added.id = lightCount + 1;
+    added.position.x += 1.0f;
+    lights.push_back(added);
+    shadows.push_back({});
+    runFrame();
+    checks.Check(matchesRebuild() && store.GetStats().packedCount == 1 && hasSingleRange(store.GetSpotRanges(), lightCount - 1, 1), "Added lights are packed and uploaded");
+
+    runFrame();
+    checks.Check(store.GetStats().uploadCount == 0, "The frame after changes uploads nothing");
+
+    store.Invalidate();
+    runFrame();
+    checks.Check(matchesRebuild() && hasSingleRange(store.GetSpotRanges(), 0, static_cast<int>(lights.size())), "Invalidating uploads everything again");
+
+    {
+        // Packing every light from scratch, the way the upload used to, against the store on a static frame
+        std::vector<Spot_light_data> rebuilt(lights.size());
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (int iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration) {
+            for (int i = 0; i < lights.size(); ++i) {
+                rebuilt[i] = PackSpotLight(lights[i]);
+                rebuilt[i].shadowTileIndex = shadows[i].tileIndex;
+                rebuilt[i].shadowTexelSize = shadows[i].texelSize;
+                rebuilt[i].shadowAtlasRect = shadows[i].atlasRect;
+                rebuilt[i].viewProjectionMatrix = shadows[i].viewProjectionMatrix;
+            }
+        }
+        std::chrono::duration<float, std::micro> rebuildElapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+        startTime = std::chrono::high_resolution_clock::now();
+        for (int iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration) {
+            store.BeginFrame();
+            for (int i = 0; i < lights.size(); ++i)
+                store.AddSpotLight(lights[i], shadows[i]);
+            store.EndFrame();
+        }
+        std::chrono::duration<float, std::micro> storeElapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+        LogInfo(
+            "%d static spot lights: rebuild %.2f us and %d bytes uploaded, store %.2f us and %d bytes uploaded\n",
+            static_cast<int>(lights.size()),
+            rebuildElapsed.count() / BENCHMARK_ITERATIONS,
+            static_cast<int>(lights.size() * sizeof(Spot_light_data)),
+            storeElapsed.count() / BENCHMARK_ITERATIONS,
+            store.GetStats().uploadedBytes
+        );
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#ifndef LIGHT_STORE_HPP
+#define LIGHT_STORE_HPP
+
+#include "rendering/render_commands.hpp"
+#include "rendering/render_data.hpp"
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace DirectX;
+
+// Keeps the light data the lighting shaders read packed between frames. Spot lights are only packed again when the
+// revision of their command changes, and only the ranges that differ from what the buffers already hold are
+// uploaded, so a frame where no light changed uploads nothing. Packed once per frame for the lighting pass and the
+// reflection probes alike.
+class LightStore {
+public:
+    // Part of a spot light that comes from its shadow atlas tile rather than the light
+    struct Spot_shadow {
+        int tileIndex = -1;
+        float texelSize = 0.0f;
+        XMFLOAT4 atlasRect = { 0.0f, 0.0f, 0.0f, 0.0f };
+        XMFLOAT4X4 viewProjectionMatrix = {
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f
+        };
+    };
+
+    // Elements to upload, first to first + count
+    struct Range {
+        int first = 0;
+        int count = 0;
+    };
+
+    struct Stats {
+        int packedCount = 0; // Spot lights that were new or changed revision
+        int uploadCount = 0; // Ranges
+        int uploadedBytes = 0;
+    };
+
+private:
+    struct Cached_spot_light {
+        uint32_t revision = 0;
+        Spot_light_data data{}; // Without the shadow part
+        bool isSubmitted = false;
+    };
+
+    std::unordered_map<uint64_t, Cached_spot_light> spotCache; // By light id
+
+    // What the buffers hold, entries past the written counts were never uploaded
+    std::vector<Directional_light_data> directionalLights;
+    std::vector<Spot_light_data> spotLights;
+    int directionalCount = 0;
+    int spotCount = 0;
+    int writtenDirectionalCount = 0;
+    int writtenSpotCount = 0;
+
+    std::vector<Range> directionalRanges;
+    std::vector<Range> spotRanges;
+
+    Stats stats;
+
+    // Appends index to the last range when it follows it
+    static void AddToRanges(std::vector<Range> &ranges, int index);
+
+public:
+    void BeginFrame();
+
+    // Lights are added in upload order, each index is one past the last
+    void AddDirectionalLight(const Directional_light_data &data);
+    void AddSpotLight(const Spot_light_command &command, const Spot_shadow &shadow);
+
+    // Forgets spot lights that weren't added this frame
+    void EndFrame();
+
+    // Forgets what the buffers hold, everything is uploaded again, e.g. after they were recreated
+    void Invalidate();
+
+    int GetDirectionalCount() const { return this->directionalCount; }
+    int GetSpotCount() const { return this->spotCount; }
+    const Directional_light_data *GetDirectionalLights() const { return this->directionalLights.data(); }
+    const Spot_light_data *GetSpotLights() const { return this->spotLights.data(); }
+
+    // Of this frame, in increasing order
+    const std::vector<Range> &GetDirectionalRanges() const { return this->directionalRanges; }
+    const std::vector<Range> &GetSpotRanges() const { return this->spotRanges; }
+
+    const Stats &GetStats() const { return this->stats; }
+
+    // Everything but the shadow part, which points at no tile
+    static Spot_light_data PackSpotLight(const Spot_light_command &command);
+
+    // Feeds synthetic lights over several frames, checks that uploading the ranges leaves the buffers equal to a
+    // full rebuild and that frames without changes upload nothing, and times both
+    static void RunStoreTest();
+    static constexpr int BENCHMARK_ITERATIONS = 1000;
+};
+
+#endif
\ No newline at end of file
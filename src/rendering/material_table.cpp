@@ -0,0 +1,604 @@
+#include "material_table.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#undef min
+#undef max
+
+static UINT BytesPerPixel(DXGI_FORMAT format) {
+    switch (format) {
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            return 8;
+
+        case DXGI_FORMAT_R8_UNORM:
+            return 1;
+
+        // Texture2DLoader only creates 8-bit RGBA textures
+        default:
+            return 4;
+    }
+}
+
+bool MaterialTable::AssignBuckets(
+    const std::vector<Texture_info> &textures,
+    std::vector<Texture_location> &outLocations,
+    std::vector<Bucket> &buckets
+) {
+    const std::vector<Bucket> previousBuckets = buckets;
+    outLocations.resize(textures.size());
+
+    for (size_t i = 0; i < textures.size(); ++i) {
+        const Texture_info &info = textures[i];
+
+        auto it = std::find_if(buckets.begin(), buckets.end(), [&](const Bucket &bucket) {
+            return bucket.info == info && bucket.sliceCount < MAX_SLICES;
+        });
+
+        if (it == buckets.end()) {
+            if (buckets.size() == MAX_BUCKETS) {
+                buckets = previousBuckets;
+                return false;
+            }
+
+            Bucket bucket{};
+            bucket.info = info;
+            buckets.push_back(bucket);
+
+            it = buckets.end() - 1;
+        }
+
+        outLocations[i].bucket = static_cast<UINT>(it - buckets.begin());
+        outLocations[i].slice  = it->sliceCount++;
+    }
+
+    return true;
+}
+
+UINT MaterialTable::GrowCapacity(UINT count, UINT capacity, UINT maxCapacity) {
+    if (count <= capacity)
+        return capacity;
+
+    UINT newCapacity = std::max(capacity, MIN_CAPACITY);
+    while (newCapacity < count)
+        newCapacity *= 2;
+
+    return std::min(newCapacity, maxCapacity);
+}
+
+uint64_t MaterialTable::CalculateTextureBytes(const Texture_info &info, UINT arraySize) {
+    uint64_t bytes = 0;
+    for (UINT mip = 0; mip < info.mipLevels; ++mip) {
+        uint64_t width  = std::max(info.width >> mip, 1U);
+        uint64_t height = std::max(info.height >> mip, 1U);
+        bytes += width * height * BytesPerPixel(info.format);
+    }
+
+    return bytes * arraySize;
+}
+
+void MaterialTable::RunPackingTest() {
+    LogInfo("Material table packing test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    auto makeInfo = [](UINT width, UINT height, UINT mipLevels, DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM) {
+        Texture_info info{};
+        info.width = width;
+        info.height = height;
+        info.mipLevels = mipLevels;
+        info.format = format;
+        return info;
+    };
+
+    // 256x256 + 128x128 + ... + 1x1 texels
+    checks.Check(CalculateTextureBytes(makeInfo(256, 256, 9), 1) == 87381 * 4, "Full mip chains add up every level");
+    checks.Check(CalculateTextureBytes(makeInfo(8, 2, 4), 1) == (16 + 4 + 2 + 1) * 4, "Non-square mips clamp to one texel");
+    checks.Check(CalculateTextureBytes(makeInfo(64, 64, 1), 6) == 6 * 64 * 64 * 4, "Bytes scale with the array size");
+    checks.Check(CalculateTextureBytes(makeInfo(64, 64, 1, DXGI_FORMAT_R16G16B16A16_FLOAT), 1) == 64 * 64 * 8, "Half float textures use 8 bytes per texel");
+    checks.Check(CalculateTextureBytes(makeInfo(64, 64, 1, DXGI_FORMAT_R8_UNORM), 1) == 64 * 64, "Single channel textures use 1 byte per texel");
+    checks.Check(CalculateTextureBytes(makeInfo(64, 64, 1), 0) == 0, "Empty arrays use no memory");
+
+    {
+        const std::vector<Texture_info> textures = {
+            makeInfo(512, 512, 10),
+            makeInfo(256, 256, 9),
+            makeInfo(512, 512, 10),
+            makeInfo(512, 512, 1),
+            makeInfo(512, 512, 10, DXGI_FORMAT_R8_UNORM),
+            makeInfo(256, 256, 9),
+        };
+
+        std::vector<Texture_location> locations;
+        std::vector<Bucket> buckets;
+        const bool isPacked = AssignBuckets(textures, locations, buckets);
+
+        checks.Check(isPacked && buckets.size() == 4, "Every distinct size, mip count and format gets its own bucket");
+        checks.Check(
+            isPacked &&
+            locations[0].bucket == 0 && locations[0].slice == 0 &&
+            locations[1].bucket == 1 && locations[1].slice == 0 &&
+            locations[2].bucket == 0 && locations[2].slice == 1 &&
+            locations[3].bucket == 2 && locations[3].slice == 0 &&
+            locations[4].bucket == 3 && locations[4].slice == 0 &&
+            locations[5].bucket == 1 && locations[5].slice == 1,
+            "Matching textures take consecutive slices of the same bucket"
+        );
+
+        // A later batch lands after the slices already in use and doesn't move the earlier textures
+        const std::vector<Bucket> previousBuckets = buckets;
+        std::vector<Texture_location> appendedLocations;
+        const bool isAppended = AssignBuckets({ makeInfo(256, 256, 9), makeInfo(128, 128, 8) }, appendedLocations, buckets);
+
+        checks.Check(
+            isAppended && buckets.size() == 5 &&
+            appendedLocations[0].bucket == 1 && appendedLocations[0].slice == 2 &&
+            appendedLocations[1].bucket == 4 && appendedLocations[1].slice == 0,
+            "Appended textures continue existing buckets and add new ones after them"
+        );
+
+        bool isPrefixKept = true;
+        for (size_t i = 0; i < previousBuckets.size(); ++i)
+            isPrefixKept = isPrefixKept && buckets[i].info == previousBuckets[i].info;
+        checks.Check(isPrefixKept, "Appending keeps the existing buckets in place");
+
+        std::vector<Texture_info> overflow;
+        for (UINT i = 0; i < MAX_BUCKETS; ++i)
+            overflow.push_back(makeInfo(16 << i, 16, 1));
+
+        const std::vector<Bucket> bucketsBeforeOverflow = buckets;
+        std::vector<Texture_location> overflowLocations;
+        const bool isOverflowPacked = AssignBuckets(overflow, overflowLocations, buckets);
+
+        bool isUnchanged = buckets.size() == bucketsBeforeOverflow.size();
+        for (size_t i = 0; isUnchanged && i < buckets.size(); ++i)
+            isUnchanged = buckets[i].info == bucketsBeforeOverflow[i].info && buckets[i].sliceCount == bucketsBeforeOverflow[i].sliceCount;
+        checks.Check(!isOverflowPacked && isUnchanged, "Needing more than MAX_BUCKETS buckets fails and leaves the buckets unchanged");
+    }
+
+    {
+        std::vector<Texture_info> textures(MAX_SLICES + 3, makeInfo(32, 32, 6));
+
+        std::vector<Texture_location> locations;
+        std::vector<Bucket> buckets;
+        const bool isPacked = AssignBuckets(textures, locations, buckets);
+
+        checks.Check(
+            isPacked && buckets.size() == 2 && buckets[0].sliceCount == MAX_SLICES && buckets[1].sliceCount == 3 &&
+            locations.back().bucket == 1 && locations.back().slice == 2,
+            "Full buckets spill into a new bucket with the same size and format"
+        );
+    }
+
+    checks.Check(GrowCapacity(0, 0, MAX_SLICES) == 0, "Nothing to hold needs no capacity");
+    checks.Check(GrowCapacity(1, 0, MAX_SLICES) == MIN_CAPACITY, "Capacity starts at MIN_CAPACITY");
+    checks.Check(GrowCapacity(3, 8, MAX_SLICES) == 8, "Capacity that still fits is kept");
+    checks.Check(GrowCapacity(9, 8, MAX_SLICES) == 16, "Capacity doubles when it runs out");
+    checks.Check(GrowCapacity(100, 8, MAX_SLICES) == 128, "Capacity doubles until it fits");
+    checks.Check(GrowCapacity(MAX_SLICES, MAX_SLICES / 2 + 1, MAX_SLICES) == MAX_SLICES, "Capacity is clamped to the maximum");
+
+    {
+        // Streams textures in the way the camera would bring materials into view, a few at a time, against
+        // a table that only ever appends
+        TestRandom random(24680);
+
+        const Texture_info sizes[] = { makeInfo(1024, 1024, 11), makeInfo(512, 512, 10), makeInfo(256, 256, 9) };
+
+        std::vector<Bucket> buckets;
+        std::vector<Texture_location> allLocations;
+        int reallocationCount = 0;
+        bool isPacked = true;
+        bool hasCapacity = true;
+        bool isUnique = true;
+
+        for (int frame = 0; frame < 200 && isPacked; ++frame) {
+            std::vector<Texture_info> textures(1 + random.NextUint(4));
+            for (Texture_info &info : textures)
+                info = sizes[random.NextUint(3)];
+
+            std::vector<Texture_location> locations;
+            isPacked = AssignBuckets(textures, locations, buckets);
+
+            for (Bucket &bucket : buckets) {
+                const UINT capacity = GrowCapacity(bucket.sliceCount, bucket.sliceCapacity, MAX_SLICES);
+                reallocationCount += capacity != bucket.sliceCapacity ? 1 : 0;
+                bucket.sliceCapacity = capacity;
+
+                hasCapacity = hasCapacity && bucket.sliceCount <= bucket.sliceCapacity;
+            }
+
+            allLocations.insert(allLocations.end(), locations.begin(), locations.end());
+        }
+
+        std::vector<std::vector<bool>> usedSlices(buckets.size());
+        for (size_t i = 0; i < buckets.size(); ++i)
+            usedSlices[i].resize(buckets[i].sliceCount, false);
+
+        for (const Texture_location &location : allLocations) {
+            isUnique = isUnique && location.bucket < buckets.size() && location.slice < usedSlices[location.bucket].size() && !usedSlices[location.bucket][location.slice];
+            if (isUnique)
+                usedSlices[location.bucket][location.slice] = true;
+        }
+
+        checks.Check(isPacked && buckets.size() == 3, "Streamed textures share one bucket per size");
+        checks.Check(isUnique, "Every streamed texture gets its own slice");
+        checks.Check(hasCapacity, "Buckets always have room for their slices");
+        checks.Check(reallocationCount <= 3 * 8, "Arrays are reallocated a logarithmic number of times");
+
+        LogInfo("%d textures streamed in over 200 frames: %d array reallocations\n", static_cast<int>(allLocations.size()), reallocationCount);
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
+
+bool MaterialTable::Material_record::operator==(const Material_record &other) const {
+    return
+        this->diffuseView == other.diffuseView &&
+        this->normalView == other.normalView &&
+        memcmp(&this->diffuseColour, &other.diffuseColour, sizeof(XMFLOAT3)) == 0 &&
+        memcmp(&this->specularColour, &other.specularColour, sizeof(XMFLOAT3)) == 0 &&
+        this->specularExponent == other.specularExponent;
+}
+
+MaterialTable::Material_record MaterialTable::MakeRecord(const Material &material) {
+    Material_record record{};
+    record.diffuseView      = material.diffuseTexture.Get()->shaderResourceView;
+    record.normalView       = material.normalTexture.Get()->shaderResourceView;
+    record.diffuseColour    = material.diffuseColour;
+    record.specularColour   = material.specularColour;
+    record.specularExponent = material.specularExponent;
+    return record;
+}
+
+MaterialTable::~MaterialTable() {
+    this->Shutdown();
+}
+
+void MaterialTable::Initialize(ID3D11Device *device, ID3D11DeviceContext *deviceContext) {
+    this->device = device;
+    this->deviceContext = deviceContext;
+}
+
+void MaterialTable::Shutdown() {
+    this->Invalidate();
+}
+
+void MaterialTable::Invalidate() {
+    this->Release();
+    this->hasFailed = false;
+}
+
+void MaterialTable::Release() {
+    for (UINT i = 0; i < MAX_BUCKETS; ++i) {
+        SafeRelease(this->bucketViews[i]);
+        SafeRelease(this->bucketTextures[i]);
+    }
+
+    SafeRelease(this->materialBufferView);
+    SafeRelease(this->materialBuffer);
+    this->materialCapacity = 0;
+
+    for (ID3D11ShaderResourceView *view : this->sourceViews)
+        view->Release();
+    this->sourceViews.clear();
+
+    this->textureInfos.clear();
+    this->textureLocations.clear();
+    this->buckets.clear();
+
+    this->materialIndices.clear();
+    this->records.clear();
+    this->entries.clear();
+
+    this->isValid = false;
+
+    const int reallocationCount = this->stats.reallocationCount;
+    this->stats = Stats{};
+    this->stats.reallocationCount = reallocationCount;
+}
+
+void MaterialTable::Update(const std::vector<Render_view> &views) {
+    if (this->hasFailed)
+        return;
+
+    std::vector<const Material *> materials;
+
+    for (const Render_view &view : views) {
+        for (const Geometry_command &command : view.queue.geometryCommands) {
+            const Material *material = command.material.Get();
+            if (!material)
+                continue;
+
+            auto it = this->materialIndices.find(material);
+            if (it != this->materialIndices.end() && this->records[it->second] == MakeRecord(*material))
+                continue;
+
+            if (std::find(materials.begin(), materials.end(), material) == materials.end())
+                materials.push_back(material);
+        }
+    }
+
+    if (materials.empty())
+        return;
+
+    // Materials that left view are kept, so moving the camera back and forth doesn't touch the arrays again
+    if (!this->Append(materials)) {
+        LogWarn("Failed to build material table, falling back to per-draw material bindings\n");
+
+        this->Release();
+        this->hasFailed = true;
+    }
+}
+
+bool MaterialTable::Append(const std::vector<const Material *> &materials) {
+    const size_t firstTexture = this->textureInfos.size();
+
+    auto addTexture = [&](ID3D11ShaderResourceView *view) -> UINT {
+        auto it = std::find(this->sourceViews.begin(), this->sourceViews.end(), view);
+        if (it != this->sourceViews.end())
+            return static_cast<UINT>(it - this->sourceViews.begin());
+
+        ID3D11Resource *resource = nullptr;
+        view->GetResource(&resource);
+
+        D3D11_TEXTURE2D_DESC desc;
+        static_cast<ID3D11Texture2D *>(resource)->GetDesc(&desc);
+        resource->Release();
+
+        Texture_info info{};
+        info.width     = desc.Width;
+        info.height    = desc.Height;
+        info.mipLevels = desc.MipLevels;
+        info.format    = desc.Format;
+
+        view->AddRef();
+        this->sourceViews.push_back(view);
+        this->textureInfos.push_back(info);
+
+        return static_cast<UINT>(this->textureInfos.size() - 1);
+    };
+
+    struct Pending_entry {
+        UINT index;
+        UINT diffuseTexture;
+        UINT normalTexture;
+    };
+
+    // Changed materials keep their index and are rewritten in place
+    std::vector<Pending_entry> pendingEntries;
+    UINT firstEntry = static_cast<UINT>(this->entries.size());
+
+    for (const Material *material : materials) {
+        const Material_record record = MakeRecord(*material);
+
+        auto [it, isNew] = this->materialIndices.try_emplace(material, static_cast<UINT>(this->records.size()));
+        const UINT index = it->second;
+
+        if (isNew) {
+            this->records.push_back(record);
+            this->entries.emplace_back();
+        }
+        else {
+            this->records[index] = record;
+        }
+
+        firstEntry = std::min(firstEntry, index);
+        pendingEntries.push_back({ index, addTexture(record.diffuseView), addTexture(record.normalView) });
+    }
+
+    std::vector<UINT> filledSliceCounts(MAX_BUCKETS, 0);
+    for (size_t i = 0; i < this->buckets.size(); ++i)
+        filledSliceCounts[i] = this->buckets[i].sliceCount;
+
+    const std::vector<Texture_info> newTextures(this->textureInfos.begin() + firstTexture, this->textureInfos.end());
+    std::vector<Texture_location> newLocations;
+    if (!AssignBuckets(newTextures, newLocations, this->buckets))
+        return false;
+
+    this->textureLocations.insert(this->textureLocations.end(), newLocations.begin(), newLocations.end());
+
+    for (UINT i = 0; i < this->buckets.size(); ++i) {
+        const Bucket &bucket = this->buckets[i];
+
+        const UINT sliceCapacity = GrowCapacity(bucket.sliceCount, bucket.sliceCapacity, MAX_SLICES);
+        if (sliceCapacity != bucket.sliceCapacity && !this->ResizeBucket(i, sliceCapacity, filledSliceCounts[i]))
+            return false;
+    }
+
+    for (size_t i = firstTexture; i < this->textureInfos.size(); ++i) {
+        const Texture_location &location = this->textureLocations[i];
+        const UINT mipLevels = this->textureInfos[i].mipLevels;
+
+        ID3D11Resource *texture = nullptr;
+        this->sourceViews[i]->GetResource(&texture);
+
+        for (UINT mip = 0; mip < mipLevels; ++mip) {
+            this->deviceContext->CopySubresourceRegion(
+                this->bucketTextures[location.bucket],
+                D3D11CalcSubresource(mip, location.slice, mipLevels),
+                0, 0, 0,
+                texture,
+                D3D11CalcSubresource(mip, 0, mipLevels),
+                nullptr
+            );
+        }
+
+        texture->Release();
+    }
+
+    for (const Pending_entry &pending : pendingEntries) {
+        const Material_record &record = this->records[pending.index];
+        const Texture_location &diffuse = this->textureLocations[pending.diffuseTexture];
+        const Texture_location &normal = this->textureLocations[pending.normalTexture];
+
+        Material_table_entry &entry = this->entries[pending.index];
+        entry = {};
+        entry.diffuseColour    = record.diffuseColour;
+        entry.specularExponent = record.specularExponent;
+        entry.specularColour   = record.specularColour;
+        entry.diffuseBucket    = diffuse.bucket;
+        entry.diffuseSlice     = diffuse.slice;
+        entry.normalBucket     = normal.bucket;
+        entry.normalSlice      = normal.slice;
+    }
+
+    if (!this->UploadEntries(firstEntry))
+        return false;
+
+    this->stats.materialCount = static_cast<int>(this->entries.size());
+    this->stats.textureCount  = static_cast<int>(this->textureInfos.size());
+    this->stats.bucketCount   = static_cast<int>(this->buckets.size());
+    this->stats.bufferBytes   = static_cast<uint64_t>(this->materialCapacity) * sizeof(Material_table_entry);
+
+    this->stats.textureBytes = 0;
+    for (const Bucket &bucket : this->buckets)
+        this->stats.textureBytes += CalculateTextureBytes(bucket.info, bucket.sliceCapacity);
+
+    LogInfo(
+        "Material table updated: %d materials, %d textures in %d buckets (%.1f KB textures, %.1f KB buffer)\n",
+        this->stats.materialCount,
+        this->stats.textureCount,
+        this->stats.bucketCount,
+        this->stats.textureBytes / 1024.0,
+        this->stats.bufferBytes / 1024.0
+    );
+
+    this->isValid = true;
+    return true;
+}
+
+bool MaterialTable::ResizeBucket(UINT bucketIndex, UINT sliceCapacity, UINT filledSliceCount) {
+    Bucket &bucket = this->buckets[bucketIndex];
+
+    D3D11_TEXTURE2D_DESC desc{};
+    desc.Width = bucket.info.width;
+    desc.Height = bucket.info.height;
+    desc.MipLevels = bucket.info.mipLevels;
+    desc.ArraySize = sliceCapacity;
+    desc.Format = bucket.info.format;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    ID3D11Texture2D *texture = nullptr;
+    HRESULT result = this->device->CreateTexture2D(&desc, nullptr, &texture);
+    if (FAILED(result)) {
+        LogWarn("Failed to create material table texture array\n");
+        return false;
+    }
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+    srvDesc.Format = desc.Format;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+    srvDesc.Texture2DArray.MipLevels = desc.MipLevels;
+    srvDesc.Texture2DArray.ArraySize = desc.ArraySize;
+
+    ID3D11ShaderResourceView *view = nullptr;
+    result = this->device->CreateShaderResourceView(texture, &srvDesc, &view);
+    if (FAILED(result)) {
+        LogWarn("Failed to create material table texture array SRV\n");
+        texture->Release();
+        return false;
+    }
+
+    // Slices that are already packed move over on the GPU instead of being copied from their sources again
+    for (UINT slice = 0; slice < filledSliceCount; ++slice) {
+        for (UINT mip = 0; mip < desc.MipLevels; ++mip) {
+            const UINT subresource = D3D11CalcSubresource(mip, slice, desc.MipLevels);
+            this->deviceContext->CopySubresourceRegion(texture, subresource, 0, 0, 0, this->bucketTextures[bucketIndex], subresource, nullptr);
+        }
+    }
+
+    SafeRelease(this->bucketViews[bucketIndex]);
+    SafeRelease(this->bucketTextures[bucketIndex]);
+    this->bucketTextures[bucketIndex] = texture;
+    this->bucketViews[bucketIndex] = view;
+
+    bucket.sliceCapacity = sliceCapacity;
+    ++this->stats.reallocationCount;
+
+    return true;
+}
+
+bool MaterialTable::UploadEntries(UINT firstEntry) {
+    const UINT entryCount = static_cast<UINT>(this->entries.size());
+
+    if (entryCount <= this->materialCapacity) {
+        D3D11_BOX box{};
+        box.left   = firstEntry * sizeof(Material_table_entry);
+        box.right  = entryCount * sizeof(Material_table_entry);
+        box.bottom = 1;
+        box.back   = 1;
+
+        this->deviceContext->UpdateSubresource(this->materialBuffer, 0, &box, &this->entries[firstEntry], 0, 0);
+        return true;
+    }
+
+    const UINT capacity = GrowCapacity(entryCount, this->materialCapacity, UINT_MAX);
+
+    std::vector<Material_table_entry> initialEntries(capacity);
+    std::copy(this->entries.begin(), this->entries.end(), initialEntries.begin());
+
+    D3D11_BUFFER_DESC desc{};
+    desc.ByteWidth = static_cast<UINT>(sizeof(Material_table_entry) * capacity);
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    desc.StructureByteStride = sizeof(Material_table_entry);
+
+    D3D11_SUBRESOURCE_DATA initialData{};
+    initialData.pSysMem = initialEntries.data();
+
+    ID3D11Buffer *buffer = nullptr;
+    HRESULT result = this->device->CreateBuffer(&desc, &initialData, &buffer);
+    if (FAILED(result)) {
+        LogWarn("Failed to create material table buffer\n");
+        return false;
+    }
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+    srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+    srvDesc.Buffer.NumElements = capacity;
+
+    ID3D11ShaderResourceView *view = nullptr;
+    result = this->device->CreateShaderResourceView(buffer, &srvDesc, &view);
+    if (FAILED(result)) {
+        LogWarn("Failed to create material table buffer SRV\n");
+        buffer->Release();
+        return false;
+    }
+
+    SafeRelease(this->materialBufferView);
+    SafeRelease(this->materialBuffer);
+    this->materialBuffer = buffer;
+    this->materialBufferView = view;
+
+    this->materialCapacity = capacity;
+    ++this->stats.reallocationCount;
+
+    return true;
+}
+
+UINT MaterialTable::GetMaterialIndex(const Material *material) const {
+    auto it = this->materialIndices.find(material);
+    if (it == this->materialIndices.end())
+        return 0;
+
+    return it->second;
+}
+
+void MaterialTable::Bind(StateCache &stateCache) const {
+    ID3D11ShaderResourceView *views[SHADER_RESOURCE_COUNT] = {};
+    for (UINT i = 0; i < MAX_BUCKETS; ++i)
+        views[i] = this->bucketViews[i];
+    views[MAX_BUCKETS] = this->materialBufferView;
+
+    stateCache.SetShaderResources(Shader_stage::pixel, 0, SHADER_RESOURCE_COUNT, views);
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#ifndef MATERIAL_TABLE_HPP
+#define MATERIAL_TABLE_HPP
+
+#include "rendering/render_data.hpp"
+#include "rendering/render_view.hpp"
+#include "rendering/state_cache.hpp"
+#include "resources/assets.hpp"
+
+#include <d3d11.h>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+// Packs every material drawn so far into one structured buffer and their textures into Texture2DArrays,
+// one array per distinct size/format ("bucket"). Passes then bind all of it once and only switch a material
+// index per draw. Materials stay in the table when they leave view, so new ones are appended to the spare
+// slices of the arrays and only grow them when they run out. Invalidate when assets are unloaded.
+class MaterialTable {
+public:
+    static constexpr UINT MAX_BUCKETS = 8; // Must match the shaders
+    static constexpr UINT MAX_SLICES = D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION;
+    static constexpr UINT MIN_CAPACITY = 4;
+
+    // Buckets in t0..t7, the material buffer in t8
+    static constexpr UINT SHADER_RESOURCE_COUNT = MAX_BUCKETS + 1;
+
+    struct Texture_info {
+        UINT width = 0;
+        UINT height = 0;
+        UINT mipLevels = 0;
+        DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+
+        bool operator==(const Texture_info &other) const {
+            return this->width == other.width && this->height == other.height && this->mipLevels == other.mipLevels && this->format == other.format;
+        }
+    };
+
+    struct Texture_location {
+        UINT bucket = 0;
+        UINT slice = 0;
+    };
+
+    struct Bucket {
+        Texture_info info;
+        UINT sliceCount = 0;
+        UINT sliceCapacity = 0; // Array size of the texture, slices past sliceCount are spare
+    };
+
+    struct Stats {
+        int materialCount = 0;
+        int textureCount = 0;
+        int bucketCount = 0;
+        uint64_t textureBytes = 0;
+        uint64_t bufferBytes = 0;
+        int reallocationCount = 0; // Arrays and buffers recreated because they ran out of room
+    };
+
+    // Places every texture in the first bucket with the same size/format that still has room, after the slices
+    // already in the buckets so earlier locations stay valid. Returns false and leaves the buckets unchanged if
+    // more than MAX_BUCKETS buckets would be needed.
+    static bool AssignBuckets(
+        const std::vector<Texture_info> &textures,
+        std::vector<Texture_location> &outLocations,
+        std::vector<Bucket> &buckets
+    );
+
+    // Capacity that fits count, doubling the current one so appending one at a time reallocates O(log n) times
+    static UINT GrowCapacity(UINT count, UINT capacity, UINT maxCapacity);
+
+    static uint64_t CalculateTextureBytes(const Texture_info &info, UINT arraySize);
+
+    // Checks bucket assignment, appending to existing buckets, capacity growth and texture sizes on synthetic
+    // textures, without a device
+    static void RunPackingTest();
+
+private:
+    // Everything a table entry is built from, so the table can tell when a material changed
+    struct Material_record {
+        ID3D11ShaderResourceView *diffuseView = nullptr;
+        ID3D11ShaderResourceView *normalView = nullptr;
+        XMFLOAT3 diffuseColour{};
+        XMFLOAT3 specularColour{};
+        float specularExponent = 0.0f;
+
+        bool operator==(const Material_record &other) const;
+    };
+
+    ID3D11Device *device = nullptr;
+    ID3D11DeviceContext *deviceContext = nullptr;
+
+    ID3D11Texture2D *bucketTextures[MAX_BUCKETS] = {};
+    ID3D11ShaderResourceView *bucketViews[MAX_BUCKETS] = {};
+
+    ID3D11Buffer *materialBuffer = nullptr;
+    ID3D11ShaderResourceView *materialBufferView = nullptr;
+
+    UINT materialCapacity = 0;
+
+    // One per texture in the arrays. Referenced so a source texture can't be freed and its address reused while
+    // the table holds a copy.
+    std::vector<ID3D11ShaderResourceView *> sourceViews;
+    std::vector<Texture_info> textureInfos;
+    std::vector<Texture_location> textureLocations;
+    std::vector<Bucket> buckets;
+
+    std::unordered_map<const Material *, UINT> materialIndices;
+    std::vector<Material_record> records;
+    std::vector<Material_table_entry> entries;
+
+    bool isValid = false;
+    bool hasFailed = false; // Not retried until invalidated
+
+    Stats stats;
+
+    static Material_record MakeRecord(const Material &material);
+
+    bool Append(const std::vector<const Material *> &materials);
+    bool ResizeBucket(UINT bucketIndex, UINT sliceCapacity, UINT filledSliceCount);
+    bool UploadEntries(UINT firstEntry);
+    void Release();
+
+public:
+    MaterialTable() = default;
+    ~MaterialTable();
+
+    MaterialTable(const MaterialTable &other) = delete;
+    MaterialTable &operator=(const MaterialTable &other) = delete;
+
+    void Initialize(ID3D11Device *device, ID3D11DeviceContext *deviceContext);
+    void Shutdown();
+
+    // Appends the materials of the views' geometry commands that the table doesn't hold yet or that changed
+    void Update(const std::vector<Render_view> &views);
+
+    // Drops every material, the next update starts over from the materials in view
+    void Invalidate();
+
+    bool IsValid() const { return this->isValid; }
+    UINT GetMaterialIndex(const Material *material) const;
+
+    // Binds the buckets and the material buffer to t0..t8 of the pixel stage
+    void Bind(StateCache &stateCache) const;
+
+    const Stats &GetStats() const { return this->stats; }
+};
+
+#endif
\ No newline at end of file
@@ -8,6 +8,7 @@ void ParticleSystem::ExecuteParticleRenderPass(
     FrameGraph::TextureHandle lightingOuputHandle
 ) {
     ID3D11DeviceContext *deviceContext = context.GetDeviceContext();
+    StateCache &stateCache = context.GetStateCache();
 
     Render_view *view = context.GetView(View_type::primary);
     if (!view || view->queue.particleEmitterCommands.empty())
@@ -16,27 +17,27 @@ void ParticleSystem::ExecuteParticleRenderPass(
     ID3D11RenderTargetView *rtv = context.GetRenderTargetView(lightingOuputHandle);
     ID3D11ShaderResourceView *depthSRV = context.GetShaderResourceView(depthHandle);
 
-    deviceContext->RSSetViewports(1, &viewport);
-    deviceContext->RSSetState(this->particleRS);
+    stateCache.SetViewport(viewport);
+    stateCache.SetRasterizerState(this->particleRS);
 
-    deviceContext->OMSetRenderTargets(1, &rtv, nullptr);
-    deviceContext->OMSetBlendState(this->additiveBlendState, nullptr, 0xFFFFFFFF);
+    stateCache.SetRenderTargets(1, &rtv, nullptr);
+    stateCache.SetBlendState(this->additiveBlendState);
 
-    deviceContext->IASetInputLayout(nullptr);
-    deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+    stateCache.SetInputLayout(nullptr);
+    stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
 
-    deviceContext->VSSetShader(this->particleVS, nullptr, 0);
-    deviceContext->GSSetShader(this->particleGS, nullptr, 0);
-    deviceContext->PSSetShader(this->particlePS, nullptr, 0);
+    stateCache.SetVertexShader(this->particleVS);
+    stateCache.SetGeometryShader(this->particleGS);
+    stateCache.SetPixelShader(this->particlePS);
 
-    deviceContext->GSSetConstantBuffers(0, 1, &sharedResources.perFrameBuffer);
-    deviceContext->GSSetConstantBuffers(1, 1, &this->visualBuffer);
+    stateCache.SetConstantBuffers(Shader_stage::geometry, 0, 1, &sharedResources.perFrameBuffer);
+    stateCache.SetConstantBuffers(Shader_stage::geometry, 1, 1, &this->visualBuffer);
 
-    deviceContext->PSSetConstantBuffers(0, 1, &this->visualBuffer);
-    deviceContext->PSSetShaderResources(1, 1, &depthSRV);
+    stateCache.SetConstantBuffers(Shader_stage::pixel, 0, 1, &this->visualBuffer);
+    stateCache.SetShaderResources(Shader_stage::pixel, 1, 1, &depthSRV);
 
-    deviceContext->CSSetShader(this->particleCS, nullptr, 0);
-    deviceContext->CSSetConstantBuffers(0, 1, &this->computeBuffer);
+    stateCache.SetComputeShader(this->particleCS);
+    stateCache.SetConstantBuffers(Shader_stage::compute, 0, 1, &this->computeBuffer);
 
     for (const Particle_emitter_command &command : view->queue.particleEmitterCommands) {
         Particle_compute_data computeData{};
@@ -46,13 +47,13 @@ void ParticleSystem::ExecuteParticleRenderPass(
 
         UploadConstantBuffer(deviceContext, this->computeBuffer, computeData);
 
-        deviceContext->CSSetUnorderedAccessViews(0, 1, &command.unorderedAccessView, nullptr);
+        stateCache.SetUnorderedAccessViews(0, 1, &command.unorderedAccessView);
 
         const UINT groups = (command.maxParticleCount + 63) / 64;
         deviceContext->Dispatch(groups, 1, 1);
 
         ID3D11UnorderedAccessView *nullUAV = nullptr;
-        deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+        stateCache.SetUnorderedAccessViews(0, 1, &nullUAV);
 
         Particle_visual_data visualData{};
         visualData.startColour = command.startColour;
@@ -64,26 +65,23 @@ void ParticleSystem::ExecuteParticleRenderPass(
 
         UploadConstantBuffer(deviceContext, this->visualBuffer, visualData);
 
-        deviceContext->VSSetShaderResources(0, 1, &command.shaderResourceView);
+        stateCache.SetShaderResources(Shader_stage::vertex, 0, 1, &command.shaderResourceView);
 
         if (Texture2D *texture = command.textureHandle.Get()) {
             ID3D11ShaderResourceView *srv = texture->shaderResourceView;
-            deviceContext->PSSetShaderResources(0, 1, &srv);
+            stateCache.SetShaderResources(Shader_stage::pixel, 0, 1, &srv);
         }
 
         deviceContext->Draw(command.maxParticleCount, 0);
     }
 
-    deviceContext->GSSetShader(nullptr, nullptr, 0);
-    deviceContext->RSSetState(nullptr);
-    deviceContext->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+    stateCache.SetGeometryShader(nullptr);
+    stateCache.SetRasterizerState(nullptr);
+    stateCache.SetBlendState(nullptr);
 
-    ID3D11RenderTargetView *nullRTV = nullptr;
-    deviceContext->OMSetRenderTargets(1, &nullRTV, nullptr);
-
-    ID3D11ShaderResourceView *nullSRVs[2] = {};
-    deviceContext->VSSetShaderResources(0, 1, nullSRVs);
-    deviceContext->PSSetShaderResources(0, 2, nullSRVs);
+    // The particle buffers aren't frame graph resources, next frame's simulation binds them as UAVs again
+    ID3D11ShaderResourceView *nullSRV = nullptr;
+    stateCache.SetShaderResources(Shader_stage::vertex, 0, 1, &nullSRV);
 }
 
 bool ParticleSystem::LoadShaders(ID3D11Device *device, const std::string &shaderDir) {
@@ -226,8 +224,7 @@ Particle_handles ParticleSystem::RegisterRenderPasses(
     const SharedResources &sharedResources,
     const D3D11_VIEWPORT &viewport,
     FrameGraph::TextureHandle depthHandle,
-    FrameGraph::TextureHandle lightingOutputHandle,
-    FrameGraph::TextureHandle lightingDummyHandle
+    FrameGraph::TextureHandle lightingOutputHandle
 ) {
     Particle_handles handles{};
 
@@ -235,20 +232,16 @@ Particle_handles ParticleSystem::RegisterRenderPasses(
         FrameGraph::TextureHandle depth;
 
         FrameGraph::TextureHandle lightingOutput;
-        FrameGraph::TextureHandle dummy;
     };
 
-    // NOTE: This pass also reads from the lightingOutput, but declaring that would likely
-    // lead to a cyclic dependency since we also declare a write on it. Instead we rely
-    // on a dummy handle to ensure the correct pass ordering.
-    // TODO: Add versioning or smth so that this isn't needed.
+    // Particles blend onto the lit image, the read orders this pass after the lighting pass
     frameGraph.AddRenderPass<Particle_pass_data>(
         "Particle pass",
         [&](Particle_pass_data &data, FrameGraph::RenderPassBuilder &builder) {
             data.depth = builder.Read(depthHandle);
 
-            data.lightingOutput = builder.Write(lightingOutputHandle);
-            data.dummy = builder.Read(lightingDummyHandle);
+            data.lightingOutput = builder.Read(lightingOutputHandle);
+            builder.Write(lightingOutputHandle);
         },
         [this, &sharedResources, &viewport](const Particle_pass_data &data, FrameGraph::ExecutionContext &context) {
             this->ExecuteParticleRenderPass(context, sharedResources, viewport, data.depth, data.lightingOutput);
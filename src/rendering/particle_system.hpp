@@ -55,8 +55,7 @@ public:
         const SharedResources &sharedResources, 
         const D3D11_VIEWPORT &viewport, 
         FrameGraph::TextureHandle depthHandle, 
-        FrameGraph::TextureHandle lightingOutputHandle, 
-        FrameGraph::TextureHandle lightingDummyHandle
+        FrameGraph::TextureHandle lightingOutputHandle
     );
 };
 
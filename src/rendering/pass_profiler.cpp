@@ -0,0 +1,251 @@
+#include "pass_profiler.hpp"
+#include "core/logging.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+static void UpdateAverage(float &average, float value, bool isFirst) {
+    if (isFirst)
+        average = value;
+    else
+        average += PassProfiler::AVERAGE_WEIGHT * (value - average);
+}
+
+static std::string EscapeJson(const std::string &str) {
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+bool PassProfiler::Initialize(ID3D11Device *device) {
+    if (!device)
+        return true;
+
+    if (!this->gpuTimer.Initialize(device)) {
+        LogWarn("Pass profiler falls back to CPU times only\n");
+        this->gpuTimer.Shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+void PassProfiler::Shutdown() {
+    this->gpuTimer.Shutdown();
+    this->pendingFrames.clear();
+}
+
+double PassProfiler::GetMicroseconds() const {
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::high_resolution_clock::now() - this->startTime;
+    return elapsed.count();
+}
+
+void PassProfiler::BeginFrame(ID3D11DeviceContext *deviceContext) {
+    // Collects whatever finished before this frame reuses the oldest queries
+    this->gpuResults.clear();
+    this->gpuTimer.Poll(deviceContext, this->gpuResults);
+
+    for (const GpuTimer::Frame_result &result : this->gpuResults)
+        this->ResolveGpuFrame(result);
+
+    this->UpdateCapture();
+
+    this->currentFrame = Frame_record{};
+    this->currentFrame.frameId = ++this->frameId;
+    this->currentFrame.cpuStart = this->GetMicroseconds();
+    this->isInFrame = true;
+
+    this->gpuTimer.BeginFrame(deviceContext, this->frameId);
+    this->gpuTimer.Timestamp(deviceContext);
+}
+
+void PassProfiler::BeginPass(const std::string &name) {
+    if (!this->isInFrame)
+        return;
+
+    Pass_record record;
+    record.name = name;
+    record.cpuStart = this->GetMicroseconds();
+    this->currentFrame.passes.push_back(record);
+}
+
+void PassProfiler::EndPass(ID3D11DeviceContext *deviceContext) {
+    if (!this->isInFrame || this->currentFrame.passes.empty())
+        return;
+
+    this->currentFrame.passes.back().cpuEnd = this->GetMicroseconds();
+    this->gpuTimer.Timestamp(deviceContext);
+}
+
+void PassProfiler::EndFrame(ID3D11DeviceContext *deviceContext) {
+    if (!this->isInFrame)
+        return;
+
+    this->isInFrame = false;
+    this->gpuTimer.EndFrame(deviceContext);
+
+    Frame_record &frame = this->currentFrame;
+    frame.cpuEnd = this->GetMicroseconds();
+
+    this->cpuFrameMilliseconds = static_cast<float>((frame.cpuEnd - frame.cpuStart) / 1000.0);
+
+    for (const Pass_record &pass : frame.passes) {
+        auto it = std::find_if(this->passStats.begin(), this->passStats.end(), [&](const Pass_stats &stats) {
+            return stats.name == pass.name;
+        });
+
+        const bool isFirst = it == this->passStats.end();
+        if (isFirst) {
+            this->passStats.emplace_back();
+            this->passStats.back().name = pass.name;
+            it = this->passStats.end() - 1;
+        }
+
+        UpdateAverage(it->cpuMilliseconds, static_cast<float>((pass.cpuEnd - pass.cpuStart) / 1000.0), isFirst);
+    }
+
+    if (this->ShouldCapture(frame.frameId)) {
+        this->traceEvents.push_back({ "Frame " + std::to_string(frame.frameId), false, frame.cpuStart, frame.cpuEnd - frame.cpuStart });
+
+        for (const Pass_record &pass : frame.passes)
+            this->traceEvents.push_back({ pass.name, false, pass.cpuStart, pass.cpuEnd - pass.cpuStart });
+    }
+
+    if (this->gpuTimer.IsInitialized() && deviceContext) {
+        this->pendingFrames.push_back(std::move(frame));
+
+        // Anything older has had its queries reused
+        while (this->pendingFrames.size() > static_cast<size_t>(GpuTimer::QUERY_FRAME_COUNT))
+            this->pendingFrames.pop_front();
+    }
+
+    this->UpdateCapture();
+}
+
+void PassProfiler::ResolveGpuFrame(const GpuTimer::Frame_result &result) {
+    // Older frames never got their results, the timestamps were disjoint
+    while (!this->pendingFrames.empty() && this->pendingFrames.front().frameId < result.frameId)
+        this->pendingFrames.pop_front();
+
+    if (this->pendingFrames.empty() || this->pendingFrames.front().frameId != result.frameId)
+        return;
+
+    const Frame_record &frame = this->pendingFrames.front();
+
+    // One timestamp at the start of the frame and one after each pass, unless a query couldn't be created
+    if (result.timestamps.size() == frame.passes.size() + 1) {
+        this->gpuFrameMilliseconds = static_cast<float>(result.timestamps.back());
+        this->hasNewGpuFrame = true;
+
+        for (size_t i = 0; i < frame.passes.size(); ++i) {
+            const float milliseconds = static_cast<float>(result.timestamps[i + 1] - result.timestamps[i]);
+
+            auto it = std::find_if(this->passStats.begin(), this->passStats.end(), [&](const Pass_stats &stats) {
+                return stats.name == frame.passes[i].name;
+            });
+
+            if (it == this->passStats.end())
+                continue;
+
+            UpdateAverage(it->gpuMilliseconds, milliseconds, !it->hasGpuTime);
+            it->hasGpuTime = true;
+        }
+
+        // The GPU clock isn't related to the CPU one, so GPU events are placed from the start of the frame on
+        // the CPU. Only their durations and order are exact.
+        if (this->ShouldCapture(frame.frameId)) {
+            this->traceEvents.push_back({ "Frame " + std::to_string(frame.frameId), true, frame.cpuStart, result.timestamps.back() * 1000.0 });
+
+            for (size_t i = 0; i < frame.passes.size(); ++i) {
+                this->traceEvents.push_back({
+                    frame.passes[i].name,
+                    true,
+                    frame.cpuStart + result.timestamps[i] * 1000.0,
+                    (result.timestamps[i + 1] - result.timestamps[i]) * 1000.0
+                });
+            }
+        }
+    }
+
+    this->pendingFrames.pop_front();
+}
+
+bool PassProfiler::PollGpuFrameMilliseconds(float &outMilliseconds) {
+    if (!this->hasNewGpuFrame)
+        return false;
+
+    this->hasNewGpuFrame = false;
+    outMilliseconds = this->gpuFrameMilliseconds;
+    return true;
+}
+
+void PassProfiler::RequestCapture(const std::string &path, int frameCount) {
+    if (this->isCapturing) {
+        LogWarn("Pass profiler is already capturing to '%s'\n", this->capturePath.c_str());
+        return;
+    }
+
+    this->capturePath = path;
+    this->captureFirstFrame = this->frameId + 1;
+    this->captureEndFrame = this->captureFirstFrame + std::max(frameCount, 1);
+    this->isCapturing = true;
+    this->traceEvents.clear();
+}
+
+bool PassProfiler::ShouldCapture(uint64_t frameId) const {
+    return this->isCapturing && frameId >= this->captureFirstFrame && frameId < this->captureEndFrame;
+}
+
+void PassProfiler::UpdateCapture() {
+    if (!this->isCapturing || this->frameId + 1 < this->captureEndFrame)
+        return;
+
+    // Waits for the GPU times of the captured frames, or until they can no longer arrive
+    for (const Frame_record &frame : this->pendingFrames)
+        if (frame.frameId < this->captureEndFrame)
+            return;
+
+    if (WriteTrace(this->capturePath, this->traceEvents))
+        LogInfo("Wrote trace of %d frames to '%s'\n", static_cast<int>(this->captureEndFrame - this->captureFirstFrame), this->capturePath.c_str());
+
+    this->isCapturing = false;
+    this->traceEvents.clear();
+}
+
+bool PassProfiler::WriteTrace(const std::string &path, const std::vector<Trace_event> &events) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        LogWarn("Unable to open '%s'\n", path.c_str());
+        return false;
+    }
+
+    // One process with a CPU and a GPU track
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+    char buffer[128];
+    for (const Trace_event &event : events) {
+        snprintf(
+            buffer,
+            sizeof(buffer),
+            "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            event.isGpu ? "gpu" : "cpu",
+            event.isGpu ? 2 : 1,
+            event.start,
+            event.duration
+        );
+
+        file << ",\n{\"name\":\"" << EscapeJson(event.name) << buffer;
+    }
+
+    file << "\n]}\n";
+    return true;
+}
\ No newline at end of file
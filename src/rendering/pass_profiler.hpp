@@ -0,0 +1,107 @@
+#ifndef PASS_PROFILER_HPP
+#define PASS_PROFILER_HPP
+
+#include "rendering/gpu_timer.hpp"
+
+#include <d3d11.h>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+// CPU and GPU time of every frame graph pass, kept as rolling averages. The GPU times arrive a few frames late, see
+// GpuTimer. Without a device or device context only the CPU side is measured.
+// A number of frames can be captured to a Chrome trace / Perfetto JSON file.
+class PassProfiler {
+public:
+    static constexpr float AVERAGE_WEIGHT = 0.05f; // Of the newest frame in the rolling averages
+
+    struct Pass_stats {
+        std::string name;
+        float cpuMilliseconds = 0.0f;
+        float gpuMilliseconds = 0.0f;
+        bool hasGpuTime = false;
+    };
+
+private:
+    struct Pass_record {
+        std::string name;
+        double cpuStart = 0.0; // In microseconds since the profiler was created
+        double cpuEnd = 0.0;
+    };
+
+    struct Frame_record {
+        uint64_t frameId = 0;
+        double cpuStart = 0.0;
+        double cpuEnd = 0.0;
+        std::vector<Pass_record> passes;
+    };
+
+    struct Trace_event {
+        std::string name;
+        bool isGpu = false;
+        double start = 0.0; // In microseconds
+        double duration = 0.0;
+    };
+
+    GpuTimer gpuTimer;
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+    uint64_t frameId = 0;
+    Frame_record currentFrame;
+    bool isInFrame = false;
+
+    // Executed frames waiting for their GPU times, the records give the timestamps their names
+    std::deque<Frame_record> pendingFrames;
+    std::vector<GpuTimer::Frame_result> gpuResults;
+
+    std::vector<Pass_stats> passStats;
+    float cpuFrameMilliseconds = 0.0f;
+    float gpuFrameMilliseconds = 0.0f;
+    bool hasNewGpuFrame = false;
+
+    std::string capturePath;
+    uint64_t captureFirstFrame = 0;
+    uint64_t captureEndFrame = 0;
+    bool isCapturing = false;
+    std::vector<Trace_event> traceEvents;
+
+    double GetMicroseconds() const;
+    void ResolveGpuFrame(const GpuTimer::Frame_result &result);
+    bool ShouldCapture(uint64_t frameId) const;
+    void UpdateCapture();
+
+    // Chrome trace event format, opens in chrome://tracing and ui.perfetto.dev
+    static bool WriteTrace(const std::string &path, const std::vector<Trace_event> &events);
+
+public:
+    PassProfiler() = default;
+
+    PassProfiler(const PassProfiler &other) = delete;
+    PassProfiler &operator=(const PassProfiler &other) = delete;
+
+    // Without a device only CPU times are measured
+    bool Initialize(ID3D11Device *device);
+    void Shutdown();
+
+    void BeginFrame(ID3D11DeviceContext *deviceContext);
+    void BeginPass(const std::string &name);
+    void EndPass(ID3D11DeviceContext *deviceContext);
+    void EndFrame(ID3D11DeviceContext *deviceContext);
+
+    const std::vector<Pass_stats> &GetPassStats() const { return this->passStats; }
+
+    // Of the newest frame, not averaged
+    float GetCpuFrameMilliseconds() const { return this->cpuFrameMilliseconds; }
+    float GetGpuFrameMilliseconds() const { return this->gpuFrameMilliseconds; }
+
+    // Returns true with the GPU time of the newest frame whose results came in since the last call
+    bool PollGpuFrameMilliseconds(float &outMilliseconds);
+
+    // Records the next frameCount frames and writes them to path once their GPU times are in
+    void RequestCapture(const std::string &path, int frameCount);
+    bool IsCapturing() const { return this->isCapturing; }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "probe_scheduler.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <unordered_set>
+
+#undef min
+#undef max
+
+void ProbeScheduler::Initialize(int slotCount) {
+    this->usedSlots.assign(slotCount, false);
+    this->entries.clear();
+}
+
+void ProbeScheduler::GrowSlots(int slotCount) {
+    if (slotCount > this->usedSlots.size())
+        this->usedSlots.resize(slotCount, false);
+}
+
+void ProbeScheduler::Schedule(const std::vector<Probe> &probes, std::vector<Assignment> &outAssignments) {
+    outAssignments.clear();
+    this->stats = {};
+    this->stats.probeCount = static_cast<int>(probes.size());
+
+    std::unordered_set<uint64_t> submitted;
+    for (const Probe &probe : probes)
+        submitted.insert(probe.id);
+
+    for (auto it = this->entries.begin(); it != this->entries.end();) {
+        if (!submitted.count(it->first)) {
+            this->usedSlots[it->second.slot] = false;
+            it = this->entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (int i = 0; i < probes.size(); ++i) {
+        const Probe &probe = probes[i];
+
+        auto it = this->entries.find(probe.id);
+        const bool isNew = it == this->entries.end();
+
+        if (isNew) {
+            auto freeSlot = std::find(this->usedSlots.begin(), this->usedSlots.end(), false);
+            if (freeSlot == this->usedSlots.end()) {
+                ++this->stats.droppedCount;
+                continue;
+            }
+
+            *freeSlot = true;
+
+            Entry entry;
+            entry.slot = static_cast<int>(freeSlot - this->usedSlots.begin());
+            it = this->entries.emplace(probe.id, entry).first;
+        }
+
+        Entry &entry = it->second;
+
+        uint8_t faceMask = 0;
+        if (isNew || probe.forceUpdate || probe.signature != entry.signature) {
+            faceMask = ALL_FACES;
+            entry.nextFace = 0;
+        }
+        else if (probe.policy == Probe_update_policy::roundRobin) {
+            const int faceCount = std::clamp(probe.facesPerFrame, 1, 6);
+            for (int face = 0; face < faceCount; ++face)
+                faceMask |= 1 << ((entry.nextFace + face) % 6);
+
+            entry.nextFace = (entry.nextFace + faceCount) % 6;
+        }
+
+        entry.signature = probe.signature;
+
+        if (faceMask != 0) {
+            ++this->stats.updatedProbeCount;
+            this->stats.faceCount += CountFaces(faceMask);
+        }
+
+        outAssignments.push_back({ i, entry.slot, faceMask });
+    }
+}
+
+void ProbeScheduler::Clear() {
+    this->entries.clear();
+    std::fill(this->usedSlots.begin(), this->usedSlots.end(), false);
+}
+
+int ProbeScheduler::CountFaces(uint8_t faceMask) {
+    int count = 0;
+    for (int face = 0; face < 6; ++face)
+        if (faceMask & (1 << face))
+            ++count;
+
+    return count;
+}
+
+void ProbeScheduler::RunSchedulerTest() {
+    LogInfo("Reflection probe scheduler test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    auto findAssignment = [](const std::vector<Assignment> &assignments, int probe) -> const Assignment * {
+        for (const Assignment &assignment : assignments)
+            if (assignment.probe == probe)
+                return &assignment;
+
+        return nullptr;
+    };
+
+    {
+        ProbeScheduler scheduler;
+        scheduler.Initialize(4);
+
+        std::vector<Probe> probes(3);
+        probes[0].id = 1;
+        probes[0].policy = Probe_update_policy::bakeOnce;
+        probes[1].id = 2;
+        probes[1].policy = Probe_update_policy::onChange;
+        probes[2].id = 3;
+        probes[2].policy = Probe_update_policy::roundRobin;
+        probes[2].facesPerFrame = 2;
+
+        std::vector<Assignment> assignments;
+        const int frameCount = 100;
+        int totalFaceCount = 0;
+        int roundRobinFaceCounts[6] = {};
+        bool isQuietBetweenEvents = true;
+        bool keepsSlots = true;
+        int slots[3] = {};
+
+        for (int frame = 0; frame < frameCount; ++frame) {
+            for (Probe &probe : probes)
+                probe.forceUpdate = false;
+
+            int expectedFaces[3] = { 0, 0, 2 };
+
+            if (frame == 0) {
+                expectedFaces[0] = expectedFaces[1] = expectedFaces[2] = 6;
+            }
+            else if (frame == 40) {
+                probes[1].signature = 1234; // Something moved near it
+                expectedFaces[1] = 6;
+            }
+            else if (frame == 50) {
+                probes[0].forceUpdate = true;
+                expectedFaces[0] = 6;
+            }
+            else if (frame == 60) {
+                probes[2].signature = 99; // Moved
+                expectedFaces[2] = 6;
+            }
+
+            scheduler.Schedule(probes, assignments);
+            totalFaceCount += scheduler.GetStats().faceCount;
+
+            for (int i = 0; i < 3; ++i) {
+                const Assignment *assignment = findAssignment(assignments, i);
+                if (!assignment) {
+                    isQuietBetweenEvents = false;
+                    continue;
+                }
+
+                if (CountFaces(assignment->faceMask) != expectedFaces[i]) {
+                    LogWarn("Frame %d: probe %d rendered %d faces, expected %d\n", frame, i, CountFaces(assignment->faceMask), expectedFaces[i]);
+                    isQuietBetweenEvents = false;
+                }
+
+                if (frame == 0)
+                    slots[i] = assignment->slot;
+                else if (assignment->slot != slots[i])
+                    keepsSlots = false;
+
+                // A full cycle right after the start, before the move resets it
+                if (i == 2 && frame >= 1 && frame <= 3)
+                    for (int face = 0; face < 6; ++face)
+                        if (assignment->faceMask & (1 << face))
+                            ++roundRobinFaceCounts[face];
+            }
+        }
+
+        checks.Check(isQuietBetweenEvents, "Probes only render the faces their policy asks for");
+        checks.Check(keepsSlots, "Probes keep their slots");
+        checks.Check(
+            std::all_of(std::begin(roundRobinFaceCounts), std::end(roundRobinFaceCounts), [](int count) { return count == 1; }),
+            "Round robin covers every face once per cycle"
+        );
+
+        LogInfo(
+            "3 probes over %d frames: %d faces rendered, %d when rendering every face every frame\n",
+            frameCount,
+            totalFaceCount,
+            3 * 6 * frameCount
+        );
+
+        // Leaving and coming back costs a full update
+        std::vector<Probe> withoutLast(probes.begin(), probes.begin() + 2);
+        scheduler.Schedule(withoutLast, assignments);
+        checks.Check(assignments.size() == 2 && scheduler.GetStats().faceCount == 0, "Leaving probes don't cost faces");
+
+        scheduler.Schedule(probes, assignments);
+        const Assignment *returned = findAssignment(assignments, 2);
+        checks.Check(returned && returned->faceMask == ALL_FACES, "Returning probes render all faces");
+    }
+
+    {
+        // More probes than slots
+        ProbeScheduler scheduler;
+        scheduler.Initialize(2);
+
+        std::vector<Probe> probes(3);
+        for (int i = 0; i < 3; ++i)
+            probes[i].id = 10 + i;
+
+        std::vector<Assignment> assignments;
+        scheduler.Schedule(probes, assignments);
+        checks.Check(assignments.size() == 2 && scheduler.GetStats().droppedCount == 1 && !findAssignment(assignments, 2), "Probes past the slots are dropped");
+
+        scheduler.Schedule(probes, assignments);
+        checks.Check(scheduler.GetStats().faceCount == 0, "Dropped probes don't disturb the others");
+
+        probes.erase(probes.begin());
+        scheduler.Schedule(probes, assignments);
+
+        const Assignment *taken = findAssignment(assignments, 1);
+        checks.Check(taken && taken->faceMask == ALL_FACES && scheduler.GetStats().droppedCount == 0, "Freed slots go to dropped probes");
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
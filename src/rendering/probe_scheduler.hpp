@@ -0,0 +1,76 @@
+#ifndef PROBE_SCHEDULER_HPP
+#define PROBE_SCHEDULER_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+enum class Probe_update_policy {
+    bakeOnce,  // Rendered when it appears or its signature changes, then reused
+    onChange,  // Same, with the geometry within its far plane hashed into its signature
+    roundRobin // A few faces every frame
+};
+
+// Decides which reflection probe faces get rendered each frame. Probes keep their slot in the cube array while they
+// are submitted, so a face only has to be rendered again when the policy asks for it. Probes that are new, lost
+// their slot or changed signature get all six faces.
+class ProbeScheduler {
+public:
+    static constexpr uint8_t ALL_FACES = 0x3F;
+
+    struct Probe {
+        uint64_t id = 0;
+        Probe_update_policy policy = Probe_update_policy::onChange;
+        int facesPerFrame = 1; // Round robin only
+        uint64_t signature = 0;
+        bool forceUpdate = false;
+    };
+
+    struct Assignment {
+        int probe = 0; // Index into the scheduled probes
+        int slot = 0;
+        uint8_t faceMask = 0; // Faces to render this frame, bit n is face n
+    };
+
+    struct Stats {
+        int probeCount = 0;
+        int updatedProbeCount = 0;
+        int faceCount = 0;
+        int droppedCount = 0; // Submitted without a free slot
+    };
+
+private:
+    struct Entry {
+        int slot = 0;
+        uint64_t signature = 0;
+        int nextFace = 0;
+    };
+
+    std::unordered_map<uint64_t, Entry> entries; // By probe id
+    std::vector<bool> usedSlots;
+
+    Stats stats;
+
+public:
+    void Initialize(int slotCount);
+
+    // Adds free slots, probes keep the ones they have. Can't shrink.
+    void GrowSlots(int slotCount);
+    int GetSlotCount() const { return static_cast<int>(this->usedSlots.size()); }
+
+    // Probes that aren't submitted give up their slot. Earlier probes get slots first when there aren't enough.
+    void Schedule(const std::vector<Probe> &probes, std::vector<Assignment> &outAssignments);
+
+    // Forgets every probe, e.g. after the cube array was recreated
+    void Clear();
+
+    // Of the last Schedule
+    const Stats &GetStats() const { return this->stats; }
+
+    static int CountFaces(uint8_t faceMask);
+
+    // Runs the policies over synthetic probes and checks which faces get rendered on which frames
+    static void RunSchedulerTest();
+};
+
+#endif
\ No newline at end of file
@@ -3,6 +3,16 @@
 #include "rendering/render_utils.hpp"
 #include "scene/scene.hpp"
 #include "rendering/shadow_system.hpp"
+#include "rendering/shadow_cache.hpp"
+#include "rendering/light_cluster_builder.hpp"
+#include "debugging/debug.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#undef min
+#undef max
 
 void ReflectionProbeSystem::ExectuteReflectionRenderPass(
     FrameGraph::ExecutionContext &context,
@@ -10,8 +20,10 @@ void ReflectionProbeSystem::ExectuteReflectionRenderPass(
     const float *clearColour
 ) {
     ID3D11DeviceContext *deviceContext = context.GetDeviceContext();
+    StateCache &stateCache = context.GetStateCache();
 
-    if (this->perFrameProbeData.count <= 0)
+    // Probes keep what was rendered into their slot on earlier frames
+    if (this->perFrameProbeData.faceCount <= 0)
         return;
 
     Render_view *primaryView = context.GetView(View_type::primary);
@@ -27,129 +39,190 @@ void ReflectionProbeSystem::ExectuteReflectionRenderPass(
         if (Texture_cube *cube = primaryView->queue.skyboxCommand->textureCubeHandle.Get())
             skyboxSRV = cube->shaderResourceView;
 
+    // Only the matrices are needed for the skybox, the single pass has no view per face
+    Render_view faceView{};
+
     if (skyboxSRV) {
-        deviceContext->CSSetShader(this->skyboxCS, nullptr, 0);
-        deviceContext->CSSetConstantBuffers(0, 1, &sharedResources.perFrameBuffer);
-        deviceContext->CSSetShaderResources(0, 1, &skyboxSRV);
+        stateCache.SetComputeShader(this->skyboxCS);
+        stateCache.SetConstantBuffers(Shader_stage::compute, 0, 1, &sharedResources.perFrameBuffer);
+        stateCache.SetShaderResources(Shader_stage::compute, 0, 1, &skyboxSRV);
 
         const UINT groups = (REFLECTION_PROBE_RESOLUTION + 7) / 8;
 
         for (int i = 0; i < this->perFrameProbeData.count; ++i) {
+            const Per_frame_probe_data::Entry &entry = this->perFrameProbeData.entries[i];
+
             for (int face = 0; face < 6; ++face) {
-                Render_view *view = context.GetView(View_type::cubeFace, i * 6 + face);
-                if (!view)
+                if (!(entry.faceMask & (1 << face)))
                     continue;
 
-                sharedResources.UploadPerFrameData(deviceContext, *view);
+                XMMATRIX viewMatrix, projectionMatrix;
+                GetFaceMatrices(entry.position, entry.nearPlane, entry.farPlane, face, viewMatrix, projectionMatrix);
+                XMStoreFloat4x4(&faceView.viewMatrix, viewMatrix);
+                XMStoreFloat4x4(&faceView.projectionMatrix, projectionMatrix);
+                faceView.cameraPosition = entry.position;
+
+                sharedResources.UploadPerFrameData(deviceContext, faceView);
 
-                ID3D11UnorderedAccessView *uav = this->probeUAVs[i * 6 + face];
-                deviceContext->CSSetUnorderedAccessViews(0, 1, &uav, nullptr);
+                ID3D11UnorderedAccessView *uav = this->probeUAVs[entry.slot * 6 + face];
+                stateCache.SetUnorderedAccessViews(0, 1, &uav);
                 deviceContext->Dispatch(groups, groups, 1);
             }
         }
 
-        deviceContext->CSSetShader(nullptr, nullptr, 0);
+        stateCache.SetComputeShader(nullptr);
         ID3D11ShaderResourceView *nullSRV = nullptr;
-        deviceContext->CSSetShaderResources(0, 1, &nullSRV);
+        stateCache.SetShaderResources(Shader_stage::compute, 0, 1, &nullSRV);
         ID3D11UnorderedAccessView *nullUAV = nullptr;
-        deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+        stateCache.SetUnorderedAccessViews(0, 1, &nullUAV);
     }
 
     D3D11_VIEWPORT viewport{};
     viewport.Width = viewport.Height = REFLECTION_PROBE_RESOLUTION;
     viewport.MaxDepth = 1.0f;
-    deviceContext->RSSetViewports(1, &viewport);
+    stateCache.SetViewport(viewport);
 
-    deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    deviceContext->IASetInputLayout(this->reflectionLayout);
-    deviceContext->VSSetShader(this->reflectionVS, nullptr, 0);
-    deviceContext->PSSetShader(this->reflectionPS, nullptr, 0);
+    stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    stateCache.SetInputLayout(this->reflectionLayout);
+    stateCache.SetVertexShader(this->reflectionVS);
+    stateCache.SetPixelShader(this->reflectionPS);
 
-    deviceContext->VSSetConstantBuffers(0, 1, &sharedResources.perFrameBuffer);
-    deviceContext->VSSetConstantBuffers(1, 1, &sharedResources.perObjectBuffer);
+    stateCache.SetConstantBuffers(Shader_stage::vertex, 0, 1, &sharedResources.perFrameBuffer);
 
-    deviceContext->PSSetConstantBuffers(0, 1, &sharedResources.perFrameBuffer);
-    deviceContext->PSSetConstantBuffers(1, 1, &sharedResources.perMaterialBuffer);
-    deviceContext->PSSetConstantBuffers(2, 1, &sharedResources.lightingBuffer);
+    stateCache.SetConstantBuffers(Shader_stage::pixel, 0, 1, &sharedResources.perFrameBuffer);
+    stateCache.SetConstantBuffers(Shader_stage::pixel, 2, 1, &sharedResources.lightingBuffer);
+
+    ConstantBufferRing &ring = *sharedResources.constantBufferRing;
 
     ID3D11ShaderResourceView *directionalLightBufferSRV = this->shadowSystem->GetDirectionalLightBufferSRV();
     ID3D11ShaderResourceView *spotLightBufferSRV = this->shadowSystem->GetSpotLightBufferSRV();
-    deviceContext->PSSetShaderResources(0, 1, &directionalLightBufferSRV);
-    deviceContext->PSSetShaderResources(1, 1, &spotLightBufferSRV);
+    stateCache.SetShaderResources(Shader_stage::pixel, 0, 1, &directionalLightBufferSRV);
+    stateCache.SetShaderResources(Shader_stage::pixel, 1, 1, &spotLightBufferSRV);
 
-    for (int i = 0; i < this->perFrameProbeData.count; ++i) {
-        for (int face = 0; face < 6; ++face) {
-            Render_view *view = context.GetView(View_type::cubeFace, i * 6 + face);
-            if (!view)
+    auto drawCommands = [&](const Render_view &view) {
+        for (const Geometry_command &command : view.queue.geometryCommands) {
+            if (command.isReflective)
+                continue;
+
+            ring.Bind(stateCache, Shader_stage::vertex, 1, command.objectConstants, sharedResources.perObjectBuffer);
+
+            if (this->isSinglePass)
+                ring.Bind(stateCache, Shader_stage::geometry, 1, command.faceMaskConstants, this->faceMaskBuffer);
+
+            Material *material = command.material.Get();
+            if (material) {
+                ring.Bind(stateCache, Shader_stage::pixel, 1, command.materialConstants, sharedResources.perMaterialBuffer);
+
+                if (Texture2D *texture = material->diffuseTexture.Get())
+                    stateCache.SetShaderResources(Shader_stage::pixel, 2, 1, &texture->shaderResourceView);
+            }
+
+            stateCache.SetVertexBuffer(command.vertexBuffer, sizeof(Vertex));
+            stateCache.SetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT);
+
+            deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
+        }
+    };
+
+    if (this->isSinglePass) {
+        stateCache.SetGeometryShader(this->reflectionGS);
+        stateCache.SetConstantBuffers(Shader_stage::geometry, 0, 1, &this->cubeFaceBuffer);
+
+        for (int i = 0; i < this->perFrameProbeData.count; ++i) {
+            const Per_frame_probe_data::Entry &entry = this->perFrameProbeData.entries[i];
+            if (entry.faceMask == 0)
                 continue;
 
-            ID3D11RenderTargetView *rtv = this->probeRTVs[i * 6 + face];
+            Render_view *view = context.GetView(View_type::cube, entry.slot);
+            if (!view)
+                continue;
 
+            // Faces that aren't scheduled keep what they hold, so they can't be cleared with the whole cube
             if (!skyboxSRV)
-                deviceContext->ClearRenderTargetView(rtv, clearColour);
+                for (int face = 0; face < 6; ++face)
+                    if (entry.faceMask & (1 << face))
+                        deviceContext->ClearRenderTargetView(this->probeRTVs[entry.slot * 6 + face], clearColour);
 
-            deviceContext->ClearDepthStencilView(this->probeDepthDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
-            deviceContext->OMSetRenderTargets(1, &rtv, this->probeDepthDSV);
+            deviceContext->ClearDepthStencilView(this->probeCubeDepthDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
+            stateCache.SetRenderTargets(1, &this->probeCubeRTVs[entry.slot], this->probeCubeDepthDSV);
 
             sharedResources.UploadPerFrameData(deviceContext, *view);
 
-            for (const Geometry_command &command : view->queue.geometryCommands) {
-                if (command.isReflective)
-                    continue;
+            Cube_face_data cubeFaceData{};
+            for (int face = 0; face < 6; ++face) {
+                XMMATRIX viewMatrix, projectionMatrix;
+                GetFaceMatrices(entry.position, entry.nearPlane, entry.farPlane, face, viewMatrix, projectionMatrix);
+                XMStoreFloat4x4(&cubeFaceData.faceViewProjectionMatrices[face], XMMatrixTranspose(viewMatrix * projectionMatrix));
+            }
+            UploadConstantBuffer(deviceContext, this->cubeFaceBuffer, cubeFaceData);
 
-                Per_object_data perObjectData{};
-                perObjectData.worldMatrix = command.worldMatrix;
-                XMStoreFloat4x4(
-                    &perObjectData.worldMatrixInvTranspose, 
-                    XMMatrixInverse(nullptr, XMMatrixTranspose(XMLoadFloat4x4(&command.worldMatrix)))
-                );
+            drawCommands(*view);
+        }
 
-                UploadConstantBuffer(deviceContext, sharedResources.perObjectBuffer, perObjectData);
+        stateCache.SetGeometryShader(nullptr);
+    }
+    else {
+        for (int i = 0; i < this->perFrameProbeData.count; ++i) {
+            const Per_frame_probe_data::Entry &entry = this->perFrameProbeData.entries[i];
 
-                Material *material = command.material.Get();
-                if (material) {
-                    Per_material_data perMaterialData{};
-                    perMaterialData.materialDiffuse          = material->diffuseColour;
-                    perMaterialData.isReflective             = command.isReflective;
-                    perMaterialData.materialSpecular         = material->specularColour;
-                    perMaterialData.materialSpecularExponent = material->specularExponent;
+            for (int face = 0; face < 6; ++face) {
+                if (!(entry.faceMask & (1 << face)))
+                    continue;
 
-                    UploadConstantBuffer(deviceContext, sharedResources.perMaterialBuffer, perMaterialData);
+                Render_view *view = context.GetView(View_type::cubeFace, entry.slot * 6 + face);
+                if (!view)
+                    continue;
 
-                    if (Texture2D *texture = material->diffuseTexture.Get())
-                        deviceContext->PSSetShaderResources(2, 1, &texture->shaderResourceView);
-                }
+                ID3D11RenderTargetView *rtv = this->probeRTVs[entry.slot * 6 + face];
+
+                if (!skyboxSRV)
+                    deviceContext->ClearRenderTargetView(rtv, clearColour);
 
-                const UINT stride = sizeof(Vertex);
-                const UINT offset = 0;
-                deviceContext->IASetVertexBuffers(0, 1, &command.vertexBuffer, &stride, &offset);
-                deviceContext->IASetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+                deviceContext->ClearDepthStencilView(this->probeDepthDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
+                stateCache.SetRenderTargets(1, &rtv, this->probeDepthDSV);
+
+                sharedResources.UploadPerFrameData(deviceContext, *view);
 
-                deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
+                drawCommands(*view);
             }
         }
     }
 
+    // GenerateMips works on the whole resource, which must not be bound as a render target
+    stateCache.UnbindOutputs(this->probeTexture);
     deviceContext->GenerateMips(this->probeSRV);
-
-    deviceContext->OMSetRenderTargets(0, nullptr, nullptr);
-    ID3D11ShaderResourceView *nullSRVs[3] = {};
-    deviceContext->PSSetShaderResources(0, 3, nullSRVs);
 }
 
-bool ReflectionProbeSystem::CreateTextureCubeArray(ID3D11Device *device) {
+bool ReflectionProbeSystem::CreateTextureCubeArray(ID3D11Device *device, int cubeCount) {
     D3D11_TEXTURE2D_DESC desc{};
     desc.Width = REFLECTION_PROBE_RESOLUTION;
     desc.Height = REFLECTION_PROBE_RESOLUTION;
     desc.MipLevels = 0;
-    desc.ArraySize = MAX_REFLECTION_PROBES * 6;
+    desc.ArraySize = cubeCount * 6;
     desc.Format = DXGI_FORMAT_R11G11B10_FLOAT; // HDR output
     desc.SampleDesc.Count = 1;
     desc.Usage = D3D11_USAGE_DEFAULT;
     desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
     desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE | D3D11_RESOURCE_MISC_GENERATE_MIPS;
 
-    HRESULT result = device->CreateTexture2D(&desc, nullptr, &this->probeTexture);
+    ID3D11Texture2D *texture = nullptr;
+    ID3D11ShaderResourceView *srv = nullptr;
+    std::vector<ID3D11RenderTargetView *> rtvs(cubeCount * 6, nullptr);
+    std::vector<ID3D11UnorderedAccessView *> uavs(cubeCount * 6, nullptr);
+    std::vector<ID3D11RenderTargetView *> cubeRTVs(cubeCount, nullptr);
+
+    auto release = [&]() {
+        for (ID3D11RenderTargetView *&rtv : rtvs)
+            SafeRelease(rtv);
+        for (ID3D11RenderTargetView *&rtv : cubeRTVs)
+            SafeRelease(rtv);
+        for (ID3D11UnorderedAccessView *&uav : uavs)
+            SafeRelease(uav);
+        SafeRelease(srv);
+        SafeRelease(texture);
+    };
+
+    HRESULT result = device->CreateTexture2D(&desc, nullptr, &texture);
     if (FAILED(result)) {
         LogError("Failed to create texture cube array");
         return false;
@@ -161,11 +234,12 @@ bool ReflectionProbeSystem::CreateTextureCubeArray(ID3D11Device *device) {
     srvDesc.TextureCubeArray.MostDetailedMip = 0;
     srvDesc.TextureCubeArray.MipLevels = -1;
     srvDesc.TextureCubeArray.First2DArrayFace = 0;
-    srvDesc.TextureCubeArray.NumCubes = MAX_REFLECTION_PROBES;
+    srvDesc.TextureCubeArray.NumCubes = cubeCount;
 
-    result = device->CreateShaderResourceView(this->probeTexture, &srvDesc, &this->probeSRV);
+    result = device->CreateShaderResourceView(texture, &srvDesc, &srv);
     if (FAILED(result)) {
         LogError("Failed to create SRV");
+        release();
         return false;
     }
 
@@ -175,11 +249,25 @@ bool ReflectionProbeSystem::CreateTextureCubeArray(ID3D11Device *device) {
     rtvDesc.Texture2DArray.MipSlice = 0;
     rtvDesc.Texture2DArray.ArraySize = 1;
 
-    for (int i = 0; i < MAX_REFLECTION_PROBES * 6; ++i) {
+    for (int i = 0; i < cubeCount * 6; ++i) {
         rtvDesc.Texture2DArray.FirstArraySlice = i;
-        result = device->CreateRenderTargetView(this->probeTexture, &rtvDesc, &this->probeRTVs[i]);
+        result = device->CreateRenderTargetView(texture, &rtvDesc, &rtvs[i]);
         if (FAILED(result)) {
             LogError("Failed to create RTV[%d]", i);
+            release();
+            return false;
+        }
+    }
+
+    // The geometry shader picks the face
+    rtvDesc.Texture2DArray.ArraySize = 6;
+
+    for (int i = 0; i < cubeCount; ++i) {
+        rtvDesc.Texture2DArray.FirstArraySlice = i * 6;
+        result = device->CreateRenderTargetView(texture, &rtvDesc, &cubeRTVs[i]);
+        if (FAILED(result)) {
+            LogError("Failed to create cube RTV[%d]", i);
+            release();
             return false;
         }
     }
@@ -190,15 +278,50 @@ bool ReflectionProbeSystem::CreateTextureCubeArray(ID3D11Device *device) {
     uavDesc.Texture2DArray.MipSlice = 0;
     uavDesc.Texture2DArray.ArraySize = 1;
 
-    for (int i = 0; i < MAX_REFLECTION_PROBES * 6; ++i) {
+    for (int i = 0; i < cubeCount * 6; ++i) {
         uavDesc.Texture2DArray.FirstArraySlice = i;
-        result = device->CreateUnorderedAccessView(this->probeTexture, &uavDesc, &this->probeUAVs[i]);
+        result = device->CreateUnorderedAccessView(texture, &uavDesc, &uavs[i]);
         if (FAILED(result)) {
             LogError("Failed to create UAV[%d]", i);
+            release();
             return false;
         }
     }
 
+    // Probes keep their slots, so what they hold is carried over, mips included
+    if (this->probeTexture) {
+        ID3D11DeviceContext *deviceContext = nullptr;
+        device->GetImmediateContext(&deviceContext);
+
+        texture->GetDesc(&desc);
+        const UINT copiedSliceCount = static_cast<UINT>(std::min(this->probeCubeCount, cubeCount) * 6);
+
+        for (UINT slice = 0; slice < copiedSliceCount; ++slice) {
+            for (UINT mip = 0; mip < desc.MipLevels; ++mip) {
+                const UINT subresource = D3D11CalcSubresource(mip, slice, desc.MipLevels);
+                deviceContext->CopySubresourceRegion(texture, subresource, 0, 0, 0, this->probeTexture, subresource, nullptr);
+            }
+        }
+
+        SafeRelease(deviceContext);
+    }
+
+    SafeRelease(this->probeSRV);
+    for (ID3D11RenderTargetView *&rtv : this->probeRTVs)
+        SafeRelease(rtv);
+    for (ID3D11UnorderedAccessView *&uav : this->probeUAVs)
+        SafeRelease(uav);
+    for (ID3D11RenderTargetView *&rtv : this->probeCubeRTVs)
+        SafeRelease(rtv);
+    SafeRelease(this->probeTexture);
+
+    this->probeTexture = texture;
+    this->probeSRV = srv;
+    this->probeRTVs = std::move(rtvs);
+    this->probeUAVs = std::move(uavs);
+    this->probeCubeRTVs = std::move(cubeRTVs);
+    this->probeCubeCount = cubeCount;
+
     return true;
 }
 
@@ -225,6 +348,52 @@ bool ReflectionProbeSystem::CreateDepthTexture(ID3D11Device *device) {
         return false;
     }
 
+    // One slice per face for the single pass
+    desc.ArraySize = 6;
+
+    result = device->CreateTexture2D(&desc, nullptr, &this->probeCubeDepthTexture);
+    if (FAILED(result)) {
+        LogError("Failed to create cube depth stencil texture");
+        return false;
+    }
+
+    D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc{};
+    dsvDesc.Format = desc.Format;
+    dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+    dsvDesc.Texture2DArray.MipSlice = 0;
+    dsvDesc.Texture2DArray.FirstArraySlice = 0;
+    dsvDesc.Texture2DArray.ArraySize = 6;
+
+    result = device->CreateDepthStencilView(this->probeCubeDepthTexture, &dsvDesc, &this->probeCubeDepthDSV);
+    if (FAILED(result)) {
+        LogError("Failed to create cube DSV");
+        return false;
+    }
+
+    return true;
+}
+
+bool ReflectionProbeSystem::CreateConstantBuffers(ID3D11Device *device) {
+    D3D11_BUFFER_DESC desc{};
+    desc.ByteWidth = sizeof(Cube_face_data);
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+    HRESULT result = device->CreateBuffer(&desc, nullptr, &this->cubeFaceBuffer);
+    if (FAILED(result)) {
+        LogError("Failed to create constant buffer");
+        return false;
+    }
+
+    desc.ByteWidth = sizeof(Cube_face_draw_data);
+
+    result = device->CreateBuffer(&desc, nullptr, &this->faceMaskBuffer);
+    if (FAILED(result)) {
+        LogError("Failed to create constant buffer");
+        return false;
+    }
+
     return true;
 }
 
@@ -262,6 +431,15 @@ bool ReflectionProbeSystem::LoadShaders(ID3D11Device *device, const std::string
         return false;
     }
 
+    if (!LoadShaderBytecode(shaderDir + "gs_reflection.cso", bytecode))
+        return false;
+
+    result = device->CreateGeometryShader(bytecode.data(), bytecode.size(), nullptr, &this->reflectionGS);
+    if (FAILED(result)) {
+        LogError("Failed to create geometry shader");
+        return false;
+    }
+
     if (!LoadShaderBytecode(shaderDir + "cs_skybox.cso", bytecode))
         return false;
 
@@ -277,12 +455,17 @@ bool ReflectionProbeSystem::LoadShaders(ID3D11Device *device, const std::string
 bool ReflectionProbeSystem::Initialize(ID3D11Device *device, const std::string &shaderDir, ShadowSystem *shadowSystem) {
     LogInfo("Creating reflection probe system...\n");
 
-    if (!this->CreateTextureCubeArray(device))
+    this->device = device;
+
+    if (!this->CreateTextureCubeArray(device, PROBE_PAGE_SIZE))
         return false;
 
     if (!this->CreateDepthTexture(device))
         return false;
 
+    if (!this->CreateConstantBuffers(device))
+        return false;
+
     if (!CreateStructuredBuffer(
         device,
         sizeof(Reflection_probe_data),
@@ -298,6 +481,7 @@ bool ReflectionProbeSystem::Initialize(ID3D11Device *device, const std::string &
         return false;
 
     this->shadowSystem = shadowSystem;
+    this->scheduler.Initialize(this->probeCubeCount);
 
     return true;
 }
@@ -306,20 +490,59 @@ void ReflectionProbeSystem::Shutdown() {
     SafeRelease(this->reflectionVS);
     SafeRelease(this->reflectionPS);
     SafeRelease(this->reflectionLayout);
+    SafeRelease(this->reflectionGS);
     SafeRelease(this->skyboxCS);
+    SafeRelease(this->cubeFaceBuffer);
+    SafeRelease(this->faceMaskBuffer);
 
     SafeRelease(this->probeSRV);
-    for (int i = 0; i < MAX_REFLECTION_PROBES * 6; ++i) {
-        SafeRelease(this->probeRTVs[i]);
-        SafeRelease(this->probeUAVs[i]);
-    }
+    for (ID3D11RenderTargetView *&rtv : this->probeRTVs)
+        SafeRelease(rtv);
+    for (ID3D11UnorderedAccessView *&uav : this->probeUAVs)
+        SafeRelease(uav);
+    for (ID3D11RenderTargetView *&rtv : this->probeCubeRTVs)
+        SafeRelease(rtv);
     SafeRelease(this->probeTexture);
+    this->probeRTVs.clear();
+    this->probeUAVs.clear();
+    this->probeCubeRTVs.clear();
+    this->probeCubeCount = 0;
 
     SafeRelease(this->probeDepthDSV);
     SafeRelease(this->probeDepthTexture);
+    SafeRelease(this->probeCubeDepthDSV);
+    SafeRelease(this->probeCubeDepthTexture);
 
     SafeRelease(this->probeBufferSRV);
     SafeRelease(this->probeBuffer);
+
+    this->scheduler.Clear();
+    this->probeSelector.Reset();
+    this->probeBounds.clear();
+}
+
+void ReflectionProbeSystem::GetFaceMatrices(
+    const XMFLOAT3 &position,
+    float nearPlane,
+    float farPlane,
+    int face,
+    XMMATRIX &outViewMatrix,
+    XMMATRIX &outProjectionMatrix
+) {
+    static constexpr struct { XMFLOAT3 forward; XMFLOAT3 up; } faces[6] = {
+        {{ 1,  0,  0}, {0,  1,  0}}, // +x
+        {{-1,  0,  0}, {0,  1,  0}}, // -x
+        {{ 0,  1,  0}, {0,  0, -1}}, // +y
+        {{ 0, -1,  0}, {0,  0,  1}}, // -y
+        {{ 0,  0,  1}, {0,  1,  0}}, // +z
+        {{ 0,  0, -1}, {0,  1,  0}}  // -z
+    };
+
+    XMVECTOR forward = XMLoadFloat3(&faces[face].forward);
+    XMVECTOR up = XMLoadFloat3(&faces[face].up);
+
+    outViewMatrix = XMMatrixLookToLH(XMLoadFloat3(&position), forward, up);
+    outProjectionMatrix = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, nearPlane, farPlane);
 }
 
 void ReflectionProbeSystem::PrepareViews(Scene *scene, const Render_view &primaryView, std::vector<Render_view> &outViews) {
@@ -329,69 +552,210 @@ void ReflectionProbeSystem::PrepareViews(Scene *scene, const Render_view &primar
     }
 
     this->perFrameProbeData.count = 0;
+    this->perFrameProbeData.faceCount = 0;
+    this->probeBounds.clear();
 
     const auto &reflectionProbeCommands = primaryView.queue.reflectionProbeCommands;
-    if (reflectionProbeCommands.empty())
-        return;
 
-    static constexpr struct { XMFLOAT3 forward; XMFLOAT3 up; } faces[6] = {
-        {{ 1,  0,  0}, {0,  1,  0}}, // +x
-        {{-1,  0,  0}, {0,  1,  0}}, // -x
-        {{ 0,  1,  0}, {0,  0, -1}}, // +y
-        {{ 0, -1,  0}, {0,  0,  1}}, // -y
-        {{ 0,  0,  1}, {0,  1,  0}}, // +z
-        {{ 0,  0, -1}, {0,  1,  0}}  // -z
-    };
+    // Probes whose influence is off screen can't be sampled, the rest are ranked by how much of the screen they cover
+    std::vector<LightSelector::Candidate> candidates;
+    for (const Reflection_probe_command &command : reflectionProbeCommands) {
+        LightSelector::Candidate candidate;
+        candidate.id = command.id;
+        candidate.bounds = BoundingSphere(command.position, command.radius);
+        candidate.intensity = 1.0f;
+        candidates.push_back(candidate);
+    }
+
+    LightSelector::Camera camera;
+    camera.position = primaryView.cameraPosition;
+    camera.projectionScale = primaryView.projectionMatrix._22;
+    camera.frustum = primaryView.frustum;
+
+    this->probeSelector.Select(candidates, camera, MAX_REFLECTION_PROBES, 0, this->probeSelection);
+    const std::vector<int> &selectedProbes = this->probeSelection.lights;
+
+    if (selectedProbes.size() > this->probeCubeCount) {
+        const int pageCount = (static_cast<int>(selectedProbes.size()) + PROBE_PAGE_SIZE - 1) / PROBE_PAGE_SIZE;
+        const int cubeCount = std::min(pageCount * PROBE_PAGE_SIZE, MAX_REFLECTION_PROBES);
+
+        if (this->CreateTextureCubeArray(this->device, cubeCount)) {
+            this->scheduler.GrowSlots(cubeCount);
+            LogInfo("Reflection probe cube array grew to %d cubes\n", cubeCount);
+        }
+        else {
+            LogWarn("Failed to grow reflection probe cube array to %d cubes\n", cubeCount);
+        }
+    }
+
+    this->isSinglePass = Debug::GetSetting("reflections.singlePass", false);
+
+    // What a probe sees apart from other objects, the skybox is in every face
+    uint64_t skyboxID = 0;
+    if (primaryView.queue.skyboxCommand.has_value())
+        skyboxID = static_cast<uint64_t>(primaryView.queue.skyboxCommand->textureCubeHandle.GetID());
+
+    // The geometry around a probe, gathered with one box the size of the cube. On change probes hash it, and the
+    // single pass draws from it.
+    std::vector<Render_view> contentViews;
+    std::vector<int> contentViewIndices(selectedProbes.size(), -1);
+
+    for (int i = 0; i < selectedProbes.size(); ++i) {
+        const Reflection_probe_command &command = reflectionProbeCommands[selectedProbes[i]];
+        if (!this->isSinglePass && command.updatePolicy != Probe_update_policy::onChange)
+            continue;
+
+        XMMATRIX viewMatrix, projectionMatrix;
+        GetFaceMatrices(command.position, command.nearPlane, command.farPlane, 0, viewMatrix, projectionMatrix);
+
+        Render_view view{};
+        view.type = View_type::cube;
+        XMStoreFloat4x4(&view.viewMatrix, viewMatrix);
+        XMStoreFloat4x4(&view.projectionMatrix, projectionMatrix);
+        view.cameraPosition = command.position;
+        view.nearPlane = command.nearPlane;
+        view.farPlane = command.farPlane;
+        view.orientedBox = BoundingOrientedBox(
+            command.position,
+            XMFLOAT3(command.farPlane, command.farPlane, command.farPlane),
+            XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f)
+        );
+        view.useOrientedBox = true;
+
+        contentViewIndices[i] = static_cast<int>(contentViews.size());
+        contentViews.push_back(view);
+    }
+
+    if (!contentViews.empty())
+        scene->GatherVisibility(contentViews);
+
+    this->scheduledProbes.clear();
+    for (int i = 0; i < selectedProbes.size(); ++i) {
+        const Reflection_probe_command &command = reflectionProbeCommands[selectedProbes[i]];
+
+        ShadowCache::Signature signature;
+        signature.Add(command.position);
+        signature.Add(command.nearPlane);
+        signature.Add(command.farPlane);
+        signature.Add(skyboxID);
+
+        if (command.updatePolicy == Probe_update_policy::onChange && contentViewIndices[i] >= 0)
+            for (const Geometry_command &geometry : contentViews[contentViewIndices[i]].queue.geometryCommands)
+                if (!geometry.isReflective)
+                    signature.AddCaster(geometry);
+
+        ProbeScheduler::Probe probe;
+        probe.id = command.id;
+        probe.policy = command.updatePolicy;
+        probe.facesPerFrame = command.facesPerFrame;
+        probe.signature = signature.Get();
+        probe.forceUpdate = command.needsUpdate;
+        this->scheduledProbes.push_back(probe);
+    }
+
+    this->scheduler.Schedule(this->scheduledProbes, this->assignments);
+
+    const ProbeScheduler::Stats &stats = this->scheduler.GetStats();
+    Debug::SetStat("reflections.probes", stats.probeCount);
+    Debug::SetStat("reflections.probesUpdated", stats.updatedProbeCount);
+    Debug::SetStat("reflections.facesRendered", stats.faceCount);
+    Debug::SetStat("reflections.probesCulled", this->probeSelection.culledCount);
+    Debug::SetStat("reflections.probesDropped", this->probeSelection.droppedCount + stats.droppedCount);
+    Debug::SetStat("reflections.cubeArraySize", this->probeCubeCount);
 
     std::vector<Render_view> views;
+    int commandCount = 0;
+    int faceDrawCount = 0; // Draws times the faces they reach
 
-    for (int i = 0; i < reflectionProbeCommands.size(); ++i) {
-        if (this->perFrameProbeData.count >= MAX_REFLECTION_PROBES)
-            break;
+    for (const ProbeScheduler::Assignment &assignment : this->assignments) {
+        const Reflection_probe_command &command = reflectionProbeCommands[selectedProbes[assignment.probe]];
 
-        const Reflection_probe_command &command = reflectionProbeCommands[i];
-        int slot = this->perFrameProbeData.count;
+        if (this->isSinglePass) {
+            if (assignment.faceMask != 0) {
+                Render_view &view = contentViews[contentViewIndices[assignment.probe]];
+                view.index = assignment.slot;
 
-        XMVECTOR position = XMLoadFloat3(&command.position);
-        XMMATRIX projectionMatrix = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, command.nearPlane, command.farPlane);
+                // Draws that miss every scheduled face are dropped, the rest go to the faces they reach
+                auto &commands = view.queue.geometryCommands;
+                for (Geometry_command &geometry : commands)
+                    geometry.faceMask = ComputeFaceMask(geometry.worldBounds, command.position, command.nearPlane, command.farPlane) & assignment.faceMask;
 
-        for (int face = 0; face < 6; ++face) {
-            XMVECTOR forward = XMLoadFloat3(&faces[face].forward);
-            XMVECTOR up = XMLoadFloat3(&faces[face].up);
+                commands.erase(
+                    std::remove_if(commands.begin(), commands.end(), [](const Geometry_command &geometry) { return geometry.faceMask == 0; }),
+                    commands.end()
+                );
+
+                commandCount += static_cast<int>(commands.size());
+                for (const Geometry_command &geometry : commands)
+                    faceDrawCount += ProbeScheduler::CountFaces(geometry.faceMask);
+
+                outViews.push_back(std::move(view));
+            }
+        }
+        else {
+            for (int face = 0; face < 6; ++face) {
+                if (!(assignment.faceMask & (1 << face)))
+                    continue;
 
-            XMMATRIX viewMatrix = XMMatrixLookToLH(position, forward, up);
+                XMMATRIX viewMatrix, projectionMatrix;
+                GetFaceMatrices(command.position, command.nearPlane, command.farPlane, face, viewMatrix, projectionMatrix);
 
-            Render_view view{};
-            view.type = View_type::cubeFace;
-            view.index = slot * 6 + face;
+                Render_view view{};
+                view.type = View_type::cubeFace;
+                view.index = assignment.slot * 6 + face;
 
-            XMStoreFloat4x4(&view.viewMatrix, viewMatrix);
-            XMStoreFloat4x4(&view.projectionMatrix, projectionMatrix);
+                XMStoreFloat4x4(&view.viewMatrix, viewMatrix);
+                XMStoreFloat4x4(&view.projectionMatrix, projectionMatrix);
 
-            view.cameraPosition = command.position;
-            view.nearPlane = command.nearPlane;
-            view.farPlane = command.farPlane;
+                view.cameraPosition = command.position;
+                view.nearPlane = command.nearPlane;
+                view.farPlane = command.farPlane;
 
-            BoundingFrustum::CreateFromMatrix(view.frustum, projectionMatrix);
-            view.frustum.Transform(view.frustum, XMMatrixInverse(nullptr, viewMatrix));
+                BoundingFrustum::CreateFromMatrix(view.frustum, projectionMatrix);
+                view.frustum.Transform(view.frustum, XMMatrixInverse(nullptr, viewMatrix));
 
-            views.push_back(view);
+                views.push_back(view);
+            }
         }
 
-        this->perFrameProbeData.entries[slot] = {command.position, command.radius};
+        this->perFrameProbeData.entries[this->perFrameProbeData.count] = {
+            command.position,
+            command.radius,
+            command.nearPlane,
+            command.farPlane,
+            assignment.slot,
+            assignment.faceMask
+        };
         ++this->perFrameProbeData.count;
+
+        this->probeBounds.push_back(BoundingSphere(command.position, command.radius));
+    }
+
+    this->perFrameProbeData.faceCount = stats.faceCount;
+
+    if (!views.empty()) {
+        scene->GatherVisibility(views);
+
+        for (const Render_view &view : views) {
+            commandCount += static_cast<int>(view.queue.geometryCommands.size());
+            faceDrawCount += static_cast<int>(view.queue.geometryCommands.size());
+        }
+
+        outViews.insert(outViews.end(), views.begin(), views.end());
     }
 
-    scene->GatherVisibility(views);
-    outViews.insert(outViews.end(), views.begin(), views.end());
+    // The two paths compare by these, a command costs CPU either way and a face draw costs vertex work
+    Debug::SetStat("reflections.drawCommands", commandCount);
+    Debug::SetStat("reflections.faceDraws", faceDrawCount);
 }
 
 Reflection_probe_handles ReflectionProbeSystem::RegisterRenderPasses(
     FrameGraph &frameGraph,
     const SharedResources &sharedResources,
-    const float *clearColour
+    const float *clearColour,
+    bool includeRenderPass
 ) {
-    Reflection_probe_handles handles{};
+    Reflection_probe_handles &handles = this->handles;
 
     handles.reflectionProbes = frameGraph.ImportTexture(
         "ReflectionProbe", 
@@ -399,7 +763,14 @@ Reflection_probe_handles ReflectionProbeSystem::RegisterRenderPasses(
         nullptr, 
         this->probeSRV
     );
-    handles.reflectionProbeBufferSRV = this->probeBufferSRV;
+    handles.reflectionProbeBuffer = frameGraph.ImportBuffer(
+        "ReflectionProbeBuffer",
+        this->probeBuffer,
+        this->probeBufferSRV
+    );
+
+    if (!includeRenderPass)
+        return handles;
 
     struct Reflection_pass_data {
         FrameGraph::TextureHandle reflectionProbes;
@@ -418,6 +789,15 @@ Reflection_probe_handles ReflectionProbeSystem::RegisterRenderPasses(
     return handles;
 }
 
+void ReflectionProbeSystem::UpdateImportedTextures(FrameGraph &frameGraph) {
+    frameGraph.UpdateImportedTexture(
+        this->handles.reflectionProbes,
+        this->probeTexture,
+        nullptr,
+        this->probeSRV
+    );
+}
+
 void ReflectionProbeSystem::UploadProbeData(ID3D11DeviceContext *deviceContext) const {
     if (this->perFrameProbeData.count <= 0)
         return;
@@ -426,7 +806,7 @@ void ReflectionProbeSystem::UploadProbeData(ID3D11DeviceContext *deviceContext)
     for (int i = 0; i < this->perFrameProbeData.count; ++i) {
         data[i].position = this->perFrameProbeData.entries[i].position;
         data[i].radius = this->perFrameProbeData.entries[i].radius;
-        data[i].slotIndex = i;
+        data[i].slotIndex = this->perFrameProbeData.entries[i].slot;
     }
 
     D3D11_MAPPED_SUBRESOURCE mapped;
@@ -438,4 +818,328 @@ void ReflectionProbeSystem::UploadProbeData(ID3D11DeviceContext *deviceContext)
 
     memcpy(mapped.pData, data, sizeof(Reflection_probe_data) * this->perFrameProbeData.count);
     deviceContext->Unmap(this->probeBuffer, 0);
+}
+
+uint8_t ReflectionProbeSystem::ComputeFaceMask(const BoundingBox &bounds, const XMFLOAT3 &position, float nearPlane, float farPlane) {
+    // Relative to the probe
+    const float minimum[3] = {
+        bounds.Center.x - bounds.Extents.x - position.x,
+        bounds.Center.y - bounds.Extents.y - position.y,
+        bounds.Center.z - bounds.Extents.z - position.z
+    };
+    const float maximum[3] = {
+        bounds.Center.x + bounds.Extents.x - position.x,
+        bounds.Center.y + bounds.Extents.y - position.y,
+        bounds.Center.z + bounds.Extents.z - position.z
+    };
+
+    uint8_t faceMask = 0;
+    for (int face = 0; face < 6; ++face) {
+        const int axis = face / 2;
+        const bool isNegative = face % 2 == 1;
+
+        // Depth range of the box in the face
+        const float nearest = isNegative ? -maximum[axis] : minimum[axis];
+        const float farthest = isNegative ? -minimum[axis] : maximum[axis];
+
+        if (farthest < nearPlane || nearest > farPlane)
+            continue;
+
+        // The face widens with depth, so the box reaches in when it does at its deepest point within the far plane.
+        // The axes are independent, each only needs its value closest to zero within that depth.
+        const float depth = std::min(farthest, farPlane);
+
+        bool reachesIn = true;
+        for (int offset = 1; offset < 3; ++offset) {
+            const int other = (axis + offset) % 3;
+            const float closestToZero = std::max({ minimum[other], -maximum[other], 0.0f });
+            reachesIn = reachesIn && closestToZero <= depth;
+        }
+
+        if (reachesIn)
+            faceMask |= 1 << face;
+    }
+
+    return faceMask;
+}
+
+void ReflectionProbeSystem::RunFaceMaskTest() {
+    LogInfo("Reflection probe face mask test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    TestRandom random(24680);
+
+    const XMFLOAT3 position = { 3.0f, -2.0f, 7.0f };
+    const float nearPlane = 0.1f;
+    const float farPlane = 50.0f;
+
+    auto boxAt = [&position](float x, float y, float z, float extent) {
+        return BoundingBox(XMFLOAT3(position.x + x, position.y + y, position.z + z), XMFLOAT3(extent, extent, extent));
+    };
+
+    checks.Check(ComputeFaceMask(boxAt(0.0f, 0.0f, 0.0f, 1.0f), position, nearPlane, farPlane) == ProbeScheduler::ALL_FACES, "Boxes around the probe reach every face");
+    checks.Check(ComputeFaceMask(boxAt(10.0f, 0.0f, 0.0f, 1.0f), position, nearPlane, farPlane) == 0x01, "Boxes in front of +x only reach +x");
+    checks.Check(ComputeFaceMask(boxAt(0.0f, -10.0f, 0.0f, 1.0f), position, nearPlane, farPlane) == 0x08, "Boxes in front of -y only reach -y");
+    checks.Check(ComputeFaceMask(boxAt(100.0f, 0.0f, 0.0f, 1.0f), position, nearPlane, farPlane) == 0, "Boxes past the far plane reach no face");
+    checks.Check(ComputeFaceMask(boxAt(10.0f, 10.0f, 10.0f, 1.0f), position, nearPlane, farPlane) == 0x15, "Boxes on a corner reach its three faces");
+
+    // The frusta the six views would cull against
+    BoundingFrustum frusta[6];
+    for (int face = 0; face < 6; ++face) {
+        XMMATRIX viewMatrix, projectionMatrix;
+        GetFaceMatrices(position, nearPlane, farPlane, face, viewMatrix, projectionMatrix);
+
+        BoundingFrustum::CreateFromMatrix(frusta[face], projectionMatrix);
+        frusta[face].Transform(frusta[face], XMMatrixInverse(nullptr, viewMatrix));
+    }
+
+    const int boxCount = 2048;
+    bool coversPoints = true;
+    bool isWithinFrusta = true;
+    int sixViewCommandCount = 0;
+    int singlePassCommandCount = 0;
+    int faceDrawCount = 0;
+
+    for (int i = 0; i < boxCount; ++i) {
+        const float extent = random.NextFloat(0.1f, 8.0f);
+        const BoundingBox box = boxAt(
+            random.NextFloat(-60.0f, 60.0f),
+            random.NextFloat(-60.0f, 60.0f),
+            random.NextFloat(-60.0f, 60.0f),
+            extent
+        );
+
+        const uint8_t faceMask = ComputeFaceMask(box, position, nearPlane, farPlane);
+
+        // Every point of the box within the cube must land in a face of the mask
+        for (int n = 0; n < 16; ++n) {
+            const float point[3] = {
+                random.NextFloat(-box.Extents.x, box.Extents.x) + box.Center.x - position.x,
+                random.NextFloat(-box.Extents.y, box.Extents.y) + box.Center.y - position.y,
+                random.NextFloat(-box.Extents.z, box.Extents.z) + box.Center.z - position.z
+            };
+
+            int axis = 0;
+            for (int other = 1; other < 3; ++other)
+                if (fabsf(point[other]) > fabsf(point[axis]))
+                    axis = other;
+
+            const float depth = fabsf(point[axis]);
+            if (depth < nearPlane || depth > farPlane)
+                continue;
+
+            const int face = axis * 2 + (point[axis] < 0.0f ? 1 : 0);
+            coversPoints = coversPoints && (faceMask & (1 << face));
+        }
+
+        for (int face = 0; face < 6; ++face) {
+            const bool isInFrustum = frusta[face].Intersects(box);
+            if (isInFrustum)
+                ++sixViewCommandCount;
+
+            // Frustum tests are conservative, the mask can only be tighter
+            if ((faceMask & (1 << face)) && !isInFrustum)
+                isWithinFrusta = false;
+        }
+
+        if (faceMask != 0) {
+            ++singlePassCommandCount;
+            faceDrawCount += ProbeScheduler::CountFaces(faceMask);
+        }
+    }
+
+    checks.Check(coversPoints, "Face masks hold the faces of every point in the box");
+    checks.Check(isWithinFrusta, "Face masks only hold faces whose frusta the box touches");
+
+    LogInfo(
+        "%d boxes: six views cull to %d commands, the single pass draws %d commands reaching %d faces\n",
+        boxCount,
+        sixViewCommandCount,
+        singlePassCommandCount,
+        faceDrawCount
+    );
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
+
+void ReflectionProbeSystem::RunProbeAssignmentTest() {
+    LogInfo("Reflection probe assignment test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    TestRandom random(54321);
+
+    // World space is view space, the camera is at the origin looking down +z
+    const float nearDepth = 0.1f;
+    const float farDepth = 200.0f;
+
+    const XMMATRIX projection = XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, nearDepth, farDepth);
+    XMFLOAT4X4 projectionMatrix;
+    XMStoreFloat4x4(&projectionMatrix, projection);
+
+    LightSelector::Camera camera;
+    camera.position = { 0.0f, 0.0f, 0.0f };
+    camera.projectionScale = projectionMatrix._22;
+    BoundingFrustum::CreateFromMatrix(camera.frustum, projection);
+
+    std::vector<LightSelector::Candidate> candidates;
+    for (int i = 0; i < 256; ++i) {
+        LightSelector::Candidate candidate;
+        candidate.id = i + 1;
+        candidate.bounds = BoundingSphere(
+            XMFLOAT3(random.NextFloat(-200.0f, 200.0f), random.NextFloat(-120.0f, 120.0f), random.NextFloat(-100.0f, 260.0f)),
+            random.NextFloat(2.0f, 30.0f)
+        );
+        candidate.intensity = 1.0f;
+        candidates.push_back(candidate);
+    }
+
+    LightSelector selector;
+    LightSelector::Selection selection;
+    selector.Select(candidates, camera, MAX_REFLECTION_PROBES, 0, selection);
+
+    {
+        bool areVisible = true;
+        bool isRanked = true;
+        for (int i = 0; i < selection.lights.size(); ++i) {
+            const LightSelector::Candidate &candidate = candidates[selection.lights[i]];
+            areVisible = areVisible && camera.frustum.Contains(candidate.bounds) != DISJOINT;
+
+            if (i > 0)
+                isRanked = isRanked && LightSelector::ComputeScore(candidates[selection.lights[i - 1]], camera) >= LightSelector::ComputeScore(candidate, camera);
+        }
+
+        checks.Check(areVisible && selection.culledCount > 0, "Probes outside the frustum are culled");
+        checks.Check(selection.lights.size() == MAX_REFLECTION_PROBES && selection.droppedCount > 0, "Visible probes past the cap are dropped");
+        checks.Check(isRanked, "Probes are ranked by screen coverage");
+    }
+
+    {
+        // The lookup cs_lighting.hlsl does against a scan over every uploaded probe
+        std::vector<XMFLOAT4> bounds;
+        for (int index : selection.lights) {
+            const BoundingSphere &sphere = candidates[index].bounds;
+            bounds.push_back({ sphere.Center.x, sphere.Center.y, sphere.Center.z, sphere.Radius });
+        }
+
+        // Large members, kept off the stack
+        std::vector<LightClusterBuilder> builders(1);
+        LightClusterBuilder &builder = builders[0];
+        builder.SetGrid(projectionMatrix, nearDepth, farDepth);
+        builder.Build(bounds);
+
+        const std::vector<XMUINT2> &ranges = builder.GetClusterRanges();
+        const std::vector<uint32_t> &indices = builder.GetLightIndices();
+
+        // Same as SampleReflectionProbe, the closest probe containing the point and the first of equally close ones
+        auto findClosest = [&bounds](const XMFLOAT3 &point, auto &&getProbe, uint32_t count) {
+            float closestDistanceSq = 0.0f;
+            int closest = -1;
+
+            for (uint32_t n = 0; n < count; ++n) {
+                const uint32_t i = getProbe(n);
+                const XMFLOAT4 &sphere = bounds[i];
+
+                const float dx = point.x - sphere.x;
+                const float dy = point.y - sphere.y;
+                const float dz = point.z - sphere.z;
+                const float distanceSq = dx * dx + dy * dy + dz * dz;
+
+                if (distanceSq <= sphere.w * sphere.w && (closest == -1 || distanceSq < closestDistanceSq)) {
+                    closest = static_cast<int>(i);
+                    closestDistanceSq = distanceSq;
+                }
+            }
+
+            return closest;
+        };
+
+        auto isNearEdge = [](float coordinate) {
+            const float fraction = coordinate - floorf(coordinate);
+            return fraction < 0.001f || fraction > 0.999f;
+        };
+
+        int testedCount = 0;
+        int foundCount = 0;
+        int differentCount = 0;
+        uint64_t clusterProbeCount = 0;
+
+        for (int i = 0; i < 8192; ++i) {
+            const float depth = random.NextFloat(nearDepth, farDepth);
+            const XMFLOAT3 point = {
+                random.NextFloat(-1.0f, 1.0f) * depth / projectionMatrix._11,
+                random.NextFloat(-1.0f, 1.0f) * depth / projectionMatrix._22,
+                depth
+            };
+
+            XMFLOAT3 coordinates;
+            if (!builder.GetClusterCoordinates(point, coordinates))
+                continue;
+
+            if (isNearEdge(coordinates.x) || isNearEdge(coordinates.y) || isNearEdge(coordinates.z))
+                continue;
+
+            const XMUINT2 &range = ranges[LightClusterBuilder::GetClusterIndex(coordinates)];
+            const int fromCluster = findClosest(point, [&](uint32_t n) { return indices[range.x + n]; }, range.y);
+            const int fromScan = findClosest(point, [](uint32_t n) { return n; }, static_cast<uint32_t>(bounds.size()));
+
+            ++testedCount;
+            clusterProbeCount += range.y;
+
+            if (fromScan >= 0)
+                ++foundCount;
+            if (fromCluster != fromScan)
+                ++differentCount;
+        }
+
+        LogInfo(
+            "%d points looked up, %d inside a probe, %d differ from the scan, %.2f probes tested per point instead of %d\n",
+            testedCount,
+            foundCount,
+            differentCount,
+            testedCount > 0 ? static_cast<double>(clusterProbeCount) / testedCount : 0.0,
+            static_cast<int>(bounds.size())
+        );
+
+        checks.Check(foundCount > 0 && differentCount == 0, "Cluster lookup finds the same probe as a scan over every probe");
+    }
+
+    {
+        // Growing the cube array a page at a time keeps the probes' slots
+        ProbeScheduler scheduler;
+        scheduler.Initialize(PROBE_PAGE_SIZE);
+
+        std::vector<ProbeScheduler::Probe> probes(PROBE_PAGE_SIZE + 4);
+        for (int i = 0; i < probes.size(); ++i)
+            probes[i].id = i + 1;
+
+        std::vector<ProbeScheduler::Probe> firstPage(probes.begin(), probes.begin() + PROBE_PAGE_SIZE);
+        std::vector<ProbeScheduler::Assignment> before;
+        scheduler.Schedule(firstPage, before);
+
+        scheduler.GrowSlots(PROBE_PAGE_SIZE * 2);
+
+        std::vector<ProbeScheduler::Assignment> after;
+        scheduler.Schedule(probes, after);
+
+        bool keepsSlots = after.size() == probes.size();
+        for (int i = 0; i < PROBE_PAGE_SIZE && keepsSlots; ++i)
+            keepsSlots = after[i].slot == before[i].slot && after[i].faceMask == 0;
+
+        bool usesNewPage = keepsSlots;
+        for (int i = PROBE_PAGE_SIZE; i < after.size() && usesNewPage; ++i)
+            usesNewPage = after[i].slot >= PROBE_PAGE_SIZE && after[i].faceMask == ProbeScheduler::ALL_FACES;
+
+        checks.Check(keepsSlots, "Probes keep their slots when the cube array grows");
+        checks.Check(usesNewPage, "New probes go into the new page");
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
 }
\ No newline at end of file
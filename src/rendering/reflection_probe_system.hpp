@@ -4,6 +4,8 @@
 #include "rendering/render_view.hpp"
 #include "rendering/frame_graph.hpp"
 #include "rendering/shared_resources.hpp"
+#include "rendering/probe_scheduler.hpp"
+#include "rendering/light_selector.hpp"
 
 #include <d3d11.h>
 #include <DirectXMath.h>
@@ -17,50 +19,95 @@ class ShadowSystem;
 struct Reflection_probe_handles {
     FrameGraph::TextureHandle reflectionProbes = FrameGraph::INVALID_HANDLE;
 
-    ID3D11ShaderResourceView *reflectionProbeBufferSRV = nullptr;
+    FrameGraph::BufferHandle reflectionProbeBuffer = FrameGraph::INVALID_HANDLE;
 };
 
+// Renders the probes in view into a cube array for the lighting pass. Probes outside the primary frustum are culled
+// and the rest ranked by how much of the screen they cover, the cube array grows a page of cubes at a time when
+// more probes are visible than it holds.
 class ReflectionProbeSystem {
     friend class Renderer;
 
 public:
-    static constexpr int MAX_REFLECTION_PROBES = 4;
+    static constexpr int MAX_REFLECTION_PROBES = 64;
+    static constexpr int PROBE_PAGE_SIZE = 8; // Cubes the cube array grows by
     static constexpr int REFLECTION_PROBE_RESOLUTION = 256;
 
+    // Constant buffer ring key of the per-draw face masks, above any material pointer the ring is also keyed by
+    static constexpr uint64_t FACE_MASK_ALLOCATION_KEY = 1ull << 63;
+
 private:
+    ID3D11Device *device = nullptr;
+
     ID3D11VertexShader *reflectionVS = nullptr;
     ID3D11PixelShader *reflectionPS = nullptr;
     ID3D11InputLayout *reflectionLayout = nullptr;
+    ID3D11GeometryShader *reflectionGS = nullptr; // Single pass, copies triangles into the faces
     ID3D11ComputeShader *skyboxCS = nullptr;
+    ID3D11Buffer *cubeFaceBuffer = nullptr;
+    ID3D11Buffer *faceMaskBuffer = nullptr; // Only used when the constant buffer ring can't bind by offset
 
     ID3D11Texture2D *probeTexture = nullptr;
     ID3D11ShaderResourceView *probeSRV = nullptr;
-    ID3D11RenderTargetView *probeRTVs[MAX_REFLECTION_PROBES * 6] = {};
-    ID3D11UnorderedAccessView *probeUAVs[MAX_REFLECTION_PROBES * 6] = {};
+    std::vector<ID3D11RenderTargetView *> probeRTVs; // Per face
+    std::vector<ID3D11UnorderedAccessView *> probeUAVs;
+    std::vector<ID3D11RenderTargetView *> probeCubeRTVs; // Per cube, all six faces for the single pass
+    int probeCubeCount = 0;
     ID3D11Texture2D *probeDepthTexture = nullptr;
     ID3D11DepthStencilView *probeDepthDSV = nullptr;
+    ID3D11Texture2D *probeCubeDepthTexture = nullptr;
+    ID3D11DepthStencilView *probeCubeDepthDSV = nullptr;
 
     ID3D11Buffer *probeBuffer = nullptr;
     ID3D11ShaderResourceView *probeBufferSRV = nullptr;
 
     struct Per_frame_probe_data {
         int count = 0;
+        int faceCount = 0; // Rendered this frame
         struct Entry {
             XMFLOAT3 position;
             float radius;
+            float nearPlane;
+            float farPlane;
+            int slot;
+            uint8_t faceMask;
         } entries[MAX_REFLECTION_PROBES];
     } perFrameProbeData;
 
+    // Every face of a probe is culled and drawn once with the geometry shader instead of once per face
+    bool isSinglePass = false;
+
+    LightSelector probeSelector;
+    LightSelector::Selection probeSelection;
+    std::vector<BoundingSphere> probeBounds; // Influence of the uploaded probes, in upload order
+
+    ProbeScheduler scheduler;
+    std::vector<ProbeScheduler::Probe> scheduledProbes;
+    std::vector<ProbeScheduler::Assignment> assignments;
+
     ShadowSystem *shadowSystem = nullptr; // Needed to get lighting in the reflections
 
+    Reflection_probe_handles handles;
+
     void ExectuteReflectionRenderPass(
         FrameGraph::ExecutionContext &context, 
         const SharedResources &sharedResources, 
         const float *clearColour
     );
 
-    bool CreateTextureCubeArray(ID3D11Device *device);
+    // Replaces the cube array with one holding cubeCount cubes, keeping what the old one held
+    bool CreateTextureCubeArray(ID3D11Device *device, int cubeCount);
     bool CreateDepthTexture(ID3D11Device *device);
+    bool CreateConstantBuffers(ID3D11Device *device);
+
+    static void GetFaceMatrices(
+        const XMFLOAT3 &position,
+        float nearPlane,
+        float farPlane,
+        int face,
+        XMMATRIX &outViewMatrix,
+        XMMATRIX &outProjectionMatrix
+    );
     bool LoadShaders(ID3D11Device *device, const std::string &shaderDir);
 
     ReflectionProbeSystem() = default;
@@ -71,15 +118,34 @@ private:
 public:
     void PrepareViews(Scene *scene, const Render_view &primaryView, std::vector<Render_view> &outViews);
 
+    // The probe texture is always imported, includeRenderPass is false when there's nothing to render this frame
     Reflection_probe_handles RegisterRenderPasses(
         FrameGraph &frameGraph, 
         const SharedResources &sharedResources, 
-        const float *clearColour
+        const float *clearColour,
+        bool includeRenderPass
     );
 
+    // The cube array is recreated when it grows, a graph built before that still points at the old one
+    void UpdateImportedTextures(FrameGraph &frameGraph);
+
     void UploadProbeData(ID3D11DeviceContext *deviceContext) const;
 
     int GetActiveProbeCount() const { return this->perFrameProbeData.count; };
+    int GetUpdatedFaceCount() const { return this->perFrameProbeData.faceCount; }
+    const std::vector<BoundingSphere> &GetProbeBounds() const { return this->probeBounds; }
+
+    // Faces of a probe at position whose frusta the bounds reach into, bit n is face n in +x, -x, +y, -y, +z, -z
+    // order. Exact for the box, the faces are the pyramids where one coordinate outweighs the other two.
+    static uint8_t ComputeFaceMask(const BoundingBox &bounds, const XMFLOAT3 &position, float nearPlane, float farPlane);
+
+    // Checks face masks of synthetic boxes against points sampled in them and the face frusta, and compares the
+    // commands drawn by the single pass with the commands the six views would cull down to
+    static void RunFaceMaskTest();
+
+    // Culls and ranks synthetic probes, assigns them to clusters and checks the lookup the lighting shader does
+    // against a scan over every probe
+    static void RunProbeAssignmentTest();
 };
 
 #endif
\ No newline at end of file
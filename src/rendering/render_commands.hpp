@@ -3,8 +3,11 @@
 
 #include "resources/assets.hpp"
 #include "resources/asset_manager.hpp"
+#include "rendering/constant_buffer_ring.hpp"
+#include "rendering/probe_scheduler.hpp"
 
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include <d3d11.h>
 
 using namespace DirectX;
@@ -12,6 +15,7 @@ using namespace DirectX;
 struct Geometry_command {
     ID3D11Buffer *vertexBuffer = nullptr;
     ID3D11Buffer *indexBuffer  = nullptr;
+    ID3D11Buffer *positionBuffer = nullptr; // Positions only, depth-only draws read vertexBuffer without it
 
     UINT indexCount = 0U;
     UINT startIndex = 0U;
@@ -19,8 +23,18 @@ struct Geometry_command {
 
     AssetHandle<Material> material{};
     bool isReflective = false;
+    bool isStatic = false; // Drawn into the cached shadow maps
 
     XMFLOAT4X4 worldMatrix{};
+    BoundingBox worldBounds{};
+
+    uint8_t faceMask = 0x3F; // Cube views only, the faces the draw reaches
+
+    // Filled in by the renderer right before the frame graph executes
+    Ring_allocation objectConstants{};
+    Ring_allocation materialConstants{};
+    Ring_allocation tessellationConstants{};
+    Ring_allocation faceMaskConstants{}; // Cube views only
 };
 
 struct Directional_light_command {
@@ -44,6 +58,9 @@ struct Spot_light_command {
     float outerConeAngle = 0.0f; // Radians
 
     bool castsShadows = false;
+
+    uint64_t id = 0; // Stable across frames, the light keeps its shadow atlas tile by it
+    uint32_t revision = 0; // Changes when anything else in the command does, the light is only packed again then
 };
 
 struct Skybox_command {
@@ -55,7 +72,12 @@ struct Reflection_probe_command {
     float    nearPlane   = 0.1f;
     float    farPlane    = 100.0f;
     float    radius      = 10.0f;
-    bool     needsUpdate = true;
+    bool     needsUpdate = false; // Renders every face this frame, whatever the policy
+
+    Probe_update_policy updatePolicy = Probe_update_policy::onChange;
+    int facesPerFrame = 1; // Round robin only
+
+    uint64_t id = 0; // Stable across frames, the probe keeps its cube array slot by it
 };
 
 struct Particle_emitter_command {
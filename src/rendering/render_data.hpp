@@ -32,6 +32,8 @@ struct Per_material_data {
     float    isReflective;
     XMFLOAT3 materialSpecular;
     float    materialSpecularExponent;
+    UINT     materialIndex; // Into the material table
+    float    pad0[3];
 };
 static_assert(sizeof(Per_material_data) % 16 == 0);
 
@@ -42,6 +44,10 @@ struct Lighting_data {
     int      spotLightCount;
     int      reflectionProbeCount;
     int      hasSkybox;
+    UINT     renderWidth; // Part of the G-buffer rendered at the current render scale
+    UINT     renderHeight;
+    float    clusterDepthScale; // Light cluster slice of a view depth is floor(log(depth) * scale + bias)
+    float    clusterDepthBias;
     float    pad0;
 };
 static_assert(sizeof(Lighting_data) % 16 == 0);
@@ -80,10 +86,14 @@ static_assert(sizeof(Tessellation_data) % 16 == 0);
 
 // CBuffer
 struct Deferred_debug_data {
-    int   debugMode = 0;
-    float nearPlane = 0.1f;
-    float farPlane  = 512.0f;
-    float pad0;
+    int      debugMode = 0;
+    float    nearPlane = 0.1f;
+    float    farPlane  = 512.0f;
+    float    pad0;
+
+    // From backbuffer UVs to the rendered part of the inputs, clamped to its last texel centre
+    XMFLOAT2 uvScale   = { 1.0f, 1.0f };
+    XMFLOAT2 uvMax     = { 1.0f, 1.0f };
 };
 static_assert(sizeof(Deferred_debug_data) % 16 == 0);
 
@@ -93,9 +103,12 @@ struct Directional_light_data {
     float      intensity;
     XMFLOAT3   colour;
     int        castsShadows;
-    int        shadowSliceIndex;
-    float      pad0[3];
-    XMFLOAT4X4 viewProjectionMatrix;
+    int        shadowSliceIndex;  // Of the first cascade, the others follow
+    int        cascadeCount;
+    float      pad0[2];
+    XMFLOAT4   cascadeSplits;     // View depth each cascade ends at
+    XMFLOAT4   cascadeTexelSizes; // In world units
+    XMFLOAT4X4 cascadeViewProjectionMatrices[4];
 };
 static_assert(sizeof(Directional_light_data) % 16 == 0);
 
@@ -109,12 +122,26 @@ struct Spot_light_data {
     float      cosInnerAngle;
     float      cosOuterAngle;
     int        castsShadows; // C++ bool != HLSL bool
-    int        shadowSliceIndex;
-    float      pad0;
+    int        shadowTileIndex;
+    float      shadowTexelSize; // 1 / tile size
+    XMFLOAT4   shadowAtlasRect; // Scale in xy and offset in zw, from tile to atlas UVs
     XMFLOAT4X4 viewProjectionMatrix;
 };
 static_assert(sizeof(Spot_light_data) % 16 == 0);
 
+// CBuffer
+struct Cube_face_data {
+    XMFLOAT4X4 faceViewProjectionMatrices[6]; // +x, -x, +y, -y, +z, -z
+};
+static_assert(sizeof(Cube_face_data) % 16 == 0);
+
+// CBuffer
+struct Cube_face_draw_data {
+    UINT  faceMask; // Faces the draw reaches, bit n is face n
+    UINT  pad0[3];
+};
+static_assert(sizeof(Cube_face_draw_data) % 16 == 0);
+
 // Structured buffer element
 struct Reflection_probe_data {
     XMFLOAT3 position;
@@ -124,4 +151,75 @@ struct Reflection_probe_data {
 };
 static_assert(sizeof(Reflection_probe_data) % 16 == 0);
 
+// CBuffer
+struct Culling_data {
+    XMFLOAT4 frustumPlanes[6];
+    UINT     batchCount;
+    UINT     pad0[3];
+};
+static_assert(sizeof(Culling_data) % 16 == 0);
+
+// CBuffer
+struct Light_cluster_data {
+    float projectionScaleX;
+    float projectionScaleY;
+    float nearDepth;
+    float farDepth;
+    UINT  lightCount;
+    UINT  pad0[3];
+};
+static_assert(sizeof(Light_cluster_data) % 16 == 0);
+
+// CBuffer
+struct Instance_batch_data {
+    UINT firstInstance;
+    UINT pad0[3];
+};
+static_assert(sizeof(Instance_batch_data) % 16 == 0);
+
+// Structured buffer element
+struct Gpu_instance_data {
+    XMFLOAT4X4 worldMatrix;
+    XMFLOAT4X4 worldMatrixInvTranspose;
+    XMFLOAT3   boundsCenter;
+    float      pad0;
+    XMFLOAT3   boundsExtents;
+    float      pad1;
+};
+static_assert(sizeof(Gpu_instance_data) % 16 == 0);
+
+// Structured buffer element
+struct Gpu_batch_data {
+    UINT firstInstance;
+    UINT instanceCount;
+    UINT indexCount;
+    UINT startIndex;
+    INT  baseVertex;
+    UINT pad0[3];
+};
+static_assert(sizeof(Gpu_batch_data) % 16 == 0);
+
+// Structured buffer element
+struct Material_table_entry {
+    XMFLOAT3 diffuseColour;
+    float    specularExponent;
+    XMFLOAT3 specularColour;
+    UINT     diffuseBucket;
+    UINT     diffuseSlice;
+    UINT     normalBucket;
+    UINT     normalSlice;
+    float    pad0;
+};
+static_assert(sizeof(Material_table_entry) % 16 == 0);
+
+// Layout expected by DrawIndexedInstancedIndirect
+struct Draw_indexed_indirect_args {
+    UINT indexCountPerInstance;
+    UINT instanceCount;
+    UINT startIndexLocation;
+    INT  baseVertexLocation;
+    UINT startInstanceLocation;
+};
+static_assert(sizeof(Draw_indexed_indirect_args) == 20);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "render_queue.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static void SortByViewDepth(std::vector<Geometry_command> &commands, FXMMATRIX viewMatrix) {
+    if (commands.size() < 2)
+        return;
+
+    struct Sort_key {
+        float depth;
+        uint32_t index;
+    };
+
+    std::vector<Sort_key> keys(commands.size());
+    for (uint32_t i = 0; i < commands.size(); ++i) {
+        const BoundingBox &bounds = commands[i].worldBounds;
+
+        XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&bounds.Center), viewMatrix);
+        float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+
+        keys[i].depth = XMVectorGetZ(center) - radius;
+        keys[i].index = i;
+    }
+
+    // Ties keep submission order so the result is deterministic
+    std::sort(keys.begin(), keys.end(), [](const Sort_key &a, const Sort_key &b) {
+        return a.depth < b.depth || (a.depth == b.depth && a.index < b.index);
+    });
+
+    std::vector<Geometry_command> sorted;
+    sorted.reserve(commands.size());
+    for (const Sort_key &key : keys)
+        sorted.push_back(std::move(commands[key.index]));
+
+    commands.swap(sorted);
+}
+
+void RenderQueue::SortFrontToBack(const XMFLOAT4X4 &viewMatrix) {
+    XMMATRIX view = XMLoadFloat4x4(&viewMatrix);
+
+    SortByViewDepth(this->geometryCommands, view);
+    SortByViewDepth(this->tessellatedGeometryCommands, view);
+}
+
+void RenderQueue::RunSortTest() {
+    LogInfo("Render queue sort test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    // The start index is only used to tell the commands apart
+    auto makeCommand = [](UINT id, const XMFLOAT3 &center, const XMFLOAT3 &extents) {
+        Geometry_command command;
+        command.startIndex = id;
+        command.worldBounds = BoundingBox(center, extents);
+        return command;
+    };
+
+    auto hasOrder = [](const std::vector<Geometry_command> &commands, std::initializer_list<UINT> ids) {
+        if (commands.size() != ids.size())
+            return false;
+
+        size_t i = 0;
+        for (UINT id : ids)
+            if (commands[i++].startIndex != id)
+                return false;
+
+        return true;
+    };
+
+    // Camera at z = -10 looking down +z, so view depth is world z + 10
+    XMFLOAT4X4 viewMatrix;
+    XMStoreFloat4x4(&viewMatrix, XMMatrixLookToLH(XMVectorSet(0.0f, 0.0f, -10.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+
+    const XMFLOAT3 smallExtents = { 0.5f, 0.5f, 0.5f };
+
+    {
+        RenderQueue queue;
+        queue.Submit(makeCommand(0, { 0.0f, 0.0f, 10.0f }, smallExtents));
+        queue.Submit(makeCommand(1, { 2.0f, 0.0f, 0.0f }, smallExtents));
+        queue.Submit(makeCommand(2, { 0.0f, -3.0f, 30.0f }, smallExtents));
+        queue.Submit(makeCommand(3, { 0.0f, 0.0f, -5.0f }, smallExtents));
+        queue.SortFrontToBack(viewMatrix);
+
+        checks.Check(hasOrder(queue.geometryCommands, { 3, 1, 0, 2 }), "Commands are sorted nearest first");
+    }
+
+    {
+        // Commands beside each other at the same depth, ties keep submission order
+        RenderQueue queue;
+        queue.Submit(makeCommand(0, { 0.0f, 0.0f, 20.0f }, smallExtents));
+        queue.Submit(makeCommand(1, { 5.0f, 0.0f, 0.0f }, smallExtents));
+        queue.Submit(makeCommand(2, { -5.0f, 0.0f, 0.0f }, smallExtents));
+        queue.Submit(makeCommand(3, { 0.0f, 0.0f, 0.0f }, smallExtents));
+        queue.Submit(makeCommand(4, { 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }));
+        queue.Submit(makeCommand(5, { 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }));
+        queue.SortFrontToBack(viewMatrix);
+
+        checks.Check(hasOrder(queue.geometryCommands, { 1, 2, 3, 4, 5, 0 }), "Commands at equal depth keep submission order");
+    }
+
+    {
+        // Bounds around the camera have their nearest point behind it, they go before everything in front
+        RenderQueue queue;
+        queue.Submit(makeCommand(0, { 0.0f, 0.0f, -9.0f }, smallExtents));
+        queue.Submit(makeCommand(1, { 0.0f, 0.0f, -5.0f }, { 20.0f, 20.0f, 20.0f }));
+        queue.Submit(makeCommand(2, { 0.0f, 0.0f, -10.0f }, { 2.0f, 2.0f, 2.0f }));
+        queue.Submit(makeCommand(3, { 0.0f, 0.0f, 5.0f }, smallExtents));
+        queue.SortFrontToBack(viewMatrix);
+
+        checks.Check(hasOrder(queue.geometryCommands, { 1, 2, 0, 3 }), "Bounds straddling the camera sort by their nearest point");
+    }
+
+    {
+        RenderQueue queue;
+        queue.SubmitTessellated(makeCommand(0, { 0.0f, 0.0f, 10.0f }, smallExtents));
+        queue.SubmitTessellated(makeCommand(1, { 0.0f, 0.0f, 5.0f }, smallExtents));
+        queue.SortFrontToBack(viewMatrix);
+
+        checks.Check(hasOrder(queue.tessellatedGeometryCommands, { 1, 0 }), "Tessellated commands are sorted too");
+    }
+
+    {
+        RenderQueue queue;
+        queue.SortFrontToBack(viewMatrix);
+        queue.Submit(makeCommand(0, { 0.0f, 0.0f, 10.0f }, smallExtents));
+        queue.SortFrontToBack(viewMatrix);
+
+        checks.Check(hasOrder(queue.geometryCommands, { 0 }), "Empty and single command queues are left alone");
+    }
+
+    {
+        // Random commands on whole depths and two sizes, so many of them tie
+        TestRandom random(24680);
+
+        const int commandCount = 2000;
+
+        RenderQueue queue;
+        for (int i = 0; i < commandCount; ++i) {
+            const float extent = random.NextFloat(0.0f, 1.0f) < 0.5f ? 1.0f : 4.0f;
+            queue.Submit(makeCommand(i, { random.NextFloat(-50.0f, 50.0f), random.NextFloat(-50.0f, 50.0f), floorf(random.NextFloat(-10.0f, 40.0f)) }, { extent, extent, extent }));
+        }
+
+        const XMMATRIX view = XMLoadFloat4x4(&viewMatrix);
+
+        std::vector<float> depths(commandCount);
+        for (const Geometry_command &command : queue.geometryCommands) {
+            const BoundingBox &bounds = command.worldBounds;
+            const float centerDepth = XMVectorGetZ(XMVector3TransformCoord(XMLoadFloat3(&bounds.Center), view));
+            depths[command.startIndex] = centerDepth - XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+        }
+
+        queue.SortFrontToBack(viewMatrix);
+
+        std::vector<bool> isSeen(commandCount, false);
+        bool isPermutation = queue.geometryCommands.size() == commandCount;
+        bool isOrdered = true;
+        int tieCount = 0;
+
+        for (size_t i = 0; i < queue.geometryCommands.size(); ++i) {
+            const UINT id = queue.geometryCommands[i].startIndex;
+            isPermutation = isPermutation && !isSeen[id];
+            isSeen[id] = true;
+
+            if (i == 0)
+                continue;
+
+            const UINT previousId = queue.geometryCommands[i - 1].startIndex;
+            if (depths[previousId] > depths[id] || (depths[previousId] == depths[id] && previousId > id))
+                isOrdered = false;
+
+            if (depths[previousId] == depths[id])
+                ++tieCount;
+        }
+
+        checks.Check(isPermutation, "Sorting keeps every command once");
+        checks.Check(isOrdered, "Random commands are ordered by nearest depth, ties by submission order");
+        LogInfo("%d random commands, %d equal depth neighbours\n", commandCount, tieCount);
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "rendering/render_commands.hpp"
 
+#include <DirectXMath.h>
 #include <vector>
 #include <optional>
 
@@ -26,6 +27,13 @@ public:
         this->particleEmitterCommands.clear();
     }
 
+    // Sorts the geometry commands by the view-space depth of the nearest point of their bounds
+    void SortFrontToBack(const XMFLOAT4X4 &viewMatrix);
+
+    // Sorts hand-placed and random synthetic commands, including equal depths and bounds straddling the camera,
+    // and checks the order against the nearest depth of their bounds
+    static void RunSortTest();
+
     void Submit(const Geometry_command &command) {
         this->geometryCommands.push_back(command);
     }
@@ -84,19 +84,71 @@ bool CreateDepthStencilArray(
     return true;
 }
 
+bool CreateDepthStencilTexture(
+    ID3D11Device *device,
+    int width,
+    int height,
+    ID3D11Texture2D **outTexture,
+    ID3D11DepthStencilView **outDSV,
+    ID3D11ShaderResourceView **outSRV,
+    const char *debugName
+) {
+    D3D11_TEXTURE2D_DESC desc{};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_R32_TYPELESS;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+
+    HRESULT result = device->CreateTexture2D(&desc, nullptr, outTexture);
+    if (FAILED(result)) {
+        LogError("Failed to create depth texture '%s'", debugName);
+        return false;
+    }
+
+    D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc{};
+    dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+    dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+    dsvDesc.Texture2D.MipSlice = 0;
+
+    result = device->CreateDepthStencilView(*outTexture, &dsvDesc, outDSV);
+    if (FAILED(result)) {
+        LogError("Failed to create DSV for '%s'", debugName);
+        return false;
+    }
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+    srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MipLevels = 1;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+
+    result = device->CreateShaderResourceView(*outTexture, &srvDesc, outSRV);
+    if (FAILED(result)) {
+        LogError("Failed to create SRV for '%s'", debugName);
+        return false;
+    }
+
+    return true;
+}
+
 bool CreateStructuredBuffer(
     ID3D11Device *device, 
     UINT elementSize, 
     UINT elementCount, 
     ID3D11Buffer **outBuffer, 
     ID3D11ShaderResourceView **outSRV, 
-    const char *debugName
+    const char *debugName,
+    D3D11_USAGE usage
 ) {
     D3D11_BUFFER_DESC desc{};
     desc.ByteWidth = elementSize * elementCount;
-    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.Usage = usage;
     desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    desc.CPUAccessFlags = usage == D3D11_USAGE_DYNAMIC ? D3D11_CPU_ACCESS_WRITE : 0;
     desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
     desc.StructureByteStride = elementSize;
 
@@ -8,6 +8,12 @@
 #include <string>
 #include <vector>
 
+// Number of Map() calls made through UploadConstantBuffer since the last reset
+inline int uploadMapCount = 0;
+
+inline int GetUploadMapCount() { return uploadMapCount; }
+inline void ResetUploadMapCount() { uploadMapCount = 0; }
+
 template <typename T>
 inline void UploadConstantBuffer(ID3D11DeviceContext *deviceContext, ID3D11Buffer *buffer, const T &data) {
     if (!deviceContext) {
@@ -29,6 +35,8 @@ inline void UploadConstantBuffer(ID3D11DeviceContext *deviceContext, ID3D11Buffe
 
     *reinterpret_cast<T *>(mapped.pData) = data;
     deviceContext->Unmap(buffer, 0);
+
+    ++uploadMapCount;
 }
 
 bool LoadShaderBytecode(const std::string &path, std::vector<uint8_t> &out);
@@ -43,13 +51,25 @@ bool CreateDepthStencilArray(
     const char *debugName
 );
 
+bool CreateDepthStencilTexture(
+    ID3D11Device *device,
+    int width,
+    int height,
+    ID3D11Texture2D **outTexture,
+    ID3D11DepthStencilView **outDSV,
+    ID3D11ShaderResourceView **outSRV,
+    const char *debugName
+);
+
+// Default usage buffers are written with UpdateSubresource, so parts of them can be uploaded
 bool CreateStructuredBuffer(
     ID3D11Device *device,
     UINT elementSize,
     UINT elementCount,
     ID3D11Buffer **outBuffer,
     ID3D11ShaderResourceView **outSRV,
-    const char *debugName
+    const char *debugName,
+    D3D11_USAGE usage = D3D11_USAGE_DYNAMIC
 );
 
 Render_view *GetView(std::vector<Render_view> &views, View_type type, int index = 0);
@@ -12,7 +12,8 @@ enum class View_type {
     primary,
     shadowMapDirectional,
     shadowMapSpot,
-    cubeFace
+    cubeFace,
+    cube // All six faces of a reflection probe, drawn in one pass
 };
 
 struct Render_view {
@@ -27,7 +28,11 @@ struct Render_view {
     float farPlane = 1000.0f;
 
     BoundingFrustum frustum;
-    bool skipFrustumCulling = false; // TODO: Orthographic views don't work with BoundingFrustum; could use OBB instead
+    bool skipFrustumCulling = false;
+
+    // Orthographic views don't work with BoundingFrustum, they and cube views cull against this box instead
+    BoundingOrientedBox orientedBox;
+    bool useOrientedBox = false;
 
     float shadowDistance = 80.0f;
 
@@ -8,27 +8,38 @@
 #include "debugging/debug.hpp"
 
 #include <vector>
+#include <chrono>
+#include <algorithm>
 
 #undef min
 #undef max
 
 static const std::string shaderDir = "assets/shaders/";
+static const int traceCaptureFrameCount = 8;
 
 Renderer::~Renderer() {
     this->frameGraph.Clear();
+    this->frameGraph.SetDevice(nullptr);
 
+    this->lightClusterSystem.Shutdown();
+    this->gpuCullingSystem.Shutdown();
     this->particleSystem.Shutdown();
     this->reflectionSystem.Shutdown();
     this->shadowSystem.Shutdown();
     this->sharedResources.Shutdown();
+    this->constantBufferRing.Shutdown();
+    this->materialTable.Shutdown();
 
     SafeRelease(this->gBufferVS);
     SafeRelease(this->gBufferPS);
+    SafeRelease(this->gBufferMaterialTablePS);
     SafeRelease(this->gBufferLayout);
 
     SafeRelease(this->wireframeRS);
     SafeRelease(this->noBackfaceCullingRS);
 
+    SafeRelease(this->depthEqualDSS);
+
     SafeRelease(this->tessellationVS);
     SafeRelease(this->tessellationHS);
     SafeRelease(this->tessellationDS);
@@ -43,6 +54,8 @@ Renderer::~Renderer() {
 
     SafeRelease(this->renderTargetView);
 
+    this->stateCache.SetDeviceContext(nullptr);
+
     if (this->deviceContext) {
         this->deviceContext->ClearState();
         this->deviceContext->Flush();
@@ -186,6 +199,15 @@ bool Renderer::LoadGBufferShaders() {
         return false;
     }
 
+    if (!LoadShaderBytecode(shaderDir + "ps_gbuffer_material_table.cso", bytecode))
+        return false;
+
+    result = this->device->CreatePixelShader(bytecode.data(), bytecode.size(), nullptr, &this->gBufferMaterialTablePS);
+    if (FAILED(result)) {
+        LogError("Failed to create G-buffer material table pixel shader");
+        return false;
+    }
+
     LogInfo("G-buffer shaders loaded\n");
     return true;
 }
@@ -221,6 +243,22 @@ bool Renderer::CreateRasterizerStates() {
     return true;
 }
 
+bool Renderer::CreateDepthStencilStates() {
+    D3D11_DEPTH_STENCIL_DESC desc{};
+    desc.DepthEnable = TRUE;
+    desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+    desc.DepthFunc = D3D11_COMPARISON_EQUAL;
+
+    HRESULT result = this->device->CreateDepthStencilState(&desc, &this->depthEqualDSS);
+    if (FAILED(result)) {
+        LogWarn("Failed to create depth equal depth stencil state\n");
+        return false;
+    }
+
+    LogInfo("Created depth stencil states\n");
+    return true;
+}
+
 bool Renderer::LoadTessellationShaders() {
     std::vector<uint8_t> bytecode;
 
@@ -329,17 +367,61 @@ void Renderer::SetViewport(int width, int height) {
     this->viewport.MaxDepth = 1.0f;
 }
 
+void Renderer::SetRenderScale(float scale) {
+    this->renderScale  = scale;
+    this->renderWidth  = std::max(static_cast<int>(this->width  * scale + 0.5f), 1);
+    this->renderHeight = std::max(static_cast<int>(this->height * scale + 0.5f), 1);
+
+    this->renderViewport = this->viewport;
+    this->renderViewport.Width  = static_cast<FLOAT>(this->renderWidth);
+    this->renderViewport.Height = static_cast<FLOAT>(this->renderHeight);
+
+    this->deferredDebugData.uvScale.x = static_cast<float>(this->renderWidth) / this->width;
+    this->deferredDebugData.uvScale.y = static_cast<float>(this->renderHeight) / this->height;
+    this->deferredDebugData.uvMax.x   = (this->renderWidth - 0.5f) / this->width;
+    this->deferredDebugData.uvMax.y   = (this->renderHeight - 0.5f) / this->height;
+}
+
+void Renderer::UpdateRenderScale() {
+    float gpuMilliseconds = 0.0f;
+    const bool hasGpuTime = this->frameGraph.GetProfiler().PollGpuFrameMilliseconds(gpuMilliseconds);
+
+    ResolutionController::Settings settings = this->resolutionController.GetSettings();
+    settings.targetMilliseconds = static_cast<float>(std::max(Debug::GetIntegerSetting("renderer.targetFrameMs", 16), 1));
+    settings.minScale = std::clamp(Debug::GetIntegerSetting("renderer.minRenderScalePercent", 50), 10, 100) / 100.0f;
+    this->resolutionController.SetSettings(settings);
+
+    float scale = this->renderScale;
+    if (Debug::GetSetting("renderer.dynamicResolution", false)) {
+        if (hasGpuTime)
+            scale = this->resolutionController.Update(gpuMilliseconds);
+    }
+    else {
+        scale = std::clamp(Debug::GetIntegerSetting("renderer.renderScalePercent", 100), 10, 100) / 100.0f;
+
+        // Dynamic resolution starts out from the fixed scale once it's turned on
+        this->resolutionController.Reset(scale);
+    }
+
+    this->SetRenderScale(scale);
+    Debug::SetStat("renderer.renderScale", this->renderScale);
+}
+
 void Renderer::RegisterGeometryPass(
     FrameGraph::TextureHandle albedoHandle,
     FrameGraph::TextureHandle normalHandle,
     FrameGraph::TextureHandle specularHandle,
-    FrameGraph::TextureHandle depthHandle
+    FrameGraph::TextureHandle depthHandle,
+    const Gpu_culling_handles &cullingHandles
 ) {
     struct Geometry_pass_data {
         FrameGraph::TextureHandle albedo;
         FrameGraph::TextureHandle normal;
         FrameGraph::TextureHandle specular;
         FrameGraph::TextureHandle depth;
+
+        FrameGraph::BufferHandle visibleInstances;
+        FrameGraph::BufferHandle drawArgs;
     };
 
     this->frameGraph.AddRenderPass<Geometry_pass_data>(
@@ -349,6 +431,9 @@ void Renderer::RegisterGeometryPass(
             data.normal   = builder.Write(normalHandle);
             data.specular = builder.Write(specularHandle);
             data.depth    = builder.Write(depthHandle);
+
+            data.visibleInstances = builder.Read(cullingHandles.visibleInstances);
+            data.drawArgs         = builder.Read(cullingHandles.drawArgs);
         },
         [this](const Geometry_pass_data &data, FrameGraph::ExecutionContext &context) {
             ID3D11DeviceContext *deviceContext = context.GetDeviceContext();
@@ -359,6 +444,8 @@ void Renderer::RegisterGeometryPass(
                 return;
             }
 
+            StateCache &stateCache = context.GetStateCache();
+
             const Render_view &renderView = this->isCameraFrozen ? this->frozenRenderView : *view;
             this->sharedResources.UploadPerFrameData(deviceContext, renderView);
 
@@ -379,92 +466,107 @@ void Renderer::RegisterGeometryPass(
             deviceContext->ClearRenderTargetView(rtvs[2], clearSpecular);
             deviceContext->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-            deviceContext->OMSetRenderTargets(3, rtvs, dsv);
+            stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            stateCache.SetViewport(this->renderViewport);
+
+            ConstantBufferRing &ring = this->constantBufferRing;
 
-            deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-            deviceContext->IASetInputLayout(this->gBufferLayout);
+            bool isWireframe = Debug::GetSetting("renderer.wireframe", false);
+            bool isGpuCullingActive = this->gpuCullingSystem.isActive;
 
-            deviceContext->VSSetShader(this->gBufferVS, nullptr, 0);
-            deviceContext->PSSetShader(this->gBufferPS, nullptr, 0);
+            // The pre-pass draws from the CPU command list, which the GPU-driven path replaces
+            bool isDepthPrepassEnabled = Debug::GetSetting("renderer.depthPrepass", false) && !isWireframe && !isGpuCullingActive;
 
-            deviceContext->VSSetConstantBuffers(0, 1, &this->sharedResources.perFrameBuffer);
-            deviceContext->VSSetConstantBuffers(1, 1, &this->sharedResources.perObjectBuffer);
-            deviceContext->PSSetConstantBuffers(2, 1, &this->sharedResources.perMaterialBuffer);
+            // Lays down the depth of the opaque geometry first so the G-buffer pass only shades visible pixels.
+            // Tessellated geometry is displaced in the domain shader and is left to the regular depth test.
+            if (isDepthPrepassEnabled) {
+                stateCache.SetRenderTargets(0, nullptr, dsv);
 
-            deviceContext->RSSetViewports(1, &this->viewport);
+                stateCache.SetInputLayout(this->shadowSystem.shadowLayout);
+                stateCache.SetVertexShader(this->shadowSystem.shadowVS);
 
-            bool isWireframe = Debug::GetSetting("renderer.wireframe", false);
+                XMMATRIX viewMatrix = XMLoadFloat4x4(&renderView.viewMatrix);
+                XMMATRIX projectionMatrix = XMLoadFloat4x4(&renderView.projectionMatrix);
+                XMFLOAT4X4 viewProjectionMatrix;
+                XMStoreFloat4x4(&viewProjectionMatrix, XMMatrixTranspose(XMMatrixMultiply(viewMatrix, projectionMatrix)));
+                UploadConstantBuffer(deviceContext, this->shadowSystem.shadowBuffer, viewProjectionMatrix);
 
-            ID3D11RasterizerState *currentRS = nullptr;
-            for (Geometry_command &command : view->queue.geometryCommands) {
-                Per_object_data perObjectData{};
-                perObjectData.worldMatrix = command.worldMatrix;
-                XMStoreFloat4x4(
-                    &perObjectData.worldMatrixInvTranspose, 
-                    XMMatrixInverse(nullptr, XMMatrixTranspose(XMLoadFloat4x4(&command.worldMatrix)))
-                );
+                stateCache.SetConstantBuffers(Shader_stage::vertex, 0, 1, &this->shadowSystem.shadowBuffer);
 
-                UploadConstantBuffer(deviceContext, this->sharedResources.perObjectBuffer, perObjectData);
+                auto isAlphaTested = [](const Geometry_command &command) {
+                    Material *material = command.material.Get();
+                    return material && material->isAlphaTested;
+                };
 
-                ID3D11RasterizerState *wantedRS = nullptr;
-                if (isWireframe)
-                    wantedRS = this->wireframeRS;
+                // Opaque geometry first without a pixel shader, then the alpha-tested geometry.
+                // The order within each group is kept.
+                for (bool drawAlphaTested : { false, true }) {
+                    stateCache.SetPixelShader(drawAlphaTested ? this->shadowSystem.shadowPS : nullptr);
 
-                Material *material = command.material.Get();
-                if (material) {
-                    Per_material_data perMaterialData{};
-                    perMaterialData.materialDiffuse          = material->diffuseColour;
-                    perMaterialData.isReflective             = command.isReflective;
-                    perMaterialData.materialSpecular         = material->specularColour;
-                    perMaterialData.materialSpecularExponent = material->specularExponent;
+                    for (const Geometry_command &command : view->queue.geometryCommands) {
+                        if (isAlphaTested(command) != drawAlphaTested)
+                            continue;
 
-                    UploadConstantBuffer(deviceContext, this->sharedResources.perMaterialBuffer, perMaterialData);
+                        ring.Bind(stateCache, Shader_stage::vertex, 1, command.objectConstants, this->sharedResources.perObjectBuffer);
 
-                    ID3D11ShaderResourceView *srvs[2] = {
-                        material->diffuseTexture.Get()->shaderResourceView,
-                        material->normalTexture.Get()->shaderResourceView
-                    };
-                    deviceContext->PSSetShaderResources(0, 2, srvs);
+                        ID3D11RasterizerState *wantedRS = nullptr;
 
-                    if (!material->enableBackfaceCulling && !isWireframe)
-                        wantedRS = this->noBackfaceCullingRS;
-                }
+                        Material *material = command.material.Get();
+                        if (material) {
+                            if (drawAlphaTested)
+                                stateCache.SetShaderResources(Shader_stage::pixel, 0, 1, &material->diffuseTexture.Get()->shaderResourceView);
+
+                            if (!material->enableBackfaceCulling)
+                                wantedRS = this->noBackfaceCullingRS;
+                        }
+
+                        stateCache.SetRasterizerState(wantedRS);
+
+                        stateCache.SetVertexBuffer(command.vertexBuffer, sizeof(Vertex));
+                        stateCache.SetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT);
 
-                if (wantedRS != currentRS) {
-                    deviceContext->RSSetState(wantedRS);
-                    currentRS = wantedRS;
+                        deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
+                    }
                 }
 
-                const UINT stride = sizeof(Vertex);
-                const UINT offset = 0;
-                deviceContext->IASetVertexBuffers(0, 1, &command.vertexBuffer, &stride, &offset);
-                deviceContext->IASetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+                stateCache.SetDepthStencilState(this->depthEqualDSS);
+            }
+
+            stateCache.SetRenderTargets(3, rtvs, dsv);
 
-                deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
+            stateCache.SetInputLayout(this->gBufferLayout);
+
+            stateCache.SetVertexShader(this->gBufferVS);
+
+            const MaterialTable *materialTable = this->sharedResources.materialTable;
+            if (materialTable) {
+                stateCache.SetPixelShader(this->gBufferMaterialTablePS);
+                materialTable->Bind(stateCache);
+            }
+            else {
+                stateCache.SetPixelShader(this->gBufferPS);
             }
 
-            if (!view->queue.tessellatedGeometryCommands.empty()) {
-                deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
+            stateCache.SetConstantBuffers(Shader_stage::vertex, 0, 1, &this->sharedResources.perFrameBuffer);
 
-                deviceContext->VSSetShader(this->tessellationVS, nullptr, 0);
-                deviceContext->HSSetShader(this->tessellationHS, nullptr, 0);
-                deviceContext->DSSetShader(this->tessellationDS, nullptr, 0);
+            if (isGpuCullingActive) {
+                GpuCullingSystem &gpuCulling = this->gpuCullingSystem;
 
-                deviceContext->HSSetConstantBuffers(0, 1, &this->sharedResources.perFrameBuffer);
-                deviceContext->HSSetConstantBuffers(3, 1, &this->tessellationBuffer);
+                stateCache.SetVertexShader(gpuCulling.instancedVS);
 
-                deviceContext->DSSetConstantBuffers(0, 1, &this->sharedResources.perFrameBuffer);
-                deviceContext->DSSetConstantBuffers(3, 1, &this->tessellationBuffer);
+                ID3D11ShaderResourceView *instanceSRVs[2] = {
+                    gpuCulling.instanceBufferSRV,
+                    context.GetShaderResourceView(data.visibleInstances)
+                };
 
-                for (Geometry_command &command : view->queue.tessellatedGeometryCommands) {
-                    Per_object_data perObjectData{};
-                    perObjectData.worldMatrix = command.worldMatrix;
-                    XMStoreFloat4x4(
-                        &perObjectData.worldMatrixInvTranspose, 
-                        XMMatrixInverse(nullptr, XMMatrixTranspose(XMLoadFloat4x4(&command.worldMatrix)))
-                    );
+                ID3D11Buffer *argsBuffer = context.GetBuffer(data.drawArgs);
+                stateCache.SetShaderResources(Shader_stage::vertex, 0, 2, instanceSRVs);
+
+                for (size_t i = 0; i < gpuCulling.instanceBatches.size(); ++i) {
+                    const Instance_batch &batch = gpuCulling.instanceBatches[i];
+                    const Geometry_command &command = batch.command;
 
-                    UploadConstantBuffer(deviceContext, this->sharedResources.perObjectBuffer, perObjectData);
+                    ring.Bind(stateCache, Shader_stage::vertex, 1, batch.batchConstants, this->sharedResources.perObjectBuffer);
 
                     ID3D11RasterizerState *wantedRS = nullptr;
                     if (isWireframe)
@@ -472,73 +574,122 @@ void Renderer::RegisterGeometryPass(
 
                     Material *material = command.material.Get();
                     if (material) {
-                        Per_material_data perMaterialData{};
-                        perMaterialData.materialDiffuse          = material->diffuseColour;
-                        perMaterialData.isReflective             = command.isReflective;
-                        perMaterialData.materialSpecular         = material->specularColour;
-                        perMaterialData.materialSpecularExponent = material->specularExponent;
+                        // With the material table only the material index changes between draws
+                        ring.Bind(stateCache, Shader_stage::pixel, 2, command.materialConstants, this->sharedResources.perMaterialBuffer);
+
+                        if (!materialTable) {
+                            ID3D11ShaderResourceView *srvs[2] = {
+                                material->diffuseTexture.Get()->shaderResourceView,
+                                material->normalTexture.Get()->shaderResourceView
+                            };
+                            stateCache.SetShaderResources(Shader_stage::pixel, 0, 2, srvs);
+                        }
+
+                        if (!material->enableBackfaceCulling && !isWireframe)
+                            wantedRS = this->noBackfaceCullingRS;
+                    }
 
-                        UploadConstantBuffer(deviceContext, this->sharedResources.perMaterialBuffer, perMaterialData);
+                    stateCache.SetRasterizerState(wantedRS);
 
-                        XMFLOAT3 scale = Transform::ExtractScale(XMMatrixTranspose(XMLoadFloat4x4(&command.worldMatrix)));
-                        float uniformScale = std::max({scale.x, scale.y, scale.z});
+                    stateCache.SetVertexBuffer(command.vertexBuffer, sizeof(Vertex));
+                    stateCache.SetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT);
 
-                        Tessellation_data tessellationData = this->tessellationData;
-                        tessellationData.displacementScale = material->displacementScale * uniformScale;
+                    deviceContext->DrawIndexedInstancedIndirect(argsBuffer, static_cast<UINT>(i * sizeof(Draw_indexed_indirect_args)));
+                }
+            }
+            else {
+                for (Geometry_command &command : view->queue.geometryCommands) {
+                    ring.Bind(stateCache, Shader_stage::vertex, 1, command.objectConstants, this->sharedResources.perObjectBuffer);
 
-                        const float normalStrengthMultiplier = 5.0f;
-                        tessellationData.normalStrength = material->displacementScale * uniformScale * normalStrengthMultiplier;
+                    ID3D11RasterizerState *wantedRS = nullptr;
+                    if (isWireframe)
+                        wantedRS = this->wireframeRS;
 
-                        Texture2D *displacementTexture = material->displacementTexture.Get();
-                        tessellationData.texelSize.x = 1.0f / displacementTexture->width;
-                        tessellationData.texelSize.y = 1.0f / displacementTexture->height;
+                    Material *material = command.material.Get();
+                    if (material) {
+                        ring.Bind(stateCache, Shader_stage::pixel, 2, command.materialConstants, this->sharedResources.perMaterialBuffer);
+
+                        if (!materialTable) {
+                            ID3D11ShaderResourceView *srvs[2] = {
+                                material->diffuseTexture.Get()->shaderResourceView,
+                                material->normalTexture.Get()->shaderResourceView
+                            };
+                            stateCache.SetShaderResources(Shader_stage::pixel, 0, 2, srvs);
+                        }
+
+                        if (!material->enableBackfaceCulling && !isWireframe)
+                            wantedRS = this->noBackfaceCullingRS;
+                    }
+
+                    stateCache.SetRasterizerState(wantedRS);
+
+                    stateCache.SetVertexBuffer(command.vertexBuffer, sizeof(Vertex));
+                    stateCache.SetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT);
+
+                    deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
+                }
+            }
+
+            stateCache.SetDepthStencilState(nullptr);
+
+            if (!view->queue.tessellatedGeometryCommands.empty()) {
+                stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
+
+                stateCache.SetVertexShader(this->tessellationVS);
+                stateCache.SetPixelShader(this->gBufferPS); // Tessellated materials always bind their textures per draw
+                stateCache.SetHullShader(this->tessellationHS);
+                stateCache.SetDomainShader(this->tessellationDS);
+
+                stateCache.SetConstantBuffers(Shader_stage::hull, 0, 1, &this->sharedResources.perFrameBuffer);
+                stateCache.SetConstantBuffers(Shader_stage::domain, 0, 1, &this->sharedResources.perFrameBuffer);
+
+                for (Geometry_command &command : view->queue.tessellatedGeometryCommands) {
+                    ring.Bind(stateCache, Shader_stage::vertex, 1, command.objectConstants, this->sharedResources.perObjectBuffer);
+
+                    ID3D11RasterizerState *wantedRS = nullptr;
+                    if (isWireframe)
+                        wantedRS = this->wireframeRS;
 
-                        UploadConstantBuffer(deviceContext, this->tessellationBuffer, tessellationData);
+                    Material *material = command.material.Get();
+                    if (material) {
+                        ring.Bind(stateCache, Shader_stage::pixel, 2, command.materialConstants, this->sharedResources.perMaterialBuffer);
+
+                        // Shared by both stages, the fallback buffer is uploaded once and then just rebound
+                        ring.Bind(stateCache, Shader_stage::hull,   3, command.tessellationConstants, this->tessellationBuffer);
+                        ring.Bind(stateCache, Shader_stage::domain, 3, command.tessellationConstants, this->tessellationBuffer);
+
+                        Texture2D *displacementTexture = material->displacementTexture.Get();
 
                         ID3D11ShaderResourceView *psSRVs[2] = {
                             material->diffuseTexture.Get()->shaderResourceView,
                             material->normalTexture.Get()->shaderResourceView
                         };
-                        deviceContext->PSSetShaderResources(0, 2, psSRVs);
+                        stateCache.SetShaderResources(Shader_stage::pixel, 0, 2, psSRVs);
 
                         ID3D11ShaderResourceView *dsSRVs[1] = {
                             displacementTexture->shaderResourceView
                         };
-                        deviceContext->DSSetShaderResources(2, 1, dsSRVs);
+                        stateCache.SetShaderResources(Shader_stage::domain, 2, 1, dsSRVs);
 
                         if (!material->enableBackfaceCulling && !isWireframe)
                             wantedRS = this->noBackfaceCullingRS;
                     }
 
-                    if (wantedRS != currentRS) {
-                        deviceContext->RSSetState(wantedRS);
-                        currentRS = wantedRS;
-                    }
+                    stateCache.SetRasterizerState(wantedRS);
 
-                    const UINT stride = sizeof(Vertex);
-                    const UINT offset = 0;
-                    deviceContext->IASetVertexBuffers(0, 1, &command.vertexBuffer, &stride, &offset);
-                    deviceContext->IASetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+                    stateCache.SetVertexBuffer(command.vertexBuffer, sizeof(Vertex));
+                    stateCache.SetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT);
 
                     deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
                 }
 
-                deviceContext->HSSetShader(nullptr, nullptr, 0);
-                deviceContext->DSSetShader(nullptr, nullptr, 0);
-                deviceContext->VSSetShader(this->gBufferVS, nullptr, 0);
-                deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-                ID3D11ShaderResourceView *nullSRV = nullptr;
-                deviceContext->DSSetShaderResources(2, 1, &nullSRV);
+                stateCache.SetHullShader(nullptr);
+                stateCache.SetDomainShader(nullptr);
+                stateCache.SetVertexShader(this->gBufferVS);
+                stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
             }
 
-            ID3D11RenderTargetView *nullRtvs[3] = {};
-            deviceContext->OMSetRenderTargets(3, nullRtvs, nullptr);
-
-            ID3D11ShaderResourceView *nullSRVs[2] = {};
-            deviceContext->PSSetShaderResources(0, 2, nullSRVs);
-
-            deviceContext->RSSetState(nullptr);
+            stateCache.SetRasterizerState(nullptr);
         }
     );
 }
@@ -550,8 +701,8 @@ void Renderer::RegisterLightingPass(
     FrameGraph::TextureHandle depthHandle,
     const Shadow_handles &shadowHandles,
     const Reflection_probe_handles &reflectionHandles,
-    FrameGraph::TextureHandle lightingOutputHandle,
-    FrameGraph::TextureHandle lightingDummyHandle
+    const Light_cluster_handles &clusterHandles,
+    FrameGraph::TextureHandle lightingOutputHandle
 ) {
     struct Lighting_pass_data {
         FrameGraph::TextureHandle albedo;
@@ -561,12 +712,18 @@ void Renderer::RegisterLightingPass(
 
         FrameGraph::TextureHandle shadowMapDirectional;
         FrameGraph::TextureHandle shadowMapSpot;
+        FrameGraph::BufferHandle directionalLightBuffer;
+        FrameGraph::BufferHandle spotLightBuffer;
 
         FrameGraph::TextureHandle reflectionProbes;
+        FrameGraph::BufferHandle reflectionProbeBuffer;
 
-        FrameGraph::TextureHandle output;
+        FrameGraph::BufferHandle clusterRanges;
+        FrameGraph::BufferHandle clusterLightIndices;
+        FrameGraph::BufferHandle probeClusterRanges;
+        FrameGraph::BufferHandle probeClusterIndices;
 
-        FrameGraph::TextureHandle dummy;
+        FrameGraph::TextureHandle output;
     };
 
     this->frameGraph.AddRenderPass<Lighting_pass_data>(
@@ -580,13 +737,20 @@ void Renderer::RegisterLightingPass(
             data.shadowMapDirectional = builder.Read(shadowHandles.shadowMapDirectional);
             data.shadowMapSpot        = builder.Read(shadowHandles.shadowMapSpot);
 
-            data.reflectionProbes = builder.Read(reflectionHandles.reflectionProbes);
+            data.directionalLightBuffer = builder.Read(shadowHandles.directionalLightBuffer);
+            data.spotLightBuffer        = builder.Read(shadowHandles.spotLightBuffer);
 
-            data.output = builder.Write(lightingOutputHandle);
+            data.reflectionProbes      = builder.Read(reflectionHandles.reflectionProbes);
+            data.reflectionProbeBuffer = builder.Read(reflectionHandles.reflectionProbeBuffer);
+
+            data.clusterRanges       = builder.Read(clusterHandles.clusterRanges);
+            data.clusterLightIndices = builder.Read(clusterHandles.lightIndices);
+            data.probeClusterRanges  = builder.Read(clusterHandles.probeClusterRanges);
+            data.probeClusterIndices = builder.Read(clusterHandles.probeIndices);
 
-            data.dummy = builder.Write(lightingDummyHandle); // Needed to ensure that this pass executes before the particle pass
+            data.output = builder.Write(lightingOutputHandle);
         },
-        [this, shadowHandles, reflectionHandles](const Lighting_pass_data &data, FrameGraph::ExecutionContext &context) {
+        [this](const Lighting_pass_data &data, FrameGraph::ExecutionContext &context) {
             ID3D11DeviceContext *deviceContext = context.GetDeviceContext();
 
             Render_view *view = context.GetView(View_type::primary);
@@ -599,50 +763,53 @@ void Renderer::RegisterLightingPass(
                 deviceContext, 
                 *view, 
                 this->sharedResources, 
-                this->reflectionSystem.GetActiveProbeCount()
+                this->reflectionSystem.GetActiveProbeCount(),
+                this->lightClusterSystem.GetGrid(),
+                this->renderWidth,
+                this->renderHeight
             );
 
             this->reflectionSystem.UploadProbeData(deviceContext);
 
-            deviceContext->CSSetShader(this->lightingCS, nullptr, 0);
-            deviceContext->CSSetConstantBuffers(0, 1, &this->sharedResources.perFrameBuffer);
-            deviceContext->CSSetConstantBuffers(1, 1, &this->sharedResources.lightingBuffer);
+            StateCache &stateCache = context.GetStateCache();
+
+            stateCache.SetComputeShader(this->lightingCS);
+            stateCache.SetConstantBuffers(Shader_stage::compute, 0, 1, &this->sharedResources.perFrameBuffer);
+            stateCache.SetConstantBuffers(Shader_stage::compute, 1, 1, &this->sharedResources.lightingBuffer);
 
             ID3D11ShaderResourceView *skyboxSRV = nullptr;
             if (view->queue.skyboxCommand.has_value())
                 if (Texture_cube *cube = view->queue.skyboxCommand->textureCubeHandle.Get())
                     skyboxSRV = cube->shaderResourceView;
 
-            ID3D11ShaderResourceView *srvs[11] = {
+            ID3D11ShaderResourceView *srvs[15] = {
                 context.GetShaderResourceView(data.albedo),
                 context.GetShaderResourceView(data.normal),
                 context.GetShaderResourceView(data.specular),
                 context.GetShaderResourceView(data.depth),
                 context.GetShaderResourceView(data.shadowMapDirectional),
                 context.GetShaderResourceView(data.shadowMapSpot),
-                shadowHandles.directionalLightBufferSRV,
-                shadowHandles.spotLightBufferSRV,
+                context.GetShaderResourceView(data.directionalLightBuffer),
+                context.GetShaderResourceView(data.spotLightBuffer),
                 context.GetShaderResourceView(data.reflectionProbes),
-                reflectionHandles.reflectionProbeBufferSRV,
-                skyboxSRV
+                context.GetShaderResourceView(data.reflectionProbeBuffer),
+                skyboxSRV,
+                context.GetShaderResourceView(data.clusterRanges),
+                context.GetShaderResourceView(data.clusterLightIndices),
+                context.GetShaderResourceView(data.probeClusterRanges),
+                context.GetShaderResourceView(data.probeClusterIndices)
             };
-            deviceContext->CSSetShaderResources(0, 11, srvs);
+            stateCache.SetShaderResources(Shader_stage::compute, 0, 15, srvs);
 
             ID3D11UnorderedAccessView *uav = context.GetUnorderedAccessView(data.output);
             deviceContext->ClearUnorderedAccessViewFloat(uav, this->clearColour);
-            deviceContext->CSSetUnorderedAccessViews(0, 1, &uav, nullptr);
+            stateCache.SetUnorderedAccessViews(0, 1, &uav);
 
-            UINT groupsX = (this->width  + 7) / 8;
-            UINT groupsY = (this->height + 7) / 8;
+            UINT groupsX = (this->renderWidth  + 7) / 8;
+            UINT groupsY = (this->renderHeight + 7) / 8;
             deviceContext->Dispatch(groupsX, groupsY, 1);
 
-            ID3D11ShaderResourceView *nullSrvs[11] = {};
-            deviceContext->CSSetShaderResources(0, 11, nullSrvs);
-
-            ID3D11UnorderedAccessView *nullUav = nullptr;
-            deviceContext->CSSetUnorderedAccessViews(0, 1, &nullUav, nullptr);
-
-            deviceContext->CSSetShader(nullptr, nullptr, 0);
+            stateCache.SetComputeShader(nullptr);
         }
     );
 }
@@ -689,20 +856,23 @@ void Renderer::RegisterResolvePass(
                 this->deferredDebugData.farPlane  = view->farPlane;
             }
 
+            StateCache &stateCache = context.GetStateCache();
+
             UploadConstantBuffer(deviceContext, this->deferredDebugBuffer, this->deferredDebugData);
-            deviceContext->PSSetConstantBuffers(3, 1, &this->deferredDebugBuffer); // Debug
+            stateCache.SetConstantBuffers(Shader_stage::pixel, 3, 1, &this->deferredDebugBuffer); // Debug mode and render scale
 
             ID3D11RenderTargetView *rtv = context.GetRenderTargetView(data.backbuffer);
             deviceContext->ClearRenderTargetView(rtv, this->clearColour);
-            deviceContext->OMSetRenderTargets(1, &rtv, nullptr);
+            stateCache.SetRenderTargets(1, &rtv, nullptr);
+            stateCache.SetViewport(this->viewport);
 
-            deviceContext->VSSetShader(this->resolveVS, nullptr, 0);
-            deviceContext->PSSetShader(this->resolvePS, nullptr, 0);
-            deviceContext->IASetInputLayout(nullptr);
-            deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            stateCache.SetVertexShader(this->resolveVS);
+            stateCache.SetPixelShader(this->resolvePS);
+            stateCache.SetInputLayout(nullptr);
+            stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
             ID3D11ShaderResourceView *srv = context.GetShaderResourceView(data.lightingOutput);
-            deviceContext->PSSetShaderResources(0, 1, &srv);
+            stateCache.SetShaderResources(Shader_stage::pixel, 0, 1, &srv);
 
             // Debug
             ID3D11ShaderResourceView *debugSrvs[4] = {
@@ -711,24 +881,86 @@ void Renderer::RegisterResolvePass(
                 context.GetShaderResourceView(data.specular),
                 context.GetShaderResourceView(data.depth)
             };
-            deviceContext->PSSetShaderResources(1, 4, debugSrvs);
+            stateCache.SetShaderResources(Shader_stage::pixel, 1, 4, debugSrvs);
 
             deviceContext->Draw(3, 0);
+        }
+    );
+}
 
-            ID3D11ShaderResourceView *nullDebugSrvs[4] = {};
-            deviceContext->PSSetShaderResources(1, 4, nullDebugSrvs);
+void Renderer::UploadDrawConstants() {
+    ConstantBufferRing &ring = this->constantBufferRing;
 
-            ID3D11ShaderResourceView *nullSrv = nullptr;
-            deviceContext->PSSetShaderResources(0, 1, &nullSrv);
+    for (Render_view &view : this->views) {
+        // Shadow views only need positions
+        const bool needsNormals = view.type == View_type::primary || view.type == View_type::cubeFace || view.type == View_type::cube;
 
-            ID3D11RenderTargetView *nullRtv = nullptr;
-            deviceContext->OMSetRenderTargets(1, &nullRtv, nullptr);
-        }
-    );
+        auto allocate = [&](Geometry_command &command, bool isTessellated) {
+            Per_object_data perObjectData{};
+            perObjectData.worldMatrix = command.worldMatrix;
+            if (needsNormals)
+                XMStoreFloat4x4(
+                    &perObjectData.worldMatrixInvTranspose, 
+                    XMMatrixInverse(nullptr, XMMatrixTranspose(XMLoadFloat4x4(&command.worldMatrix)))
+                );
+
+            command.objectConstants = ring.Allocate(perObjectData);
+
+            // There are only 63 masks, draws reaching the same faces share one
+            if (view.type == View_type::cube) {
+                Cube_face_draw_data cubeFaceDrawData{};
+                cubeFaceDrawData.faceMask = command.faceMask;
+                command.faceMaskConstants = ring.AllocateShared(ReflectionProbeSystem::FACE_MASK_ALLOCATION_KEY | command.faceMask, cubeFaceDrawData);
+            }
+
+            Material *material = command.material.Get();
+            if (!material)
+                return;
+
+            Per_material_data perMaterialData{};
+            perMaterialData.materialDiffuse          = material->diffuseColour;
+            perMaterialData.isReflective             = command.isReflective;
+            perMaterialData.materialSpecular         = material->specularColour;
+            perMaterialData.materialSpecularExponent = material->specularExponent;
+            perMaterialData.materialIndex            = this->materialTable.GetMaterialIndex(material);
+
+            // Materials are aligned, so the lowest bit is free for the reflective flag
+            uint64_t materialKey = (reinterpret_cast<uintptr_t>(material)) | (command.isReflective ? 1 : 0);
+            command.materialConstants = ring.AllocateShared(materialKey, perMaterialData);
+
+            if (!isTessellated)
+                return;
+
+            XMFLOAT3 scale = Transform::ExtractScale(XMMatrixTranspose(XMLoadFloat4x4(&command.worldMatrix)));
+            float uniformScale = std::max({scale.x, scale.y, scale.z});
+
+            Tessellation_data tessellationData = this->tessellationData;
+            tessellationData.displacementScale = material->displacementScale * uniformScale;
+
+            const float normalStrengthMultiplier = 5.0f;
+            tessellationData.normalStrength = material->displacementScale * uniformScale * normalStrengthMultiplier;
+
+            Texture2D *displacementTexture = material->displacementTexture.Get();
+            tessellationData.texelSize.x = 1.0f / displacementTexture->width;
+            tessellationData.texelSize.y = 1.0f / displacementTexture->height;
+
+            command.tessellationConstants = ring.Allocate(tessellationData);
+        };
+
+        for (Geometry_command &command : view.queue.geometryCommands)
+            allocate(command, false);
+
+        for (Geometry_command &command : view.queue.tessellatedGeometryCommands)
+            allocate(command, true);
+    }
+
+    ring.Flush(this->deviceContext);
 }
 
-void Renderer::BuildFrameGraph() {
-    this->frameGraph.Clear();
+bool Renderer::BuildFrameGraph(bool isPerFrame) {
+    // Compiled graphs and their textures are kept, an unchanged graph reuses them
+    this->frameGraph.Reset();
+    this->isFrameGraphPerFrame = isPerFrame;
 
     this->backbufferHandle = this->frameGraph.ImportTexture(
         "Backbuffer", 
@@ -767,17 +999,11 @@ void Renderer::BuildFrameGraph() {
     desc.format = DXGI_FORMAT_R16G16B16A16_FLOAT;
     auto lightingOutputHandle = this->frameGraph.CreateTexture("Lighting_output", desc);
 
-    // Dummy handle is used to ensure correct ordering of the particle pass
-    desc.sizeMode = FrameGraph::Texture_desc::Size_mode::absolute;
-    desc.width = desc.height = 1.0f;
-    desc.bindFlags = 0;
-    desc.format = DXGI_FORMAT_R8_UNORM;
-    auto lightingDummyHandle = this->frameGraph.CreateTexture("Lighting_dummy", desc);
-
     Reflection_probe_handles reflectionHandles = this->reflectionSystem.RegisterRenderPasses(
         this->frameGraph, 
         this->sharedResources, 
-        this->clearColour
+        this->clearColour,
+        !isPerFrame || this->reflectionSystem.GetUpdatedFaceCount() > 0
     );
 
     Shadow_handles shadowHandles = this->shadowSystem.RegisterRenderPasses(
@@ -785,25 +1011,32 @@ void Renderer::BuildFrameGraph() {
         this->sharedResources
     );
 
-    this->RegisterGeometryPass(albedoHandle, normalHandle, specularHandle, depthHandle);
+    Gpu_culling_handles cullingHandles = this->gpuCullingSystem.RegisterRenderPasses(
+        this->frameGraph,
+        !isPerFrame || this->gpuCullingSystem.isActive
+    );
+
+    this->RegisterGeometryPass(albedoHandle, normalHandle, specularHandle, depthHandle, cullingHandles);
+
+    Light_cluster_handles clusterHandles = this->lightClusterSystem.RegisterRenderPasses(this->frameGraph);
 
     this->RegisterLightingPass(
         albedoHandle, normalHandle, specularHandle, depthHandle, 
-        shadowHandles, reflectionHandles, lightingOutputHandle, lightingDummyHandle
+        shadowHandles, reflectionHandles, clusterHandles, lightingOutputHandle
     );
 
     Particle_handles particleHandles = this->particleSystem.RegisterRenderPasses(
         this->frameGraph, 
         this->sharedResources, 
-        this->viewport, 
+        this->renderViewport, 
         depthHandle, 
-        lightingOutputHandle, 
-        lightingDummyHandle
+        lightingOutputHandle
     );
 
     this->RegisterResolvePass(lightingOutputHandle, albedoHandle, normalHandle, specularHandle, depthHandle);
 
-    this->frameGraph.Compile(this->width, this->height);
+    this->frameGraph.SetAliasingEnabled(Debug::GetSetting("frameGraph.aliasing", true));
+    return this->frameGraph.Compile(this->width, this->height);
 }
 
 bool Renderer::Initialize(HWND hWnd) {
@@ -821,15 +1054,27 @@ bool Renderer::Initialize(HWND hWnd) {
     if (!this->CreateRenderTargetView())
         return false;
 
+    this->stateCache.SetDeviceContext(this->deviceContext);
+
     if (!this->sharedResources.Initialize(this->device))
         return false;
 
+    if (!this->constantBufferRing.Initialize(this->device, this->stateCache))
+        return false;
+
+    this->sharedResources.constantBufferRing = &this->constantBufferRing;
+
+    this->materialTable.Initialize(this->device, this->deviceContext);
+
     if (!this->LoadGBufferShaders())
         return false;
 
     if (!this->CreateRasterizerStates())
         return false;
 
+    if (!this->CreateDepthStencilStates())
+        return false;
+
     if (!this->LoadTessellationShaders())
         return false;
 
@@ -848,13 +1093,28 @@ bool Renderer::Initialize(HWND hWnd) {
     if (!this->particleSystem.Initialize(this->device, shaderDir))
         return false;
 
+    if (!this->gpuCullingSystem.Initialize(this->device, shaderDir))
+        return false;
+
+    if (!this->lightClusterSystem.Initialize(
+        this->device,
+        shaderDir,
+        ShadowSystem::MAX_SPOT_LIGHTS,
+        ReflectionProbeSystem::MAX_REFLECTION_PROBES
+    ))
+        return false;
+
     if (!this->CreateConstantBuffers())
         return false;
 
     this->SetViewport(this->width, this->height);
+    this->SetRenderScale(this->renderScale);
 
     this->frameGraph.SetDevice(this->device);
-    this->BuildFrameGraph();
+    if (!this->BuildFrameGraph(false)) {
+        LogError("Failed to compile the frame graph");
+        return false;
+    }
 
     LogUnindent();
     return true;
@@ -872,6 +1132,7 @@ bool Renderer::Resize(int width, int height) {
 
     this->deviceContext->ClearState();
     this->deviceContext->Flush();
+    this->stateCache.Invalidate();
 
     HRESULT result = this->swapChain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, 0);
     if (FAILED(result)) {
@@ -885,8 +1146,11 @@ bool Renderer::Resize(int width, int height) {
     this->SetViewport(width, height);
     this->width = width;
     this->height = height;
+    this->SetRenderScale(this->renderScale);
 
-    this->frameGraph.OnResize(width, height);
+    this->frameGraph.SetAliasingEnabled(Debug::GetSetting("frameGraph.aliasing", true));
+    if (!this->frameGraph.OnResize(width, height))
+        return false;
 
     LogUnindent();
     return true;
@@ -908,7 +1172,7 @@ void Renderer::Render(Scene *scene) {
         this->renderTargetView
     );
 
-    this->sharedResources.BindSamplers(this->deviceContext);
+    this->sharedResources.BindSamplers(this->stateCache);
 
     scene->GatherVisibility(this->views);
 
@@ -916,7 +1180,14 @@ void Renderer::Render(Scene *scene) {
 
     if (primary) {
         this->reflectionSystem.PrepareViews(scene, *primary, this->views);
-        this->shadowSystem.PrepareViews(scene, *primary, this->views);
+        this->shadowSystem.PrepareViews(scene, *primary, this->renderHeight, this->views);
+
+        // Indexes the spot lights and probes in the order UploadLightData and UploadProbeData upload them
+        this->lightClusterSystem.PrepareClusters(
+            *primary,
+            this->shadowSystem.GetSelectedSpotLights(),
+            this->reflectionSystem.GetProbeBounds()
+        );
     }
 
     bool isFreezeRequested = Debug::GetSetting("renderer.freezeCamera", false);
@@ -938,10 +1209,70 @@ void Renderer::Render(Scene *scene) {
     this->deferredDebugData.debugMode = ((deferredDebugMode % 6) + 6) % 6;
     Debug::SetIntegerSetting("renderer.deferredMode", this->deferredDebugData.debugMode);
 
-    this->frameGraph.Execute(this->deviceContext, this->views);
+    if (Debug::GetSetting("renderer.sortFrontToBack", true)) {
+        for (Render_view &view : this->views)
+            view.queue.SortFrontToBack(view.viewMatrix);
+    }
+
+    if (Debug::GetSetting("renderer.materialTable", true))
+        this->materialTable.Update(this->views);
+
+    const bool useMaterialTable = Debug::GetSetting("renderer.materialTable", true) && this->materialTable.IsValid();
+    this->sharedResources.materialTable = useMaterialTable ? &this->materialTable : nullptr;
+
+    this->constantBufferRing.BeginFrame();
+    this->UploadDrawConstants();
+
+    // Shared by the lighting pass and the reflection probes
+    if (primary)
+        this->shadowSystem.UploadLights(this->deviceContext, *primary);
+
+    // CPU culling stays per component; the GPU path refines it per sub-model and replaces the opaque draws
+    if (Debug::GetSetting("renderer.gpuCulling", false) && primary) {
+        const Render_view &cullingView = this->isCameraFrozen ? this->frozenRenderView : *primary;
+        this->gpuCullingSystem.PrepareBatches(this->deviceContext, this->constantBufferRing, primary->queue, cullingView);
+        this->constantBufferRing.Flush(this->deviceContext);
+    }
+    else {
+        this->gpuCullingSystem.Reset();
+    }
+
+    // Rebuilding is cheap as long as the structure matches a cached compiled graph
+    if (Debug::GetSetting("frameGraph.rebuildPerFrame", true)) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        this->BuildFrameGraph(true);
+        std::chrono::duration<float, std::micro> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+        Debug::SetStat("frameGraph.rebuildUs", elapsed.count());
+    }
+    else if (this->isFrameGraphPerFrame) {
+        // Back to a static graph, which has to contain every pass
+        this->BuildFrameGraph(false);
+    }
+
+    // One-shot, writes frame_graph.json and frame_graph.dot to the working directory
+    if (Debug::GetSetting("frameGraph.dumpGraph", false)) {
+        Debug::SetSetting("frameGraph.dumpGraph", false);
+        this->frameGraph.DumpGraph("frame_graph");
+    }
+
+    this->gpuCullingSystem.UpdateImportedBuffers(this->frameGraph);
+    this->reflectionSystem.UpdateImportedTextures(this->frameGraph);
+
+    // The controller sees the frame graph's GPU time, ImGui and debug drawing are left out
+    this->UpdateRenderScale();
+
+    if (Debug::GetSetting("frameGraph.captureTrace", false)) {
+        Debug::SetSetting("frameGraph.captureTrace", false);
+        this->frameGraph.GetProfiler().RequestCapture("frame_graph_trace.json", traceCaptureFrameCount);
+    }
+
+    // Failed graphs were already reported when compiling
+    if (this->frameGraph.IsCompiled())
+        this->frameGraph.Execute(this->stateCache, this->views);
 
     // Needed for DebugDraw and ImGui
-    this->deviceContext->OMSetRenderTargets(1, &this->renderTargetView, nullptr);
+    this->stateCache.SetRenderTargets(1, &this->renderTargetView, nullptr);
 
     const Render_view *debugView = this->isCameraFrozen ? &this->frozenRenderView : primary;
     if (debugView) {
@@ -950,7 +1281,71 @@ void Renderer::Render(Scene *scene) {
         XMFLOAT4X4 viewProjectionMatrix;
         XMStoreFloat4x4(&viewProjectionMatrix, XMMatrixTranspose(XMMatrixMultiply(viewMatrix, projectionMatrix)));
         DebugDraw::Render(this->deviceContext, viewProjectionMatrix);
+
+        // DebugDraw binds its state through the raw device context
+        this->stateCache.InvalidateShader(Shader_stage::vertex);
+        this->stateCache.InvalidateShader(Shader_stage::pixel);
+        this->stateCache.InvalidateConstantBuffers(Shader_stage::vertex);
+        this->stateCache.InvalidateInputAssembler();
     }
+
+    const StateCache::Stats &stateCacheStats = this->stateCache.GetStats();
+    Debug::SetStat("stateCache.issued", stateCacheStats.issuedCount);
+    Debug::SetStat("stateCache.filtered", stateCacheStats.filteredCount);
+    Debug::SetStat("stateCache.hazardUnbinds", stateCacheStats.hazardUnbindCount);
+    this->stateCache.ResetStats();
+
+    const ConstantBufferRing::Stats &ringStats = this->constantBufferRing.GetStats();
+    Debug::SetStat("constants.maps", ringStats.mapCount + GetUploadMapCount());
+    Debug::SetStat("constants.allocations", ringStats.allocationCount);
+    Debug::SetStat("constants.sharedHits", ringStats.sharedHitCount);
+    Debug::SetStat("constants.uploadedKB", ringStats.uploadedBytes / 1024.0f);
+    this->constantBufferRing.ResetStats();
+    ResetUploadMapCount();
+
+    Debug::SetStat("frameGraph.compileMs", this->frameGraph.GetCompileMilliseconds());
+    Debug::SetStat("frameGraph.levels", static_cast<int>(this->frameGraph.GetLevelCount()));
+
+    // GPU times lag a few frames behind
+    const PassProfiler &profiler = this->frameGraph.GetProfiler();
+    Debug::SetStat("frameGraph.cpuMs", profiler.GetCpuFrameMilliseconds());
+    Debug::SetStat("frameGraph.gpuMs", profiler.GetGpuFrameMilliseconds());
+
+    for (const PassProfiler::Pass_stats &passStats : profiler.GetPassStats()) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.3f ms CPU, %.3f ms GPU", passStats.cpuMilliseconds, passStats.gpuMilliseconds);
+        Debug::SetStat("pass." + passStats.name, std::string(buffer));
+    }
+
+    const FrameGraph::Cache_stats &frameGraphCacheStats = this->frameGraph.GetCacheStats();
+    Debug::SetStat("frameGraph.cacheHits", frameGraphCacheStats.hitCount);
+    Debug::SetStat("frameGraph.cacheMisses", frameGraphCacheStats.missCount);
+    Debug::SetStat("frameGraph.cachedGraphs", frameGraphCacheStats.cachedGraphCount);
+    Debug::SetStat("frameGraph.physicalResources", frameGraphCacheStats.physicalResourceCount);
+    Debug::SetStat("frameGraph.pooledResources", frameGraphCacheStats.pooledResourceCount);
+    Debug::SetStat("frameGraph.createdResources", frameGraphCacheStats.createdCount);
+    Debug::SetStat("frameGraph.evictedResources", frameGraphCacheStats.evictedCount);
+
+    const FrameGraph::Memory_stats &frameGraphMemoryStats = this->frameGraph.GetMemoryStats();
+    Debug::SetStat("frameGraph.transientAllocations", frameGraphMemoryStats.allocationCount);
+    Debug::SetStat("frameGraph.allocatedMB", frameGraphMemoryStats.allocatedBytes / (1024.0f * 1024.0f));
+    Debug::SetStat("frameGraph.summedMB", frameGraphMemoryStats.summedBytes / (1024.0f * 1024.0f));
+    Debug::SetStat("frameGraph.peakMB", frameGraphMemoryStats.peakBytes / (1024.0f * 1024.0f));
+
+    const MaterialTable::Stats &materialTableStats = this->materialTable.GetStats();
+    Debug::SetStat("materialTable.materials", materialTableStats.materialCount);
+    Debug::SetStat("materialTable.textures", materialTableStats.textureCount);
+    Debug::SetStat("materialTable.buckets", materialTableStats.bucketCount);
+    Debug::SetStat("materialTable.textureKB", materialTableStats.textureBytes / 1024.0f);
+    Debug::SetStat("materialTable.bufferKB", materialTableStats.bufferBytes / 1024.0f);
+    Debug::SetStat("materialTable.reallocations", materialTableStats.reallocationCount);
+
+    const GpuCullingSystem::Stats &cullingStats = this->gpuCullingSystem.GetStats();
+    Debug::SetStat("gpuCulling.instances", cullingStats.instanceCount);
+    Debug::SetStat("gpuCulling.batches", cullingStats.batchCount);
+    Debug::SetStat("gpuCulling.uploads", cullingStats.uploadCount);
+    Debug::SetStat("gpuCulling.validationFailures", cullingStats.validationFailures);
+    this->gpuCullingSystem.ResetStats();
 }
 
 void Renderer::Present() {
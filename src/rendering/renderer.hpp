@@ -6,9 +6,15 @@
 #include "rendering/render_view.hpp"
 #include "rendering/render_data.hpp"
 #include "rendering/shared_resources.hpp"
+#include "rendering/state_cache.hpp"
+#include "rendering/constant_buffer_ring.hpp"
+#include "rendering/material_table.hpp"
 #include "rendering/shadow_system.hpp"
 #include "rendering/reflection_probe_system.hpp"
 #include "rendering/particle_system.hpp"
+#include "rendering/gpu_culling_system.hpp"
+#include "rendering/light_cluster_system.hpp"
+#include "rendering/resolution_controller.hpp"
 
 #include <Windows.h>
 
@@ -23,8 +29,20 @@ class Renderer {
     D3D11_VIEWPORT viewport{};
     int width = 0;
     int height = 0;
+
+    // The G-buffer and lighting targets are allocated at full size and rendered in their top left part
+    D3D11_VIEWPORT renderViewport{};
+    int renderWidth = 0;
+    int renderHeight = 0;
+    float renderScale = 1.0f;
+
+    ResolutionController resolutionController;
     float clearColour[4] = {0.0f, 0.0f, 0.0f, 1.0f};
 
+    StateCache stateCache;
+    ConstantBufferRing constantBufferRing;
+    MaterialTable materialTable;
+
     FrameGraph frameGraph;
     FrameGraph::TextureHandle backbufferHandle = FrameGraph::INVALID_HANDLE;
     std::vector<Render_view> views;
@@ -34,14 +52,19 @@ class Renderer {
     ShadowSystem shadowSystem;
     ReflectionProbeSystem reflectionSystem;
     ParticleSystem particleSystem;
+    GpuCullingSystem gpuCullingSystem;
+    LightClusterSystem lightClusterSystem;
 
     ID3D11VertexShader *gBufferVS = nullptr;
     ID3D11PixelShader *gBufferPS = nullptr;
+    ID3D11PixelShader *gBufferMaterialTablePS = nullptr;
     ID3D11InputLayout *gBufferLayout = nullptr;
 
     ID3D11RasterizerState *wireframeRS = nullptr;
     ID3D11RasterizerState *noBackfaceCullingRS = nullptr;
 
+    ID3D11DepthStencilState *depthEqualDSS = nullptr; // Used after the depth pre-pass
+
     ID3D11VertexShader *tessellationVS = nullptr;
     ID3D11HullShader *tessellationHS = nullptr;
     ID3D11DomainShader *tessellationDS = nullptr;
@@ -60,24 +83,31 @@ class Renderer {
 
     // Debug
     bool isCameraFrozen = false;
+    bool isFrameGraphPerFrame = false;
     Render_view frozenRenderView{};
 
     bool CreateInterface(HWND hWnd);
     bool CreateRenderTargetView();
     bool LoadGBufferShaders();
     bool CreateRasterizerStates();
+    bool CreateDepthStencilStates();
     bool LoadTessellationShaders();
     bool LoadLightingShader();
     bool LoadResolveShaders();
     bool CreateConstantBuffers();
 
     void SetViewport(int width, int height);
+    void SetRenderScale(float scale);
+
+    // Picks the render scale for this frame, from the settings or the measured GPU frame time
+    void UpdateRenderScale();
 
     void RegisterGeometryPass(
         FrameGraph::TextureHandle albedoHandle, 
         FrameGraph::TextureHandle normalHandle, 
         FrameGraph::TextureHandle specularHandle, 
-        FrameGraph::TextureHandle depthHandle
+        FrameGraph::TextureHandle depthHandle,
+        const Gpu_culling_handles &cullingHandles
     );
 
     void RegisterLightingPass(
@@ -87,8 +117,8 @@ class Renderer {
         FrameGraph::TextureHandle depthHandle,
         const Shadow_handles &shadowHandles,
         const Reflection_probe_handles &reflectionHandles,
-        FrameGraph::TextureHandle lightingOutputHandle,
-        FrameGraph::TextureHandle lightingDummyHandle
+        const Light_cluster_handles &clusterHandles,
+        FrameGraph::TextureHandle lightingOutputHandle
     );
 
     void RegisterResolvePass(
@@ -99,7 +129,11 @@ class Renderer {
         FrameGraph::TextureHandle depthHandle
     );
 
-    void BuildFrameGraph();
+    void UploadDrawConstants();
+
+    // Per-frame builds leave out passes with nothing to do this frame, like reflections without visible probes.
+    // Fails when the graph doesn't compile.
+    bool BuildFrameGraph(bool isPerFrame);
 
 public:
     Renderer() = default;
@@ -118,8 +152,12 @@ public:
     void AddView(const Render_view &view);
     void AddView(const Render_view &view, const XMMATRIX &viewMatrix, const XMMATRIX &projectionMatrix);
 
+    // The material table keeps every material it has seen, call when assets were unloaded
+    void InvalidateMaterialTable() { this->materialTable.Invalidate(); }
+
     ID3D11Device *GetDevice() const { return this->device; }
     ID3D11DeviceContext *GetDeviceContext() const { return this->deviceContext; }
+    StateCache &GetStateCache() { return this->stateCache; }
     int GetWidth() const { return this->width; }
     int GetHeight() const { return this->height; }
     float GetAspectRatio() const { return static_cast<float>(this->width) / this->height; }
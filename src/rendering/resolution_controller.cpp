@@ -0,0 +1,148 @@
+#include "resolution_controller.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#undef min
+#undef max
+
+void ResolutionController::SetSettings(const Settings &settings) {
+    this->settings = settings;
+    this->scale = std::clamp(this->scale, settings.minScale, settings.maxScale);
+}
+
+void ResolutionController::Reset(float scale) {
+    this->scale = std::clamp(scale, this->settings.minScale, this->settings.maxScale);
+    this->averageMilliseconds = 0.0f;
+    this->hasAverage = false;
+}
+
+float ResolutionController::Update(float frameMilliseconds) {
+    if (!this->hasAverage) {
+        this->averageMilliseconds = frameMilliseconds;
+        this->hasAverage = true;
+    }
+    else {
+        this->averageMilliseconds += this->settings.smoothing * (frameMilliseconds - this->averageMilliseconds);
+    }
+
+    const float target = this->settings.targetMilliseconds;
+    const float lowerBound = target * (1.0f - this->settings.headroom);
+
+    // Aims for the middle of the band, so noise doesn't immediately push it back out
+    const float aim = 0.5f * (target + lowerBound);
+
+    float wantedScale = this->scale;
+    if (this->averageMilliseconds > target || this->averageMilliseconds < lowerBound)
+        wantedScale = this->scale * std::sqrt(aim / std::max(this->averageMilliseconds, 0.001f));
+
+    wantedScale = std::clamp(wantedScale, this->scale - this->settings.maxStepDown, this->scale + this->settings.maxStepUp);
+    wantedScale = std::clamp(wantedScale, this->settings.minScale, this->settings.maxScale);
+
+    // The average still describes the old scale. Moving it along with the model keeps the next updates from
+    // correcting for the same overshoot again.
+    if (wantedScale != this->scale) {
+        const float ratio = wantedScale / this->scale;
+        this->averageMilliseconds *= ratio * ratio;
+        this->scale = wantedScale;
+    }
+
+    return this->scale;
+}
+
+void ResolutionController::RunControllerTest() {
+    // Frame time of a synthetic scene, a fixed part plus a part that scales with the pixel count
+    struct Scene_model {
+        float fixedMilliseconds;
+        float pixelMilliseconds; // At scale 1
+
+        float GetMilliseconds(float scale) const { return this->fixedMilliseconds + this->pixelMilliseconds * scale * scale; }
+    };
+
+    struct Scenario {
+        const char *name;
+        Scene_model before;
+        Scene_model after; // Switched to halfway through
+    };
+
+    const Scenario scenarios[] = {
+        { "Light scene",          { 2.0f, 8.0f },  { 2.0f, 8.0f } },
+        { "Heavy scene",          { 4.0f, 20.0f }, { 4.0f, 20.0f } },
+        { "Over budget at min",   { 14.0f, 20.0f }, { 14.0f, 20.0f } },
+        { "Light to heavy",       { 2.0f, 8.0f },  { 4.0f, 24.0f } },
+        { "Heavy to light",       { 4.0f, 24.0f }, { 2.0f, 8.0f } }
+    };
+
+    const int frameCount = 1200;
+    const int measuredFrameCount = 200; // At the end of each half
+    const float noise = 0.05f;
+
+    LogInfo("Resolution controller test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    for (const Scenario &scenario : scenarios) {
+        ResolutionController controller;
+        const Settings &settings = controller.GetSettings();
+
+        // Deterministic noise, so runs are comparable
+        TestRandom random(12345);
+        auto nextNoise = [&random, noise]() {
+            return random.NextFloat(-1.0f, 1.0f) * noise;
+        };
+
+        bool hasPassed = true;
+        float scale = controller.GetScale();
+
+        for (int half = 0; half < 2; ++half) {
+            const Scene_model &model = half == 0 ? scenario.before : scenario.after;
+
+            float minScale = settings.maxScale;
+            float maxScale = settings.minScale;
+
+            for (int frame = 0; frame < frameCount / 2; ++frame) {
+                scale = controller.Update(model.GetMilliseconds(scale) * (1.0f + nextNoise()));
+
+                if (frame >= frameCount / 2 - measuredFrameCount) {
+                    minScale = std::min(minScale, scale);
+                    maxScale = std::max(maxScale, scale);
+                }
+            }
+
+            // Settled means inside the band, or pinned to a scale limit when the band can't be reached
+            const float milliseconds = model.GetMilliseconds(scale);
+            const bool isWithinTarget =
+                milliseconds <= settings.targetMilliseconds ?
+                    milliseconds >= settings.targetMilliseconds * (1.0f - settings.headroom) || scale == settings.maxScale :
+                    scale == settings.minScale;
+
+            const bool isStable = maxScale - minScale <= 0.05f;
+
+            if (!isWithinTarget || !isStable)
+                hasPassed = false;
+
+            if (half == 1 || !hasPassed) {
+                LogInfo(
+                    "%s: scale %.3f (%.3f to %.3f), %.2f ms for a target of %.2f ms\n",
+                    scenario.name,
+                    scale,
+                    minScale,
+                    maxScale,
+                    milliseconds,
+                    settings.targetMilliseconds
+                );
+            }
+        }
+
+        if (!checks.Check(hasPassed, "The scale settles within the target"))
+            LogInfo("%s did not settle\n", scenario.name);
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
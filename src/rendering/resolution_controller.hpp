@@ -0,0 +1,45 @@
+#ifndef RESOLUTION_CONTROLLER_HPP
+#define RESOLUTION_CONTROLLER_HPP
+
+// Picks the render scale that holds the measured GPU frame time at a target. The scale applies to both axes,
+// so the frame time is modelled as growing with its square.
+class ResolutionController {
+public:
+    struct Settings {
+        float targetMilliseconds = 16.0f;
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+
+        // The scale only grows once the frame time is this fraction below the target, which keeps it from
+        // oscillating around the target
+        float headroom = 0.1f;
+
+        float smoothing = 0.1f;    // Weight of the newest frame time in the moving average
+        float maxStepDown = 0.1f;  // Largest scale change per update, dropping quickly avoids long slow streaks
+        float maxStepUp = 0.02f;
+    };
+
+private:
+    Settings settings;
+    float scale = 1.0f;
+    float averageMilliseconds = 0.0f;
+    bool hasAverage = false;
+
+public:
+    void SetSettings(const Settings &settings);
+    const Settings &GetSettings() const { return this->settings; }
+
+    // Forgets the frame time history
+    void Reset(float scale);
+
+    // Returns the scale for the next frame
+    float Update(float frameMilliseconds);
+
+    float GetScale() const { return this->scale; }
+    float GetAverageMilliseconds() const { return this->averageMilliseconds; }
+
+    // Runs the controller against synthetic frame time models and logs whether it settles within the target
+    static void RunControllerTest();
+};
+
+#endif
\ No newline at end of file
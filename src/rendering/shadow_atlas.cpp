@@ -0,0 +1,485 @@
+#include "shadow_atlas.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#undef min
+#undef max
+
+void ShadowAtlas::Initialize(int rootSize, int rootCount, int minTileSize) {
+    this->rootSize = rootSize;
+    this->rootCount = rootCount;
+    this->minTileSize = minTileSize;
+
+    this->levelCount = 1;
+    while ((rootSize >> this->levelCount) >= minTileSize)
+        ++this->levelCount;
+
+    this->Reset();
+}
+
+void ShadowAtlas::Reset() {
+    this->freeTiles.assign(this->levelCount, {});
+    this->allocations.clear();
+
+    for (int i = 0; i < this->rootCount; ++i)
+        this->freeTiles[0].push_back({ i * this->rootSize, 0, this->rootSize });
+}
+
+int ShadowAtlas::GetLevel(int size) const {
+    int level = 0;
+    while ((this->rootSize >> level) > size)
+        ++level;
+
+    return level;
+}
+
+int ShadowAtlas::RoundTileSize(int size) const {
+    int tileSize = this->minTileSize;
+    while (tileSize < size && tileSize < this->rootSize)
+        tileSize *= 2;
+
+    return tileSize;
+}
+
+bool ShadowAtlas::RemoveFreeTile(int level, int x, int y) {
+    std::vector<Tile> &tiles = this->freeTiles[level];
+
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        if (tiles[i].x == x && tiles[i].y == y) {
+            tiles[i] = tiles.back();
+            tiles.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ShadowAtlas::Allocate(int size, Tile &outTile) {
+    const int level = this->GetLevel(size);
+    if (level >= this->levelCount || (this->rootSize >> level) != size)
+        return false;
+
+    // The tightest free tile, so large ones stay whole for large requests
+    int sourceLevel = level;
+    while (sourceLevel >= 0 && this->freeTiles[sourceLevel].empty())
+        --sourceLevel;
+
+    if (sourceLevel < 0)
+        return false;
+
+    Tile tile = this->freeTiles[sourceLevel].back();
+    this->freeTiles[sourceLevel].pop_back();
+
+    // Keeps the first child and frees the other three
+    while (sourceLevel < level) {
+        ++sourceLevel;
+        tile.size /= 2;
+
+        this->freeTiles[sourceLevel].push_back({ tile.x + tile.size, tile.y,             tile.size });
+        this->freeTiles[sourceLevel].push_back({ tile.x,             tile.y + tile.size, tile.size });
+        this->freeTiles[sourceLevel].push_back({ tile.x + tile.size, tile.y + tile.size, tile.size });
+    }
+
+    outTile = tile;
+    return true;
+}
+
+void ShadowAtlas::Free(const Tile &tile) {
+    Tile current = tile;
+    int level = this->GetLevel(current.size);
+
+    // Merges with the siblings as long as all of them are free
+    while (level > 0) {
+        const int parentSize = current.size * 2;
+        const int parentX = current.x - current.x % parentSize;
+        const int parentY = current.y - current.y % parentSize;
+
+        int siblingCount = 0;
+        for (const Tile &freeTile : this->freeTiles[level]) {
+            if (freeTile.x >= parentX && freeTile.x < parentX + parentSize &&
+                freeTile.y >= parentY && freeTile.y < parentY + parentSize)
+                ++siblingCount;
+        }
+
+        if (siblingCount < 3)
+            break;
+
+        for (int i = 0; i < 4; ++i) {
+            const int x = parentX + (i % 2) * current.size;
+            const int y = parentY + (i / 2) * current.size;
+            if (x != current.x || y != current.y)
+                this->RemoveFreeTile(level, x, y);
+        }
+
+        current = { parentX, parentY, parentSize };
+        --level;
+    }
+
+    this->freeTiles[level].push_back(current);
+}
+
+void ShadowAtlas::Update(std::vector<Request> &requests) {
+    this->keptCount = 0;
+    this->movedCount = 0;
+    this->loweredCount = 0;
+    this->droppedCount = 0;
+    this->wasRepacked = false;
+
+    std::vector<int> wantedSizes(requests.size());
+    for (size_t i = 0; i < requests.size(); ++i)
+        requests[i].size = this->RoundTileSize(requests[i].size);
+
+    std::stable_sort(requests.begin(), requests.end(), [](const Request &a, const Request &b) {
+        return a.size > b.size;
+    });
+
+    for (size_t i = 0; i < requests.size(); ++i)
+        wantedSizes[i] = requests[i].size;
+
+    const uint64_t capacity = static_cast<uint64_t>(this->rootSize) * this->rootSize * this->rootCount;
+    uint64_t total = 0;
+    for (const Request &request : requests)
+        total += static_cast<uint64_t>(request.size) * request.size;
+
+    // Halving every request of the largest size keeps the list sorted
+    while (total > capacity && !requests.empty() && requests.front().size > this->minTileSize) {
+        const int largest = requests.front().size;
+
+        for (Request &request : requests) {
+            if (request.size != largest)
+                break;
+
+            total -= static_cast<uint64_t>(request.size) * request.size * 3 / 4;
+            request.size /= 2;
+        }
+    }
+
+    size_t fittingCount = requests.size();
+    while (total > capacity) {
+        --fittingCount;
+        total -= static_cast<uint64_t>(requests[fittingCount].size) * requests[fittingCount].size;
+    }
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (i >= fittingCount) {
+            requests[i].size = 0;
+            ++this->droppedCount;
+        }
+        else if (requests[i].size < wantedSizes[i]) {
+            ++this->loweredCount;
+        }
+    }
+
+    std::unordered_map<uint64_t, Tile> previous;
+    previous.swap(this->allocations);
+
+    std::vector<bool> isKept(fittingCount, false);
+    for (size_t i = 0; i < fittingCount; ++i) {
+        auto it = previous.find(requests[i].id);
+        if (it == previous.end())
+            continue;
+
+        const int size = it->second.size;
+        if (size == requests[i].size || size == requests[i].size * 2) {
+            this->allocations[requests[i].id] = it->second;
+            previous.erase(it);
+            isKept[i] = true;
+            ++this->keptCount;
+        }
+    }
+
+    for (const auto &[id, tile] : previous)
+        this->Free(tile);
+
+    bool hasFailed = false;
+    for (size_t i = 0; i < fittingCount; ++i) {
+        if (isKept[i])
+            continue;
+
+        Tile tile;
+        if (!this->Allocate(requests[i].size, tile)) {
+            hasFailed = true;
+            break;
+        }
+
+        this->allocations[requests[i].id] = tile;
+        ++this->movedCount;
+    }
+
+    // Sorted power of two sizes that add up to at most the capacity always pack into an empty atlas
+    if (hasFailed) {
+        this->Reset();
+        this->wasRepacked = true;
+        this->keptCount = 0;
+        this->movedCount = 0;
+
+        for (size_t i = 0; i < fittingCount; ++i) {
+            Tile tile;
+            if (!this->Allocate(requests[i].size, tile)) {
+                LogWarn("Shadow atlas repack failed at request %zu\n", i);
+                break;
+            }
+
+            this->allocations[requests[i].id] = tile;
+            ++this->movedCount;
+        }
+    }
+}
+
+const ShadowAtlas::Tile *ShadowAtlas::GetTile(uint64_t id) const {
+    auto it = this->allocations.find(id);
+    if (it == this->allocations.end())
+        return nullptr;
+
+    return &it->second;
+}
+
+ShadowAtlas::Stats ShadowAtlas::GetStats() const {
+    Stats stats;
+
+    for (const auto &[id, tile] : this->allocations) {
+        ++stats.usedTileCount;
+        stats.usedTexels += static_cast<uint64_t>(tile.size) * tile.size;
+    }
+
+    for (const std::vector<Tile> &tiles : this->freeTiles) {
+        for (const Tile &tile : tiles) {
+            ++stats.freeTileCount;
+            stats.freeTexels += static_cast<uint64_t>(tile.size) * tile.size;
+            stats.largestFreeTile = std::max(stats.largestFreeTile, tile.size);
+        }
+    }
+
+    if (stats.freeTexels > 0)
+        stats.fragmentation = 1.0f - static_cast<float>(static_cast<double>(stats.largestFreeTile) * stats.largestFreeTile / stats.freeTexels);
+
+    stats.keptCount = this->keptCount;
+    stats.movedCount = this->movedCount;
+    stats.loweredCount = this->loweredCount;
+    stats.droppedCount = this->droppedCount;
+    stats.wasRepacked = this->wasRepacked;
+
+    return stats;
+}
+
+// Tiles inside the atlas, aligned to their size and not overlapping each other
+static bool AreTilesValid(const ShadowAtlas &atlas, const std::vector<ShadowAtlas::Tile> &tiles) {
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        const ShadowAtlas::Tile &a = tiles[i];
+
+        if (a.x < 0 || a.y < 0 || a.x + a.size > atlas.GetWidth() || a.y + a.size > atlas.GetHeight())
+            return false;
+
+        if (a.x % a.size != 0 || a.y % a.size != 0)
+            return false;
+
+        for (size_t j = i + 1; j < tiles.size(); ++j) {
+            const ShadowAtlas::Tile &b = tiles[j];
+
+            if (a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void ShadowAtlas::RunAllocatorTest() {
+    LogInfo("Shadow atlas test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    // Deterministic, so runs are comparable
+    TestRandom random(12345);
+
+    ShadowAtlas atlas;
+    atlas.Initialize(2048, 2, 128);
+    const uint64_t capacity = static_cast<uint64_t>(atlas.GetWidth()) * atlas.GetHeight();
+
+    {
+        // Random sizes until full, then freed in a random order
+        std::vector<Tile> tiles;
+        for (int attempt = 0; attempt < 1000; ++attempt) {
+            Tile tile;
+            if (atlas.Allocate(atlas.GetMinTileSize() << random.NextUint(4), tile))
+                tiles.push_back(tile);
+        }
+
+        Stats stats = atlas.GetStats();
+        checks.Check(AreTilesValid(atlas, tiles), "Allocated tiles don't overlap");
+        checks.Check(stats.freeTexels + [&tiles]() {
+            uint64_t texels = 0;
+            for (const Tile &tile : tiles)
+                texels += static_cast<uint64_t>(tile.size) * tile.size;
+            return texels;
+        }() == capacity, "Free and allocated tiles cover the atlas");
+
+        while (!tiles.empty()) {
+            const size_t index = random.NextUint(static_cast<uint32_t>(tiles.size()));
+            atlas.Free(tiles[index]);
+            tiles[index] = tiles.back();
+            tiles.pop_back();
+        }
+
+        stats = atlas.GetStats();
+        checks.Check(stats.freeTileCount == 2 && stats.freeTexels == capacity, "Freed tiles merge back into the roots");
+    }
+
+    {
+        // Exactly the capacity, in every tile size
+        std::vector<Request> requests;
+        uint64_t id = 1;
+        for (int size = atlas.GetMaxTileSize(); size >= atlas.GetMinTileSize(); size /= 2)
+            requests.push_back({ id++, size });
+
+        uint64_t texels = 0;
+        for (const Request &request : requests)
+            texels += static_cast<uint64_t>(request.size) * request.size;
+
+        while (texels + atlas.GetMinTileSize() * atlas.GetMinTileSize() <= capacity) {
+            requests.push_back({ id++, atlas.GetMinTileSize() });
+            texels += atlas.GetMinTileSize() * atlas.GetMinTileSize();
+        }
+
+        atlas.Reset();
+        atlas.Update(requests);
+
+        const Stats stats = atlas.GetStats();
+        checks.Check(stats.loweredCount == 0 && stats.droppedCount == 0 && stats.freeTexels == 0, "A full atlas packs without losses");
+
+        // One more light halves the largest tile
+        requests.push_back({ id++, atlas.GetMaxTileSize() });
+        atlas.Update(requests);
+        checks.Check(atlas.GetStats().droppedCount == 0, "Over budget lowers sizes before dropping lights");
+    }
+
+    {
+        // Lights coming and going and their screen coverage changing
+        const int lightCount = 48;
+        const int frameCount = 2000;
+
+        struct Light {
+            uint64_t id;
+            int size;
+            bool isVisible;
+        };
+
+        std::vector<Light> lights(lightCount);
+        for (int i = 0; i < lightCount; ++i)
+            lights[i] = { static_cast<uint64_t>(i + 1), atlas.GetMinTileSize() << random.NextUint(4), random.NextUint(4) != 0 };
+
+        std::unordered_map<uint64_t, Tile> previousTiles;
+        std::unordered_map<uint64_t, int> previousSizes;
+
+        int unstableCount = 0;
+        int invalidCount = 0;
+        int repackCount = 0;
+        uint64_t keptTotal = 0;
+        uint64_t movedTotal = 0;
+        double fragmentationTotal = 0.0;
+        float fragmentationMax = 0.0f;
+        double usageTotal = 0.0;
+
+        atlas.Reset();
+
+        std::vector<Request> requests;
+        for (int frame = 0; frame < frameCount; ++frame) {
+            for (Light &light : lights) {
+                if (random.NextUint(50) == 0)
+                    light.isVisible = !light.isVisible;
+
+                if (random.NextUint(20) == 0)
+                    light.size = random.NextUint(2) == 0 ? std::max(light.size / 2, atlas.GetMinTileSize()) : std::min(light.size * 2, atlas.GetMaxTileSize());
+            }
+
+            requests.clear();
+            for (const Light &light : lights)
+                if (light.isVisible)
+                    requests.push_back({ light.id, light.size });
+
+            atlas.Update(requests);
+            const Stats stats = atlas.GetStats();
+
+            std::vector<Tile> tiles;
+            std::unordered_map<uint64_t, Tile> currentTiles;
+            std::unordered_map<uint64_t, int> currentSizes;
+
+            for (const Request &request : requests) {
+                const Tile *tile = atlas.GetTile(request.id);
+                if (!tile)
+                    continue;
+
+                tiles.push_back(*tile);
+                currentTiles[request.id] = *tile;
+                currentSizes[request.id] = request.size;
+
+                // Same size as last frame means the same place, unless everything was packed again
+                auto previousTile = previousTiles.find(request.id);
+                if (!stats.wasRepacked && previousTile != previousTiles.end() && previousSizes[request.id] == request.size &&
+                    (previousTile->second.x != tile->x || previousTile->second.y != tile->y))
+                    ++unstableCount;
+            }
+
+            if (!AreTilesValid(atlas, tiles))
+                ++invalidCount;
+
+            previousTiles.swap(currentTiles);
+            previousSizes.swap(currentSizes);
+
+            repackCount += stats.wasRepacked ? 1 : 0;
+            keptTotal += stats.keptCount;
+            movedTotal += stats.movedCount;
+            fragmentationTotal += stats.fragmentation;
+            fragmentationMax = std::max(fragmentationMax, stats.fragmentation);
+            usageTotal += static_cast<double>(stats.usedTexels) / capacity;
+        }
+
+        checks.Check(invalidCount == 0, "Tiles stay valid while lights change");
+        checks.Check(unstableCount == 0, "Lights keep their tile while their size holds");
+
+        LogInfo(
+            "%d frames of %d lights: %.1f%% of tiles kept per frame, %d full repacks\n",
+            frameCount,
+            lightCount,
+            100.0 * keptTotal / std::max<uint64_t>(keptTotal + movedTotal, 1),
+            repackCount
+        );
+        LogInfo(
+            "Atlas %.1f%% used on average, fragmentation %.3f on average and %.3f at most\n",
+            100.0 * usageTotal / frameCount,
+            fragmentationTotal / frameCount,
+            fragmentationMax
+        );
+    }
+
+    {
+        std::vector<Request> requests;
+        std::vector<Request> frameRequests;
+        for (int i = 0; i < 32; ++i)
+            requests.push_back({ static_cast<uint64_t>(i + 1), atlas.GetMinTileSize() << random.NextUint(4) });
+
+        atlas.Reset();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int frame = 0; frame < BENCHMARK_FRAME_COUNT; ++frame) {
+            Request &changed = requests[random.NextUint(static_cast<uint32_t>(requests.size()))];
+            changed.size = atlas.GetMinTileSize() << random.NextUint(4);
+
+            frameRequests = requests;
+            atlas.Update(frameRequests);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        const double microseconds = std::chrono::duration<double, std::micro>(end - start).count();
+        LogInfo("Update of 32 lights: %.2f us\n", microseconds / BENCHMARK_FRAME_COUNT);
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
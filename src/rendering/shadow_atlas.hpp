@@ -0,0 +1,91 @@
+#ifndef SHADOW_ATLAS_HPP
+#define SHADOW_ATLAS_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Hands out square power of two tiles of a shadow atlas to lights. The atlas is a row of quadtrees: a tile is either
+// free, split into four children or used by one light, and freed tiles merge back with their siblings. Only does
+// CPU bookkeeping, so it can be driven by synthetic lights.
+class ShadowAtlas {
+public:
+    struct Tile {
+        int x = 0; // Texels
+        int y = 0;
+        int size = 0;
+    };
+
+    struct Request {
+        uint64_t id = 0; // Stable across frames
+        int size = 0;    // Wanted tile size, lowered by Update when the atlas is full
+    };
+
+    struct Stats {
+        int usedTileCount = 0;
+        uint64_t usedTexels = 0;
+        uint64_t freeTexels = 0;
+        int freeTileCount = 0;
+        int largestFreeTile = 0;
+        float fragmentation = 0.0f; // 0 when the free space is a single tile, towards 1 when it's scattered
+
+        // Last Update only
+        int keptCount = 0;
+        int movedCount = 0;   // Allocated again, new lights included
+        int loweredCount = 0; // Got a smaller tile than they asked for
+        int droppedCount = 0; // Got no tile
+        bool wasRepacked = false;
+    };
+
+private:
+    int rootSize = 0;
+    int rootCount = 0;
+    int minTileSize = 0;
+    int levelCount = 0; // Level 0 tiles are rootSize, each level halves that
+
+    std::vector<std::vector<Tile>> freeTiles; // Per level
+    std::unordered_map<uint64_t, Tile> allocations;
+
+    int keptCount = 0;
+    int movedCount = 0;
+    int loweredCount = 0;
+    int droppedCount = 0;
+    bool wasRepacked = false;
+
+    int GetLevel(int size) const;
+    bool RemoveFreeTile(int level, int x, int y);
+
+public:
+    void Initialize(int rootSize, int rootCount, int minTileSize);
+
+    // Frees every tile
+    void Reset();
+
+    bool Allocate(int size, Tile &outTile);
+    void Free(const Tile &tile);
+
+    // Gives the requests tiles for this frame, larger ones first. Lights keep their tile while it's the size they
+    // ask for or one step larger, so a small camera move doesn't move them. When everything doesn't fit, the largest
+    // requests are halved until it does, and whatever still doesn't fit at the smallest size goes without. Only when
+    // the kept tiles leave too little room in one piece is the whole atlas packed again.
+    void Update(std::vector<Request> &requests);
+
+    // nullptr if the light has no tile
+    const Tile *GetTile(uint64_t id) const;
+
+    Stats GetStats() const;
+
+    int GetWidth() const { return this->rootSize * this->rootCount; }
+    int GetHeight() const { return this->rootSize; }
+    int GetMinTileSize() const { return this->minTileSize; }
+    int GetMaxTileSize() const { return this->rootSize; }
+
+    // Smallest power of two at least as large as size, within the tile sizes
+    int RoundTileSize(int size) const;
+
+    // Checks the allocator against its guarantees with synthetic lights and logs fragmentation and timings
+    static void RunAllocatorTest();
+    static constexpr int BENCHMARK_FRAME_COUNT = 10000;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "shadow_cache.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+void ShadowCache::Signature::Add(const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        this->hash ^= bytes[i];
+        this->hash *= 1099511628211ull;
+    }
+}
+
+void ShadowCache::Signature::AddCaster(const Geometry_command &command) {
+    this->Add(command.vertexBuffer);
+    this->Add(command.indexBuffer);
+    this->Add(command.indexCount);
+    this->Add(command.startIndex);
+    this->Add(command.baseVertex);
+    this->Add(static_cast<uint64_t>(command.material.GetID())); // Alpha testing
+    this->Add(command.worldMatrix);
+}
+
+uint64_t ShadowCache::ComputeSignature(
+    const ShadowAtlas::Tile &tile,
+    const XMFLOAT4X4 &viewMatrix,
+    const XMFLOAT4X4 &projectionMatrix,
+    const std::vector<Geometry_command> &commands
+) {
+    Signature signature;
+    signature.Add(tile.x);
+    signature.Add(tile.y);
+    signature.Add(tile.size);
+    signature.Add(viewMatrix);
+    signature.Add(projectionMatrix);
+
+    for (const Geometry_command &command : commands)
+        if (command.isStatic)
+            signature.AddCaster(command);
+
+    return signature.Get();
+}
+
+void ShadowCache::BeginFrame() {
+    ++this->frame;
+    this->redrawnCount = 0;
+    this->reusedCount = 0;
+}
+
+bool ShadowCache::NeedsRedraw(uint64_t id, uint64_t signature) {
+    auto [it, isNew] = this->entries.try_emplace(id);
+    Entry &entry = it->second;
+
+    const bool needsRedraw = isNew || entry.signature != signature;
+
+    entry.signature = signature;
+    entry.lastFrame = this->frame;
+
+    if (needsRedraw)
+        ++this->redrawnCount;
+    else
+        ++this->reusedCount;
+
+    return needsRedraw;
+}
+
+void ShadowCache::EndFrame() {
+    for (auto it = this->entries.begin(); it != this->entries.end();) {
+        if (it->second.lastFrame != this->frame)
+            it = this->entries.erase(it);
+        else
+            ++it;
+    }
+}
+
+void ShadowCache::Clear() {
+    this->entries.clear();
+}
+
+void ShadowCache::RunInvalidationTest() {
+    struct Test_light {
+        uint64_t id;
+        XMFLOAT3 position;
+        float range;
+        ShadowAtlas::Tile tile;
+        bool isVisible;
+    };
+
+    struct Test_caster {
+        XMFLOAT3 position;
+        bool isStatic;
+    };
+
+    std::vector<Test_light> lights;
+    for (int i = 0; i < 6; ++i)
+        lights.push_back({ static_cast<uint64_t>(i + 1), { i * 10.0f, 5.0f, 0.0f }, 12.0f, { (i % 4) * 512, (i / 4) * 512, 512 }, true });
+
+    std::vector<Test_caster> casters;
+    for (int i = 0; i < 20; ++i)
+        casters.push_back({ { -5.0f + i * 3.0f, 0.0f, 0.0f }, true });
+    for (int i = 0; i < 8; ++i)
+        casters.push_back({ { i * 7.0f, 0.0f, 3.0f }, false });
+
+    // The culling a light view would do
+    auto sees = [](const Test_light &light, const XMFLOAT3 &position) {
+        const float dx = position.x - light.position.x;
+        const float dy = position.y - light.position.y;
+        const float dz = position.z - light.position.z;
+        return dx * dx + dy * dy + dz * dz < light.range * light.range;
+    };
+
+    auto countSeeing = [&](const XMFLOAT3 &before, const XMFLOAT3 &after) {
+        int count = 0;
+        for (const Test_light &light : lights)
+            if (light.isVisible && (sees(light, before) || sees(light, after)))
+                ++count;
+        return count;
+    };
+
+    LogInfo("Shadow cache invalidation test:\n");
+    LogIndent();
+
+    ShadowCache cache;
+    const int frameCount = 300;
+
+    TestChecks checks;
+    int redrawnTotal = 0;
+    int drawnWithoutCache = 0;
+
+    for (int frame = 0; frame < frameCount; ++frame) {
+        const char *event = nullptr;
+        int expected = 0;
+
+        if (frame == 0) {
+            event = "first frame";
+            expected = static_cast<int>(lights.size());
+        }
+        else if (frame == 50) {
+            event = "light moved";
+            lights[2].position.x += 1.0f;
+            expected = 1;
+        }
+        else if (frame == 100) {
+            event = "static caster moved";
+            const XMFLOAT3 before = casters[7].position;
+            casters[7].position.x += 4.0f;
+            expected = countSeeing(before, casters[7].position);
+        }
+        else if (frame == 150) {
+            event = "tile moved by a repack";
+            lights[4].tile.x += 512;
+            expected = 1;
+        }
+        else if (frame == 200) {
+            event = "light left the atlas";
+            lights[5].isVisible = false;
+        }
+        else if (frame == 210) {
+            event = "light came back";
+            lights[5].isVisible = true;
+            expected = 1;
+        }
+        else if (frame == 250) {
+            event = "static caster added";
+            casters.push_back({ { 21.0f, 1.0f, 0.0f }, true });
+            expected = countSeeing(casters.back().position, casters.back().position);
+        }
+
+        // Dynamic casters move every frame and must never cost a redraw
+        for (Test_caster &caster : casters)
+            if (!caster.isStatic)
+                caster.position.x += 0.1f;
+
+        cache.BeginFrame();
+
+        int visibleCount = 0;
+        for (const Test_light &light : lights) {
+            if (!light.isVisible)
+                continue;
+
+            std::vector<Geometry_command> commands;
+            for (const Test_caster &caster : casters) {
+                if (!sees(light, caster.position))
+                    continue;
+
+                Geometry_command command{};
+                command.indexCount = 36;
+                command.isStatic = caster.isStatic;
+                XMStoreFloat4x4(&command.worldMatrix, XMMatrixTranslation(caster.position.x, caster.position.y, caster.position.z));
+                commands.push_back(command);
+            }
+
+            XMFLOAT4X4 viewMatrix;
+            XMFLOAT4X4 projectionMatrix;
+            XMStoreFloat4x4(&viewMatrix, XMMatrixTranslation(-light.position.x, -light.position.y, -light.position.z));
+            XMStoreFloat4x4(&projectionMatrix, XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 0.1f, light.range));
+
+            cache.NeedsRedraw(light.id, ComputeSignature(light.tile, viewMatrix, projectionMatrix, commands));
+            ++visibleCount;
+        }
+
+        cache.EndFrame();
+
+        redrawnTotal += cache.GetRedrawnCount();
+        drawnWithoutCache += visibleCount;
+
+        if (event)
+            LogInfo("Frame %d, %s: %d of %d maps redrawn\n", frame, event, cache.GetRedrawnCount(), visibleCount);
+
+        if (!checks.Check(cache.GetRedrawnCount() == expected, "Only invalidated maps are redrawn"))
+            LogInfo("Frame %d: expected %d redrawn maps, got %d\n", frame, expected, cache.GetRedrawnCount());
+    }
+
+    LogInfo(
+        "%d static caster maps drawn in %d frames, %d without the cache\n",
+        redrawnTotal,
+        frameCount,
+        drawnWithoutCache
+    );
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#ifndef SHADOW_CACHE_HPP
+#define SHADOW_CACHE_HPP
+
+#include "rendering/render_commands.hpp"
+#include "rendering/shadow_atlas.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Decides which lights need their cached static caster depth drawn again. Everything that ends up in a cached map
+// is hashed into a signature each frame, the light's matrices, its atlas tile and the static casters it sees, so
+// moving, adding or removing any of them is noticed without the scene reporting changes.
+class ShadowCache {
+public:
+    // FNV-1a over the bytes added
+    class Signature {
+        uint64_t hash = 14695981039346656037ull;
+
+    public:
+        void Add(const void *data, size_t size);
+
+        template <typename T>
+        void Add(const T &value) { this->Add(&value, sizeof(T)); }
+
+        // The fields that change what the caster draws into a depth map
+        void AddCaster(const Geometry_command &command);
+
+        uint64_t Get() const { return this->hash; }
+    };
+
+private:
+    struct Entry {
+        uint64_t signature = 0;
+        uint64_t lastFrame = 0;
+    };
+
+    std::unordered_map<uint64_t, Entry> entries; // By light id
+    uint64_t frame = 0;
+
+    int redrawnCount = 0;
+    int reusedCount = 0;
+
+public:
+    // Signature of a light's cached map, only the static casters in the commands count
+    static uint64_t ComputeSignature(
+        const ShadowAtlas::Tile &tile,
+        const XMFLOAT4X4 &viewMatrix,
+        const XMFLOAT4X4 &projectionMatrix,
+        const std::vector<Geometry_command> &commands
+    );
+
+    void BeginFrame();
+
+    // Returns true if the light's cached map doesn't match the signature and has to be drawn again. Lights that
+    // aren't seen in a frame are forgotten, since another light may draw over their part of the cache meanwhile.
+    bool NeedsRedraw(uint64_t id, uint64_t signature);
+
+    void EndFrame();
+
+    // Forgets every light, e.g. after the cache texture was recreated
+    void Clear();
+
+    // Of the current frame
+    int GetRedrawnCount() const { return this->redrawnCount; }
+    int GetReusedCount() const { return this->reusedCount; }
+
+    // Moves lights and casters around in a synthetic scene and checks that exactly the affected maps are redrawn,
+    // logging the redraws per frame
+    static void RunInvalidationTest();
+};
+
+#endif
\ No newline at end of file
@@ -2,39 +2,70 @@
 #include "core/logging.hpp"
 #include "rendering/render_utils.hpp"
 #include "scene/scene.hpp"
+#include "debugging/debug.hpp"
 
 #include <algorithm>
+#include <chrono>
 
 #undef min
 #undef max
 
-void ShadowSystem::ComputeDirectionalLightMatrices(
-    XMMATRIX &outView,
-    XMMATRIX &outProjection,
-    const Directional_light_command &command,
-    const Render_view &primaryView
-) const {
-    XMFLOAT3 corners[8];
-    primaryView.frustum.GetCorners(corners);
+static_assert(ShadowSystem::MAX_SHADOW_CASCADES == 4, "Directional_light_data has four cascade matrices");
+
+void ShadowSystem::ComputeCascadeSplits(float nearDistance, float farDistance, int cascadeCount, float lambda, float *outSplits) {
+    for (int i = 1; i <= cascadeCount; ++i) {
+        const float t = static_cast<float>(i) / cascadeCount;
+
+        const float logarithmic = nearDistance * powf(farDistance / nearDistance, t);
+        const float uniform = nearDistance + (farDistance - nearDistance) * t;
+
+        outSplits[i - 1] = lambda * logarithmic + (1.0f - lambda) * uniform;
+    }
+
+    // Exact, so the last cascade ends where the shadows do
+    outSplits[cascadeCount - 1] = farDistance;
+}
 
-    float t = std::min(primaryView.shadowDistance / primaryView.farPlane, 1.0f);
-    for (int i = 0; i < 4; ++i)
-        XMStoreFloat3(&corners[i + 4], XMVectorLerp(XMLoadFloat3(&corners[i]), XMLoadFloat3(&corners[i + 4]), t));
+ShadowSystem::Cascade_fit ShadowSystem::FitCascade(
+    const XMFLOAT3 frustumCorners[8],
+    float nearPlane,
+    float farPlane,
+    float splitNear,
+    float splitFar,
+    const XMFLOAT3 &lightDirection,
+    int resolution
+) {
+    Cascade_fit fit;
+
+    // View depth is linear along the edges from the near to the far corners
+    const float tNear = (splitNear - nearPlane) / (farPlane - nearPlane);
+    const float tFar = (splitFar - nearPlane) / (farPlane - nearPlane);
+
+    XMVECTOR corners[8];
+    for (int i = 0; i < 4; ++i) {
+        XMVECTOR nearCorner = XMLoadFloat3(&frustumCorners[i]);
+        XMVECTOR farCorner = XMLoadFloat3(&frustumCorners[i + 4]);
+
+        corners[i]     = XMVectorLerp(nearCorner, farCorner, tNear);
+        corners[i + 4] = XMVectorLerp(nearCorner, farCorner, tFar);
+    }
 
     XMVECTOR centre = XMVectorZero();
-    for (const XMFLOAT3 &corner : corners)
-        centre += XMLoadFloat3(&corner);
+    for (XMVECTOR corner : corners)
+        centre += corner;
     centre /= 8.0f;
 
+    // A sphere doesn't change as the camera turns. Rounding up keeps floating point noise out of the texel size.
     float radius = 0.0f;
-    for (const XMFLOAT3 &corner : corners) {
-        float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&corner) - centre));
-        radius = std::max(radius, distance);
-    }
+    for (XMVECTOR corner : corners)
+        radius = std::max(radius, XMVectorGetX(XMVector3Length(corner - centre)));
+    radius = ceilf(radius * 16.0f) / 16.0f;
 
-    float worldUnitsPerTexel = (2.0f * radius) / SHADOW_MAP_DIRECTIONAL_RESOLUTION;
+    // A texel of border on each side covers the snapping below, which moves the centre by less than a texel
+    fit.worldUnitsPerTexel = (2.0f * radius) / (resolution - 2);
+    const float halfExtent = 0.5f * fit.worldUnitsPerTexel * resolution;
 
-    XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&command.direction));
+    XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&lightDirection));
     XMVECTOR up = fabsf(XMVectorGetY(direction)) < 0.99f ? XMVectorSet(0, 1, 0, 0) : XMVectorSet(1, 0, 0, 0);
 
     XMMATRIX refView = XMMatrixLookToLH(XMVectorZero(), direction, up);
@@ -43,22 +74,233 @@ void ShadowSystem::ComputeDirectionalLightMatrices(
     XMFLOAT3 centreRef;
     XMStoreFloat3(&centreRef, XMVector3Transform(centre, refView));
 
-    centreRef.x = floorf(centreRef.x / worldUnitsPerTexel) * worldUnitsPerTexel;
-    centreRef.y = floorf(centreRef.y / worldUnitsPerTexel) * worldUnitsPerTexel;
+    centreRef.x = floorf(centreRef.x / fit.worldUnitsPerTexel) * fit.worldUnitsPerTexel;
+    centreRef.y = floorf(centreRef.y / fit.worldUnitsPerTexel) * fit.worldUnitsPerTexel;
 
     XMVECTOR snappedCentre = XMVector3Transform(XMLoadFloat3(&centreRef), invRefView);
-    outView = XMMatrixLookToLH(snappedCentre, direction, up);
+    XMMATRIX view = XMMatrixLookToLH(snappedCentre, direction, up);
 
     float minZ = FLT_MAX;
     float maxZ = -FLT_MAX;
-    for (const XMFLOAT3 &corner : corners) {
-        float z = XMVectorGetZ(XMVector3Transform(XMLoadFloat3(&corner), outView));
+    for (XMVECTOR corner : corners) {
+        float z = XMVectorGetZ(XMVector3Transform(corner, view));
         minZ = std::min(minZ, z);
         maxZ = std::max(maxZ, z);
     }
-    minZ -= 500.0f;
+    minZ -= DIRECTIONAL_CASTER_DISTANCE;
+
+    XMMATRIX projection = XMMatrixOrthographicOffCenterLH(-halfExtent, halfExtent, -halfExtent, halfExtent, minZ, maxZ);
+
+    XMStoreFloat4x4(&fit.viewMatrix, view);
+    XMStoreFloat4x4(&fit.projectionMatrix, projection);
+
+    // Everything the projection covers, casters outside of it can't affect the cascade
+    BoundingOrientedBox localBox(
+        XMFLOAT3(0.0f, 0.0f, (minZ + maxZ) * 0.5f),
+        XMFLOAT3(halfExtent, halfExtent, (maxZ - minZ) * 0.5f),
+        XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f)
+    );
+    localBox.Transform(fit.casterBox, XMMatrixInverse(nullptr, view));
+
+    return fit;
+}
+
+void ShadowSystem::RunCascadeTest() {
+    LogInfo("Shadow cascade test:\n");
+    LogIndent();
+
+    const float nearPlane = 0.1f;
+    const float farPlane = 1000.0f;
+    const float shadowDistance = 80.0f;
+    const int resolution = SHADOW_MAP_DIRECTIONAL_RESOLUTION;
+
+    // Splits: increasing, ending at the shadow distance, uniform at lambda 0 and with a constant ratio at lambda 1
+    {
+        const float lambdas[] = { 0.0f, 0.5f, 0.75f, 1.0f };
+        int errorCount = 0;
+
+        for (int cascadeCount = MIN_SHADOW_CASCADES; cascadeCount <= MAX_SHADOW_CASCADES; ++cascadeCount) {
+            for (float lambda : lambdas) {
+                float splits[MAX_SHADOW_CASCADES];
+                ComputeCascadeSplits(nearPlane, shadowDistance, cascadeCount, lambda, splits);
+
+                float previous = nearPlane;
+                for (int i = 0; i < cascadeCount; ++i) {
+                    if (splits[i] <= previous)
+                        ++errorCount;
+
+                    previous = splits[i];
+                }
+
+                if (splits[cascadeCount - 1] != shadowDistance)
+                    ++errorCount;
+
+                for (int i = 0; i < cascadeCount - 1; ++i) {
+                    const float uniform = nearPlane + (shadowDistance - nearPlane) * (i + 1) / cascadeCount;
+                    if (lambda == 0.0f && fabsf(splits[i] - uniform) > 1e-3f * shadowDistance)
+                        ++errorCount;
+
+                    const float ratio = powf(shadowDistance / nearPlane, 1.0f / cascadeCount);
+                    const float start = i > 0 ? splits[i - 1] : nearPlane;
+                    if (lambda == 1.0f && fabsf(splits[i] / start - ratio) > 1e-3f * ratio)
+                        ++errorCount;
+                }
+            }
+        }
+
+        float splits[MAX_SHADOW_CASCADES];
+        ComputeCascadeSplits(nearPlane, shadowDistance, MAX_SHADOW_CASCADES, 0.75f, splits);
+
+        if (errorCount == 0)
+            LogInfo("Splits: passed, %.2f / %.2f / %.2f / %.2f at lambda 0.75\n", splits[0], splits[1], splits[2], splits[3]);
+        else
+            LogWarn("Splits: %d problems\n", errorCount);
+    }
+
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, nearPlane, farPlane);
+
+    auto getCorners = [&](XMFLOAT3 *outCorners, const XMFLOAT3 &position, float yaw, float pitch) {
+        BoundingFrustum frustum;
+        BoundingFrustum::CreateFromMatrix(frustum, projection);
+        frustum.Transform(frustum, XMMatrixMultiply(XMMatrixRotationRollPitchYaw(pitch, yaw, 0.0f), XMMatrixTranslation(position.x, position.y, position.z)));
+        frustum.GetCorners(outCorners);
+    };
+
+    const XMFLOAT3 lightDirections[] = { { 0.3f, -1.0f, 0.2f }, { 0.0f, -1.0f, 0.0f }, { -0.8f, -0.3f, 0.5f } };
+
+    float splits[MAX_SHADOW_CASCADES];
+    ComputeCascadeSplits(nearPlane, shadowDistance, MAX_SHADOW_CASCADES, 0.75f, splits);
+
+    // Coverage: every corner of a cascade's slice lands inside its shadow map and caster box
+    {
+        int errorCount = 0;
+        int fitCount = 0;
+
+        for (const XMFLOAT3 &lightDirection : lightDirections) {
+            for (int i = 0; i < 8; ++i) {
+                const XMFLOAT3 position = { i * 37.3f - 100.0f, 5.0f + i, i * -11.7f };
+                const float yaw = i * 0.8f;
+                const float pitch = i * 0.15f - 0.5f;
+
+                XMFLOAT3 corners[8];
+                getCorners(corners, position, yaw, pitch);
+
+                for (int cascade = 0; cascade < MAX_SHADOW_CASCADES; ++cascade) {
+                    const float splitNear = cascade > 0 ? splits[cascade - 1] : nearPlane;
+                    const float splitFar = splits[cascade];
+
+                    Cascade_fit fit = FitCascade(corners, nearPlane, farPlane, splitNear, splitFar, lightDirection, resolution);
+                    XMMATRIX viewProjection = XMMatrixMultiply(XMLoadFloat4x4(&fit.viewMatrix), XMLoadFloat4x4(&fit.projectionMatrix));
+                    ++fitCount;
+
+                    const float tNear = (splitNear - nearPlane) / (farPlane - nearPlane);
+                    const float tFar = (splitFar - nearPlane) / (farPlane - nearPlane);
+
+                    for (int j = 0; j < 8; ++j) {
+                        const float t = j < 4 ? tNear : tFar;
+                        XMVECTOR corner = XMVectorLerp(XMLoadFloat3(&corners[j % 4]), XMLoadFloat3(&corners[j % 4 + 4]), t);
+
+                        XMFLOAT3 ndc;
+                        XMStoreFloat3(&ndc, XMVector3TransformCoord(corner, viewProjection));
+
+                        const float epsilon = 1e-4f;
+                        if (fabsf(ndc.x) > 1.0f + epsilon || fabsf(ndc.y) > 1.0f + epsilon || ndc.z < -epsilon || ndc.z > 1.0f + epsilon)
+                            ++errorCount;
+
+                        if (fit.casterBox.Contains(corner) == DISJOINT)
+                            ++errorCount;
+                    }
+                }
+            }
+        }
+
+        if (errorCount == 0)
+            LogInfo("Coverage: passed for %d cascades\n", fitCount);
+        else
+            LogWarn("Coverage: %d corners outside of their cascade\n", errorCount);
+    }
+
+    // Stability: moving the camera leaves the texel size alone and moves the map by whole texels, turning it
+    // doesn't change the texel size
+    {
+        int errorCount = 0;
+        float worstTexelError = 0.0f;
+
+        const XMFLOAT3 &lightDirection = lightDirections[0];
+        const XMVECTOR fixedPoint = XMVectorSet(3.0f, 1.0f, 7.0f, 1.0f);
+
+        for (int cascade = 0; cascade < MAX_SHADOW_CASCADES; ++cascade) {
+            const float splitNear = cascade > 0 ? splits[cascade - 1] : nearPlane;
+            const float splitFar = splits[cascade];
+
+            XMFLOAT3 corners[8];
+            getCorners(corners, XMFLOAT3(0.0f, 2.0f, 0.0f), 0.3f, 0.0f);
+            Cascade_fit reference = FitCascade(corners, nearPlane, farPlane, splitNear, splitFar, lightDirection, resolution);
+
+            XMFLOAT2 referenceTexel;
+            XMStoreFloat2(&referenceTexel, XMVector3TransformCoord(fixedPoint, XMMatrixMultiply(XMLoadFloat4x4(&reference.viewMatrix), XMLoadFloat4x4(&reference.projectionMatrix))));
+
+            for (int step = 1; step <= 50; ++step) {
+                getCorners(corners, XMFLOAT3(step * 0.137f, 2.0f + step * 0.011f, step * -0.071f), 0.3f + step * 0.05f, 0.0f);
+                Cascade_fit fit = FitCascade(corners, nearPlane, farPlane, splitNear, splitFar, lightDirection, resolution);
+
+                if (fit.worldUnitsPerTexel != reference.worldUnitsPerTexel) {
+                    ++errorCount;
+                    continue;
+                }
+
+                XMFLOAT2 texel;
+                XMStoreFloat2(&texel, XMVector3TransformCoord(fixedPoint, XMMatrixMultiply(XMLoadFloat4x4(&fit.viewMatrix), XMLoadFloat4x4(&fit.projectionMatrix))));
+
+                // NDC to texels
+                const float dx = (texel.x - referenceTexel.x) * resolution * 0.5f;
+                const float dy = (texel.y - referenceTexel.y) * resolution * 0.5f;
+                const float texelError = std::max(fabsf(dx - roundf(dx)), fabsf(dy - roundf(dy)));
+
+                worstTexelError = std::max(worstTexelError, texelError);
+                if (texelError > 0.05f)
+                    ++errorCount;
+            }
+        }
+
+        if (errorCount == 0)
+            LogInfo("Stability: passed, worst sub-texel movement %.4f texels\n", worstTexelError);
+        else
+            LogWarn("Stability: %d problems, worst sub-texel movement %.4f texels\n", errorCount, worstTexelError);
+    }
+
+    // Per-frame cost: the splits and every cascade of every shadowed directional light
+    {
+        XMFLOAT3 corners[8];
+        getCorners(corners, XMFLOAT3(0.0f, 2.0f, 0.0f), 0.3f, 0.0f);
+
+        float checksum = 0.0f;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < CASCADE_BENCHMARK_ITERATIONS; ++i) {
+            float frameSplits[MAX_SHADOW_CASCADES];
+            ComputeCascadeSplits(nearPlane, shadowDistance, MAX_SHADOW_CASCADES, 0.75f, frameSplits);
+
+            for (int light = 0; light < MAX_DIRECTIONAL_SHADOW_MAPS; ++light) {
+                for (int cascade = 0; cascade < MAX_SHADOW_CASCADES; ++cascade) {
+                    const float splitNear = cascade > 0 ? frameSplits[cascade - 1] : nearPlane;
+                    Cascade_fit fit = FitCascade(corners, nearPlane, farPlane, splitNear, frameSplits[cascade], lightDirections[light], resolution);
+                    checksum += fit.worldUnitsPerTexel;
+                }
+            }
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+        LogInfo(
+            "Setup of %d lights with %d cascades: %.3f us per frame (checksum %.1f)\n",
+            MAX_DIRECTIONAL_SHADOW_MAPS,
+            MAX_SHADOW_CASCADES,
+            elapsed.count() / CASCADE_BENCHMARK_ITERATIONS,
+            checksum
+        );
+    }
 
-    outProjection = XMMatrixOrthographicOffCenterLH(-radius, radius, -radius, radius, minZ, maxZ);
+    LogUnindent();
 }
 
 void ShadowSystem::ComputeSpotLightMatrices(
@@ -74,6 +316,129 @@ void ShadowSystem::ComputeSpotLightMatrices(
     outProjection = XMMatrixPerspectiveFovLH(command.outerConeAngle * 2.0f, 1.0f, 0.1f, command.range);
 }
 
+int ShadowSystem::ComputeSpotTileSize(const Spot_light_command &command, const Render_view &primaryView, int renderHeight) const {
+    const BoundingSphere bounds = LightSelector::ComputeConeBounds(command);
+    const float radius = bounds.Radius;
+
+    const float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - XMLoadFloat3(&primaryView.cameraPosition)));
+    if (distance <= radius)
+        return SHADOW_TILE_SPOT_MAX_RESOLUTION;
+
+    // _22 of a perspective projection is 1 / tan(fovY / 2)
+    const float coverage = radius * primaryView.projectionMatrix._22 / distance;
+    const float quality = std::clamp(Debug::GetIntegerSetting("shadows.spotTexelsPerPixelPercent", 100), 10, 400) / 100.0f;
+
+    const int size = static_cast<int>(coverage * renderHeight * quality);
+    return std::clamp(this->spotAtlas.RoundTileSize(size), SHADOW_TILE_SPOT_MIN_RESOLUTION, SHADOW_TILE_SPOT_MAX_RESOLUTION);
+}
+
+void ShadowSystem::BindDepthOnlyCasterState(StateCache &stateCache) {
+    stateCache.SetRasterizerState(this->shadowRS);
+    stateCache.SetDepthStencilState(nullptr);
+
+    stateCache.SetInputLayout(this->shadowDepthLayout);
+    stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    stateCache.SetVertexShader(this->shadowDepthVS);
+    stateCache.SetPixelShader(nullptr);
+
+    stateCache.SetConstantBuffers(Shader_stage::vertex, 0, 1, &this->shadowBuffer);
+}
+
+void ShadowSystem::BindCasterState(StateCache &stateCache, const SharedResources &sharedResources) {
+    stateCache.SetRasterizerState(this->shadowRS);
+    stateCache.SetDepthStencilState(nullptr);
+
+    stateCache.SetInputLayout(this->shadowLayout);
+    stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    stateCache.SetVertexShader(this->shadowVS);
+
+    const MaterialTable *materialTable = sharedResources.materialTable;
+    if (materialTable) {
+        stateCache.SetPixelShader(this->shadowMaterialTablePS);
+        materialTable->Bind(stateCache);
+    }
+    else {
+        stateCache.SetPixelShader(this->shadowPS);
+    }
+
+    stateCache.SetConstantBuffers(Shader_stage::vertex, 0, 1, &this->shadowBuffer);
+}
+
+void ShadowSystem::DrawCasters(
+    ID3D11DeviceContext *deviceContext,
+    StateCache &stateCache,
+    const SharedResources &sharedResources,
+    const Render_view &view,
+    Caster_filter filter
+) {
+    XMMATRIX viewMatrix = XMLoadFloat4x4(&view.viewMatrix);
+    XMMATRIX projectionMatrix = XMLoadFloat4x4(&view.projectionMatrix);
+    XMFLOAT4X4 viewProjectionMatrix;
+    XMStoreFloat4x4(&viewProjectionMatrix, XMMatrixTranspose(XMMatrixMultiply(viewMatrix, projectionMatrix)));
+    UploadConstantBuffer(deviceContext, this->shadowBuffer, viewProjectionMatrix);
+
+    const MaterialTable *materialTable = sharedResources.materialTable;
+    ConstantBufferRing &ring = *sharedResources.constantBufferRing;
+
+    auto isFiltered = [filter](const Geometry_command &command) {
+        return (filter == Caster_filter::staticOnly && !command.isStatic) || (filter == Caster_filter::dynamicOnly && command.isStatic);
+    };
+
+    auto isAlphaTested = [](const Geometry_command &command) {
+        Material *material = command.material.Get();
+        return material && material->isAlphaTested;
+    };
+
+    // Opaque casters first, without a pixel shader. The order within each group is kept.
+    if (this->useDepthOnlyCasters) {
+        this->BindDepthOnlyCasterState(stateCache);
+
+        for (const Geometry_command &command : view.queue.geometryCommands) {
+            if (isFiltered(command) || isAlphaTested(command))
+                continue;
+
+            ring.Bind(stateCache, Shader_stage::vertex, 1, command.objectConstants, sharedResources.perObjectBuffer);
+
+            if (command.positionBuffer)
+                stateCache.SetVertexBuffer(command.positionBuffer, sizeof(XMFLOAT3));
+            else
+                stateCache.SetVertexBuffer(command.vertexBuffer, sizeof(Vertex)); // Position comes first
+
+            stateCache.SetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT);
+
+            deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
+            ++this->casterDrawCount;
+        }
+
+        this->BindCasterState(stateCache, sharedResources);
+    }
+
+    for (const Geometry_command &command : view.queue.geometryCommands) {
+        if (isFiltered(command) || (this->useDepthOnlyCasters && !isAlphaTested(command)))
+            continue;
+
+        ring.Bind(stateCache, Shader_stage::vertex, 1, command.objectConstants, sharedResources.perObjectBuffer);
+
+        Material *material = command.material.Get();
+        if (material) {
+            // Required for alpha testing
+            if (materialTable)
+                ring.Bind(stateCache, Shader_stage::pixel, 2, command.materialConstants, sharedResources.perMaterialBuffer);
+            else
+                stateCache.SetShaderResources(Shader_stage::pixel, 0, 1, &material->diffuseTexture.Get()->shaderResourceView);
+        }
+
+        stateCache.SetVertexBuffer(command.vertexBuffer, sizeof(Vertex));
+        stateCache.SetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT);
+
+        deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
+        ++this->casterDrawCount;
+        ++this->pixelShaderCasterDrawCount;
+    }
+}
+
 void ShadowSystem::ExecuteShadowPass(
     FrameGraph::ExecutionContext &context,
     const SharedResources &sharedResources,
@@ -81,101 +446,114 @@ void ShadowSystem::ExecuteShadowPass(
     FrameGraph::TextureHandle spotHandle
 ) {
     ID3D11DeviceContext *deviceContext = context.GetDeviceContext();
+    StateCache &stateCache = context.GetStateCache();
 
-    deviceContext->RSSetState(this->shadowRS);
-
-    deviceContext->IASetInputLayout(this->shadowLayout);
-    deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    this->useDepthOnlyCasters = Debug::GetSetting("shadows.depthOnlyCasters", true);
+    this->casterDrawCount = 0;
+    this->pixelShaderCasterDrawCount = 0;
 
-    deviceContext->VSSetShader(this->shadowVS, nullptr, 0);
-    deviceContext->PSSetShader(this->shadowPS, nullptr, 0);
-
-    deviceContext->VSSetConstantBuffers(0, 1, &this->shadowBuffer);
-    deviceContext->VSSetConstantBuffers(1, 1, &sharedResources.perObjectBuffer);
+    this->BindCasterState(stateCache, sharedResources);
 
     {
         D3D11_VIEWPORT viewport{};
         viewport.Width = viewport.Height = SHADOW_MAP_DIRECTIONAL_RESOLUTION;
         viewport.MaxDepth = 1.0f;
-        deviceContext->RSSetViewports(1, &viewport);
+        stateCache.SetViewport(viewport);
 
-        for (int i = 0; i < this->perFrameShadowData.directionalCount; ++i) {
+        // A slice per cascade of each light, unused cascades have no view
+        for (int i = 0; i < MAX_DIRECTIONAL_SHADOW_SLICES; ++i) {
             Render_view *view = context.GetView(View_type::shadowMapDirectional, i);
             if (!view)
-                break;
+                continue;
 
             deviceContext->ClearDepthStencilView(this->shadowMapDirectionalDSVs[i], D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-            deviceContext->OMSetRenderTargets(0, nullptr, this->shadowMapDirectionalDSVs[i]);
+            stateCache.SetRenderTargets(0, nullptr, this->shadowMapDirectionalDSVs[i]);
 
-            XMMATRIX viewMatrix = XMLoadFloat4x4(&view->viewMatrix);
-            XMMATRIX projectionMatrix = XMLoadFloat4x4(&view->projectionMatrix);
-            XMFLOAT4X4 viewProjectionMatrix;
-            XMStoreFloat4x4(&viewProjectionMatrix, XMMatrixTranspose(XMMatrixMultiply(viewMatrix, projectionMatrix)));
-            UploadConstantBuffer(deviceContext, this->shadowBuffer, viewProjectionMatrix);
+            this->DrawCasters(deviceContext, stateCache, sharedResources, *view, Caster_filter::all);
+        }
+    }
 
-            for (const Geometry_command &command : view->queue.geometryCommands) {
-                Per_object_data perObjectData{};
-                perObjectData.worldMatrix = command.worldMatrix;
-                UploadConstantBuffer(deviceContext, sharedResources.perObjectBuffer, perObjectData);
+    {
+        const int spotCount = this->perFrameShadowData.spotCount;
+        const bool *needsRedraw = this->perFrameShadowData.spotNeedsRedraw;
 
-                Material *material = command.material.Get();
-                if (material) {
-                    deviceContext->PSSetShaderResources(0, 1, &material->diffuseTexture.Get()->shaderResourceView); // Required for alpha testing
-                }
+        // Static casters go into the cache, only for the lights where something about them changed
+        stateCache.UnbindShaderResources(this->shadowCacheSpotTexture);
+        stateCache.SetRenderTargets(0, nullptr, this->shadowCacheSpotDSV);
+
+        for (int i = 0; i < spotCount; ++i) {
+            Render_view *view = context.GetView(View_type::shadowMapSpot, i);
+            if (!view || !needsRedraw[i])
+                continue;
 
-                const UINT stride = sizeof(Vertex);
-                const UINT offset = 0;
-                deviceContext->IASetVertexBuffers(0, 1, &command.vertexBuffer, &stride, &offset);
-                deviceContext->IASetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+            // A viewport with its depth range at 1 clears just the tile
+            this->DrawTileTriangle(deviceContext, stateCache, this->perFrameShadowData.spotTiles[i], 1.0f, nullptr);
 
-                deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
-            }
+            this->BindCasterState(stateCache, sharedResources);
+            this->SetTileViewport(stateCache, this->perFrameShadowData.spotTiles[i]);
+            this->DrawCasters(deviceContext, stateCache, sharedResources, *view, Caster_filter::staticOnly);
         }
-    }
 
-    {
-        D3D11_VIEWPORT viewport{};
-        viewport.Width = viewport.Height = SHADOW_MAP_SPOT_RESOLUTION;
-        viewport.MaxDepth = 1.0f;
-        deviceContext->RSSetViewports(1, &viewport);
+        // Every tile starts as a copy of its cache, which also stands in for clearing the atlas
+        stateCache.SetRenderTargets(0, nullptr, this->shadowMapSpotDSV);
+        stateCache.SetShaderResources(Shader_stage::pixel, 0, 1, &this->shadowCacheSpotSRV);
+
+        for (int i = 0; i < spotCount; ++i) {
+            if (!context.GetView(View_type::shadowMapSpot, i))
+                break;
+
+            this->DrawTileTriangle(deviceContext, stateCache, this->perFrameShadowData.spotTiles[i], 0.0f, this->shadowCopyPS);
+        }
+
+        this->BindCasterState(stateCache, sharedResources);
 
-        for (int i = 0; i < this->perFrameShadowData.spotCount; ++i) {
+        for (int i = 0; i < spotCount; ++i) {
             Render_view *view = context.GetView(View_type::shadowMapSpot, i);
             if (!view)
                 break;
 
-            deviceContext->ClearDepthStencilView(this->shadowMapSpotDSVs[i], D3D11_CLEAR_DEPTH, 1.0f, 0);
+            this->SetTileViewport(stateCache, this->perFrameShadowData.spotTiles[i]);
+            this->DrawCasters(deviceContext, stateCache, sharedResources, *view, Caster_filter::dynamicOnly);
+        }
+    }
 
-            deviceContext->OMSetRenderTargets(0, nullptr, this->shadowMapSpotDSVs[i]);
+    stateCache.SetRasterizerState(nullptr);
 
-            XMMATRIX viewMatrix = XMLoadFloat4x4(&view->viewMatrix);
-            XMMATRIX projectionMatrix = XMLoadFloat4x4(&view->projectionMatrix);
-            XMFLOAT4X4 viewProjectionMatrix;
-            XMStoreFloat4x4(&viewProjectionMatrix, XMMatrixTranspose(XMMatrixMultiply(viewMatrix, projectionMatrix)));
-            UploadConstantBuffer(deviceContext, this->shadowBuffer, viewProjectionMatrix);
+    // Without the depth-only path both are the same
+    Debug::SetStat("shadows.casterDraws", this->casterDrawCount);
+    Debug::SetStat("shadows.pixelShaderCasterDraws", this->pixelShaderCasterDrawCount);
+}
 
-            for (const Geometry_command &command : view->queue.geometryCommands) {
-                Per_object_data perObjectData{};
-                perObjectData.worldMatrix = command.worldMatrix;
-                UploadConstantBuffer(deviceContext, sharedResources.perObjectBuffer, perObjectData);
+void ShadowSystem::SetTileViewport(StateCache &stateCache, const ShadowAtlas::Tile &tile, float minDepth) {
+    D3D11_VIEWPORT viewport{};
+    viewport.TopLeftX = static_cast<FLOAT>(tile.x);
+    viewport.TopLeftY = static_cast<FLOAT>(tile.y);
+    viewport.Width = viewport.Height = static_cast<FLOAT>(tile.size);
+    viewport.MinDepth = minDepth;
+    viewport.MaxDepth = 1.0f;
+    stateCache.SetViewport(viewport);
+}
 
-                Material *material = command.material.Get();
-                if (material)
-                    deviceContext->PSSetShaderResources(0, 1, &material->diffuseTexture.Get()->shaderResourceView); // Required for alpha testing
+void ShadowSystem::DrawTileTriangle(
+    ID3D11DeviceContext *deviceContext,
+    StateCache &stateCache,
+    const ShadowAtlas::Tile &tile,
+    float minDepth,
+    ID3D11PixelShader *pixelShader
+) {
+    stateCache.SetRasterizerState(nullptr);
+    stateCache.SetDepthStencilState(this->depthAlwaysDSS);
 
-                const UINT stride = sizeof(Vertex);
-                const UINT offset = 0;
-                deviceContext->IASetVertexBuffers(0, 1, &command.vertexBuffer, &stride, &offset);
-                deviceContext->IASetIndexBuffer(command.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+    stateCache.SetInputLayout(nullptr);
+    stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-                deviceContext->DrawIndexed(command.indexCount, command.startIndex, command.baseVertex);
-            }
-        }
-    }
+    stateCache.SetVertexShader(this->fullscreenVS);
+    stateCache.SetPixelShader(pixelShader);
 
-    deviceContext->RSSetState(nullptr);
-    deviceContext->OMSetRenderTargets(0, nullptr, nullptr);
+    this->SetTileViewport(stateCache, tile, minDepth);
+
+    deviceContext->Draw(3, 0);
 }
 
 bool ShadowSystem::CreateConstantBuffers(ID3D11Device *device) {
@@ -217,6 +595,25 @@ bool ShadowSystem::LoadShaders(ID3D11Device *device, const std::string &shaderDi
         return false;
     }
 
+    if (!LoadShaderBytecode(shaderDir + "vs_shadow_depth.cso", bytecode))
+        return false;
+
+    result = device->CreateVertexShader(bytecode.data(), bytecode.size(), nullptr, &this->shadowDepthVS);
+    if (FAILED(result)) {
+        LogError("Failed to create vertex shader");
+        return false;
+    }
+
+    D3D11_INPUT_ELEMENT_DESC depthLayoutDesc[] = {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+    };
+
+    result = device->CreateInputLayout(depthLayoutDesc, 1, bytecode.data(), bytecode.size(), &this->shadowDepthLayout);
+    if (FAILED(result)) {
+        LogError("Failed to create input layout");
+        return false;
+    }
+
     if (!LoadShaderBytecode(shaderDir + "ps_shadow.cso", bytecode))
         return false;
 
@@ -226,6 +623,33 @@ bool ShadowSystem::LoadShaders(ID3D11Device *device, const std::string &shaderDi
         return false;
     }
 
+    if (!LoadShaderBytecode(shaderDir + "ps_shadow_material_table.cso", bytecode))
+        return false;
+
+    result = device->CreatePixelShader(bytecode.data(), bytecode.size(), nullptr, &this->shadowMaterialTablePS);
+    if (FAILED(result)) {
+        LogError("Failed to create pixel shader");
+        return false;
+    }
+
+    if (!LoadShaderBytecode(shaderDir + "vs_resolve.cso", bytecode))
+        return false;
+
+    result = device->CreateVertexShader(bytecode.data(), bytecode.size(), nullptr, &this->fullscreenVS);
+    if (FAILED(result)) {
+        LogError("Failed to create vertex shader");
+        return false;
+    }
+
+    if (!LoadShaderBytecode(shaderDir + "ps_shadow_copy.cso", bytecode))
+        return false;
+
+    result = device->CreatePixelShader(bytecode.data(), bytecode.size(), nullptr, &this->shadowCopyPS);
+    if (FAILED(result)) {
+        LogError("Failed to create pixel shader");
+        return false;
+    }
+
     return true;
 }
 
@@ -247,13 +671,28 @@ bool ShadowSystem::CreateRasterizerState(ID3D11Device *device) {
     return true;
 }
 
+bool ShadowSystem::CreateDepthStencilState(ID3D11Device *device) {
+    D3D11_DEPTH_STENCIL_DESC desc{};
+    desc.DepthEnable = TRUE;
+    desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+    desc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+
+    HRESULT result = device->CreateDepthStencilState(&desc, &this->depthAlwaysDSS);
+    if (FAILED(result)) {
+        LogError("Failed to create depth stencil state");
+        return false;
+    }
+
+    return true;
+}
+
 bool ShadowSystem::Initialize(ID3D11Device *device, const std::string &shaderDir) {
     LogInfo("Creating shadow system...\n");
 
     if (!CreateDepthStencilArray(
         device,
         SHADOW_MAP_DIRECTIONAL_RESOLUTION,
-        MAX_DIRECTIONAL_SHADOW_MAPS,
+        MAX_DIRECTIONAL_SHADOW_SLICES,
         &this->shadowMapDirectionalTexture,
         this->shadowMapDirectionalDSVs,
         &this->shadowMapDirectionalSRV,
@@ -268,30 +707,46 @@ bool ShadowSystem::Initialize(ID3D11Device *device, const std::string &shaderDir
         MAX_DIRECTIONAL_LIGHTS,
         &this->directionalLightBuffer,
         &this->directionalLightBufferSRV,
-        "directional"
+        "directional",
+        D3D11_USAGE_DEFAULT
     )) {
         return false;
     }
 
-    if (!CreateDepthStencilArray(
+    this->spotAtlas.Initialize(SHADOW_ATLAS_SPOT_ROOT_SIZE, SHADOW_ATLAS_SPOT_ROOT_COUNT, SHADOW_TILE_SPOT_MIN_RESOLUTION);
+
+    if (!CreateDepthStencilTexture(
         device,
-        SHADOW_MAP_SPOT_RESOLUTION,
-        MAX_SPOT_SHADOW_MAPS,
+        this->spotAtlas.GetWidth(),
+        this->spotAtlas.GetHeight(),
         &this->shadowMapSpotTexture,
-        this->shadowMapSpotDSVs,
+        &this->shadowMapSpotDSV,
         &this->shadowMapSpotSRV,
         "spot"
     )) {
         return false;
     }
 
+    if (!CreateDepthStencilTexture(
+        device,
+        this->spotAtlas.GetWidth(),
+        this->spotAtlas.GetHeight(),
+        &this->shadowCacheSpotTexture,
+        &this->shadowCacheSpotDSV,
+        &this->shadowCacheSpotSRV,
+        "spot cache"
+    )) {
+        return false;
+    }
+
     if (!CreateStructuredBuffer(
         device,
         sizeof(Spot_light_data),
         MAX_SPOT_LIGHTS,
         &this->spotLightBuffer,
         &this->spotLightBufferSRV,
-        "spot"
+        "spot",
+        D3D11_USAGE_DEFAULT
     )) {
         return false;
     }
@@ -305,14 +760,23 @@ bool ShadowSystem::Initialize(ID3D11Device *device, const std::string &shaderDir
     if (!this->CreateRasterizerState(device))
         return false;
 
+    if (!this->CreateDepthStencilState(device))
+        return false;
+
     return true;
 }
 
 void ShadowSystem::Shutdown() {
     SafeRelease(this->shadowVS);
     SafeRelease(this->shadowPS);
+    SafeRelease(this->shadowMaterialTablePS);
     SafeRelease(this->shadowLayout);
+    SafeRelease(this->shadowDepthVS);
+    SafeRelease(this->shadowDepthLayout);
     SafeRelease(this->shadowRS);
+    SafeRelease(this->fullscreenVS);
+    SafeRelease(this->shadowCopyPS);
+    SafeRelease(this->depthAlwaysDSS);
     SafeRelease(this->shadowBuffer);
 
     SafeRelease(this->directionalLightBufferSRV);
@@ -321,17 +785,24 @@ void ShadowSystem::Shutdown() {
     SafeRelease(this->spotLightBuffer);
 
     SafeRelease(this->shadowMapDirectionalSRV);
-    for (int i = 0; i < MAX_DIRECTIONAL_SHADOW_MAPS; ++i)
+    for (int i = 0; i < MAX_DIRECTIONAL_SHADOW_SLICES; ++i)
         SafeRelease(this->shadowMapDirectionalDSVs[i]);
     SafeRelease(this->shadowMapDirectionalTexture);
 
     SafeRelease(this->shadowMapSpotSRV);
-    for (int i = 0; i < MAX_SPOT_SHADOW_MAPS; ++i)
-        SafeRelease(this->shadowMapSpotDSVs[i]);
+    SafeRelease(this->shadowMapSpotDSV);
     SafeRelease(this->shadowMapSpotTexture);
+
+    SafeRelease(this->shadowCacheSpotSRV);
+    SafeRelease(this->shadowCacheSpotDSV);
+    SafeRelease(this->shadowCacheSpotTexture);
+    this->spotCache.Clear();
 }
 
-void ShadowSystem::PrepareViews(Scene *scene, const Render_view &primaryView, std::vector<Render_view> &outViews) {
+void ShadowSystem::PrepareViews(Scene *scene, const Render_view &primaryView, int renderHeight, std::vector<Render_view> &outViews) {
+    // Indices into this frame's commands, UploadLightData mustn't see last frame's
+    this->spotSelection = {};
+
     if (!scene) {
         LogWarn("Scene was nullptr\n");
         return;
@@ -342,6 +813,16 @@ void ShadowSystem::PrepareViews(Scene *scene, const Render_view &primaryView, st
 
     std::vector<Render_view> views;
 
+    const int cascadeCount = std::clamp(Debug::GetIntegerSetting("shadows.cascadeCount", MAX_SHADOW_CASCADES), MIN_SHADOW_CASCADES, MAX_SHADOW_CASCADES);
+    const float splitLambda = std::clamp(Debug::GetIntegerSetting("shadows.cascadeSplitPercent", 75), 0, 100) / 100.0f;
+    const float shadowDistance = std::min(primaryView.shadowDistance, primaryView.farPlane);
+
+    this->perFrameShadowData.cascadeCount = cascadeCount;
+    ComputeCascadeSplits(primaryView.nearPlane, shadowDistance, cascadeCount, splitLambda, this->perFrameShadowData.cascadeSplits);
+
+    XMFLOAT3 frustumCorners[8];
+    primaryView.frustum.GetCorners(frustumCorners);
+
     for (int i = 0; i < primaryView.queue.directionalLightCommands.size(); ++i) {
         if (this->perFrameShadowData.directionalCount >= MAX_DIRECTIONAL_SHADOW_MAPS)
             break;
@@ -351,36 +832,83 @@ void ShadowSystem::PrepareViews(Scene *scene, const Render_view &primaryView, st
             continue;
 
         int slot = this->perFrameShadowData.directionalCount;
-        XMMATRIX viewMatrix;
-        XMMATRIX projectionMatrix;
-        this->ComputeDirectionalLightMatrices(viewMatrix, projectionMatrix, command, primaryView);
 
-        Render_view view{};
-        view.type = View_type::shadowMapDirectional;
-        view.index = slot;
-        view.skipFrustumCulling = true;
-        XMStoreFloat4x4(&view.viewMatrix, viewMatrix);
-        XMStoreFloat4x4(&view.projectionMatrix, projectionMatrix);
-        views.push_back(view);
+        for (int cascade = 0; cascade < cascadeCount; ++cascade) {
+            const int slice = slot * MAX_SHADOW_CASCADES + cascade;
+            const float splitNear = cascade > 0 ? this->perFrameShadowData.cascadeSplits[cascade - 1] : primaryView.nearPlane;
+
+            Cascade_fit fit = FitCascade(
+                frustumCorners,
+                primaryView.nearPlane,
+                primaryView.farPlane,
+                splitNear,
+                this->perFrameShadowData.cascadeSplits[cascade],
+                command.direction,
+                SHADOW_MAP_DIRECTIONAL_RESOLUTION
+            );
+
+            Render_view view{};
+            view.type = View_type::shadowMapDirectional;
+            view.index = slice;
+            view.viewMatrix = fit.viewMatrix;
+            view.projectionMatrix = fit.projectionMatrix;
+            view.orientedBox = fit.casterBox;
+            view.useOrientedBox = true;
+            views.push_back(view);
+
+            XMMATRIX viewProjectionMatrix = XMMatrixTranspose(XMMatrixMultiply(
+                XMLoadFloat4x4(&fit.viewMatrix), 
+                XMLoadFloat4x4(&fit.projectionMatrix)
+            ));
+            XMStoreFloat4x4(
+                &this->perFrameShadowData.directionalViewProjectionMatrices[slice], 
+                viewProjectionMatrix
+            );
+            this->perFrameShadowData.directionalTexelSizes[slice] = fit.worldUnitsPerTexel;
+        }
 
-        XMMATRIX viewProjectionMatrix = XMMatrixTranspose(XMMatrixMultiply(viewMatrix, projectionMatrix));
-        XMStoreFloat4x4(
-            &this->perFrameShadowData.directionalViewProjectionMatrices[slot], 
-            viewProjectionMatrix
-        );
         this->perFrameShadowData.directionalSlotToCommand[slot] = i;
         ++this->perFrameShadowData.directionalCount;
     }
 
-    for (int i = 0; i < primaryView.queue.spotLightCommands.size(); ++i) {
-        if (this->perFrameShadowData.spotCount >= MAX_SPOT_SHADOW_MAPS)
-            break;
+    // Which spot lights get uploaded and which of them get shadows, most important first
+    std::vector<LightSelector::Candidate> spotCandidates;
+    for (const Spot_light_command &command : primaryView.queue.spotLightCommands) {
+        LightSelector::Candidate candidate;
+        candidate.id = command.id;
+        candidate.bounds = LightSelector::ComputeConeBounds(command);
+        candidate.intensity = command.intensity;
+        candidate.castsShadows = command.castsShadows;
+        spotCandidates.push_back(candidate);
+    }
+
+    LightSelector::Camera camera;
+    camera.position = primaryView.cameraPosition;
+    camera.projectionScale = primaryView.projectionMatrix._22;
+    camera.frustum = primaryView.frustum;
+
+    this->spotSelector.Select(spotCandidates, camera, MAX_SPOT_LIGHTS, MAX_SPOT_SHADOW_MAPS, this->spotSelection);
+
+    Debug::SetStat("shadows.spotLightsCulled", this->spotSelection.culledCount);
+    Debug::SetStat("shadows.spotLightsDropped", this->spotSelection.droppedCount);
 
+    std::vector<ShadowAtlas::Request> spotRequests;
+    for (int i : this->spotSelection.shadowed) {
         const Spot_light_command &command = primaryView.queue.spotLightCommands[i];
-        if (!command.castsShadows)
+        spotRequests.push_back({ command.id, this->ComputeSpotTileSize(command, primaryView, renderHeight) });
+    }
+
+    this->spotAtlas.Update(spotRequests);
+
+    for (int i : this->spotSelection.shadowed) {
+        const Spot_light_command &command = primaryView.queue.spotLightCommands[i];
+
+        const ShadowAtlas::Tile *tile = this->spotAtlas.GetTile(command.id);
+        if (!tile)
             continue;
 
         int slot = this->perFrameShadowData.spotCount;
+        this->perFrameShadowData.spotTiles[slot] = *tile;
         XMMATRIX viewMatrix;
         XMMATRIX projectionMatrix;
         this->ComputeSpotLightMatrices(viewMatrix, projectionMatrix, command);
@@ -405,7 +933,40 @@ void ShadowSystem::PrepareViews(Scene *scene, const Render_view &primaryView, st
         ++this->perFrameShadowData.spotCount;
     }
 
+    const ShadowAtlas::Stats atlasStats = this->spotAtlas.GetStats();
+    Debug::SetStat("shadows.spotTiles", atlasStats.usedTileCount);
+    Debug::SetStat("shadows.spotTilesMoved", atlasStats.movedCount);
+    Debug::SetStat("shadows.spotTilesLowered", atlasStats.loweredCount);
+    Debug::SetStat("shadows.spotTilesDropped", atlasStats.droppedCount);
+    Debug::SetStat("shadows.atlasUsage", static_cast<float>(atlasStats.usedTexels) / (this->spotAtlas.GetWidth() * this->spotAtlas.GetHeight()));
+    Debug::SetStat("shadows.atlasFragmentation", atlasStats.fragmentation);
+
     scene->GatherVisibility(views);
+
+    const bool isCacheEnabled = Debug::GetSetting("shadows.cacheStaticCasters", true);
+
+    this->spotCache.BeginFrame();
+    for (const Render_view &view : views) {
+        if (view.type != View_type::shadowMapSpot)
+            continue;
+
+        const int slot = view.index;
+        const uint64_t id = primaryView.queue.spotLightCommands[this->perFrameShadowData.spotSlotToCommand[slot]].id;
+        const uint64_t signature = ShadowCache::ComputeSignature(
+            this->perFrameShadowData.spotTiles[slot],
+            view.viewMatrix,
+            view.projectionMatrix,
+            view.queue.geometryCommands
+        );
+
+        const bool needsRedraw = this->spotCache.NeedsRedraw(id, signature);
+        this->perFrameShadowData.spotNeedsRedraw[slot] = needsRedraw || !isCacheEnabled;
+    }
+    this->spotCache.EndFrame();
+
+    Debug::SetStat("shadows.cacheRedrawn", isCacheEnabled ? this->spotCache.GetRedrawnCount() : this->perFrameShadowData.spotCount);
+    Debug::SetStat("shadows.cacheReused", isCacheEnabled ? this->spotCache.GetReusedCount() : 0);
+
     outViews.insert(outViews.end(), views.begin(), views.end());
 }
 
@@ -425,11 +986,20 @@ Shadow_handles ShadowSystem::RegisterRenderPasses(FrameGraph &frameGraph, const
         this->shadowMapSpotTexture,
         nullptr,
         this->shadowMapSpotSRV,
-        this->shadowMapSpotDSVs[0]
+        this->shadowMapSpotDSV
     );
 
-    handles.directionalLightBufferSRV = this->directionalLightBufferSRV;
-    handles.spotLightBufferSRV = this->spotLightBufferSRV;
+    handles.directionalLightBuffer = frameGraph.ImportBuffer(
+        "DirectionalLightBuffer",
+        this->directionalLightBuffer,
+        this->directionalLightBufferSRV
+    );
+
+    handles.spotLightBuffer = frameGraph.ImportBuffer(
+        "SpotLightBuffer",
+        this->spotLightBuffer,
+        this->spotLightBufferSRV
+    );
 
     struct Shadow_pass_data {
         FrameGraph::TextureHandle shadowMapDirectional;
@@ -454,13 +1024,20 @@ void ShadowSystem::UploadLightData(
     ID3D11DeviceContext *deviceContext,
     const Render_view &primaryView,
     const SharedResources &sharedResources,
-    int reflectionProbeCount
+    int reflectionProbeCount,
+    const LightClusterBuilder::Grid &clusterGrid,
+    int renderWidth,
+    int renderHeight
 ) {
     Lighting_data lightingData{};
     lightingData.directionalLightCount = primaryView.queue.directionalLightCommands.size();
-    lightingData.spotLightCount = primaryView.queue.spotLightCommands.size();
+    lightingData.spotLightCount = static_cast<int>(this->spotSelection.lights.size());
     lightingData.reflectionProbeCount = reflectionProbeCount;
     lightingData.hasSkybox = primaryView.queue.skyboxCommand.has_value() ? 1 : 0;
+    lightingData.renderWidth = renderWidth;
+    lightingData.renderHeight = renderHeight;
+    lightingData.clusterDepthScale = clusterGrid.depthScale;
+    lightingData.clusterDepthBias = clusterGrid.depthBias;
 
     for (const auto &dlc : primaryView.queue.directionalLightCommands) {
         lightingData.ambientColour.x += dlc.ambientColour.x;
@@ -469,6 +1046,10 @@ void ShadowSystem::UploadLightData(
     }
 
     UploadConstantBuffer(deviceContext, sharedResources.lightingBuffer, lightingData);
+}
+
+void ShadowSystem::UploadLights(ID3D11DeviceContext *deviceContext, const Render_view &primaryView) {
+    this->lightStore.BeginFrame();
 
     // Directional
 
@@ -479,69 +1060,94 @@ void ShadowSystem::UploadLightData(
 
     int directionalCount = std::min((size_t)MAX_DIRECTIONAL_LIGHTS, primaryView.queue.directionalLightCommands.size());
 
-    Directional_light_data directionalData[MAX_DIRECTIONAL_LIGHTS];
+    // Few enough to pack every frame, the store still only uploads the ones that changed
     for (int i = 0; i < directionalCount; ++i) {
         const Directional_light_command &dlc = primaryView.queue.directionalLightCommands[i];
-        Directional_light_data &entry = directionalData[i];
+        Directional_light_data entry{};
 
         entry.direction        = dlc.direction;
         entry.intensity        = dlc.intensity;
         entry.colour           = dlc.colour;
         entry.castsShadows     = dlc.castsShadows ? 1 : 0;
-        entry.shadowSliceIndex = directionalCommandToSlot[i];
+        entry.shadowSliceIndex = -1;
+        entry.cascadeCount     = 0;
 
-        if (entry.shadowSliceIndex >= 0)
-            entry.viewProjectionMatrix = this->perFrameShadowData.directionalViewProjectionMatrices[entry.shadowSliceIndex];
-        else
-            XMStoreFloat4x4(&entry.viewProjectionMatrix, XMMatrixIdentity());
-    }
+        const int slot = directionalCommandToSlot[i];
+        if (slot < 0) {
+            this->lightStore.AddDirectionalLight(entry);
+            continue;
+        }
 
-    D3D11_MAPPED_SUBRESOURCE mapped;
-    HRESULT result = deviceContext->Map(this->directionalLightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    if (FAILED(result)) {
-        LogWarn("Failed to map directional light buffer\n");
-        return;
-    }
+        entry.shadowSliceIndex = slot * MAX_SHADOW_CASCADES;
+        entry.cascadeCount     = this->perFrameShadowData.cascadeCount;
+
+        float *splits = &entry.cascadeSplits.x;
+        float *texelSizes = &entry.cascadeTexelSizes.x;
+
+        for (int cascade = 0; cascade < MAX_SHADOW_CASCADES; ++cascade) {
+            const int slice = entry.shadowSliceIndex + cascade;
+
+            if (cascade < entry.cascadeCount) {
+                splits[cascade] = this->perFrameShadowData.cascadeSplits[cascade];
+                texelSizes[cascade] = this->perFrameShadowData.directionalTexelSizes[slice];
+                entry.cascadeViewProjectionMatrices[cascade] = this->perFrameShadowData.directionalViewProjectionMatrices[slice];
+            }
+            else {
+                splits[cascade] = 0.0f;
+                texelSizes[cascade] = 0.0f;
+                XMStoreFloat4x4(&entry.cascadeViewProjectionMatrices[cascade], XMMatrixIdentity());
+            }
+        }
 
-    memcpy(mapped.pData, directionalData, sizeof(Directional_light_data) * directionalCount);
-    deviceContext->Unmap(this->directionalLightBuffer, 0);
+        this->lightStore.AddDirectionalLight(entry);
+    }
 
     // Spot
 
-    int spotCommandToSlot[MAX_SPOT_LIGHTS];
-    memset(spotCommandToSlot, -1, sizeof(spotCommandToSlot));
+    std::vector<int> spotCommandToSlot(primaryView.queue.spotLightCommands.size(), -1);
     for (int i = 0; i < this->perFrameShadowData.spotCount; ++i)
         spotCommandToSlot[this->perFrameShadowData.spotSlotToCommand[i]] = i;
 
-    int spotCount = std::min((size_t)MAX_SPOT_LIGHTS, primaryView.queue.spotLightCommands.size());
-
-    Spot_light_data spotData[MAX_SPOT_LIGHTS];
-    for (int i = 0; i < spotCount; ++i) {
-        const Spot_light_command &slc = primaryView.queue.spotLightCommands[i];
-        Spot_light_data &entry = spotData[i];
-
-        entry.position         = slc.position;
-        entry.intensity        = slc.intensity;
-        entry.direction        = slc.direction;
-        entry.range            = slc.range;
-        entry.colour           = slc.colour;
-        entry.cosInnerAngle    = cosf(slc.innerConeAngle);
-        entry.cosOuterAngle    = cosf(slc.outerConeAngle);
-        entry.castsShadows     = slc.castsShadows ? 1 : 0;
-        entry.shadowSliceIndex = spotCommandToSlot[i];
-
-        if (entry.shadowSliceIndex >= 0)
-            entry.viewProjectionMatrix = this->perFrameShadowData.spotViewProjectionMatrices[entry.shadowSliceIndex];
-        else
-            XMStoreFloat4x4(&entry.viewProjectionMatrix, XMMatrixIdentity());
-    }
+    const float atlasWidth = static_cast<float>(this->spotAtlas.GetWidth());
+    const float atlasHeight = static_cast<float>(this->spotAtlas.GetHeight());
 
-    result = deviceContext->Map(this->spotLightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    if (FAILED(result)) {
-        LogWarn("Failed to map spot light buffer\n");
-        return;
+    // Selected by PrepareViews, culled and in order of importance
+    for (int commandIndex : this->spotSelection.lights) {
+        LightStore::Spot_shadow shadow;
+
+        const int tileIndex = spotCommandToSlot[commandIndex];
+        if (tileIndex >= 0) {
+            const ShadowAtlas::Tile &tile = this->perFrameShadowData.spotTiles[tileIndex];
+
+            shadow.tileIndex = tileIndex;
+            shadow.texelSize = 1.0f / tile.size;
+            shadow.atlasRect = { tile.size / atlasWidth, tile.size / atlasHeight, tile.x / atlasWidth, tile.y / atlasHeight };
+            shadow.viewProjectionMatrix = this->perFrameShadowData.spotViewProjectionMatrices[tileIndex];
+        }
+
+        this->lightStore.AddSpotLight(primaryView.queue.spotLightCommands[commandIndex], shadow);
     }
 
-    memcpy(mapped.pData, spotData, sizeof(Spot_light_data) * spotCount);
-    deviceContext->Unmap(this->spotLightBuffer, 0);
+    this->lightStore.EndFrame();
+
+    // Only the ranges that differ from what the buffers hold
+    auto uploadRanges = [deviceContext](ID3D11Buffer *buffer, const std::vector<LightStore::Range> &ranges, const void *data, UINT elementSize) {
+        for (const LightStore::Range &range : ranges) {
+            D3D11_BOX box{};
+            box.left = range.first * elementSize;
+            box.right = (range.first + range.count) * elementSize;
+            box.bottom = 1;
+            box.back = 1;
+
+            deviceContext->UpdateSubresource(buffer, 0, &box, static_cast<const uint8_t *>(data) + box.left, 0, 0);
+        }
+    };
+
+    uploadRanges(this->directionalLightBuffer, this->lightStore.GetDirectionalRanges(), this->lightStore.GetDirectionalLights(), sizeof(Directional_light_data));
+    uploadRanges(this->spotLightBuffer, this->lightStore.GetSpotRanges(), this->lightStore.GetSpotLights(), sizeof(Spot_light_data));
+
+    const LightStore::Stats &stats = this->lightStore.GetStats();
+    Debug::SetStat("lighting.lightsPacked", stats.packedCount);
+    Debug::SetStat("lighting.lightUploads", stats.uploadCount);
+    Debug::SetStat("lighting.lightUploadBytes", stats.uploadedBytes);
 }
\ No newline at end of file
@@ -5,6 +5,11 @@
 #include "rendering/render_view.hpp"
 #include "rendering/frame_graph.hpp"
 #include "rendering/shared_resources.hpp"
+#include "rendering/shadow_atlas.hpp"
+#include "rendering/shadow_cache.hpp"
+#include "rendering/light_selector.hpp"
+#include "rendering/light_cluster_builder.hpp"
+#include "rendering/light_store.hpp"
 
 #include <d3d11.h>
 #include <DirectXMath.h>
@@ -18,8 +23,8 @@ struct Shadow_handles {
     FrameGraph::TextureHandle shadowMapDirectional = FrameGraph::INVALID_HANDLE;
     FrameGraph::TextureHandle shadowMapSpot = FrameGraph::INVALID_HANDLE;
 
-    ID3D11ShaderResourceView *directionalLightBufferSRV = nullptr;
-    ID3D11ShaderResourceView *spotLightBufferSRV = nullptr;
+    FrameGraph::BufferHandle directionalLightBuffer = FrameGraph::INVALID_HANDLE;
+    FrameGraph::BufferHandle spotLightBuffer = FrameGraph::INVALID_HANDLE;
 };
 
 class ShadowSystem {
@@ -28,58 +33,132 @@ class ShadowSystem {
 public:
     static constexpr int MAX_DIRECTIONAL_LIGHTS = 4;
     static constexpr int SHADOW_MAP_DIRECTIONAL_RESOLUTION = 2048;
-    static constexpr int MAX_DIRECTIONAL_SHADOW_MAPS = 2;
+    static constexpr int MAX_DIRECTIONAL_SHADOW_MAPS = 2; // Lights with shadows, each has a slice per cascade
+
+    static constexpr int MIN_SHADOW_CASCADES = 2;
+    static constexpr int MAX_SHADOW_CASCADES = 4;
+    static constexpr int MAX_DIRECTIONAL_SHADOW_SLICES = MAX_DIRECTIONAL_SHADOW_MAPS * MAX_SHADOW_CASCADES;
+
+    // Casters this far behind a cascade towards the light still cast into it
+    static constexpr float DIRECTIONAL_CASTER_DISTANCE = 500.0f;
 
-    static constexpr int MAX_SPOT_LIGHTS = 64;
-    static constexpr int SHADOW_MAP_SPOT_RESOLUTION = 1024;
-    static constexpr int MAX_SPOT_SHADOW_MAPS = 8;
+    static constexpr int MAX_SPOT_LIGHTS = 1024; // The lighting pass only loops over the lights of a pixel's cluster
+    static constexpr int MAX_SPOT_SHADOW_MAPS = 32;
+
+    // Spot shadows share an atlas of two 2048x2048 quadtrees, the memory of eight 1024x1024 maps. Each light gets
+    // a tile sized by how large it is on screen.
+    static constexpr int SHADOW_ATLAS_SPOT_ROOT_SIZE = 2048;
+    static constexpr int SHADOW_ATLAS_SPOT_ROOT_COUNT = 2;
+    static constexpr int SHADOW_TILE_SPOT_MIN_RESOLUTION = 128;
+    static constexpr int SHADOW_TILE_SPOT_MAX_RESOLUTION = 1024;
+
+    struct Cascade_fit {
+        XMFLOAT4X4 viewMatrix;
+        XMFLOAT4X4 projectionMatrix;
+        BoundingOrientedBox casterBox; // World space volume the projection covers
+        float worldUnitsPerTexel = 0.0f;
+    };
 
 private:
     ID3D11Texture2D *shadowMapDirectionalTexture = nullptr; // Texture2DArray
     ID3D11ShaderResourceView *shadowMapDirectionalSRV = nullptr;
-    ID3D11DepthStencilView *shadowMapDirectionalDSVs[MAX_DIRECTIONAL_SHADOW_MAPS] = {};
+    ID3D11DepthStencilView *shadowMapDirectionalDSVs[MAX_DIRECTIONAL_SHADOW_SLICES] = {};
 
-    ID3D11Texture2D *shadowMapSpotTexture = nullptr; // Texture2DArray
+    ID3D11Texture2D *shadowMapSpotTexture = nullptr; // Atlas
     ID3D11ShaderResourceView *shadowMapSpotSRV = nullptr;
-    ID3D11DepthStencilView *shadowMapSpotDSVs[MAX_SPOT_SHADOW_MAPS] = {};
+    ID3D11DepthStencilView *shadowMapSpotDSV = nullptr;
+
+    // Static casters only, laid out like the atlas
+    ID3D11Texture2D *shadowCacheSpotTexture = nullptr;
+    ID3D11ShaderResourceView *shadowCacheSpotSRV = nullptr;
+    ID3D11DepthStencilView *shadowCacheSpotDSV = nullptr;
+
+    ShadowAtlas spotAtlas;
+    ShadowCache spotCache;
+
+    LightSelector spotSelector;
+    LightSelector::Selection spotSelection; // Of this frame
 
     ID3D11VertexShader *shadowVS = nullptr;
     ID3D11PixelShader *shadowPS = nullptr;
+    ID3D11PixelShader *shadowMaterialTablePS = nullptr;
     ID3D11InputLayout *shadowLayout = nullptr;
+    ID3D11VertexShader *shadowDepthVS = nullptr; // Opaque casters, no pixel shader
+    ID3D11InputLayout *shadowDepthLayout = nullptr; // Positions only
     ID3D11RasterizerState *shadowRS = nullptr;
 
+    ID3D11VertexShader *fullscreenVS = nullptr;
+    ID3D11PixelShader *shadowCopyPS = nullptr;
+    ID3D11DepthStencilState *depthAlwaysDSS = nullptr;
+
     ID3D11Buffer *shadowBuffer = nullptr;
 
+    // Default usage, the light store uploads the ranges that changed
     ID3D11Buffer *directionalLightBuffer = nullptr;
     ID3D11ShaderResourceView *directionalLightBufferSRV = nullptr;
 
     ID3D11Buffer *spotLightBuffer = nullptr;
     ID3D11ShaderResourceView *spotLightBufferSRV = nullptr;
 
+    LightStore lightStore;
+
+    // Opaque casters only write depth, alpha-tested ones follow with the pixel shader
+    bool useDepthOnlyCasters = true;
+    int casterDrawCount = 0;
+    int pixelShaderCasterDrawCount = 0; // Of this frame, every caster drew with one before the depth-only path
+
     // TODO: There has to be some better way to do this
     struct Per_frame_shadow_data {
         int directionalCount = 0;
-        XMFLOAT4X4 directionalViewProjectionMatrices[MAX_DIRECTIONAL_SHADOW_MAPS] = {};
+        int cascadeCount = 0;
+        float cascadeSplits[MAX_SHADOW_CASCADES] = {};
+        XMFLOAT4X4 directionalViewProjectionMatrices[MAX_DIRECTIONAL_SHADOW_SLICES] = {};
+        float directionalTexelSizes[MAX_DIRECTIONAL_SHADOW_SLICES] = {};
         int directionalSlotToCommand[MAX_DIRECTIONAL_SHADOW_MAPS] = {};
 
         int spotCount = 0;
         XMFLOAT4X4 spotViewProjectionMatrices[MAX_SPOT_SHADOW_MAPS] = {};
+        ShadowAtlas::Tile spotTiles[MAX_SPOT_SHADOW_MAPS] = {};
+        bool spotNeedsRedraw[MAX_SPOT_SHADOW_MAPS] = {}; // Cached static casters are out of date
         int spotSlotToCommand[MAX_SPOT_SHADOW_MAPS] = {};
     } perFrameShadowData;
 
-    void ComputeDirectionalLightMatrices(
-        XMMATRIX &outView, 
-        XMMATRIX &outProjection, 
-        const Directional_light_command &command, 
-        const Render_view &primaryView
-    ) const;
-
     void ComputeSpotLightMatrices(
         XMMATRIX &outView, 
         XMMATRIX &outProjection, 
         const Spot_light_command &command
     ) const;
 
+    // Texels across the light's cone on screen, so the tile's texels roughly match the pixels it shadows
+    int ComputeSpotTileSize(const Spot_light_command &command, const Render_view &primaryView, int renderHeight) const;
+
+    enum class Caster_filter {
+        all,
+        staticOnly,
+        dynamicOnly
+    };
+
+    void BindCasterState(StateCache &stateCache, const SharedResources &sharedResources);
+    void BindDepthOnlyCasterState(StateCache &stateCache);
+    void DrawCasters(
+        ID3D11DeviceContext *deviceContext,
+        StateCache &stateCache,
+        const SharedResources &sharedResources,
+        const Render_view &view,
+        Caster_filter filter
+    );
+
+    void SetTileViewport(StateCache &stateCache, const ShadowAtlas::Tile &tile, float minDepth = 0.0f);
+
+    // Fullscreen triangle into a tile with depth testing off. Without a pixel shader it writes minDepth.
+    void DrawTileTriangle(
+        ID3D11DeviceContext *deviceContext,
+        StateCache &stateCache,
+        const ShadowAtlas::Tile &tile,
+        float minDepth,
+        ID3D11PixelShader *pixelShader
+    );
+
     void ExecuteShadowPass(
         FrameGraph::ExecutionContext &context,
         const SharedResources &sharedResources,
@@ -90,6 +169,7 @@ private:
     bool CreateConstantBuffers(ID3D11Device *device);
     bool LoadShaders(ID3D11Device *device, const std::string &shaderDir);
     bool CreateRasterizerState(ID3D11Device *device);
+    bool CreateDepthStencilState(ID3D11Device *device);
 
     ShadowSystem() = default;
 
@@ -97,18 +177,50 @@ private:
     void Shutdown();
 
 public:
-    void PrepareViews(Scene *scene, const Render_view &primaryView, std::vector<Render_view> &outViews);
+    // Practical split scheme, blends logarithmic (lambda 1) and uniform (lambda 0) splits between the distances.
+    // Writes the view depth each cascade ends at, the last one is farDistance.
+    static void ComputeCascadeSplits(float nearDistance, float farDistance, int cascadeCount, float lambda, float *outSplits);
+
+    // Fits an orthographic projection around the part of the view frustum between two view depths. The corners are
+    // in BoundingFrustum::GetCorners order. The size only depends on the slice's shape and the centre is snapped to
+    // whole texels, so moving or turning the camera doesn't make the shadow edges shimmer.
+    static Cascade_fit FitCascade(
+        const XMFLOAT3 frustumCorners[8],
+        float nearPlane,
+        float farPlane,
+        float splitNear,
+        float splitFar,
+        const XMFLOAT3 &lightDirection,
+        int resolution
+    );
+
+    // Checks the split and fit math against their guarantees and times the per-frame cascade setup
+    static void RunCascadeTest();
+    static constexpr int CASCADE_BENCHMARK_ITERATIONS = 10000;
+
+    void PrepareViews(Scene *scene, const Render_view &primaryView, int renderHeight, std::vector<Render_view> &outViews);
     Shadow_handles RegisterRenderPasses(FrameGraph &frameGraph, const SharedResources &sharedResources);
 
+    // Packs the lights the primary view selected into the light buffers, once a frame for every pass that reads
+    // them. Only lights that changed are packed and uploaded.
+    void UploadLights(ID3D11DeviceContext *deviceContext, const Render_view &primaryView);
+
+    // The lighting constants, which differ between the lighting pass and the reflection probes
     void UploadLightData(
         ID3D11DeviceContext *deviceContext, 
         const Render_view &primaryView, 
         const SharedResources &sharedResources, 
-        int reflectionProbeCount
+        int reflectionProbeCount,
+        const LightClusterBuilder::Grid &clusterGrid = {}, // Only the lighting pass reads these
+        int renderWidth = 0,
+        int renderHeight = 0
     );
 
     ID3D11ShaderResourceView *GetDirectionalLightBufferSRV() const { return this->directionalLightBufferSRV; }
     ID3D11ShaderResourceView *GetSpotLightBufferSRV() const { return this->spotLightBufferSRV; }
+
+    // Indices into the primary view's spot light commands, in the order they are uploaded
+    const std::vector<int> &GetSelectedSpotLights() const { return this->spotSelection.lights; }
 };
 
 #endif
\ No newline at end of file
@@ -106,10 +106,10 @@ void SharedResources::Shutdown() {
         SafeRelease(this->samplers[i]);
 }
 
-void SharedResources::BindSamplers(ID3D11DeviceContext *deviceContext) const {
-    deviceContext->PSSetSamplers(0, +Sampler_slot::count, this->samplers);
-    deviceContext->CSSetSamplers(0, +Sampler_slot::count, this->samplers);
-    deviceContext->DSSetSamplers(0, +Sampler_slot::count, this->samplers);
+void SharedResources::BindSamplers(StateCache &stateCache) const {
+    stateCache.SetSamplers(Shader_stage::pixel,   0, +Sampler_slot::count, this->samplers);
+    stateCache.SetSamplers(Shader_stage::compute, 0, +Sampler_slot::count, this->samplers);
+    stateCache.SetSamplers(Shader_stage::domain,  0, +Sampler_slot::count, this->samplers);
 }
 
 void SharedResources::UploadPerFrameData(ID3D11DeviceContext *deviceContext, const Render_view &view) const {
@@ -4,6 +4,9 @@
 #include "rendering/render_data.hpp"
 #include "rendering/render_utils.hpp"
 #include "rendering/render_view.hpp"
+#include "rendering/state_cache.hpp"
+#include "rendering/constant_buffer_ring.hpp"
+#include "rendering/material_table.hpp"
 
 #include <d3d11.h>
 
@@ -29,6 +32,10 @@ public:
 
     ID3D11SamplerState *samplers[+Sampler_slot::count] = {};
 
+    // Owned by the renderer
+    ConstantBufferRing *constantBufferRing = nullptr;
+    const MaterialTable *materialTable = nullptr; // Null when materials are bound per draw
+
 private:
     bool CreateConstantBuffers(ID3D11Device *device);
     bool CreateSamplers(ID3D11Device *device);
@@ -39,7 +46,7 @@ private:
     SharedResources() = default;
 
 public:
-    void BindSamplers(ID3D11DeviceContext *deviceContext) const;
+    void BindSamplers(StateCache &stateCache) const;
     void UploadPerFrameData(ID3D11DeviceContext *deviceContext, const Render_view &view) const;
 };
 
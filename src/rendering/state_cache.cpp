@@ -0,0 +1,554 @@
+#include "state_cache.hpp"
+#include "core/logging.hpp"
+#include "debugging/render_tests.hpp"
+
+#include <cstring>
+
+template <typename T>
+bool StateCache::Update(Cached<T> &cached, const T &value) {
+    if (cached.isKnown && IsSame(cached.value, value)) {
+        ++this->stats.filteredCount;
+        return false;
+    }
+
+    cached.value = value;
+    cached.isKnown = true;
+
+    ++this->stats.issuedCount;
+    return true;
+}
+
+template <typename T>
+bool StateCache::IsSame(const T &a, const T &b) {
+    return memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+// Compared by field, the padding after count isn't guaranteed to match
+bool StateCache::IsSame(const Render_target_binding &a, const Render_target_binding &b) {
+    if (a.count != b.count || a.depthStencilView != b.depthStencilView)
+        return false;
+
+    for (UINT i = 0; i < MAX_RENDER_TARGETS; ++i)
+        if (a.renderTargetViews[i] != b.renderTargetViews[i])
+            return false;
+
+    return true;
+}
+
+template <typename T, typename U>
+bool StateCache::UpdateRange(Cached<T> *cached, UINT &startSlot, UINT &count, U const *&values, int maxSlots) {
+    if (startSlot + count > (UINT)maxSlots) {
+        LogWarn("Slot range [%u, %u) exceeds the tracked slot count (%d)\n", startSlot, startSlot + count, maxSlots);
+        count = startSlot < (UINT)maxSlots ? maxSlots - startSlot : 0;
+    }
+
+    int firstChanged = -1;
+    int lastChanged = -1;
+
+    for (UINT i = 0; i < count; ++i) {
+        Cached<T> &slot = cached[startSlot + i];
+        if (slot.isKnown && slot.value == T(values[i]))
+            continue;
+
+        if (firstChanged < 0)
+            firstChanged = i;
+        lastChanged = i;
+
+        slot.value = values[i];
+        slot.isKnown = true;
+    }
+
+    if (firstChanged < 0) {
+        ++this->stats.filteredCount;
+        return false;
+    }
+
+    values    += firstChanged;
+    startSlot += firstChanged;
+    count      = lastChanged - firstChanged + 1;
+
+    ++this->stats.issuedCount;
+    return true;
+}
+
+void StateCache::SetShader(Shader_stage stage, ID3D11DeviceChild *shader) {
+    if (!this->Update(this->stages[+stage].shader, shader))
+        return;
+
+    this->sink->SetShader(stage, shader);
+}
+
+void StateCache::SetDeviceContext(ID3D11DeviceContext *deviceContext) {
+    this->contextSink.SetDeviceContext(deviceContext);
+    this->sink = &this->contextSink;
+
+    this->Invalidate();
+}
+
+ID3D11DeviceContext *StateCache::GetDeviceContext() const {
+    return this->sink == &this->contextSink ? this->contextSink.GetDeviceContext() : nullptr;
+}
+
+void StateCache::SetSink(StateSink *sink) {
+    this->sink = sink ? sink : &this->contextSink;
+
+    this->Invalidate();
+}
+
+void StateCache::SetVertexShader(ID3D11VertexShader *shader) {
+    this->SetShader(Shader_stage::vertex, shader);
+}
+
+void StateCache::SetHullShader(ID3D11HullShader *shader) {
+    this->SetShader(Shader_stage::hull, shader);
+}
+
+void StateCache::SetDomainShader(ID3D11DomainShader *shader) {
+    this->SetShader(Shader_stage::domain, shader);
+}
+
+void StateCache::SetGeometryShader(ID3D11GeometryShader *shader) {
+    this->SetShader(Shader_stage::geometry, shader);
+}
+
+void StateCache::SetPixelShader(ID3D11PixelShader *shader) {
+    this->SetShader(Shader_stage::pixel, shader);
+}
+
+void StateCache::SetComputeShader(ID3D11ComputeShader *shader) {
+    this->SetShader(Shader_stage::compute, shader);
+}
+
+void StateCache::SetConstantBuffers(Shader_stage stage, UINT startSlot, UINT count, ID3D11Buffer *const *buffers) {
+    if (!this->UpdateRange(this->stages[+stage].constantBuffers, startSlot, count, buffers, MAX_CONSTANT_BUFFERS))
+        return;
+
+    this->sink->SetConstantBuffers(stage, startSlot, count, buffers);
+}
+
+void StateCache::SetConstantBufferRange(Shader_stage stage, UINT slot, ID3D11Buffer *buffer, UINT firstConstant, UINT constantCount) {
+    // Callers check SupportsConstantBufferOffsets first, this keeps a buffer bound if one didn't
+    if (!this->sink->SupportsConstantBufferOffsets()) {
+        this->SetConstantBuffers(stage, slot, 1, &buffer);
+        return;
+    }
+
+    Constant_buffer_binding binding(buffer, firstConstant, constantCount);
+
+    UINT count = 1;
+    const Constant_buffer_binding *bindings = &binding;
+    if (!this->UpdateRange(this->stages[+stage].constantBuffers, slot, count, bindings, MAX_CONSTANT_BUFFERS))
+        return;
+
+    this->sink->SetConstantBufferRange(stage, slot, buffer, firstConstant, constantCount);
+}
+
+void StateCache::SetShaderResources(Shader_stage stage, UINT startSlot, UINT count, ID3D11ShaderResourceView *const *views) {
+    if (!this->UpdateRange(this->stages[+stage].shaderResources, startSlot, count, views, MAX_SHADER_RESOURCES))
+        return;
+
+    for (UINT i = 0; i < count; ++i)
+        this->stages[+stage].shaderResourceOwners[startSlot + i] = this->sink->GetViewResource(views[i]);
+
+    this->sink->SetShaderResources(stage, startSlot, count, views);
+}
+
+void StateCache::SetSamplers(Shader_stage stage, UINT startSlot, UINT count, ID3D11SamplerState *const *samplers) {
+    if (!this->UpdateRange(this->stages[+stage].samplers, startSlot, count, samplers, MAX_SAMPLERS))
+        return;
+
+    this->sink->SetSamplers(stage, startSlot, count, samplers);
+}
+
+void StateCache::SetInputLayout(ID3D11InputLayout *inputLayout) {
+    if (this->Update(this->inputLayout, inputLayout))
+        this->sink->SetInputLayout(inputLayout);
+}
+
+void StateCache::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) {
+    if (this->Update(this->primitiveTopology, topology))
+        this->sink->SetPrimitiveTopology(topology);
+}
+
+void StateCache::SetVertexBuffer(ID3D11Buffer *buffer, UINT stride, UINT offset) {
+    Vertex_buffer_binding binding{};
+    binding.buffer = buffer;
+    binding.stride = stride;
+    binding.offset = offset;
+
+    if (this->Update(this->vertexBuffer, binding))
+        this->sink->SetVertexBuffer(buffer, stride, offset);
+}
+
+void StateCache::SetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset) {
+    Index_buffer_binding binding{};
+    binding.buffer = buffer;
+    binding.format = format;
+    binding.offset = offset;
+
+    if (this->Update(this->indexBuffer, binding))
+        this->sink->SetIndexBuffer(buffer, format, offset);
+}
+
+void StateCache::SetRasterizerState(ID3D11RasterizerState *state) {
+    if (this->Update(this->rasterizerState, state))
+        this->sink->SetRasterizerState(state);
+}
+
+void StateCache::SetViewport(const D3D11_VIEWPORT &viewport) {
+    if (this->Update(this->viewport, viewport))
+        this->sink->SetViewport(viewport);
+}
+
+void StateCache::SetRenderTargets(UINT count, ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depthStencilView) {
+    if (count > MAX_RENDER_TARGETS) {
+        LogWarn("Render target count %u exceeds the maximum (%d)\n", count, MAX_RENDER_TARGETS);
+        count = MAX_RENDER_TARGETS;
+    }
+
+    Render_target_binding binding{};
+    binding.count = count;
+    for (UINT i = 0; i < count; ++i)
+        binding.renderTargetViews[i] = views ? views[i] : nullptr;
+    binding.depthStencilView = depthStencilView;
+
+    if (this->Update(this->renderTargets, binding)) {
+        for (UINT i = 0; i < MAX_RENDER_TARGETS; ++i)
+            this->renderTargetOwners[i] = this->sink->GetViewResource(binding.renderTargetViews[i]);
+        this->depthStencilOwner = this->sink->GetViewResource(depthStencilView);
+
+        this->sink->SetRenderTargets(count, count > 0 ? binding.renderTargetViews : nullptr, depthStencilView);
+        this->InvalidateHazardousBindings();
+        for (auto &view : this->unorderedAccessViews)
+            view.isKnown = false;
+    }
+}
+
+void StateCache::SetBlendState(ID3D11BlendState *state) {
+    if (this->Update(this->blendState, state))
+        this->sink->SetBlendState(state);
+}
+
+void StateCache::SetDepthStencilState(ID3D11DepthStencilState *state, UINT stencilRef) {
+    bool refChanged = this->depthStencilState.isKnown && this->stencilRef != stencilRef;
+    if (refChanged)
+        this->depthStencilState.isKnown = false;
+
+    if (this->Update(this->depthStencilState, state)) {
+        this->stencilRef = stencilRef;
+        this->sink->SetDepthStencilState(state, stencilRef);
+    }
+}
+
+void StateCache::SetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView *const *views) {
+    if (this->UpdateRange(this->unorderedAccessViews, startSlot, count, views, MAX_UNORDERED_ACCESS_VIEWS)) {
+        for (UINT i = 0; i < count; ++i)
+            this->unorderedAccessOwners[startSlot + i] = this->sink->GetViewResource(views[i]);
+
+        this->sink->SetUnorderedAccessViews(startSlot, count, views);
+        this->InvalidateHazardousBindings();
+        this->renderTargets.isKnown = false;
+    }
+}
+
+int StateCache::UnbindShaderResources(ID3D11Resource *resource) {
+    if (!resource)
+        return 0;
+
+    int unbindCount = 0;
+
+    for (int stage = 0; stage < +Shader_stage::count; ++stage) {
+        for (UINT slot = 0; slot < MAX_SHADER_RESOURCES; ++slot) {
+            if (this->stages[stage].shaderResourceOwners[slot] != resource)
+                continue;
+
+            ID3D11ShaderResourceView *nullView = nullptr;
+            this->SetShaderResources(static_cast<Shader_stage>(stage), slot, 1, &nullView);
+            ++unbindCount;
+        }
+    }
+
+    this->stats.hazardUnbindCount += unbindCount;
+    return unbindCount;
+}
+
+int StateCache::UnbindOutputs(ID3D11Resource *resource) {
+    if (!resource)
+        return 0;
+
+    int unbindCount = 0;
+
+    // The output merger is always set as a whole, and rebinding the other views could restore ones the runtime dropped
+    bool isBoundAsTarget = this->depthStencilOwner == resource;
+    for (UINT i = 0; i < MAX_RENDER_TARGETS; ++i)
+        isBoundAsTarget |= this->renderTargetOwners[i] == resource;
+
+    if (isBoundAsTarget) {
+        this->SetRenderTargets(0, nullptr, nullptr);
+        ++unbindCount;
+    }
+
+    for (UINT slot = 0; slot < MAX_UNORDERED_ACCESS_VIEWS; ++slot) {
+        if (this->unorderedAccessOwners[slot] != resource)
+            continue;
+
+        ID3D11UnorderedAccessView *nullView = nullptr;
+        this->SetUnorderedAccessViews(slot, 1, &nullView);
+        ++unbindCount;
+    }
+
+    this->stats.hazardUnbindCount += unbindCount;
+    return unbindCount;
+}
+
+// Binding a resource as an output makes the runtime silently unbind it from every input slot,
+// so the cached shader resources can no longer be trusted
+void StateCache::InvalidateHazardousBindings() {
+    for (auto &stage : this->stages)
+        for (auto &view : stage.shaderResources)
+            view.isKnown = false;
+}
+
+void StateCache::Invalidate() {
+    for (int i = 0; i < +Shader_stage::count; ++i)
+        this->stages[i] = Stage_state{};
+
+    this->InvalidateInputAssembler();
+    this->InvalidateOutputMerger();
+
+    this->rasterizerState.isKnown = false;
+    this->viewport.isKnown = false;
+
+    for (auto &view : this->unorderedAccessViews)
+        view.isKnown = false;
+
+    // Forgotten like the rest of the state, a hazard on a binding made before is left to the runtime
+    for (auto &owner : this->renderTargetOwners)
+        owner = nullptr;
+    this->depthStencilOwner = nullptr;
+    for (auto &owner : this->unorderedAccessOwners)
+        owner = nullptr;
+}
+
+void StateCache::InvalidateShader(Shader_stage stage) {
+    this->stages[+stage].shader.isKnown = false;
+}
+
+void StateCache::InvalidateConstantBuffers(Shader_stage stage) {
+    for (auto &buffer : this->stages[+stage].constantBuffers)
+        buffer.isKnown = false;
+}
+
+void StateCache::InvalidateInputAssembler() {
+    this->inputLayout.isKnown = false;
+    this->primitiveTopology.isKnown = false;
+    this->vertexBuffer.isKnown = false;
+    this->indexBuffer.isKnown = false;
+}
+
+void StateCache::InvalidateOutputMerger() {
+    this->renderTargets.isKnown = false;
+    this->blendState.isKnown = false;
+    this->depthStencilState.isKnown = false;
+}
+
+void StateCache::ResetStats() {
+    this->stats = Stats{};
+}
+
+void StateCache::RunCacheTest() {
+    LogInfo("State cache test:\n");
+    LogIndent();
+
+    TestChecks checks;
+
+    using Call_type = RecordingStateSink::Call_type;
+
+    // Made up device objects, only their addresses are used
+    static char objects[64];
+    auto fake = [](int index) { return static_cast<void *>(&objects[index]); };
+
+    ID3D11PixelShader *pixelShaders[2] = { static_cast<ID3D11PixelShader *>(fake(0)), static_cast<ID3D11PixelShader *>(fake(1)) };
+    ID3D11Buffer *buffer = static_cast<ID3D11Buffer *>(fake(2));
+    ID3D11DepthStencilState *depthStencilState = static_cast<ID3D11DepthStencilState *>(fake(3));
+
+    ID3D11Resource *resources[4];
+    ID3D11ShaderResourceView *shaderResourceViews[4];
+    for (int i = 0; i < 4; ++i) {
+        resources[i] = static_cast<ID3D11Resource *>(fake(8 + i));
+        shaderResourceViews[i] = static_cast<ID3D11ShaderResourceView *>(fake(16 + i));
+    }
+
+    ID3D11RenderTargetView *renderTargetView = static_cast<ID3D11RenderTargetView *>(fake(24));
+    ID3D11UnorderedAccessView *unorderedAccessView = static_cast<ID3D11UnorderedAccessView *>(fake(25));
+
+    RecordingStateSink sink;
+    for (int i = 0; i < 4; ++i)
+        sink.SetViewResource(shaderResourceViews[i], resources[i]);
+    sink.SetViewResource(renderTargetView, resources[0]);
+    sink.SetViewResource(unorderedAccessView, resources[1]);
+
+    StateCache cache;
+    cache.SetSink(&sink);
+
+    auto lastCallIs = [&sink](Call_type type, Shader_stage stage, UINT startSlot, std::initializer_list<const void *> objects) {
+        if (sink.GetCalls().empty())
+            return false;
+
+        const RecordingStateSink::Call &call = sink.GetCalls().back();
+        return call.type == type && call.stage == stage && call.startSlot == startSlot && call.objects == std::vector<const void *>(objects);
+    };
+
+    checks.Check(cache.GetDeviceContext() == nullptr, "A test sink hides the device context");
+
+    cache.SetPixelShader(pixelShaders[0]);
+    cache.SetPixelShader(pixelShaders[0]);
+    checks.Check(sink.GetCalls().size() == 1 && cache.GetStats().issuedCount == 1 && cache.GetStats().filteredCount == 1, "Binding the same shader twice issues one call");
+
+    cache.SetPixelShader(pixelShaders[1]);
+    checks.Check(lastCallIs(Call_type::shader, Shader_stage::pixel, 0, { pixelShaders[1] }), "Changing the shader issues a call");
+
+    sink.ClearCalls();
+    cache.SetShaderResources(Shader_stage::pixel, 0, 4, shaderResourceViews);
+    checks.Check(lastCallIs(Call_type::shaderResources, Shader_stage::pixel, 0, { shaderResourceViews[0], shaderResourceViews[1], shaderResourceViews[2], shaderResourceViews[3] }), "New views are bound in one call");
+
+    ID3D11ShaderResourceView *changedViews[4] = { shaderResourceViews[0], shaderResourceViews[1], shaderResourceViews[0], shaderResourceViews[3] };
+    cache.SetShaderResources(Shader_stage::pixel, 0, 4, changedViews);
+    checks.Check(lastCallIs(Call_type::shaderResources, Shader_stage::pixel, 2, { shaderResourceViews[0] }), "A range is narrowed to the slots that changed");
+
+    sink.ClearCalls();
+    cache.SetShaderResources(Shader_stage::pixel, 0, 4, changedViews);
+    checks.Check(sink.GetCalls().empty(), "Binding the same views again is filtered");
+
+    cache.SetShaderResources(Shader_stage::vertex, 0, 4, changedViews);
+    checks.Check(sink.GetCalls().size() == 1, "Stages are tracked separately");
+
+    sink.ClearCalls();
+    cache.SetConstantBufferRange(Shader_stage::vertex, 0, buffer, 0, 16);
+    cache.SetConstantBufferRange(Shader_stage::vertex, 0, buffer, 0, 16);
+    cache.SetConstantBufferRange(Shader_stage::vertex, 0, buffer, 16, 16);
+    cache.SetConstantBuffers(Shader_stage::vertex, 0, 1, &buffer);
+    checks.Check(sink.GetCalls().size() == 3 && sink.GetCalls()[2].type == Call_type::constantBuffers, "Constant buffer ranges are told apart by their offset and from whole buffers");
+
+    sink.ClearCalls();
+    cache.SetDepthStencilState(depthStencilState, 0);
+    cache.SetDepthStencilState(depthStencilState, 0);
+    cache.SetDepthStencilState(depthStencilState, 1);
+    checks.Check(sink.GetCalls().size() == 2, "A changed stencil reference is issued with the same state");
+
+    // Binding an output makes the runtime drop the resource from the inputs on its own, so they're bound again
+    sink.ClearCalls();
+    cache.SetShaderResources(Shader_stage::pixel, 0, 1, &shaderResourceViews[0]);
+    cache.SetRenderTargets(1, &renderTargetView, nullptr);
+    cache.SetShaderResources(Shader_stage::pixel, 3, 1, &shaderResourceViews[3]);
+    checks.Check(sink.GetCalls().size() == 2 && lastCallIs(Call_type::shaderResources, Shader_stage::pixel, 3, { shaderResourceViews[3] }), "Shader resources are bound again after binding outputs");
+
+    // Slots 0 and 2 of both stages still hold views of resource 0
+    sink.ClearCalls();
+    checks.Check(cache.UnbindShaderResources(resources[0]) == 4 && sink.GetCalls().size() == 4, "Unbinding shader resources unbinds every slot holding the resource");
+    checks.Check(lastCallIs(Call_type::shaderResources, Shader_stage::pixel, 2, { nullptr }), "Unbinding binds null to the slot");
+    checks.Check(cache.UnbindShaderResources(resources[0]) == 0, "Unbound resources aren't unbound again");
+    checks.Check(cache.UnbindShaderResources(resources[2]) == 0, "Resources that aren't bound are left alone");
+
+    sink.ClearCalls();
+    cache.SetUnorderedAccessViews(1, 1, &unorderedAccessView);
+    checks.Check(cache.UnbindOutputs(resources[0]) == 1 && lastCallIs(Call_type::renderTargets, Shader_stage::count, 0, { nullptr }), "Unbinding a render target unbinds the output merger");
+    checks.Check(cache.UnbindOutputs(resources[1]) == 1 && lastCallIs(Call_type::unorderedAccessViews, Shader_stage::count, 1, { nullptr }), "Unbinding an unordered access view binds null to its slot");
+    checks.Check(cache.UnbindOutputs(resources[0]) == 0 && cache.UnbindOutputs(resources[1]) == 0, "Unbound outputs aren't unbound again");
+    checks.Check(cache.GetStats().hazardUnbindCount == 6, "Hazard unbinds are counted");
+
+    sink.ClearCalls();
+    cache.Invalidate();
+    cache.SetPixelShader(pixelShaders[1]);
+    checks.Check(sink.GetCalls().size() == 1, "Invalidated state is bound again");
+
+    sink.SetSupportsConstantBufferOffsets(false);
+    checks.Check(!cache.SupportsConstantBufferOffsets(), "Constant buffer offset support comes from the sink");
+
+    sink.ClearCalls();
+    cache.SetConstantBufferRange(Shader_stage::pixel, 1, buffer, 16, 16);
+    checks.Check(lastCallIs(Call_type::constantBuffers, Shader_stage::pixel, 1, { buffer }), "Without offset support a range falls back to binding the whole buffer");
+    sink.SetSupportsConstantBufferOffsets(true);
+
+    {
+        // Random binds, applying what the sink received has to leave the same state as applying every request
+        TestRandom random(97531);
+
+        static constexpr int STAGE_COUNT = +Shader_stage::count;
+
+        ID3D11DeviceChild *requestedShaders[STAGE_COUNT] = {};
+        ID3D11ShaderResourceView *requestedViews[STAGE_COUNT][MAX_SHADER_RESOURCES] = {};
+        const void *issuedShaders[STAGE_COUNT] = {};
+        const void *issuedViews[STAGE_COUNT][MAX_SHADER_RESOURCES] = {};
+
+        StateCache randomCache;
+        randomCache.SetSink(&sink);
+        sink.ClearCalls();
+
+        const int stepCount = 20000;
+        bool isMatching = true;
+
+        for (int step = 0; step < stepCount; ++step) {
+            const uint32_t action = random.NextUint(10);
+            const Shader_stage stage = static_cast<Shader_stage>(random.NextUint(STAGE_COUNT));
+            const size_t appliedCount = sink.GetCalls().size();
+
+            if (action < 3) {
+                ID3D11DeviceChild *shader = random.NextUint(3) == 0 ? nullptr : static_cast<ID3D11DeviceChild *>(fake(random.NextUint(2)));
+                randomCache.SetShader(stage, shader);
+                requestedShaders[+stage] = shader;
+            }
+            else if (action < 8) {
+                const UINT startSlot = random.NextUint(MAX_SHADER_RESOURCES - 3);
+                const UINT count = 1 + random.NextUint(4);
+
+                ID3D11ShaderResourceView *views[4];
+                for (UINT i = 0; i < count; ++i)
+                    views[i] = random.NextUint(5) == 0 ? nullptr : shaderResourceViews[random.NextUint(4)];
+
+                randomCache.SetShaderResources(stage, startSlot, count, views);
+                for (UINT i = 0; i < count; ++i)
+                    requestedViews[+stage][startSlot + i] = views[i];
+            }
+            else if (action < 9) {
+                ID3D11Resource *resource = resources[random.NextUint(4)];
+                randomCache.UnbindShaderResources(resource);
+
+                for (auto &stageViews : requestedViews)
+                    for (ID3D11ShaderResourceView *&view : stageViews)
+                        if (sink.GetViewResource(view) == resource)
+                            view = nullptr;
+            }
+            else if (random.NextUint(2) == 0) {
+                randomCache.SetRenderTargets(1, &renderTargetView, nullptr);
+            }
+            else {
+                randomCache.SetRenderTargets(0, nullptr, nullptr);
+            }
+
+            for (size_t i = appliedCount; i < sink.GetCalls().size(); ++i) {
+                const RecordingStateSink::Call &call = sink.GetCalls()[i];
+                if (call.type == Call_type::shader)
+                    issuedShaders[+call.stage] = call.objects[0];
+                else if (call.type == Call_type::shaderResources)
+                    for (size_t slot = 0; slot < call.objects.size(); ++slot)
+                        issuedViews[+call.stage][call.startSlot + slot] = call.objects[slot];
+            }
+
+            for (int stageIndex = 0; stageIndex < STAGE_COUNT; ++stageIndex) {
+                isMatching = isMatching && requestedShaders[stageIndex] == issuedShaders[stageIndex];
+                for (int slot = 0; slot < MAX_SHADER_RESOURCES; ++slot)
+                    isMatching = isMatching && requestedViews[stageIndex][slot] == issuedViews[stageIndex][slot];
+            }
+        }
+
+        const Stats &stats = randomCache.GetStats();
+        checks.Check(isMatching, "Random binds leave the state they requested");
+        checks.Check(sink.GetCalls().size() == static_cast<size_t>(stats.issuedCount), "Every issued call reaches the sink");
+        LogInfo("%d random binds: %d issued, %d filtered, %d hazard unbinds\n", stepCount, stats.issuedCount, stats.filteredCount, stats.hazardUnbindCount);
+    }
+
+    checks.LogSummary();
+
+    LogUnindent();
+}
\ No newline at end of file
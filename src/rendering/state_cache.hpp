@@ -0,0 +1,182 @@
+#ifndef STATE_CACHE_HPP
+#define STATE_CACHE_HPP
+
+#include "rendering/state_sink.hpp"
+
+#include <d3d11_1.h>
+
+// Wraps the device context and drops bind calls that would not change the current pipeline state. The calls that
+// get through go to a sink, the device context unless a test sink is set.
+// Anything that binds state through the raw device context must invalidate the affected state afterwards.
+class StateCache {
+public:
+    static constexpr int MAX_CONSTANT_BUFFERS = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+    static constexpr int MAX_SHADER_RESOURCES = 16;
+    static constexpr int MAX_SAMPLERS = 4;
+    static constexpr int MAX_UNORDERED_ACCESS_VIEWS = 4;
+    static constexpr int MAX_RENDER_TARGETS = D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT;
+
+    struct Stats {
+        int issuedCount = 0;
+        int filteredCount = 0;
+        int hazardUnbindCount = 0;
+    };
+
+private:
+    template <typename T>
+    struct Cached {
+        T value{};
+        bool isKnown = false;
+    };
+
+    // A constant count of 0 binds the whole buffer
+    struct Constant_buffer_binding {
+        ID3D11Buffer *buffer = nullptr;
+        UINT firstConstant = 0;
+        UINT constantCount = 0;
+
+        Constant_buffer_binding(ID3D11Buffer *buffer = nullptr, UINT firstConstant = 0, UINT constantCount = 0)
+            : buffer(buffer), firstConstant(firstConstant), constantCount(constantCount) {
+        }
+
+        bool operator==(const Constant_buffer_binding &other) const {
+            return this->buffer == other.buffer && this->firstConstant == other.firstConstant && this->constantCount == other.constantCount;
+        }
+    };
+
+    struct Stage_state {
+        Cached<ID3D11DeviceChild *> shader;
+        Cached<Constant_buffer_binding> constantBuffers[MAX_CONSTANT_BUFFERS];
+        Cached<ID3D11ShaderResourceView *> shaderResources[MAX_SHADER_RESOURCES];
+        Cached<ID3D11SamplerState *> samplers[MAX_SAMPLERS];
+
+        ID3D11Resource *shaderResourceOwners[MAX_SHADER_RESOURCES] = {};
+    };
+
+    struct Vertex_buffer_binding {
+        ID3D11Buffer *buffer = nullptr;
+        UINT stride = 0;
+        UINT offset = 0;
+    };
+
+    struct Index_buffer_binding {
+        ID3D11Buffer *buffer = nullptr;
+        DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+        UINT offset = 0;
+    };
+
+    struct Render_target_binding {
+        UINT count = 0;
+        ID3D11RenderTargetView *renderTargetViews[MAX_RENDER_TARGETS] = {};
+        ID3D11DepthStencilView *depthStencilView = nullptr;
+    };
+
+    DeviceContextSink contextSink;
+    StateSink *sink = &this->contextSink;
+
+    Stage_state stages[+Shader_stage::count];
+
+    Cached<ID3D11InputLayout *> inputLayout;
+    Cached<D3D11_PRIMITIVE_TOPOLOGY> primitiveTopology;
+    Cached<Vertex_buffer_binding> vertexBuffer;
+    Cached<Index_buffer_binding> indexBuffer;
+
+    Cached<ID3D11RasterizerState *> rasterizerState;
+    Cached<D3D11_VIEWPORT> viewport;
+
+    Cached<Render_target_binding> renderTargets;
+    Cached<ID3D11BlendState *> blendState;
+    Cached<ID3D11DepthStencilState *> depthStencilState;
+    UINT stencilRef = 0;
+
+    Cached<ID3D11UnorderedAccessView *> unorderedAccessViews[MAX_UNORDERED_ACCESS_VIEWS];
+
+    // Resources of the last views bound, recorded while the views are known to be alive. A view the runtime unbound
+    // on its own may be destroyed since, so these are only ever compared, never dereferenced.
+    ID3D11Resource *renderTargetOwners[MAX_RENDER_TARGETS] = {};
+    ID3D11Resource *depthStencilOwner = nullptr;
+    ID3D11Resource *unorderedAccessOwners[MAX_UNORDERED_ACCESS_VIEWS] = {};
+
+    Stats stats;
+
+    template <typename T>
+    static bool IsSame(const T &a, const T &b);
+    static bool IsSame(const Render_target_binding &a, const Render_target_binding &b);
+
+    template <typename T>
+    bool Update(Cached<T> &cached, const T &value);
+
+    // Updates the tracked slots and narrows [startSlot, startSlot + count) to the range that actually changed.
+    // Returns false if nothing changed.
+    template <typename T, typename U>
+    bool UpdateRange(Cached<T> *cached, UINT &startSlot, UINT &count, U const *&values, int maxSlots);
+
+    void SetShader(Shader_stage stage, ID3D11DeviceChild *shader);
+    void InvalidateHazardousBindings();
+
+public:
+    StateCache() = default;
+
+    StateCache(const StateCache &other) = delete;
+    StateCache &operator=(const StateCache &other) = delete;
+
+    void SetDeviceContext(ID3D11DeviceContext *deviceContext);
+
+    // Null while a test sink is set
+    ID3D11DeviceContext *GetDeviceContext() const;
+
+    // Sends the calls to sink instead of the device context, nullptr goes back to the device context
+    void SetSink(StateSink *sink);
+
+    // Binding constant buffer ranges requires the D3D11.1 runtime
+    bool SupportsConstantBufferOffsets() const { return this->sink->SupportsConstantBufferOffsets(); }
+
+    void SetVertexShader(ID3D11VertexShader *shader);
+    void SetHullShader(ID3D11HullShader *shader);
+    void SetDomainShader(ID3D11DomainShader *shader);
+    void SetGeometryShader(ID3D11GeometryShader *shader);
+    void SetPixelShader(ID3D11PixelShader *shader);
+    void SetComputeShader(ID3D11ComputeShader *shader);
+
+    void SetConstantBuffers(Shader_stage stage, UINT startSlot, UINT count, ID3D11Buffer *const *buffers);
+    void SetConstantBufferRange(Shader_stage stage, UINT slot, ID3D11Buffer *buffer, UINT firstConstant, UINT constantCount);
+    void SetShaderResources(Shader_stage stage, UINT startSlot, UINT count, ID3D11ShaderResourceView *const *views);
+    void SetSamplers(Shader_stage stage, UINT startSlot, UINT count, ID3D11SamplerState *const *samplers);
+
+    void SetInputLayout(ID3D11InputLayout *inputLayout);
+    void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+    void SetVertexBuffer(ID3D11Buffer *buffer, UINT stride, UINT offset = 0);
+    void SetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset = 0);
+
+    void SetRasterizerState(ID3D11RasterizerState *state);
+    void SetViewport(const D3D11_VIEWPORT &viewport);
+
+    void SetRenderTargets(UINT count, ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depthStencilView);
+    void SetBlendState(ID3D11BlendState *state);
+    void SetDepthStencilState(ID3D11DepthStencilState *state, UINT stencilRef = 0);
+
+    void SetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView *const *views);
+
+    // Unbind the views of a resource ahead of a conflicting use. Slots whose state is no longer known are treated
+    // as still holding their last view, so a binding the runtime already dropped may be unbound a second time.
+    // Returns the number of bind calls issued.
+    int UnbindShaderResources(ID3D11Resource *resource);
+    int UnbindOutputs(ID3D11Resource *resource);
+
+    // Forget everything, e.g. after ClearState()
+    void Invalidate();
+
+    void InvalidateShader(Shader_stage stage);
+    void InvalidateConstantBuffers(Shader_stage stage);
+    void InvalidateInputAssembler();
+    void InvalidateOutputMerger();
+
+    const Stats &GetStats() const { return this->stats; }
+    void ResetStats();
+
+    // Binds synthetic state through a recording sink and checks which calls are issued and which are filtered,
+    // how ranges are narrowed, and what binding outputs and invalidating do to the cached state
+    static void RunCacheTest();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include "state_sink.hpp"
+
+DeviceContextSink::~DeviceContextSink() {
+    if (this->deviceContext1)
+        this->deviceContext1->Release();
+}
+
+void DeviceContextSink::SetDeviceContext(ID3D11DeviceContext *deviceContext) {
+    if (this->deviceContext1) {
+        this->deviceContext1->Release();
+        this->deviceContext1 = nullptr;
+    }
+
+    this->deviceContext = deviceContext;
+
+    if (deviceContext && FAILED(deviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void **)&this->deviceContext1)))
+        this->deviceContext1 = nullptr;
+}
+
+ID3D11Resource *DeviceContextSink::GetViewResource(ID3D11View *view) const {
+    if (!view)
+        return nullptr;
+
+    ID3D11Resource *resource = nullptr;
+    view->GetResource(&resource);
+    resource->Release(); // The view keeps its resource alive
+
+    return resource;
+}
+
+void DeviceContextSink::SetShader(Shader_stage stage, ID3D11DeviceChild *shader) {
+    switch (stage) {
+        case Shader_stage::vertex:
+            this->deviceContext->VSSetShader(static_cast<ID3D11VertexShader *>(shader), nullptr, 0);
+            break;
+        case Shader_stage::hull:
+            this->deviceContext->HSSetShader(static_cast<ID3D11HullShader *>(shader), nullptr, 0);
+            break;
+        case Shader_stage::domain:
+            this->deviceContext->DSSetShader(static_cast<ID3D11DomainShader *>(shader), nullptr, 0);
+            break;
+        case Shader_stage::geometry:
+            this->deviceContext->GSSetShader(static_cast<ID3D11GeometryShader *>(shader), nullptr, 0);
+            break;
+        case Shader_stage::pixel:
+            this->deviceContext->PSSetShader(static_cast<ID3D11PixelShader *>(shader), nullptr, 0);
+            break;
+        case Shader_stage::compute:
+            this->deviceContext->CSSetShader(static_cast<ID3D11ComputeShader *>(shader), nullptr, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+void DeviceContextSink::SetConstantBuffers(Shader_stage stage, UINT startSlot, UINT count, ID3D11Buffer *const *buffers) {
+    switch (stage) {
+        case Shader_stage::vertex:   this->deviceContext->VSSetConstantBuffers(startSlot, count, buffers); break;
+        case Shader_stage::hull:     this->deviceContext->HSSetConstantBuffers(startSlot, count, buffers); break;
+        case Shader_stage::domain:   this->deviceContext->DSSetConstantBuffers(startSlot, count, buffers); break;
+        case Shader_stage::geometry: this->deviceContext->GSSetConstantBuffers(startSlot, count, buffers); break;
+        case Shader_stage::pixel:    this->deviceContext->PSSetConstantBuffers(startSlot, count, buffers); break;
+        case Shader_stage::compute:  this->deviceContext->CSSetConstantBuffers(startSlot, count, buffers); break;
+        default: break;
+    }
+}
+
+void DeviceContextSink::SetConstantBufferRange(Shader_stage stage, UINT slot, ID3D11Buffer *buffer, UINT firstConstant, UINT constantCount) {
+    ID3D11DeviceContext1 *context = this->deviceContext1;
+    switch (stage) {
+        case Shader_stage::vertex:   context->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount); break;
+        case Shader_stage::hull:     context->HSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount); break;
+        case Shader_stage::domain:   context->DSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount); break;
+        case Shader_stage::geometry: context->GSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount); break;
+        case Shader_stage::pixel:    context->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount); break;
+        case Shader_stage::compute:  context->CSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount); break;
+        default: break;
+    }
+}
+
+void DeviceContextSink::SetShaderResources(Shader_stage stage, UINT startSlot, UINT count, ID3D11ShaderResourceView *const *views) {
+    switch (stage) {
+        case Shader_stage::vertex:   this->deviceContext->VSSetShaderResources(startSlot, count, views); break;
+        case Shader_stage::hull:     this->deviceContext->HSSetShaderResources(startSlot, count, views); break;
+        case Shader_stage::domain:   this->deviceContext->DSSetShaderResources(startSlot, count, views); break;
+        case Shader_stage::geometry: this->deviceContext->GSSetShaderResources(startSlot, count, views); break;
+        case Shader_stage::pixel:    this->deviceContext->PSSetShaderResources(startSlot, count, views); break;
+        case Shader_stage::compute:  this->deviceContext->CSSetShaderResources(startSlot, count, views); break;
+        default: break;
+    }
+}
+
+void DeviceContextSink::SetSamplers(Shader_stage stage, UINT startSlot, UINT count, ID3D11SamplerState *const *samplers) {
+    switch (stage) {
+        case Shader_stage::vertex:   this->deviceContext->VSSetSamplers(startSlot, count, samplers); break;
+        case Shader_stage::hull:     this->deviceContext->HSSetSamplers(startSlot, count, samplers); break;
+        case Shader_stage::domain:   this->deviceContext->DSSetSamplers(startSlot, count, samplers); break;
+        case Shader_stage::geometry: this->deviceContext->GSSetSamplers(startSlot, count, samplers); break;
+        case Shader_stage::pixel:    this->deviceContext->PSSetSamplers(startSlot, count, samplers); break;
+        case Shader_stage::compute:  this->deviceContext->CSSetSamplers(startSlot, count, samplers); break;
+        default: break;
+    }
+}
+
+void DeviceContextSink::SetInputLayout(ID3D11InputLayout *inputLayout) {
+    this->deviceContext->IASetInputLayout(inputLayout);
+}
+
+void DeviceContextSink::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) {
+    this->deviceContext->IASetPrimitiveTopology(topology);
+}
+
+void DeviceContextSink::SetVertexBuffer(ID3D11Buffer *buffer, UINT stride, UINT offset) {
+    this->deviceContext->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+}
+
+void DeviceContextSink::SetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset) {
+    this->deviceContext->IASetIndexBuffer(buffer, format, offset);
+}
+
+void DeviceContextSink::SetRasterizerState(ID3D11RasterizerState *state) {
+    this->deviceContext->RSSetState(state);
+}
+
+void DeviceContextSink::SetViewport(const D3D11_VIEWPORT &viewport) {
+    this->deviceContext->RSSetViewports(1, &viewport);
+}
+
+void DeviceContextSink::SetRenderTargets(UINT count, ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depthStencilView) {
+    this->deviceContext->OMSetRenderTargets(count, views, depthStencilView);
+}
+
+void DeviceContextSink::SetBlendState(ID3D11BlendState *state) {
+    this->deviceContext->OMSetBlendState(state, nullptr, 0xFFFFFFFF);
+}
+
+void DeviceContextSink::SetDepthStencilState(ID3D11DepthStencilState *state, UINT stencilRef) {
+    this->deviceContext->OMSetDepthStencilState(state, stencilRef);
+}
+
+void DeviceContextSink::SetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView *const *views) {
+    this->deviceContext->CSSetUnorderedAccessViews(startSlot, count, views, nullptr);
+}
+
+void RecordingStateSink::Record(Call_type type, Shader_stage stage, UINT startSlot, UINT count, const void *const *objects) {
+    Call call;
+    call.type = type;
+    call.stage = stage;
+    call.startSlot = startSlot;
+
+    for (UINT i = 0; i < count; ++i)
+        call.objects.push_back(objects ? objects[i] : nullptr);
+
+    this->calls.push_back(std::move(call));
+}
+
+ID3D11Resource *RecordingStateSink::GetViewResource(ID3D11View *view) const {
+    auto it = this->viewResources.find(view);
+    return it != this->viewResources.end() ? it->second : nullptr;
+}
+
+void RecordingStateSink::SetShader(Shader_stage stage, ID3D11DeviceChild *shader) {
+    const void *object = shader;
+    this->Record(Call_type::shader, stage, 0, 1, &object);
+}
+
+void RecordingStateSink::SetConstantBuffers(Shader_stage stage, UINT startSlot, UINT count, ID3D11Buffer *const *buffers) {
+    this->Record(Call_type::constantBuffers, stage, startSlot, count, reinterpret_cast<const void *const *>(buffers));
+}
+
+void RecordingStateSink::SetConstantBufferRange(Shader_stage stage, UINT slot, ID3D11Buffer *buffer, UINT firstConstant, UINT constantCount) {
+    const void *object = buffer;
+    this->Record(Call_type::constantBufferRange, stage, slot, 1, &object);
+}
+
+void RecordingStateSink::SetShaderResources(Shader_stage stage, UINT startSlot, UINT count, ID3D11ShaderResourceView *const *views) {
+    this->Record(Call_type::shaderResources, stage, startSlot, count, reinterpret_cast<const void *const *>(views));
+}
+
+void RecordingStateSink::SetSamplers(Shader_stage stage, UINT startSlot, UINT count, ID3D11SamplerState *const *samplers) {
+    this->Record(Call_type::samplers, stage, startSlot, count, reinterpret_cast<const void *const *>(samplers));
+}
+
+void RecordingStateSink::SetInputLayout(ID3D11InputLayout *inputLayout) {
+    const void *object = inputLayout;
+    this->Record(Call_type::inputLayout, Shader_stage::count, 0, 1, &object);
+}
+
+void RecordingStateSink::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) {
+    this->Record(Call_type::primitiveTopology, Shader_stage::count, 0, 0, nullptr);
+}
+
+void RecordingStateSink::SetVertexBuffer(ID3D11Buffer *buffer, UINT stride, UINT offset) {
+    const void *object = buffer;
+    this->Record(Call_type::vertexBuffer, Shader_stage::count, 0, 1, &object);
+}
+
+void RecordingStateSink::SetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset) {
+    const void *object = buffer;
+    this->Record(Call_type::indexBuffer, Shader_stage::count, 0, 1, &object);
+}
+
+void RecordingStateSink::SetRasterizerState(ID3D11RasterizerState *state) {
+    const void *object = state;
+    this->Record(Call_type::rasterizerState, Shader_stage::count, 0, 1, &object);
+}
+
+void RecordingStateSink::SetViewport(const D3D11_VIEWPORT &viewport) {
+    this->Record(Call_type::viewport, Shader_stage::count, 0, 0, nullptr);
+}
+
+void RecordingStateSink::SetRenderTargets(UINT count, ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depthStencilView) {
+    this->Record(Call_type::renderTargets, Shader_stage::count, 0, count, reinterpret_cast<const void *const *>(views));
+    this->calls.back().objects.push_back(depthStencilView);
+}
+
+void RecordingStateSink::SetBlendState(ID3D11BlendState *state) {
+    const void *object = state;
+    this->Record(Call_type::blendState, Shader_stage::count, 0, 1, &object);
+}
+
+void RecordingStateSink::SetDepthStencilState(ID3D11DepthStencilState *state, UINT stencilRef) {
+    const void *object = state;
+    this->Record(Call_type::depthStencilState, Shader_stage::count, 0, 1, &object);
+}
+
+void RecordingStateSink::SetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView *const *views) {
+    this->Record(Call_type::unorderedAccessViews, Shader_stage::count, startSlot, count, reinterpret_cast<const void *const *>(views));
+}
\ No newline at end of file
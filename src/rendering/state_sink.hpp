@@ -0,0 +1,163 @@
+#ifndef STATE_SINK_HPP
+#define STATE_SINK_HPP
+
+#include <d3d11_1.h>
+#include <unordered_map>
+#include <vector>
+
+enum class Shader_stage : int {
+    vertex,
+    hull,
+    domain,
+    geometry,
+    pixel,
+    compute,
+
+    count
+};
+
+constexpr int operator+(Shader_stage stage) noexcept {
+    return static_cast<int>(stage);
+}
+
+// Receives the bind calls the state cache lets through. The renderer forwards them to its device context,
+// tests record them instead.
+class StateSink {
+public:
+    virtual ~StateSink() = default;
+
+    // Binding constant buffer ranges requires the D3D11.1 runtime
+    virtual bool SupportsConstantBufferOffsets() const = 0;
+
+    // The resource a view was created for, only compared, so it doesn't hold a reference
+    virtual ID3D11Resource *GetViewResource(ID3D11View *view) const = 0;
+
+    virtual void SetShader(Shader_stage stage, ID3D11DeviceChild *shader) = 0;
+    virtual void SetConstantBuffers(Shader_stage stage, UINT startSlot, UINT count, ID3D11Buffer *const *buffers) = 0;
+    virtual void SetConstantBufferRange(Shader_stage stage, UINT slot, ID3D11Buffer *buffer, UINT firstConstant, UINT constantCount) = 0;
+    virtual void SetShaderResources(Shader_stage stage, UINT startSlot, UINT count, ID3D11ShaderResourceView *const *views) = 0;
+    virtual void SetSamplers(Shader_stage stage, UINT startSlot, UINT count, ID3D11SamplerState *const *samplers) = 0;
+
+    virtual void SetInputLayout(ID3D11InputLayout *inputLayout) = 0;
+    virtual void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) = 0;
+    virtual void SetVertexBuffer(ID3D11Buffer *buffer, UINT stride, UINT offset) = 0;
+    virtual void SetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset) = 0;
+
+    virtual void SetRasterizerState(ID3D11RasterizerState *state) = 0;
+    virtual void SetViewport(const D3D11_VIEWPORT &viewport) = 0;
+
+    virtual void SetRenderTargets(UINT count, ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depthStencilView) = 0;
+    virtual void SetBlendState(ID3D11BlendState *state) = 0;
+    virtual void SetDepthStencilState(ID3D11DepthStencilState *state, UINT stencilRef) = 0;
+
+    virtual void SetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView *const *views) = 0;
+};
+
+// Forwards to a device context, constant buffer ranges go through ID3D11DeviceContext1 when the runtime has it
+class DeviceContextSink : public StateSink {
+    ID3D11DeviceContext *deviceContext = nullptr;
+    ID3D11DeviceContext1 *deviceContext1 = nullptr;
+
+public:
+    DeviceContextSink() = default;
+    ~DeviceContextSink();
+
+    DeviceContextSink(const DeviceContextSink &other) = delete;
+    DeviceContextSink &operator=(const DeviceContextSink &other) = delete;
+
+    void SetDeviceContext(ID3D11DeviceContext *deviceContext);
+    ID3D11DeviceContext *GetDeviceContext() const { return this->deviceContext; }
+
+    bool SupportsConstantBufferOffsets() const override { return this->deviceContext1 != nullptr; }
+    ID3D11Resource *GetViewResource(ID3D11View *view) const override;
+
+    void SetShader(Shader_stage stage, ID3D11DeviceChild *shader) override;
+    void SetConstantBuffers(Shader_stage stage, UINT startSlot, UINT count, ID3D11Buffer *const *buffers) override;
+    void SetConstantBufferRange(Shader_stage stage, UINT slot, ID3D11Buffer *buffer, UINT firstConstant, UINT constantCount) override;
+    void SetShaderResources(Shader_stage stage, UINT startSlot, UINT count, ID3D11ShaderResourceView *const *views) override;
+    void SetSamplers(Shader_stage stage, UINT startSlot, UINT count, ID3D11SamplerState *const *samplers) override;
+
+    void SetInputLayout(ID3D11InputLayout *inputLayout) override;
+    void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+    void SetVertexBuffer(ID3D11Buffer *buffer, UINT stride, UINT offset) override;
+    void SetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset) override;
+
+    void SetRasterizerState(ID3D11RasterizerState *state) override;
+    void SetViewport(const D3D11_VIEWPORT &viewport) override;
+
+    void SetRenderTargets(UINT count, ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depthStencilView) override;
+    void SetBlendState(ID3D11BlendState *state) override;
+    void SetDepthStencilState(ID3D11DepthStencilState *state, UINT stencilRef) override;
+
+    void SetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView *const *views) override;
+};
+
+// Records the calls instead of issuing them, so what the state cache lets through can be checked without a device.
+// Views and state objects can be made up pointers that are never dereferenced, the resource of each view is
+// looked up in the views given to SetViewResource.
+class RecordingStateSink : public StateSink {
+public:
+    enum class Call_type {
+        shader,
+        constantBuffers,
+        constantBufferRange,
+        shaderResources,
+        samplers,
+        inputLayout,
+        primitiveTopology,
+        vertexBuffer,
+        indexBuffer,
+        rasterizerState,
+        viewport,
+        renderTargets,
+        blendState,
+        depthStencilState,
+        unorderedAccessViews
+    };
+
+    struct Call {
+        Call_type type = Call_type::shader;
+        Shader_stage stage = Shader_stage::count; // count for calls without a stage
+        UINT startSlot = 0;
+        std::vector<const void *> objects; // One per slot, render targets end with the depth stencil view
+    };
+
+private:
+    std::unordered_map<ID3D11View *, ID3D11Resource *> viewResources;
+    std::vector<Call> calls;
+    bool supportsConstantBufferOffsets = true;
+
+    void Record(Call_type type, Shader_stage stage, UINT startSlot, UINT count, const void *const *objects);
+
+public:
+    void SetViewResource(ID3D11View *view, ID3D11Resource *resource) { this->viewResources[view] = resource; }
+    void SetSupportsConstantBufferOffsets(bool isSupported) { this->supportsConstantBufferOffsets = isSupported; }
+
+    const std::vector<Call> &GetCalls() const { return this->calls; }
+    void ClearCalls() { this->calls.clear(); }
+
+    bool SupportsConstantBufferOffsets() const override { return this->supportsConstantBufferOffsets; }
+    ID3D11Resource *GetViewResource(ID3D11View *view) const override;
+
+    void SetShader(Shader_stage stage, ID3D11DeviceChild *shader) override;
+    void SetConstantBuffers(Shader_stage stage, UINT startSlot, UINT count, ID3D11Buffer *const *buffers) override;
+    void SetConstantBufferRange(Shader_stage stage, UINT slot, ID3D11Buffer *buffer, UINT firstConstant, UINT constantCount) override;
+    void SetShaderResources(Shader_stage stage, UINT startSlot, UINT count, ID3D11ShaderResourceView *const *views) override;
+    void SetSamplers(Shader_stage stage, UINT startSlot, UINT count, ID3D11SamplerState *const *samplers) override;
+
+    void SetInputLayout(ID3D11InputLayout *inputLayout) override;
+    void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+    void SetVertexBuffer(ID3D11Buffer *buffer, UINT stride, UINT offset) override;
+    void SetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset) override;
+
+    void SetRasterizerState(ID3D11RasterizerState *state) override;
+    void SetViewport(const D3D11_VIEWPORT &viewport) override;
+
+    void SetRenderTargets(UINT count, ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depthStencilView) override;
+    void SetBlendState(ID3D11BlendState *state) override;
+    void SetDepthStencilState(ID3D11DepthStencilState *state, UINT stencilRef) override;
+
+    void SetUnorderedAccessViews(UINT startSlot, UINT count, ID3D11UnorderedAccessView *const *views) override;
+};
+
+#endif
\ No newline at end of file
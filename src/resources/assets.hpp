@@ -110,11 +110,16 @@ struct Material {
     float displacementScale = 0.05f;
 
     bool enableBackfaceCulling = true;
+
+    // The diffuse texture has texels the shadow and depth pixel shaders discard, opaque materials are drawn
+    // without a pixel shader
+    bool isAlphaTested = false;
 };
 
 struct Model {
     ID3D11Buffer *vertexBuffer = nullptr;
     ID3D11Buffer *indexBuffer = nullptr;
+    ID3D11Buffer *positionBuffer = nullptr; // Same vertices, positions only, for depth-only draws
 
     BoundingBox localBounds;
 
@@ -133,6 +138,7 @@ struct Model {
     std::vector<Sub_model> subModels;
 
     ~Model() {
+        SafeRelease(this->positionBuffer);
         SafeRelease(this->indexBuffer);
         SafeRelease(this->vertexBuffer);
     }
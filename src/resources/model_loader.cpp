@@ -4,6 +4,7 @@
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader/tiny_obj_loader.h"
+#include "stb_image/stb_image.h"
 
 #include <unordered_map>
 
@@ -113,6 +114,28 @@ void ModelLoader::ComputeTangents(std::vector<Vertex> &vertices, const std::vect
     }
 }
 
+bool ModelLoader::HasCutoutTexels(const std::string &texturePath) {
+    int width, height, components;
+    if (!stbi_info(texturePath.c_str(), &width, &height, &components))
+        return false;
+
+    // No alpha channel, every texel is opaque
+    if (components != 2 && components != 4)
+        return false;
+
+    unsigned char *data = stbi_load(texturePath.c_str(), &width, &height, &components, 4);
+    if (!data)
+        return false;
+
+    bool hasCutout = false;
+    for (size_t i = 0; i < static_cast<size_t>(width) * height && !hasCutout; ++i)
+        hasCutout = data[i * 4 + 3] < 128;
+
+    stbi_image_free(data);
+
+    return hasCutout;
+}
+
 Model *ModelLoader::Load(AssetID uuid) {
     std::string path = this->assetManager->UUIDToFullPath(uuid);
 
@@ -134,8 +157,12 @@ Model *ModelLoader::Load(AssetID uuid) {
         return nullptr;
     }
 
+    const std::string fullBaseDir = baseDir;
     baseDir = baseDir.substr(this->assetManager->GetAssetDirectory().size());
 
+    // Decoded once per texture, materials of a model often share them
+    std::unordered_map<std::string, bool> textureCutouts;
+
     bool enableBackfaceCulling = this->assetManager->GetMetadata(uuid, "enable_backface_culling") != "false";
 
     std::vector<AssetHandle<Material>> modelMaterials(materials.size());
@@ -158,6 +185,13 @@ Model *ModelLoader::Load(AssetID uuid) {
         if (!materials[i].diffuse_texname.empty()) {
             AssetID textureID = this->assetManager->PathToUUID(baseDir + materials[i].diffuse_texname);
             newMaterial->diffuseTexture = this->assetManager->GetHandle<Texture2D>(textureID);
+
+            const std::string &texturePath = materials[i].diffuse_texname;
+            auto cutout = textureCutouts.find(texturePath);
+            if (cutout == textureCutouts.end())
+                cutout = textureCutouts.emplace(texturePath, this->HasCutoutTexels(fullBaseDir + texturePath)).first;
+
+            newMaterial->isAlphaTested = cutout->second;
         }
         else {
             newMaterial->diffuseTexture = defaultMaterial->diffuseTexture;
@@ -340,6 +374,23 @@ Model *ModelLoader::Load(AssetID uuid) {
         return nullptr;
     }
 
+    std::vector<XMFLOAT3> positions(finalVertices.size());
+    for (size_t i = 0; i < finalVertices.size(); ++i)
+        positions[i] = finalVertices[i].position;
+
+    D3D11_BUFFER_DESC positionBufferDesc = vertexBufferDesc;
+    positionBufferDesc.ByteWidth = sizeof(XMFLOAT3) * positions.size();
+
+    D3D11_SUBRESOURCE_DATA positionData = {};
+    positionData.pSysMem = positions.data();
+
+    result = device->CreateBuffer(&positionBufferDesc, &positionData, &newModel->positionBuffer);
+    if (FAILED(result)) {
+        LogWarn("Failed to create position buffer\n");
+        delete newModel;
+        return nullptr;
+    }
+
     LogInfo("Model '%s' loaded successfully\n", path.c_str());
 
     return newModel;
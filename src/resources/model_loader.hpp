@@ -4,11 +4,15 @@
 #include "resources/asset_loader.hpp"
 #include "resources/assets.hpp"
 
+#include <string>
 #include <vector>
 
 class ModelLoader : public AssetLoader<Model> {
     void ComputeTangents(std::vector<Vertex> &vertices, const std::vector<UINT> &indices);
 
+    // Whether any texel's alpha is below the 0.5 the shadow and depth pixel shaders discard at
+    bool HasCutoutTexels(const std::string &texturePath);
+
 public:
     ModelLoader(AssetManager *assetManager) : AssetLoader<Model>(assetManager) {}
 
@@ -73,11 +73,12 @@ void Octree::CollectAll(const Node *node, std::vector<Component *> &outComponent
         this->CollectAll(child.get(), outComponents);
 }
 
-void Octree::Query(const Node *node, const BoundingFrustum &frustum, std::vector<Component *> &outComponents) const {
+template <typename Volume>
+void Octree::Query(const Node *node, const Volume &volume, std::vector<Component *> &outComponents) const {
     if (!node)
         return;
 
-    ContainmentType contains = frustum.Contains(node->bounds);
+    ContainmentType contains = volume.Contains(node->bounds);
 
     if (contains == DISJOINT)
         return;
@@ -95,7 +96,7 @@ void Octree::Query(const Node *node, const BoundingFrustum &frustum, std::vector
             BoundingBox bounds;
             component->GetWorldBounds(bounds);
 
-            if (frustum.Contains(bounds) != DISJOINT)
+            if (volume.Contains(bounds) != DISJOINT)
                 outComponents.push_back(component);
         }
 
@@ -103,7 +104,7 @@ void Octree::Query(const Node *node, const BoundingFrustum &frustum, std::vector
     }
 
     for (auto &child : node->children)
-        this->Query(child.get(), frustum, outComponents);
+        this->Query(child.get(), volume, outComponents);
 }
 
 void Octree::Build(const std::vector<std::pair<Component *, BoundingBox>> &items, const BoundingBox &sceneBounds) {
@@ -120,6 +121,10 @@ void Octree::Query(const BoundingFrustum &frustum, std::vector<Component *> &out
     this->Query(this->root.get(), frustum, outComponents);
 }
 
+void Octree::Query(const BoundingOrientedBox &box, std::vector<Component *> &outComponents) const {
+    this->Query(this->root.get(), box, outComponents);
+}
+
 void Octree::QueryAll(std::vector<Component *> &outComponents) const {
     this->CollectAll(this->root.get(), outComponents);
 }
@@ -214,6 +219,25 @@ void SceneCuller::Build() {
     this->needsRebuild = false;
 }
 
+template <typename Volume>
+void SceneCuller::GatherVisible(const Volume &volume, std::vector<Component *> &outComponents) const {
+    // Static
+    this->octree.Query(volume, outComponents);
+
+    // Dynamic
+    for (Component *component : this->dynamicRenderables) {
+        if (!component->GetOwner()->IsActive() || !component->isActive)
+            continue;
+
+        BoundingBox bounds;
+        if (!component->GetWorldBounds(bounds))
+            continue;
+
+        if (volume.Contains(bounds) != DISJOINT)
+            outComponents.push_back(component);
+    }
+}
+
 void SceneCuller::GatherVisibility(std::vector<Render_view> &views) const {
     for (Render_view &view : views) {
         std::vector<Component *> visible;
@@ -227,22 +251,11 @@ void SceneCuller::GatherVisibility(std::vector<Render_view> &views) const {
                 if (component->GetOwner()->IsActive() && component->isActive)
                     visible.push_back(component);
         }
+        else if (view.useOrientedBox) {
+            this->GatherVisible(view.orientedBox, visible);
+        }
         else {
-            // Static
-            this->octree.Query(view.frustum, visible);
-
-            // Dynamic
-            for (Component *component : this->dynamicRenderables) {
-                if (!component->GetOwner()->IsActive() || !component->isActive)
-                    continue;
-
-                BoundingBox bounds;
-                if (!component->GetWorldBounds(bounds))
-                    continue;
-
-                if (view.frustum.Contains(bounds) != DISJOINT)
-                    visible.push_back(component);
-            }
+            this->GatherVisible(view.frustum, visible);
         }
 
         std::sort(visible.begin(), visible.end());
@@ -35,7 +35,8 @@ class Octree {
 
     void CollectAll(const Node *node, std::vector<Component *> &outComponents) const;
 
-    void Query(const Node *node, const BoundingFrustum &frustum, std::vector<Component *> &outComponents) const;
+    template <typename Volume>
+    void Query(const Node *node, const Volume &volume, std::vector<Component *> &outComponents) const;
 
     void DebugDrawNode(const Node *node, int depth);
 
@@ -46,6 +47,7 @@ public:
     void Build(const std::vector<std::pair<Component *, BoundingBox>> &items, const BoundingBox &sceneBounds);
 
     void Query(const BoundingFrustum &frustum, std::vector<Component *> &outComponents) const;
+    void Query(const BoundingOrientedBox &box, std::vector<Component *> &outComponents) const;
     void QueryAll(std::vector<Component *> &outComponents) const;
 
     void Clear();
@@ -64,6 +66,9 @@ class SceneCuller {
 
     bool needsRebuild = false;
 
+    template <typename Volume>
+    void GatherVisible(const Volume &volume, std::vector<Component *> &outComponents) const;
+
 public:
     SceneCuller() = default;
     ~SceneCuller() = default;
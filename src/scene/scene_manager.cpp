@@ -2,6 +2,7 @@
 #include "scene/scene.hpp"
 #include "core/logging.hpp"
 #include "resources/scene_loader.hpp"
+#include "rendering/renderer.hpp"
 
 SceneManager::SceneManager() : loader(nullptr) {}
 SceneManager::~SceneManager() {}
@@ -51,6 +52,10 @@ void SceneManager::Update(const Frame_context &context) {
     if (this->targetSceneName != this->currentSceneName || this->shouldReload) {
         this->ChangeScene(this->targetSceneName);
         this->shouldReload = false;
+
+        // Loading a scene unloads the assets the previous one used
+        if (context.engineContext.renderer)
+            context.engineContext.renderer->InvalidateMaterialTable();
     }
 
     this->currentScene.Update(context);
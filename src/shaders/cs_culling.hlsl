@@ -0,0 +1,98 @@
+#define THREAD_GROUP_SIZE 64
+
+struct Instance {
+    float4x4 worldMatrix;
+    float4x4 worldMatrixInvTranspose;
+    float3 boundsCenter;
+    float pad0;
+    float3 boundsExtents;
+    float pad1;
+};
+
+struct Batch {
+    uint firstInstance;
+    uint instanceCount;
+    uint indexCount;
+    uint startIndex;
+    int baseVertex;
+    uint3 pad0;
+};
+
+cbuffer Culling : register(b0) {
+    float4 frustumPlanes[6];
+    uint batchCount;
+    uint3 pad0;
+};
+
+StructuredBuffer<Instance> instances : register(t0);
+StructuredBuffer<Batch> batches : register(t1);
+
+RWStructuredBuffer<uint> visibleInstances : register(u0);
+RWByteAddressBuffer drawArgs : register(u1);
+
+groupshared uint visibleSums[THREAD_GROUP_SIZE];
+
+// Same operation order as GpuCullingSystem::IsInstanceVisible
+bool IsVisible(Instance instance) {
+    float3 c = instance.boundsCenter;
+    float3 e = instance.boundsExtents;
+
+    [unroll]
+    for (uint i = 0; i < 6; ++i) {
+        float4 p = frustumPlanes[i];
+
+        precise float distance = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+        precise float radius = abs(p.x) * e.x + abs(p.y) * e.y + abs(p.z) * e.z;
+        precise float signedDistance = distance + radius;
+
+        if (signedDistance < 0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+// One group per batch. Visible instances are compacted with a prefix sum so the output doesn't depend on thread timing.
+[numthreads(THREAD_GROUP_SIZE, 1, 1)]
+void main(uint3 groupID : SV_GroupID, uint threadIndex : SV_GroupIndex) {
+    const uint batchIndex = groupID.x;
+    if (batchIndex >= batchCount)
+        return;
+
+    Batch batch = batches[batchIndex];
+
+    uint visibleCount = 0;
+
+    for (uint base = 0; base < batch.instanceCount; base += THREAD_GROUP_SIZE) {
+        const uint localIndex = base + threadIndex;
+
+        uint isVisible = 0;
+        if (localIndex < batch.instanceCount && IsVisible(instances[batch.firstInstance + localIndex]))
+            isVisible = 1;
+
+        visibleSums[threadIndex] = isVisible;
+        GroupMemoryBarrierWithGroupSync();
+
+        // Inclusive scan
+        [unroll]
+        for (uint offset = 1; offset < THREAD_GROUP_SIZE; offset <<= 1) {
+            uint value = threadIndex >= offset ? visibleSums[threadIndex - offset] : 0;
+            GroupMemoryBarrierWithGroupSync();
+
+            visibleSums[threadIndex] += value;
+            GroupMemoryBarrierWithGroupSync();
+        }
+
+        if (isVisible)
+            visibleInstances[batch.firstInstance + visibleCount + visibleSums[threadIndex] - 1] = batch.firstInstance + localIndex;
+
+        visibleCount += visibleSums[THREAD_GROUP_SIZE - 1];
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (threadIndex == 0) {
+        const uint address = batchIndex * 20;
+        drawArgs.Store4(address, uint4(batch.indexCount, visibleCount, batch.startIndex, asuint(batch.baseVertex)));
+        drawArgs.Store(address + 16, batch.firstInstance);
+    }
+}
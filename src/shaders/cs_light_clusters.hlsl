@@ -0,0 +1,82 @@
+#define THREAD_GROUP_SIZE 64
+
+// Must match LightClusterBuilder
+static const uint CLUSTER_COUNT_X = 16;
+static const uint CLUSTER_COUNT_Y = 9;
+static const uint CLUSTER_COUNT_Z = 24;
+static const uint CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+static const uint MAX_LIGHTS_PER_CLUSTER = 128;
+
+cbuffer Light_clusters : register(b0) {
+    float projectionScaleX;
+    float projectionScaleY;
+    float nearDepth;
+    float farDepth;
+    uint lightCount;
+    uint3 pad0;
+};
+
+StructuredBuffer<float4> lightBounds : register(t0); // View space centre and radius
+
+RWStructuredBuffer<uint2> clusterRanges : register(u0);
+RWStructuredBuffer<uint> clusterLightIndices : register(u1);
+
+groupshared float4 sharedBounds[THREAD_GROUP_SIZE];
+
+// Same as LightClusterBuilder, what is left of the squared radius after the distance along one axis
+float GetRemainingRadiusSq(float radiusSq, float centre, float minimum, float maximum) {
+    float distance = max(max(minimum - centre, centre - maximum), 0.0f);
+    return radiusSq - distance * distance;
+}
+
+// One thread per cluster, the lights are loaded into group shared memory a group's width at a time. Every cluster
+// owns a fixed stretch of the index buffer, so no atomics are needed and the lists keep the order of the lights.
+[numthreads(THREAD_GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint threadIndex : SV_GroupIndex) {
+    const uint cluster = id.x;
+    const bool isCluster = cluster < CLUSTER_COUNT;
+
+    const uint x = cluster % CLUSTER_COUNT_X;
+    const uint y = (cluster / CLUSTER_COUNT_X) % CLUSTER_COUNT_Y;
+    const uint z = cluster / (CLUSTER_COUNT_X * CLUSTER_COUNT_Y);
+
+    // The froxel's view space bounds, see LightClusterBuilder::SetGrid
+    const float depthRatio = farDepth / nearDepth;
+    const float sliceNear = nearDepth * pow(depthRatio, float(z) / CLUSTER_COUNT_Z);
+    const float sliceFar = z == CLUSTER_COUNT_Z - 1 ? farDepth : nearDepth * pow(depthRatio, float(z + 1) / CLUSTER_COUNT_Z);
+
+    const float2 ndcMin = float2(-1.0f + 2.0f * x / CLUSTER_COUNT_X, 1.0f - 2.0f * (y + 1) / CLUSTER_COUNT_Y);
+    const float2 ndcMax = float2(-1.0f + 2.0f * (x + 1) / CLUSTER_COUNT_X, 1.0f - 2.0f * y / CLUSTER_COUNT_Y);
+    const float2 projectionScale = float2(projectionScaleX, projectionScaleY);
+
+    const float2 boundsMin = min(ndcMin * sliceNear, ndcMin * sliceFar) / projectionScale;
+    const float2 boundsMax = max(ndcMax * sliceNear, ndcMax * sliceFar) / projectionScale;
+
+    const uint offset = cluster * MAX_LIGHTS_PER_CLUSTER;
+    uint count = 0;
+
+    for (uint base = 0; base < lightCount; base += THREAD_GROUP_SIZE) {
+        if (base + threadIndex < lightCount)
+            sharedBounds[threadIndex] = lightBounds[base + threadIndex];
+        GroupMemoryBarrierWithGroupSync();
+
+        const uint batchCount = min(THREAD_GROUP_SIZE, lightCount - base);
+        for (uint i = 0; i < batchCount; ++i) {
+            const float4 sphere = sharedBounds[i];
+
+            float remaining = GetRemainingRadiusSq(sphere.w * sphere.w, sphere.z, sliceNear, sliceFar);
+            remaining = GetRemainingRadiusSq(remaining, sphere.y, boundsMin.y, boundsMax.y);
+
+            const float distanceX = max(max(boundsMin.x - sphere.x, sphere.x - boundsMax.x), 0.0f);
+            if (isCluster && distanceX * distanceX <= remaining && count < MAX_LIGHTS_PER_CLUSTER) {
+                clusterLightIndices[offset + count] = base + i;
+                ++count;
+            }
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (isCluster)
+        clusterRanges[cluster] = uint2(offset, count);
+}
\ No newline at end of file
@@ -16,10 +16,17 @@ static const float DIRECTIONAL_PCF_RADIUS = 2.0f;
 static const float SPOT_PCF_RADIUS = 1.5f;
 
 static const float DIRECTIONAL_TEXEL_SIZE = 1.0f / 2048.0f;
-static const float SPOT_TEXEL_SIZE = 1.0f / 1024.0f;
 
-static const float DIRECTIONAL_NORMAL_FACTOR = 0.15f;
-static const float SPOT_NORMAL_FACTOR = 0.1f;
+static const float DIRECTIONAL_NORMAL_TEXELS = 2.5f; // Cascades differ in texel size, so the bias is in texels
+static const float SPOT_NORMAL_FACTOR = 0.1f; // For a 1024 texel tile, smaller tiles need more
+static const float SPOT_NORMAL_RESOLUTION = 1024.0f;
+
+static const int MAX_SHADOW_CASCADES = 4;
+
+// Must match LightClusterBuilder
+static const uint CLUSTER_COUNT_X = 16;
+static const uint CLUSTER_COUNT_Y = 9;
+static const uint CLUSTER_COUNT_Z = 24;
 
 cbuffer Per_frame : register(b0) {
     float4x4 viewMatrix;
@@ -38,6 +45,10 @@ cbuffer Lighting_data : register(b1) {
     int spotLightCount;
     int reflectionProbeCount;
     int hasSkybox;
+    uint renderWidth; // The targets are allocated at full size, only this part is rendered
+    uint renderHeight;
+    float clusterDepthScale; // Slice of a view depth is floor(log(depth) * scale + bias)
+    float clusterDepthBias;
     float pad1;
 }
 
@@ -46,9 +57,12 @@ struct Directional_light_data {
     float intensity;
     float3 colour;
     int castsShadows;
-    int shadowSliceIndex;
-    float pad2[3];
-    float4x4 viewProjectionMatrix;
+    int shadowSliceIndex; // Of the first cascade, the others follow
+    int cascadeCount;
+    float2 pad2;
+    float4 cascadeSplits; // View depth each cascade ends at
+    float4 cascadeTexelSizes;
+    float4x4 cascadeViewProjectionMatrices[MAX_SHADOW_CASCADES];
 };
 
 struct Spot_light_data {
@@ -60,8 +74,9 @@ struct Spot_light_data {
     float cosInnerAngle;
     float cosOuterAngle;
     int castsShadows;
-    int shadowSliceIndex;
-    float pad3;
+    int shadowTileIndex;
+    float shadowTexelSize; // 1 / tile size
+    float4 shadowAtlasRect; // Scale in xy and offset in zw, from tile to atlas UVs
     float4x4 viewProjectionMatrix;
 };
 
@@ -78,7 +93,7 @@ Texture2D<float4> gbufferSpecular : register(t2);
 Texture2D<float4> depthBuffer : register(t3);
 
 Texture2DArray<float> shadowMapDirectional : register(t4);
-Texture2DArray<float> shadowMapSpot : register(t5);
+Texture2D<float> shadowMapSpot : register(t5); // Atlas
 
 StructuredBuffer<Directional_light_data> directionalLights : register(t6);
 StructuredBuffer<Spot_light_data> spotLights : register(t7);
@@ -87,6 +102,11 @@ TextureCubeArray reflectionCubeMap : register(t8);
 StructuredBuffer<Reflection_probe_data> reflectionProbes : register(t9);
 TextureCube skybox : register(t10);
 
+StructuredBuffer<uint2> clusterRanges : register(t11); // Offset into clusterLightIndices and count
+StructuredBuffer<uint> clusterLightIndices : register(t12); // Into spotLights
+StructuredBuffer<uint2> probeClusterRanges : register(t13); // Offset into probeClusterIndices and count
+StructuredBuffer<uint> probeClusterIndices : register(t14); // Into reflectionProbes
+
 RWTexture2D<float4> outputTexture : register(u0);
 
 float3 ReconstructWorldPosition(float2 uv, float depth) {
@@ -96,11 +116,16 @@ float3 ReconstructWorldPosition(float2 uv, float depth) {
     return positionWorld.xyz / positionWorld.w;
 }
 
-float3 SampleReflectionProbe(float3 reflectV, float3 positionWorld, uint2 pixel) {
+// Only the probes whose influence reaches into the pixel's cluster are tested
+float3 SampleReflectionProbe(float3 reflectV, float3 positionWorld, uint2 pixel, uint cluster) {
     float closestDistanceSq = 999999.0f;
     int indexOfClosest = -1;
 
-    for (int i = 0; i < reflectionProbeCount; ++i) {
+    uint2 probeRange = probeClusterRanges[cluster];
+
+    for (uint n = 0; n < probeRange.y; ++n) {
+        int i = probeClusterIndices[probeRange.x + n];
+
         float3 deltaV = positionWorld - reflectionProbes[i].position;
             
         float distanceToCentreSq = dot(deltaV, deltaV);
@@ -120,6 +145,13 @@ float3 SampleReflectionProbe(float3 reflectV, float3 positionWorld, uint2 pixel)
     return outputTexture[pixel].rgb;
 }
 
+uint GetCluster(float2 uv, float viewDepth) {
+    uint2 tile = min(uint2(uv * float2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y)), uint2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+    uint slice = uint(clamp(floor(log(max(viewDepth, 0.0001f)) * clusterDepthScale + clusterDepthBias), 0.0f, CLUSTER_COUNT_Z - 1.0f));
+
+    return (slice * CLUSTER_COUNT_Y + tile.y) * CLUSTER_COUNT_X + tile.x;
+}
+
 float Ease(float x) {
     const float x0 = 0.75f;
     const float k = 15.0f;
@@ -130,15 +162,27 @@ float Ease(float x) {
 float SampleShadowDirectional(float3 positionWorld, float3 normalV, int lightIndex) {
     Directional_light_data light = directionalLights[lightIndex];
 
-    if (!light.castsShadows || light.shadowSliceIndex < 0)
+    if (!light.castsShadows || light.shadowSliceIndex < 0 || light.cascadeCount <= 0)
         return 1.0f;
+
+    // The first cascade whose range reaches the position, the splits are increasing
+    float viewDepth = mul(float4(positionWorld, 1.0f), viewMatrix).z;
+    if (viewDepth > light.cascadeSplits[light.cascadeCount - 1])
+        return 1.0f;
+
+    int cascade = 0;
+    [unroll]
+    for (int c = 0; c < MAX_SHADOW_CASCADES - 1; ++c) {
+        if (c < light.cascadeCount - 1 && viewDepth > light.cascadeSplits[c])
+            cascade = c + 1;
+    }
         
     float3 lightV = normalize(-light.direction);
     float cosine = saturate(dot(normalV, lightV));
     float tangent = sqrt(1.0f - cosine * cosine) / max(cosine, 0.001f);
-    float normalBias = DIRECTIONAL_NORMAL_FACTOR * clamp(tangent, 0.0f, 2.0f);
+    float normalBias = DIRECTIONAL_NORMAL_TEXELS * light.cascadeTexelSizes[cascade] * clamp(tangent, 0.0f, 2.0f);
 
-    float4 lightClip = mul(float4(positionWorld + normalV * normalBias, 1.0f), light.viewProjectionMatrix);
+    float4 lightClip = mul(float4(positionWorld + normalV * normalBias, 1.0f), directionalLights[lightIndex].cascadeViewProjectionMatrices[cascade]);
     float3 ndc = lightClip.xyz / lightClip.w;
 
     float2 uv = ndc.xy * float2(0.5f, -0.5f) + 0.5f;
@@ -153,7 +197,7 @@ float SampleShadowDirectional(float3 positionWorld, float3 normalV, int lightInd
         float2 sampleUV = uv + POISSON_DISK[i] * radius;
         shadow += shadowMapDirectional.SampleCmpLevelZero(
             samplerShadow,
-            float3(sampleUV, light.shadowSliceIndex),
+            float3(sampleUV, light.shadowSliceIndex + cascade),
             depth
         );
     }
@@ -165,13 +209,13 @@ float SampleShadowDirectional(float3 positionWorld, float3 normalV, int lightInd
 float SampleShadowSpot(float3 positionWorld, float3 normalV, int lightIndex) {
     Spot_light_data light = spotLights[lightIndex];
 
-    if (!light.castsShadows || light.shadowSliceIndex < 0)
+    if (!light.castsShadows || light.shadowTileIndex < 0)
         return 1.0f;
         
     float3 lightV = normalize(-light.direction);
     float cosine = saturate(dot(normalV, lightV));
     float tangent = sqrt(1.0f - cosine * cosine) / max(cosine, 0.001f);
-    float normalBias = SPOT_NORMAL_FACTOR * clamp(tangent, 0.0f, 2.0f);
+    float normalBias = SPOT_NORMAL_FACTOR * light.shadowTexelSize * SPOT_NORMAL_RESOLUTION * clamp(tangent, 0.0f, 2.0f);
 
     float4 lightClip = mul(float4(positionWorld + normalV * normalBias, 1.0f), light.viewProjectionMatrix);
     float3 ndc = lightClip.xyz / lightClip.w;
@@ -181,25 +225,25 @@ float SampleShadowSpot(float3 positionWorld, float3 normalV, int lightIndex) {
     
     if (any(uv < 0.0f) || any(uv > 1.0f) || depth < 0.0f || depth > 1.0f)
         return 1.0f;
+
+    // Half a texel in from the edges, so filtering doesn't pick up the neighbouring tiles
+    uv = clamp(uv, 0.5f * light.shadowTexelSize, 1.0f - 0.5f * light.shadowTexelSize);
     
     return shadowMapSpot.SampleCmpLevelZero(
             samplerShadow,
-            float3(uv, light.shadowSliceIndex),
+            uv * light.shadowAtlasRect.xy + light.shadowAtlasRect.zw,
             depth
         );
 }
 
 [numthreads(8, 8, 1)]
 void main(uint3 id : SV_DispatchThreadID) {
-    uint width, height;
-    outputTexture.GetDimensions(width, height);
-
-    if (id.x >= width || id.y >= height)
+    if (id.x >= renderWidth || id.y >= renderHeight)
         return;
 
     int2 pixel = int2(id.xy);
     float2 positionScreen = float2(pixel) + 0.5f;
-    float2 uv = positionScreen / float2(width, height);
+    float2 uv = positionScreen / float2(renderWidth, renderHeight);
     
     float depth = depthBuffer[pixel].r;
 
@@ -231,11 +275,14 @@ void main(uint3 id : SV_DispatchThreadID) {
     
     float3 positionWorld = ReconstructWorldPosition(uv, depth);
     float3 viewV = normalize(cameraPosition - positionWorld);
+
+    float viewDepth = mul(float4(positionWorld, 1.0f), viewMatrix).z;
+    uint cluster = GetCluster(uv, viewDepth);
     
     if (isReflective) {
         float3 reflectV = reflect(-viewV, normalV);
         
-        float3 environmentColour = SampleReflectionProbe(reflectV, positionWorld, pixel);
+        float3 environmentColour = SampleReflectionProbe(reflectV, positionWorld, pixel, cluster);
         outputTexture[pixel] = float4(albedoColour * environmentColour, 1.0f);
         
         return;
@@ -268,7 +315,12 @@ void main(uint3 id : SV_DispatchThreadID) {
         specular += radiance * pow(specularFactor, specularExponent);
     }
 
-    for (int i = 0; i < spotLightCount; ++i) {
+    // Only the spot lights that reach into the pixel's cluster
+    uint2 clusterRange = clusterRanges[cluster];
+
+    for (uint n = 0; n < clusterRange.y; ++n) {
+        int i = clusterLightIndices[clusterRange.x + n];
+
         float3 lightV = spotLights[i].position - positionWorld;
         float distance = length(lightV);
 
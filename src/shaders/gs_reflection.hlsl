@@ -0,0 +1,64 @@
+cbuffer Cube_faces : register(b0) {
+    float4x4 faceViewProjectionMatrices[6]; // +x, -x, +y, -y, +z, -z
+};
+
+cbuffer Cube_face_draw : register(b1) {
+    uint faceMask; // Faces the draw reaches, bit n is face n
+    uint3 pad0;
+};
+
+struct Geometry_shader_input {
+    float4 positionClip : SV_POSITION;
+    float3 positionWorld : POSITION;
+    float3 normalWorld : NORMAL;
+    float2 uv : TEXCOORD;
+};
+
+struct Geometry_shader_output {
+    float4 positionClip : SV_POSITION;
+    float3 positionWorld : POSITION;
+    float3 normalWorld : NORMAL;
+    float2 uv : TEXCOORD;
+    uint face : SV_RenderTargetArrayIndex;
+};
+
+// Copies each triangle into the cube faces it can reach, so a probe is drawn in one pass instead of one per face
+[maxvertexcount(18)]
+void main(triangle Geometry_shader_input input[3], inout TriangleStream<Geometry_shader_output> stream) {
+    [unroll]
+    for (uint face = 0; face < 6; ++face) {
+        if (!(faceMask & (1u << face)))
+            continue;
+
+        float4 positionsClip[3];
+        [unroll]
+        for (int i = 0; i < 3; ++i)
+            positionsClip[i] = mul(float4(input[i].positionWorld, 1.0f), faceViewProjectionMatrices[face]);
+
+        // Triangles entirely outside one of the face's side planes are left to the faces they are in
+        bool isOutside = false;
+        [unroll]
+        for (int axis = 0; axis < 2; ++axis) {
+            isOutside = isOutside || all(float3(positionsClip[0][axis], positionsClip[1][axis], positionsClip[2][axis]) < -float3(positionsClip[0].w, positionsClip[1].w, positionsClip[2].w));
+            isOutside = isOutside || all(float3(positionsClip[0][axis], positionsClip[1][axis], positionsClip[2][axis]) > float3(positionsClip[0].w, positionsClip[1].w, positionsClip[2].w));
+        }
+
+        if (isOutside)
+            continue;
+
+        [unroll]
+        for (int j = 0; j < 3; ++j) {
+            Geometry_shader_output output;
+
+            output.positionClip = positionsClip[j];
+            output.positionWorld = input[j].positionWorld;
+            output.normalWorld = input[j].normalWorld;
+            output.uv = input[j].uv;
+            output.face = face;
+
+            stream.Append(output);
+        }
+
+        stream.RestartStrip();
+    }
+}
\ No newline at end of file
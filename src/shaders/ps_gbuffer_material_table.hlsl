@@ -0,0 +1,84 @@
+// Same as ps_gbuffer, but the material comes from the material table instead of per-draw bindings
+
+cbuffer Per_material : register(b2) {
+    float3 materialDiffuse;
+    float isReflective;
+    float3 materialSpecular;
+    float materialSpecularExponent;
+    uint materialIndex;
+    float3 pad0;
+};
+
+struct Material {
+    float3 diffuseColour;
+    float specularExponent;
+    float3 specularColour;
+    uint diffuseBucket;
+    uint diffuseSlice;
+    uint normalBucket;
+    uint normalSlice;
+    float pad0;
+};
+
+Texture2DArray textureBuckets[8] : register(t0);
+StructuredBuffer<Material> materials : register(t8);
+
+SamplerState linearSampler : register(s0);
+
+struct Pixel_shader_input {
+    float4 position : SV_POSITION;
+    float3 normal : TEXCOORD0;
+    float3 tangent : TEXCOORD1;
+    float3 bitangent : TEXCOORD2;
+    float2 uv : TEXCOORD3;
+};
+
+struct Pixel_shader_output {
+    float4 albedo : SV_TARGET0;
+    float4 normal : SV_TARGET1;
+    float4 specular : SV_TARGET2;
+};
+
+// Resource arrays can only be indexed with literals in SM 5.0. The bucket is the same for the whole draw.
+float4 SampleBucket(uint bucket, uint slice, float2 uv, float2 dx, float2 dy) {
+    float3 location = float3(uv, slice);
+
+    switch (bucket) {
+        case 0:  return textureBuckets[0].SampleGrad(linearSampler, location, dx, dy);
+        case 1:  return textureBuckets[1].SampleGrad(linearSampler, location, dx, dy);
+        case 2:  return textureBuckets[2].SampleGrad(linearSampler, location, dx, dy);
+        case 3:  return textureBuckets[3].SampleGrad(linearSampler, location, dx, dy);
+        case 4:  return textureBuckets[4].SampleGrad(linearSampler, location, dx, dy);
+        case 5:  return textureBuckets[5].SampleGrad(linearSampler, location, dx, dy);
+        case 6:  return textureBuckets[6].SampleGrad(linearSampler, location, dx, dy);
+        default: return textureBuckets[7].SampleGrad(linearSampler, location, dx, dy);
+    }
+}
+
+Pixel_shader_output main(Pixel_shader_input input) {
+    Pixel_shader_output output;
+
+    Material material = materials[materialIndex];
+
+    float2 dx = ddx(input.uv);
+    float2 dy = ddy(input.uv);
+
+    float4 albedoSample = SampleBucket(material.diffuseBucket, material.diffuseSlice, input.uv, dx, dy);
+    if (albedoSample.a < 0.5f)
+        discard;
+    
+    float3 albedo = material.diffuseColour * albedoSample.rgb;
+    output.albedo = float4(albedo, material.specularExponent / 1000.0f);
+
+    float3 normal = SampleBucket(material.normalBucket, material.normalSlice, input.uv, dx, dy).rgb * 2.0f - 1.0f;
+    float3x3 tbnMatrix = float3x3(
+        normalize(input.tangent),
+        normalize(input.bitangent),
+        normalize(input.normal)
+    );
+    output.normal = float4(normalize(mul(normal, tbnMatrix)) * 0.5f + 0.5f, isReflective);
+
+    output.specular = float4(material.specularColour, 0.0f);
+
+    return output;
+}
@@ -32,8 +32,11 @@ struct Directional_light_data {
     float3 colour;
     int castsShadows;
     int shadowSliceIndex;
-    float3 pad2;
-    float4x4 viewProjectionMatrix;
+    int cascadeCount;
+    float2 pad2;
+    float4 cascadeSplits;
+    float4 cascadeTexelSizes;
+    float4x4 cascadeViewProjectionMatrices[4];
 };
 
 struct Spot_light_data {
@@ -45,8 +48,9 @@ struct Spot_light_data {
     float cosInnerAngle;
     float cosOuterAngle;
     int castsShadows;
-    int shadowSliceIndex;
-    float pad3;
+    int shadowTileIndex;
+    float shadowTexelSize;
+    float4 shadowAtlasRect;
     float4x4 viewProjectionMatrix;
 };
 
@@ -13,8 +13,14 @@ cbuffer ResolveData : register(b3) {
     float nearPlane;
     float farPlane;
     float pad0;
+    float2 uvScale; // The inputs are only rendered in their top left part at render scales below 1
+    float2 uvMax;
 };
 
+float2 ToRenderUV(float2 uv) {
+    return min(uv * uvScale, uvMax);
+}
+
 float LineariseDepth(float d) {
     return (nearPlane * farPlane) / (farPlane - d * (farPlane - nearPlane)) / farPlane;
 }
@@ -27,7 +33,7 @@ float3 SampleQuadrant(float2 uv) {
     int2 quadrant = floor(uv * 2);
     int index = quadrant.x + 2 * quadrant.y;
     
-    float2 localUV = frac(uv * 2);
+    float2 localUV = ToRenderUV(frac(uv * 2));
     
     if (index == 0)
         return gbufferAlbedo.Sample(linearSampler, localUV).rgb;
@@ -50,19 +56,22 @@ float3 SampleQuadrant(float2 uv) {
 
 float4 main(float4 position : SV_POSITION, float2 uv : TEXCOORD0) : SV_TARGET {
     float3 ldr = float3(0.0f, 0.0f, 0.0f);
+
+    // Bilinear upscale from the render resolution
+    float2 renderUV = ToRenderUV(uv);
     
     if (debugMode == 1)
-        ldr = gbufferAlbedo.Sample(linearSampler, uv).rgb;
+        ldr = gbufferAlbedo.Sample(linearSampler, renderUV).rgb;
     else if (debugMode == 2)
-        ldr = gbufferNormal.Sample(linearSampler, uv).rgb;
+        ldr = gbufferNormal.Sample(linearSampler, renderUV).rgb;
     else if (debugMode == 3)
-        ldr = gbufferSpecular.Sample(linearSampler, uv).rgb;
+        ldr = gbufferSpecular.Sample(linearSampler, renderUV).rgb;
     else if (debugMode == 4)
-        ldr = LineariseDepth(depthBuffer.Sample(linearSampler, uv).r).rrr;
+        ldr = LineariseDepth(depthBuffer.Sample(linearSampler, renderUV).r).rrr;
     else if (debugMode == 5)
         ldr = SampleQuadrant(uv);
     else {
-        float3 hdr = max(hdrBuffer.Sample(linearSampler, uv).rgb, 0.0f);
+        float3 hdr = max(hdrBuffer.Sample(linearSampler, renderUV).rgb, 0.0f);
     
         // https://64.github.io/tonemapping/
         // Reinhard-Jodie
@@ -0,0 +1,8 @@
+// Copies the cached static caster depth of a tile into the atlas. Drawn as a fullscreen triangle into the tile's
+// viewport, the cache has the layout of the atlas so the pixel position addresses both.
+
+Texture2D<float> shadowCache : register(t0);
+
+float main(float4 position : SV_POSITION) : SV_DEPTH {
+    return shadowCache.Load(int3(position.xy, 0));
+}
\ No newline at end of file
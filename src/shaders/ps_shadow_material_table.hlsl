@@ -0,0 +1,52 @@
+cbuffer Per_material : register(b2) {
+    float3 materialDiffuse;
+    float isReflective;
+    float3 materialSpecular;
+    float materialSpecularExponent;
+    uint materialIndex;
+    float3 pad0;
+};
+
+struct Material {
+    float3 diffuseColour;
+    float specularExponent;
+    float3 specularColour;
+    uint diffuseBucket;
+    uint diffuseSlice;
+    uint normalBucket;
+    uint normalSlice;
+    float pad0;
+};
+
+Texture2DArray textureBuckets[8] : register(t0);
+StructuredBuffer<Material> materials : register(t8);
+
+SamplerState samplerLinearWrap : register(s0);
+
+struct Pixel_shader_input {
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+float4 SampleBucket(uint bucket, uint slice, float2 uv, float2 dx, float2 dy) {
+    float3 location = float3(uv, slice);
+
+    switch (bucket) {
+        case 0:  return textureBuckets[0].SampleGrad(samplerLinearWrap, location, dx, dy);
+        case 1:  return textureBuckets[1].SampleGrad(samplerLinearWrap, location, dx, dy);
+        case 2:  return textureBuckets[2].SampleGrad(samplerLinearWrap, location, dx, dy);
+        case 3:  return textureBuckets[3].SampleGrad(samplerLinearWrap, location, dx, dy);
+        case 4:  return textureBuckets[4].SampleGrad(samplerLinearWrap, location, dx, dy);
+        case 5:  return textureBuckets[5].SampleGrad(samplerLinearWrap, location, dx, dy);
+        case 6:  return textureBuckets[6].SampleGrad(samplerLinearWrap, location, dx, dy);
+        default: return textureBuckets[7].SampleGrad(samplerLinearWrap, location, dx, dy);
+    }
+}
+
+void main(Pixel_shader_input input) {
+    Material material = materials[materialIndex];
+
+    float4 diffuse = SampleBucket(material.diffuseBucket, material.diffuseSlice, input.uv, ddx(input.uv), ddy(input.uv));
+    if (diffuse.a < 0.5f)
+        discard;
+}
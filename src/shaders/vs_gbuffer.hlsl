@@ -32,10 +32,11 @@ struct Vertex_shader_output {
 Vertex_shader_output main(Vertex_shader_input input) {
     Vertex_shader_output output;
 
-    float4 position = float4(input.position, 1.0f);
+    precise float4 position = float4(input.position, 1.0f);
     position = mul(position, worldMatrix);
     
-    output.position = mul(position, viewProjectionMatrix);
+    precise float4 clipPosition = mul(position, viewProjectionMatrix);
+    output.position = clipPosition;
     output.uv = input.uv;
     
     output.normal = normalize(mul(input.normal, (float3x3)worldMatrixInvTransform));
@@ -0,0 +1,62 @@
+cbuffer Per_frame : register(b0) {
+    float4x4 viewMatrix;
+    float4x4 invViewMatrix;
+    float4x4 projectionMatrix;
+    float4x4 invProjectionMatrix;
+    float4x4 viewProjectionMatrix;
+    float4x4 invViewProjectionMatrix;
+    float3 cameraPosition;
+    float pad0;
+};
+
+cbuffer Instance_batch : register(b1) {
+    uint firstInstance;
+    uint3 pad1;
+};
+
+struct Instance {
+    float4x4 worldMatrix;
+    float4x4 worldMatrixInvTranspose;
+    float3 boundsCenter;
+    float pad0;
+    float3 boundsExtents;
+    float pad1;
+};
+
+StructuredBuffer<Instance> instances : register(t0);
+StructuredBuffer<uint> visibleInstances : register(t1); // Written by cs_culling
+
+struct Vertex_shader_input {
+    float3 position : POSITION;
+    float3 normal : NORMAL;
+    float2 uv : TEXCOORD0;
+    float4 tangent : TANGENT;
+};
+
+struct Vertex_shader_output {
+    float4 position : SV_POSITION;
+    float3 normal : TEXCOORD0;
+    float3 tangent : TEXCOORD1;
+    float3 bitangent : TEXCOORD2;
+    float2 uv : TEXCOORD3;
+};
+
+// SV_InstanceID doesn't include StartInstanceLocation, so the batch offset comes from the constant buffer
+Vertex_shader_output main(Vertex_shader_input input, uint instanceID : SV_InstanceID) {
+    Vertex_shader_output output;
+
+    Instance instance = instances[visibleInstances[firstInstance + instanceID]];
+
+    precise float4 position = float4(input.position, 1.0f);
+    position = mul(position, instance.worldMatrix);
+    
+    precise float4 clipPosition = mul(position, viewProjectionMatrix);
+    output.position = clipPosition;
+    output.uv = input.uv;
+    
+    output.normal = normalize(mul(input.normal, (float3x3)instance.worldMatrixInvTranspose));
+    output.tangent = normalize(mul(input.tangent.xyz, (float3x3)instance.worldMatrixInvTranspose));
+    output.bitangent = cross(output.normal, output.tangent) * input.tangent.w;
+
+    return output;
+}
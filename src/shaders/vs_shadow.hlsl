@@ -20,8 +20,10 @@ struct Vertex_shader_output {
 Vertex_shader_output main(Vertex_shader_input input) {
     Vertex_shader_output output;
     
-    float4 worldPosition = mul(float4(input.position, 1.0f), worldMatrix);
-    output.position = mul(worldPosition, viewProjectionMatrix);
+    precise float4 worldPosition = mul(float4(input.position, 1.0f), worldMatrix);
+    // precise keeps the depth bit-identical to the G-buffer pass, which tests against it with EQUAL
+    precise float4 position = mul(worldPosition, viewProjectionMatrix);
+    output.position = position;
     
     output.uv = input.uv;
     
@@ -0,0 +1,21 @@
+cbuffer Shadow_pass : register(b0) {
+    float4x4 viewProjectionMatrix;
+};
+
+cbuffer Per_object : register(b1) {
+    float4x4 worldMatrix;
+    float4x4 worldMatrixInvTranspose;
+};
+
+struct Vertex_shader_input {
+    float3 position : POSITION;
+};
+
+// Opaque casters, drawn without a pixel shader from the position-only stream
+float4 main(Vertex_shader_input input) : SV_POSITION {
+    precise float4 worldPosition = mul(float4(input.position, 1.0f), worldMatrix);
+    // precise keeps the depth bit-identical to vs_shadow.hlsl, which draws the alpha-tested casters
+    precise float4 position = mul(worldPosition, viewProjectionMatrix);
+
+    return position;
+}
\ No newline at end of file
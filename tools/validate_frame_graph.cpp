@@ -0,0 +1,21 @@
+// Validates a frame_graph.json written by the frameGraph.dumpGraph setting, without the renderer or a device.
+// Exits with 1 if the graph has errors, so it can gate a build. Builds on its own, e.g. from the repository root:
+//     g++ -std=c++17 -Isrc tools/validate_frame_graph.cpp src/rendering/frame_graph_dump.cpp src/core/logging.cpp -o validate_frame_graph
+#include "rendering/frame_graph_dump.hpp"
+#include "core/logging.hpp"
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        printf("Usage: %s <frame_graph.json>\n", argv[0]);
+        return 2;
+    }
+
+    Frame_graph_dump dump;
+    if (!ReadFrameGraphJson(argv[1], dump))
+        return 2;
+
+    const Frame_graph_report report = ValidateFrameGraph(dump);
+    LogFrameGraphReport(dump, report);
+
+    return report.errors.empty() ? 0 : 1;
+}
\ No newline at end of file